@@ -0,0 +1,291 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "FileSystem.hpp"
+#include "FileDescriptor.hpp"
+
+namespace {
+
+/**
+ * @brief One measured benchmark.
+ */
+struct Result {
+    std::string name; ///< What was measured.
+    std::string parameter; ///< The size or shape it was measured at, e.g. "entries".
+    size_t value; ///< The value of the parameter.
+    size_t operations; ///< Number of operations timed.
+    double seconds; ///< Wall-clock time for all of them.
+    size_t bytes; ///< Bytes moved, for I/O benchmarks; 0 otherwise.
+};
+
+std::vector<Result> results; ///< Everything measured so far, in order.
+volatile size_t sink; ///< Keeps the optimizer from discarding results we do not otherwise use.
+
+/**
+ * @brief Helper function to time a piece of work and record the result.
+ * @param name What is being measured.
+ * @param parameter The name of the size or shape being varied.
+ * @param value The value of that parameter.
+ * @param operations The number of operations the work performs.
+ * @param bytes The number of bytes the work moves, or 0.
+ * @param work The work to time.
+ */
+template <typename Work>
+void measure(const std::string& name, const std::string& parameter, size_t value, size_t operations, size_t bytes, Work work) {
+    auto start = std::chrono::steady_clock::now();
+    work();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    results.push_back({name, parameter, value, operations, elapsed.count(), bytes});
+    std::cerr << name << " " << parameter << "=" << value << ": "
+              << elapsed.count() * 1e9 / operations << " ns/op\n"; // Progress for whoever is watching
+}
+
+/**
+ * @brief Helper function to build the names used by the namespace benchmarks.
+ * @param count The number of names.
+ * @return The names "f0" to "f<count-1>".
+ */
+std::vector<std::string> makeNames(size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back("f" + std::to_string(i));
+    }
+    return names;
+}
+
+/**
+ * @brief Helper function to benchmark creating, finding, listing and deleting entries in one directory.
+ * @param entries The number of entries in the directory.
+ */
+void benchmarkNamespace(size_t entries) {
+    FileSystem fs;
+    fs.createDirectory("bench");
+    fs.changeDirectory("/bench");
+    std::vector<std::string> names = makeNames(entries);
+    std::vector<size_t> order(entries);
+    std::mt19937_64 random(entries);
+    for (size_t i = 0; i < entries; ++i) {
+        order[i] = random() % entries;
+    }
+
+    measure("createFile", "entries", entries, entries, 0, [&] {
+        for (const std::string& name : names) {
+            fs.createFile(name);
+        }
+    });
+    Directory* dir = fs.getCurrentDirectory();
+    measure("findFile", "entries", entries, entries, 0, [&] {
+        size_t found = 0;
+        for (size_t i : order) {
+            found += dir->findFile(names[i]) != nullptr;
+        }
+        sink = found;
+    });
+    measure("readFile", "entries", entries, entries, 0, [&] {
+        size_t total = 0;
+        for (size_t i : order) {
+            total += fs.readFile(names[i]).size();
+        }
+        sink = total;
+    });
+    measure("listContents", "entries", entries, 1, 0, [&] {
+        sink = fs.listContents().size();
+    });
+    measure("entries", "entries", entries, 1, 0, [&] {
+        size_t total = 0;
+        for (DirectoryEntry entry : dir->entries()) {
+            total += entry.name.size();
+        }
+        sink = total;
+    });
+    measure("listPage/first", "entries", entries, 1, 0, [&] {
+        sink = fs.listPage(ListCursor{}, 20).entries.size(); // Picks the first page without sorting everything
+    });
+    measure("listPage/resume", "entries", entries, 1, 0, [&] {
+        sink = fs.listPage(ListCursor{names[entries / 2], false}, 20).entries.size(); // Sorts once, for this and later pages
+    });
+    measure("listPage/next", "entries", entries, 1, 0, [&] {
+        sink = fs.listPage(ListCursor{names[entries / 4], false}, 20).entries.size(); // Served from the sorted view
+    });
+    measure("deleteFile", "entries", entries, entries, 0, [&] {
+        for (const std::string& name : names) {
+            fs.deleteFile(name);
+        }
+    });
+
+    std::vector<BatchOp> batch;
+    batch.reserve(entries);
+    for (const std::string& name : names) {
+        batch.push_back({BatchOpType::CreateFile, name, {}});
+    }
+    measure("applyBatch/createFile", "entries", entries, entries, 0, [&] {
+        sink = fs.applyBatch(batch).size();
+    });
+
+    std::vector<std::string> renamed;
+    renamed.reserve(entries);
+    for (const std::string& name : names) {
+        renamed.push_back(name + "~");
+    }
+    measure("rename/file", "entries", entries, entries, 0, [&] {
+        for (size_t i = 0; i < entries; ++i) {
+            fs.rename(names[i], renamed[i]);
+        }
+    });
+    const size_t moves = 1000;
+    measure("rename/directory", "entries", entries, moves, 0, [&] {
+        for (size_t i = 0; i < moves; ++i) { // The subtree moved holds every entry, and is never walked
+            fs.rename(i % 2 ? "/moved" : "/bench", i % 2 ? "/bench" : "/moved");
+        }
+    });
+}
+
+/**
+ * @brief Helper function to benchmark sequential and random I/O through a FileDescriptor.
+ * @param fileSize The size of the file in bytes.
+ * @param ioSize The size of each read or write in bytes.
+ */
+void benchmarkIo(size_t fileSize, size_t ioSize) {
+    File file("bench.dat");
+    FileDescriptor fd(file);
+    std::vector<char> buffer(ioSize, 'x');
+    size_t operations = fileSize / ioSize;
+    std::vector<size_t> offsets(operations);
+    std::mt19937_64 random(fileSize);
+    for (size_t i = 0; i < operations; ++i) {
+        offsets[i] = (random() % operations) * ioSize;
+    }
+    size_t passes = (64u << 20) / fileSize + 1; // Small files run several passes so the timings are not all noise
+    std::string shape = std::to_string(ioSize) + "B";
+
+    measure("sequentialWrite/" + shape, "fileSize", fileSize, operations * passes, fileSize * passes, [&] {
+        for (size_t pass = 0; pass < passes; ++pass) {
+            fd.seek(0);
+            for (size_t i = 0; i < operations; ++i) {
+                fd.write(buffer);
+            }
+        }
+    });
+    measure("sequentialRead/" + shape, "fileSize", fileSize, operations * passes, fileSize * passes, [&] {
+        size_t total = 0;
+        for (size_t pass = 0; pass < passes; ++pass) {
+            fd.seek(0);
+            for (size_t i = 0; i < operations; ++i) {
+                total += fd.read(ioSize).size();
+            }
+        }
+        sink = total;
+    });
+    measure("randomWrite/" + shape, "fileSize", fileSize, operations * passes, fileSize * passes, [&] {
+        for (size_t pass = 0; pass < passes; ++pass) {
+            for (size_t offset : offsets) {
+                fd.pwrite(buffer.data(), ioSize, offset);
+            }
+        }
+    });
+    measure("randomRead/" + shape, "fileSize", fileSize, operations * passes, fileSize * passes, [&] {
+        size_t total = 0;
+        for (size_t pass = 0; pass < passes; ++pass) {
+            for (size_t offset : offsets) {
+                total += fd.pread(buffer.data(), ioSize, offset);
+            }
+        }
+        sink = total;
+    });
+}
+
+/**
+ * @brief Helper function to benchmark resolving a deep path with changeDirectory.
+ * @param depth The number of directories on the path.
+ */
+void benchmarkDeepPath(size_t depth) {
+    FileSystem fs;
+    std::string path;
+    for (size_t i = 0; i < depth; ++i) {
+        std::string name = "d" + std::to_string(i);
+        fs.createDirectory(name);
+        fs.changeDirectory(name);
+        path += "/" + name;
+    }
+    std::string uncached = path + "/"; // A trailing slash keeps the path out of the dentry cache
+    const size_t operations = 100000;
+
+    measure("changeDirectory/cached", "depth", depth, operations, 0, [&] {
+        for (size_t i = 0; i < operations; ++i) {
+            fs.changeDirectory(path);
+        }
+    });
+    measure("changeDirectory/walk", "depth", depth, operations, 0, [&] {
+        for (size_t i = 0; i < operations; ++i) {
+            fs.changeDirectory(uncached);
+        }
+    });
+}
+
+/**
+ * @brief Helper function to write the results as JSON.
+ * @param out The stream to write to.
+ */
+void writeJson(std::ostream& out) {
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"" << result.parameter << "\": " << result.value
+            << ", \"operations\": " << result.operations << ", \"seconds\": " << result.seconds
+            << ", \"ns_per_op\": " << result.seconds * 1e9 / result.operations
+            << ", \"ops_per_sec\": " << result.operations / result.seconds;
+        if (result.bytes) {
+            out << ", \"bytes_per_sec\": " << result.bytes / result.seconds;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+/**
+ * @brief Runs every benchmark and prints the results as JSON.
+ * @details Usage: benchmark [--max-entries N] [--output FILE]. Namespace benchmarks run
+ * at 1k entries and every power of ten up to N (default 1M; pass 10000000 for the
+ * full 10M run). Results go to FILE, or to standard output.
+ */
+int main(int argc, char* argv[]) {
+    size_t maxEntries = 1000000;
+    std::string output;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--max-entries") == 0 && i + 1 < argc) {
+            maxEntries = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--max-entries N] [--output FILE]\n";
+            return 1;
+        }
+    }
+
+    for (size_t entries = 1000; entries <= maxEntries; entries *= 10) {
+        benchmarkNamespace(entries);
+    }
+    for (size_t fileSize : {size_t(64) << 10, size_t(1) << 20, size_t(16) << 20}) {
+        benchmarkIo(fileSize, 4096);
+        benchmarkIo(fileSize, 512);
+    }
+    for (size_t depth : {8, 64}) {
+        benchmarkDeepPath(depth);
+    }
+
+    if (output.empty()) {
+        writeJson(std::cout);
+    } else {
+        std::ofstream out(output);
+        writeJson(out);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "BlockPool.hpp"
+#include <cstring>
+#include <new>
+
+const size_t BlockPool::BLOCK_SIZE;
+const size_t BlockPool::HEADER_SIZE;
+
+/**
+ * @brief Gets the reference count of a block.
+ * @param block A block from allocate().
+ * @return The counter in the block's header.
+ */
+std::atomic<uint32_t>& BlockPool::references(const char* block) {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(const_cast<char*>(block) - HEADER_SIZE);
+}
+
+/**
+ * @brief Gets the process-wide block pool.
+ * @details The pool is never destroyed, so files owned by static objects can still be released at exit.
+ * @return A reference to the shared pool.
+ */
+BlockPool& BlockPool::instance() {
+    static BlockPool* pool = new BlockPool();
+    return *pool;
+}
+
+/**
+ * @brief Takes a zero-filled block from the pool.
+ * @return A pointer to BLOCK_SIZE bytes of zeroed storage, with one reference.
+ */
+char* BlockPool::allocate() {
+    char* block;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeBlocks.empty()) { // Out of blocks, carve up a new slab
+            const size_t stride = HEADER_SIZE + BLOCK_SIZE;
+            std::unique_ptr<char[]> slab(new char[stride * BLOCKS_PER_SLAB]);
+            for (size_t i = BLOCKS_PER_SLAB; i > 0; --i) {
+                char* block = slab.get() + (i - 1) * stride + HEADER_SIZE;
+                new (block - HEADER_SIZE) std::atomic<uint32_t>(0); // The header lives just in front of the data
+                freeBlocks.push_back(block);
+            }
+            slabs.push_back(std::move(slab));
+        }
+        block = freeBlocks.back();
+        freeBlocks.pop_back();
+    }
+    std::memset(block, 0, BLOCK_SIZE); // Blocks always start out zeroed, outside the lock
+    references(block).store(1, std::memory_order_relaxed);
+    return block;
+}
+
+/**
+ * @brief Adds a reference to a block, for another owner sharing it.
+ * @param block The block to share; must have come from allocate().
+ */
+void BlockPool::retain(const char* block) {
+    references(block).fetch_add(1, std::memory_order_relaxed); // The caller already holds a reference
+}
+
+/**
+ * @brief Drops a reference to a block, returning it to the pool with the last one.
+ * @param block The block to release; must have come from allocate().
+ */
+void BlockPool::release(char* block) {
+    if (block && references(block).fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBlocks.push_back(block); // Make the block available for reuse
+    }
+}
+
+/**
+ * @brief Determines if a block has more than one owner.
+ * @details An owner must copy a shared block before changing it.
+ * @param block The block to check.
+ * @return true if the block is shared.
+ */
+bool BlockPool::isShared(const char* block) {
+    return references(block).load(std::memory_order_acquire) > 1;
+}
+
+/**
+ * @brief Gets the number of blocks currently handed out.
+ * @return The number of allocated blocks not yet released.
+ */
+size_t BlockPool::blocksInUse() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slabs.size() * BLOCKS_PER_SLAB - freeBlocks.size();
+}
+
+/**
+ * @brief Gets the number of blocks the pool has reserved from the system.
+ * @return The total number of blocks across all slabs.
+ */
+size_t BlockPool::capacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slabs.size() * BLOCKS_PER_SLAB;
+}
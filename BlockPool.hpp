@@ -0,0 +1,91 @@
+#ifndef BLOCKPOOL_HPP
+#define BLOCKPOOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class BlockPool
+ * @brief A shared pool of fixed-size data blocks used to store file contents.
+ *
+ * Blocks are carved out of larger slabs and recycled through a free list, so
+ * growing or shrinking a file only allocates or frees the blocks it touches.
+ * The pool may be used from any thread.
+ *
+ * Blocks are reference counted so that files can share them copy-on-write:
+ * each block carries its count in a small header just in front of its data,
+ * and goes back on the free list when the last reference is released.
+ */
+class BlockPool {
+private:
+    static const size_t BLOCKS_PER_SLAB = 16; ///< Number of blocks allocated from the system at a time.
+    static const size_t HEADER_SIZE = 64; ///< Bytes in front of each block holding its reference count; keeps blocks cache-line aligned.
+
+    /**
+     * @brief Gets the reference count of a block.
+     * @param block A block from allocate().
+     * @return The counter in the block's header.
+     */
+    static std::atomic<uint32_t>& references(const char* block);
+
+    std::vector<std::unique_ptr<char[]>> slabs; ///< The slabs owned by the pool.
+    std::vector<char*> freeBlocks; ///< Blocks available for reuse.
+    mutable std::mutex mutex; ///< Guards the slabs and the free list.
+
+public:
+    static const size_t BLOCK_SIZE = 4096; ///< Size of each block in bytes.
+
+    BlockPool() = default;
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    /**
+     * @brief Gets the process-wide block pool.
+     * @return A reference to the shared pool.
+     */
+    static BlockPool& instance();
+
+    /**
+     * @brief Takes a zero-filled block from the pool.
+     * @return A pointer to BLOCK_SIZE bytes of zeroed storage, with one reference.
+     */
+    char* allocate();
+
+    /**
+     * @brief Adds a reference to a block, for another owner sharing it.
+     * @param block The block to share; must have come from allocate().
+     */
+    void retain(const char* block);
+
+    /**
+     * @brief Drops a reference to a block, returning it to the pool with the last one.
+     * @param block The block to release; must have come from allocate().
+     */
+    void release(char* block);
+
+    /**
+     * @brief Determines if a block has more than one owner.
+     * @details An owner must copy a shared block before changing it.
+     * @param block The block to check.
+     * @return true if the block is shared.
+     */
+    static bool isShared(const char* block);
+
+    /**
+     * @brief Gets the number of blocks currently handed out.
+     * @return The number of allocated blocks not yet released.
+     */
+    size_t blocksInUse() const;
+
+    /**
+     * @brief Gets the number of blocks the pool has reserved from the system.
+     * @return The total number of blocks across all slabs.
+     */
+    size_t capacity() const;
+};
+
+#endif
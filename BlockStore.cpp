@@ -0,0 +1,153 @@
+#include "BlockStore.hpp"
+#include "BlockPool.hpp"
+#include "File.hpp"
+#include <cstring>
+#include <vector>
+
+/**
+ * @brief Gets the fraction of scanned blocks that were duplicates.
+ * @return duplicates / blocksScanned, or 0 before anything was scanned.
+ */
+double BlockStore::Stats::hitRate() const {
+    return blocksScanned ? static_cast<double>(duplicates) / blocksScanned : 0.0;
+}
+
+/**
+ * @brief Constructor for the BlockStore class.
+ */
+BlockStore::BlockStore() : blocksScanned(0), duplicates(0), bytesSaved(0) {}
+
+/**
+ * @brief Destructor for the BlockStore class; drops the store's references.
+ */
+BlockStore::~BlockStore() {
+    for (const auto& entry : byHash) {
+        BlockPool::instance().release(entry.second);
+    }
+}
+
+/**
+ * @brief Hashes the contents of a block.
+ * @param block BLOCK_SIZE bytes.
+ * @return A 64-bit hash of the bytes.
+ */
+uint64_t BlockStore::hash(const char* block) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ull;
+    uint64_t h = 0;
+    for (size_t i = 0; i < BlockPool::BLOCK_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, block + i, sizeof(word)); // A word at a time, whatever the alignment
+        h = (h ^ word) * prime;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+/**
+ * @brief Merges a file's blocks with identical stored blocks, and stores the rest.
+ * @details Call while holding the file exclusively. Files whose contents are
+ * still served from an image, or held compressed or spilled, are skipped.
+ * @param file The file.
+ * @return The number of the file's blocks merged with stored blocks.
+ */
+size_t BlockStore::deduplicate(File& file) {
+    if (file.image || file.blocks.empty()) {
+        return 0;
+    }
+    std::vector<std::pair<std::map<size_t, char*>::iterator, uint64_t>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = file.blocks.begin(); it != file.blocks.end(); ++it) {
+            if (!stored.count(it->second)) { // Already merged or stored on an earlier pass
+                pending.emplace_back(it, 0);
+            }
+        }
+    }
+    for (auto& entry : pending) {
+        entry.second = hash(entry.first->second); // Hash the whole batch without holding the lock
+    }
+
+    size_t merged = 0;
+    std::vector<char*> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : pending) {
+            char* block = entry.first->second;
+            char* match = nullptr;
+            auto range = byHash.equal_range(entry.second);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (std::memcmp(it->second, block, BlockPool::BLOCK_SIZE) == 0) {
+                    match = it->second;
+                    break;
+                }
+            }
+            if (match == block) {
+                continue; // Stored meanwhile through another file sharing it
+            }
+            if (match) {
+                BlockPool::instance().retain(match);
+                entry.first->second = match;
+                dropped.push_back(block);
+                ++merged;
+            } else {
+                BlockPool::instance().retain(block); // The store's reference keeps it from changing in place
+                byHash.emplace(entry.second, block);
+                stored.insert(block);
+            }
+        }
+    }
+    for (char* block : dropped) {
+        BlockPool::instance().release(block); // Freed unless another file still shares it
+    }
+    blocksScanned.fetch_add(pending.size(), std::memory_order_relaxed);
+    duplicates.fetch_add(merged, std::memory_order_relaxed);
+    bytesSaved.fetch_add(merged * BlockPool::BLOCK_SIZE, std::memory_order_relaxed);
+    return merged;
+}
+
+/**
+ * @brief Drops stored blocks no file uses any more, returning them to the pool.
+ * @return The number of blocks dropped.
+ */
+size_t BlockStore::sweep() {
+    std::vector<char*> unused;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = byHash.begin(); it != byHash.end();) {
+            if (!BlockPool::isShared(it->second)) { // Only the store's own reference is left
+                unused.push_back(it->second);
+                stored.erase(it->second);
+                it = byHash.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (char* block : unused) {
+        BlockPool::instance().release(block);
+    }
+    return unused.size();
+}
+
+/**
+ * @brief Gets the deduplication counters.
+ * @return A snapshot of the counters.
+ */
+BlockStore::Stats BlockStore::stats() const {
+    Stats result;
+    result.blocksScanned = blocksScanned.load(std::memory_order_relaxed);
+    result.duplicates = duplicates.load(std::memory_order_relaxed);
+    result.bytesSaved = bytesSaved.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex);
+    result.uniqueBlocks = byHash.size();
+    return result;
+}
+
+/**
+ * @brief Zeroes the scan, duplicate and bytes-saved counters.
+ */
+void BlockStore::resetStats() {
+    blocksScanned.store(0, std::memory_order_relaxed);
+    duplicates.store(0, std::memory_order_relaxed);
+    bytesSaved.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,99 @@
+#ifndef BLOCKSTORE_HPP
+#define BLOCKSTORE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+class File;
+
+/**
+ * @class BlockStore
+ * @brief A content-addressed index of pooled blocks, used to deduplicate file data.
+ *
+ * deduplicate() hashes a file's blocks and, for each one whose bytes match a
+ * block already in the store, points the file at the stored block and drops
+ * its own copy. Stored blocks are shared through the BlockPool's reference
+ * counts: the store holds one reference to each, so they are never changed in
+ * place, and a file that later writes to one copies it first, as it would any
+ * shared block. The write path itself is untouched; deduplication runs as a
+ * separate pass over files that have already been written.
+ */
+class BlockStore {
+public:
+    /**
+     * @brief Counters describing how much deduplication has found.
+     */
+    struct Stats {
+        uint64_t blocksScanned; ///< Blocks hashed by deduplicate().
+        uint64_t duplicates; ///< Blocks found to match a stored block and merged with it.
+        uint64_t bytesSaved; ///< Bytes freed by merging duplicates.
+        size_t uniqueBlocks; ///< Distinct blocks currently stored.
+
+        /**
+         * @brief Gets the fraction of scanned blocks that were duplicates.
+         * @return duplicates / blocksScanned, or 0 before anything was scanned.
+         */
+        double hitRate() const;
+    };
+
+private:
+    mutable std::mutex mutex; ///< Guards the index.
+    std::unordered_multimap<uint64_t, char*> byHash; ///< Stored blocks by content hash; collisions are told apart by comparing bytes.
+    std::unordered_set<const char*> stored; ///< Every stored block, to skip blocks already deduplicated.
+    std::atomic<uint64_t> blocksScanned; ///< See Stats.
+    std::atomic<uint64_t> duplicates; ///< See Stats.
+    std::atomic<uint64_t> bytesSaved; ///< See Stats.
+
+    /**
+     * @brief Hashes the contents of a block.
+     * @param block BLOCK_SIZE bytes.
+     * @return A 64-bit hash of the bytes.
+     */
+    static uint64_t hash(const char* block);
+
+public:
+    /**
+     * @brief Constructor for the BlockStore class.
+     */
+    BlockStore();
+
+    /**
+     * @brief Destructor for the BlockStore class; drops the store's references.
+     */
+    ~BlockStore();
+
+    BlockStore(const BlockStore&) = delete;
+    BlockStore& operator=(const BlockStore&) = delete;
+
+    /**
+     * @brief Merges a file's blocks with identical stored blocks, and stores the rest.
+     * @details Call while holding the file exclusively. Files whose contents are
+     * still served from an image, or held compressed or spilled, are skipped.
+     * @param file The file.
+     * @return The number of the file's blocks merged with stored blocks.
+     */
+    size_t deduplicate(File& file);
+
+    /**
+     * @brief Drops stored blocks no file uses any more, returning them to the pool.
+     * @return The number of blocks dropped.
+     */
+    size_t sweep();
+
+    /**
+     * @brief Gets the deduplication counters.
+     * @return A snapshot of the counters.
+     */
+    Stats stats() const;
+
+    /**
+     * @brief Zeroes the scan, duplicate and bytes-saved counters.
+     */
+    void resetStats();
+};
+
+#endif
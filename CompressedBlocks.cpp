@@ -0,0 +1,158 @@
+#include "CompressedBlocks.hpp"
+#include "BlockPool.hpp"
+#include "LzCodec.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+std::atomic<uint64_t> CompressedBlocks::filesCompressed(0);
+std::atomic<uint64_t> CompressedBlocks::rawBytes(0);
+std::atomic<uint64_t> CompressedBlocks::compressedBytes(0);
+std::atomic<uint64_t> CompressedBlocks::blocksDecompressed(0);
+std::atomic<uint64_t> CompressedBlocks::decompressNanoseconds(0);
+
+/**
+ * @brief Gets the compression ratio of the data currently packed.
+ * @return rawBytes / compressedBytes, or 1 when nothing is packed.
+ */
+double CompressedBlocks::Stats::ratio() const {
+    return compressedBytes ? static_cast<double>(rawBytes) / compressedBytes : 1.0;
+}
+
+/**
+ * @brief Constructor for the CompressedBlocks class; called by compress().
+ * @param indices The block indices.
+ * @param offsets Where each block starts in data.
+ * @param data The packed blocks.
+ */
+CompressedBlocks::CompressedBlocks(std::vector<size_t> indices, std::vector<uint32_t> offsets, std::vector<char> data)
+    : indices(std::move(indices)), offsets(std::move(offsets)), data(std::move(data)) {
+    rawBytes.fetch_add(this->indices.size() * BlockPool::BLOCK_SIZE, std::memory_order_relaxed);
+    compressedBytes.fetch_add(this->data.size(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Destructor for the CompressedBlocks class.
+ */
+CompressedBlocks::~CompressedBlocks() {
+    rawBytes.fetch_sub(indices.size() * BlockPool::BLOCK_SIZE, std::memory_order_relaxed);
+    compressedBytes.fetch_sub(data.size(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Packs a file's blocks.
+ * @param blocks The blocks, keyed by block index.
+ * @return The packed blocks, or nullptr if they would not save at least an eighth of their
+ * size or would not fit the 32-bit offsets.
+ */
+std::shared_ptr<const CompressedBlocks> CompressedBlocks::compress(const std::map<size_t, char*>& blocks) {
+    const size_t blockSize = BlockPool::BLOCK_SIZE;
+    std::vector<size_t> indices;
+    std::vector<uint32_t> offsets;
+    std::vector<char> data;
+    std::vector<char> scratch(LzCodec::bound(blockSize));
+    indices.reserve(blocks.size());
+    offsets.reserve(blocks.size() + 1);
+    for (const auto& entry : blocks) {
+        indices.push_back(entry.first);
+        offsets.push_back(static_cast<uint32_t>(data.size()));
+        size_t packed = LzCodec::compress(entry.second, blockSize, scratch.data());
+        if (packed < blockSize) {
+            data.insert(data.end(), scratch.data(), scratch.data() + packed);
+        } else {
+            data.insert(data.end(), entry.second, entry.second + blockSize); // Stored as is; read back by its size
+        }
+        if (data.size() > UINT32_MAX) {
+            return nullptr; // Past what an offset can hold; the file stays unpacked
+        }
+    }
+    offsets.push_back(static_cast<uint32_t>(data.size()));
+    if (data.size() > blocks.size() * blockSize / 8 * 7) {
+        return nullptr; // Not worth a decompression on every read
+    }
+    data.shrink_to_fit();
+    filesCompressed.fetch_add(1, std::memory_order_relaxed);
+    return std::shared_ptr<const CompressedBlocks>(new CompressedBlocks(std::move(indices), std::move(offsets), std::move(data)));
+}
+
+/**
+ * @brief Gets the number of blocks packed.
+ * @return The number of blocks.
+ */
+size_t CompressedBlocks::blockCount() const {
+    return indices.size();
+}
+
+/**
+ * @brief Finds the first packed block at or after a block index.
+ * @param index The block index.
+ * @return The block's position, or blockCount() if there is none.
+ */
+size_t CompressedBlocks::find(size_t index) const {
+    return std::lower_bound(indices.begin(), indices.end(), index) - indices.begin();
+}
+
+/**
+ * @brief Gets the block index of a packed block.
+ * @param position The block's position, below blockCount().
+ * @return Its block index in the file.
+ */
+size_t CompressedBlocks::blockIndex(size_t position) const {
+    return indices[position];
+}
+
+/**
+ * @brief Decompresses one block.
+ * @param position The block's position, below blockCount().
+ * @param block The buffer to decompress into; BLOCK_SIZE bytes.
+ * @throws std::runtime_error if the packed data is corrupt.
+ */
+void CompressedBlocks::decompress(size_t position, char* block) const {
+    const char* packed = data.data() + offsets[position];
+    size_t length = offsets[position + 1] - offsets[position];
+    if (length == BlockPool::BLOCK_SIZE) {
+        std::memcpy(block, packed, length); // Did not compress
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!LzCodec::decompress(packed, length, block, BlockPool::BLOCK_SIZE)) {
+        throw std::runtime_error("Corrupt compressed block");
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    blocksDecompressed.fetch_add(1, std::memory_order_relaxed);
+    decompressNanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Gets the size of the packed data.
+ * @return The number of bytes the blocks take packed.
+ */
+size_t CompressedBlocks::compressedSize() const {
+    return data.size();
+}
+
+/**
+ * @brief Gets the process-wide compression counters.
+ * @return A snapshot of the counters.
+ */
+CompressedBlocks::Stats CompressedBlocks::stats() {
+    Stats result;
+    result.filesCompressed = filesCompressed.load(std::memory_order_relaxed);
+    result.rawBytes = rawBytes.load(std::memory_order_relaxed);
+    result.compressedBytes = compressedBytes.load(std::memory_order_relaxed);
+    result.blocksDecompressed = blocksDecompressed.load(std::memory_order_relaxed);
+    result.decompressNanoseconds = decompressNanoseconds.load(std::memory_order_relaxed);
+    return result;
+}
+
+/**
+ * @brief Zeroes the files-compressed and decompression counters.
+ * @details rawBytes and compressedBytes describe what is packed now, and are left alone.
+ */
+void CompressedBlocks::resetStats() {
+    filesCompressed.store(0, std::memory_order_relaxed);
+    blocksDecompressed.store(0, std::memory_order_relaxed);
+    decompressNanoseconds.store(0, std::memory_order_relaxed);
+}
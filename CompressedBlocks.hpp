@@ -0,0 +1,124 @@
+#ifndef COMPRESSEDBLOCKS_HPP
+#define COMPRESSEDBLOCKS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+/**
+ * @class CompressedBlocks
+ * @brief A file's blocks packed with LzCodec, each compressed on its own.
+ *
+ * Compressing the blocks separately lets a read decompress only the blocks it
+ * covers. Blocks that do not shrink are kept as they are. The packed form is
+ * immutable, so copies of a file share it; a file unpacks its blocks back into
+ * the BlockPool the first time it is modified.
+ *
+ * Counters covering every packed file in the process are kept for stats().
+ */
+class CompressedBlocks {
+public:
+    /**
+     * @brief Counters describing compression across the process.
+     */
+    struct Stats {
+        uint64_t filesCompressed; ///< Files packed so far.
+        uint64_t rawBytes; ///< Bytes of file blocks currently held packed, before compression.
+        uint64_t compressedBytes; ///< Bytes those blocks take packed.
+        uint64_t blocksDecompressed; ///< Blocks decompressed to serve reads or unpack files.
+        uint64_t decompressNanoseconds; ///< Time spent decompressing them.
+
+        /**
+         * @brief Gets the compression ratio of the data currently packed.
+         * @return rawBytes / compressedBytes, or 1 when nothing is packed.
+         */
+        double ratio() const;
+    };
+
+private:
+    std::vector<size_t> indices; ///< The block indices, ascending.
+    std::vector<uint32_t> offsets; ///< Where each block starts in data, plus one entry marking the end.
+    std::vector<char> data; ///< The packed blocks, back to back.
+
+    static std::atomic<uint64_t> filesCompressed; ///< See Stats.
+    static std::atomic<uint64_t> rawBytes; ///< See Stats.
+    static std::atomic<uint64_t> compressedBytes; ///< See Stats.
+    static std::atomic<uint64_t> blocksDecompressed; ///< See Stats.
+    static std::atomic<uint64_t> decompressNanoseconds; ///< See Stats.
+
+    /**
+     * @brief Constructor for the CompressedBlocks class; called by compress().
+     * @param indices The block indices.
+     * @param offsets Where each block starts in data.
+     * @param data The packed blocks.
+     */
+    CompressedBlocks(std::vector<size_t> indices, std::vector<uint32_t> offsets, std::vector<char> data);
+
+public:
+    /**
+     * @brief Destructor for the CompressedBlocks class.
+     */
+    ~CompressedBlocks();
+
+    CompressedBlocks(const CompressedBlocks&) = delete;
+    CompressedBlocks& operator=(const CompressedBlocks&) = delete;
+
+    /**
+     * @brief Packs a file's blocks.
+     * @param blocks The blocks, keyed by block index.
+     * @return The packed blocks, or nullptr if they would not save at least an eighth of their
+     * size or would not fit the 32-bit offsets.
+     */
+    static std::shared_ptr<const CompressedBlocks> compress(const std::map<size_t, char*>& blocks);
+
+    /**
+     * @brief Gets the number of blocks packed.
+     * @return The number of blocks.
+     */
+    size_t blockCount() const;
+
+    /**
+     * @brief Finds the first packed block at or after a block index.
+     * @param index The block index.
+     * @return The block's position, or blockCount() if there is none.
+     */
+    size_t find(size_t index) const;
+
+    /**
+     * @brief Gets the block index of a packed block.
+     * @param position The block's position, below blockCount().
+     * @return Its block index in the file.
+     */
+    size_t blockIndex(size_t position) const;
+
+    /**
+     * @brief Decompresses one block.
+     * @param position The block's position, below blockCount().
+     * @param block The buffer to decompress into; BLOCK_SIZE bytes.
+     * @throws std::runtime_error if the packed data is corrupt.
+     */
+    void decompress(size_t position, char* block) const;
+
+    /**
+     * @brief Gets the size of the packed data.
+     * @return The number of bytes the blocks take packed.
+     */
+    size_t compressedSize() const;
+
+    /**
+     * @brief Gets the process-wide compression counters.
+     * @return A snapshot of the counters.
+     */
+    static Stats stats();
+
+    /**
+     * @brief Zeroes the files-compressed and decompression counters.
+     * @details rawBytes and compressedBytes describe what is packed now, and are left alone.
+     */
+    static void resetStats();
+};
+
+#endif
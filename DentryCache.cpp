@@ -0,0 +1,179 @@
+#include "DentryCache.hpp"
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Constructor for the DentryCache class.
+ * @param capacity The maximum number of paths to cache.
+ */
+DentryCache::DentryCache(size_t capacity) : shardCapacity(capacity / SHARDS ? capacity / SHARDS : 1) {}
+
+/**
+ * @brief Gets the shard responsible for a path.
+ * @param path The canonical path.
+ * @return The shard holding the path, if cached.
+ */
+DentryCache::Shard& DentryCache::shardFor(std::string_view path) {
+    return shards[std::hash<std::string_view>()(path) % SHARDS];
+}
+
+/**
+ * @brief Gets the prefix shard filing a path.
+ * @details Paths are filed by their first component, so a directory and
+ * everything below it share one prefix shard.
+ * @param path The canonical path.
+ * @return The prefix shard for the path.
+ */
+DentryCache::PrefixShard& DentryCache::prefixShardFor(std::string_view path) {
+    return prefixes[std::hash<std::string_view>()(path.substr(0, path.find('/', 1))) % SHARDS];
+}
+
+/**
+ * @brief Determines if a path can be used as a cache key as it is.
+ * @details Canonical paths start with '/', have no empty, "." or ".." components
+ * and no trailing slash, so each directory has exactly one of them.
+ * @param path The path to check.
+ * @return true if the path is canonical.
+ */
+bool DentryCache::isCanonical(std::string_view path) {
+    if (path.size() < 2 || path[0] != '/' || path.back() == '/') {
+        return false;
+    }
+    size_t start = 1;
+    for (size_t i = 1; i <= path.size(); ++i) {
+        if (i == path.size() || path[i] == '/') {
+            size_t length = i - start;
+            if (length == 0 || (path[start] == '.' && (length == 1 || (length == 2 && path[start + 1] == '.')))) {
+                return false; // Empty, "." or ".." component
+            }
+            start = i + 1;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Looks up a canonical path.
+ * @param path The canonical path to resolve.
+ * @return The cached directory, or nullptr on a miss.
+ */
+Directory* DentryCache::lookup(std::string_view path) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(path);
+    if (it == shard.index.end()) {
+        shard.misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second); // Mark as most recently used
+    shard.hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->second;
+}
+
+/**
+ * @brief Caches the directory a canonical path resolved to.
+ * @param path The canonical path.
+ * @param dir The directory it names.
+ */
+void DentryCache::insert(std::string_view path, Directory* dir) {
+    Shard& shard = shardFor(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(path);
+    if (it != shard.index.end()) {
+        it->second->second = dir; // Another thread resolved it first
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    if (shard.index.size() >= shardCapacity) {
+        std::string_view evicted = shard.lru.back().first; // Evict the least recently used path
+        PrefixShard& evictedPrefix = prefixShardFor(evicted);
+        {
+            std::lock_guard<std::mutex> prefixLock(evictedPrefix.mutex);
+            evictedPrefix.paths.erase(evicted);
+        }
+        shard.index.erase(evicted);
+        shard.lru.pop_back();
+    }
+    shard.lru.emplace_front(std::string(path), dir);
+    std::string_view key = shard.lru.front().first; // Keyed by the entry's own copy of the path
+    shard.index.emplace(key, shard.lru.begin());
+    PrefixShard& prefix = prefixShardFor(key);
+    std::lock_guard<std::mutex> prefixLock(prefix.mutex);
+    prefix.paths.insert(key);
+}
+
+/**
+ * @brief Drops a path and every path below it.
+ * @details Only the affected entries are visited: they are found as one range
+ * in the sorted prefix shard, then dropped from the shards holding them.
+ * @param path The canonical path of a directory being removed or moved.
+ */
+void DentryCache::invalidate(std::string_view path) {
+    std::string below(path);
+    below += '/';
+    std::vector<std::string> doomed;
+    {
+        PrefixShard& prefix = prefixShardFor(path);
+        std::lock_guard<std::mutex> prefixLock(prefix.mutex);
+        auto it = prefix.paths.find(path);
+        if (it != prefix.paths.end()) {
+            doomed.emplace_back(*it);
+            prefix.paths.erase(it);
+        }
+        for (it = prefix.paths.lower_bound(below); it != prefix.paths.end() && it->compare(0, below.size(), below) == 0;) {
+            doomed.emplace_back(*it); // Copied: the view dies with its entry
+            it = prefix.paths.erase(it);
+        }
+    }
+    for (const std::string& doomedPath : doomed) { // Shard locks come first elsewhere, so take them after
+        Shard& shard = shardFor(doomedPath);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(doomedPath);
+        if (it != shard.index.end()) {
+            LruList::iterator entry = it->second;
+            shard.index.erase(it);
+            shard.lru.erase(entry);
+        }
+    }
+}
+
+/**
+ * @brief Drops every cached path.
+ */
+void DentryCache::clear() {
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& entry : shard.lru) {
+            PrefixShard& prefix = prefixShardFor(entry.first);
+            std::lock_guard<std::mutex> prefixLock(prefix.mutex);
+            prefix.paths.erase(entry.first);
+        }
+        shard.index.clear();
+        shard.lru.clear();
+    }
+}
+
+/**
+ * @brief Gets the hit and miss counters and the number of cached paths.
+ * @return A snapshot of the counters.
+ */
+DentryCache::Stats DentryCache::stats() {
+    Stats result = {0, 0, 0};
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        result.hits += shard.hits.load(std::memory_order_relaxed);
+        result.misses += shard.misses.load(std::memory_order_relaxed);
+        result.entries += shard.index.size();
+    }
+    return result;
+}
+
+/**
+ * @brief Zeroes the hit and miss counters.
+ */
+void DentryCache::resetStats() {
+    for (Shard& shard : shards) {
+        shard.hits.store(0, std::memory_order_relaxed);
+        shard.misses.store(0, std::memory_order_relaxed);
+    }
+}
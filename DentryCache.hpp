@@ -0,0 +1,143 @@
+#ifndef DENTRYCACHE_HPP
+#define DENTRYCACHE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+class Directory;
+
+/**
+ * @class DentryCache
+ * @brief A bounded cache from canonical absolute paths to the directories they resolve to.
+ *
+ * Entries are spread over SHARDS independently locked shards by the hash of
+ * their path, and each shard evicts its least recently used entry when full.
+ * A hit costs one hash probe instead of a walk through every component.
+ * Every cached path is also filed, in order, under its first component, so
+ * invalidating a directory visits only the paths at or below it.
+ *
+ * The cache does not watch the tree: whoever removes or moves a directory
+ * must call invalidate() with its path before the node goes away.
+ */
+class DentryCache {
+public:
+    /**
+     * @brief Counters describing how well the cache is doing.
+     */
+    struct Stats {
+        uint64_t hits; ///< Lookups answered from the cache.
+        uint64_t misses; ///< Lookups that had to walk the tree.
+        size_t entries; ///< Paths currently cached.
+    };
+
+private:
+    static const size_t SHARDS = 16; ///< Number of independently locked shards.
+
+    typedef std::list<std::pair<std::string, Directory*>> LruList; ///< Most recently used first.
+
+    /**
+     * @brief One shard of the cache, padded to its own cache line.
+     */
+    struct alignas(64) Shard {
+        std::mutex mutex; ///< Guards the shard.
+        LruList lru; ///< Entries in recency order.
+        std::unordered_map<std::string_view, LruList::iterator> index; ///< Path, viewed in its entry, to the entry.
+        std::atomic<uint64_t> hits{0}; ///< Hits served by this shard.
+        std::atomic<uint64_t> misses{0}; ///< Misses seen by this shard.
+    };
+
+    /**
+     * @brief The cached paths sharing a first component, kept sorted so a subtree is one range.
+     */
+    struct alignas(64) PrefixShard {
+        std::mutex mutex; ///< Guards the set; taken after a Shard's mutex, never before.
+        std::set<std::string_view> paths; ///< Paths, viewed in their entries.
+    };
+
+    Shard shards[SHARDS]; ///< The shards.
+    PrefixShard prefixes[SHARDS]; ///< The cached paths by first component.
+    size_t shardCapacity; ///< Maximum entries per shard.
+
+    /**
+     * @brief Gets the shard responsible for a path.
+     * @param path The canonical path.
+     * @return The shard holding the path, if cached.
+     */
+    Shard& shardFor(std::string_view path);
+
+    /**
+     * @brief Gets the prefix shard filing a path.
+     * @details Paths are filed by their first component, so a directory and
+     * everything below it share one prefix shard.
+     * @param path The canonical path.
+     * @return The prefix shard for the path.
+     */
+    PrefixShard& prefixShardFor(std::string_view path);
+
+public:
+    /**
+     * @brief Constructor for the DentryCache class.
+     * @param capacity The maximum number of paths to cache.
+     */
+    explicit DentryCache(size_t capacity = 65536);
+
+    DentryCache(const DentryCache&) = delete;
+    DentryCache& operator=(const DentryCache&) = delete;
+
+    /**
+     * @brief Determines if a path can be used as a cache key as it is.
+     * @details Canonical paths start with '/', have no empty, "." or ".." components
+     * and no trailing slash, so each directory has exactly one of them.
+     * @param path The path to check.
+     * @return true if the path is canonical.
+     */
+    static bool isCanonical(std::string_view path);
+
+    /**
+     * @brief Looks up a canonical path.
+     * @param path The canonical path to resolve.
+     * @return The cached directory, or nullptr on a miss.
+     */
+    Directory* lookup(std::string_view path);
+
+    /**
+     * @brief Caches the directory a canonical path resolved to.
+     * @param path The canonical path.
+     * @param dir The directory it names.
+     */
+    void insert(std::string_view path, Directory* dir);
+
+    /**
+     * @brief Drops a path and every path below it.
+     * @details Only the affected entries are visited: they are found as one range
+     * in the sorted prefix shard, then dropped from the shards holding them.
+     * @param path The canonical path of a directory being removed or moved.
+     */
+    void invalidate(std::string_view path);
+
+    /**
+     * @brief Drops every cached path.
+     */
+    void clear();
+
+    /**
+     * @brief Gets the hit and miss counters and the number of cached paths.
+     * @return A snapshot of the counters.
+     */
+    Stats stats();
+
+    /**
+     * @brief Zeroes the hit and miss counters.
+     */
+    void resetStats();
+};
+
+#endif
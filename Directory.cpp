@@ -1,47 +1,644 @@
 #include "Directory.hpp"
+#include "NodePool.hpp"
+#include "FileSystemImage.hpp"
+#include "NameIndex.hpp"
+#include "ShardedSharedMutex.hpp"
+#include "Snapshot.hpp"
 #include <algorithm>
+#include <functional>
+#include <mutex>
+
+namespace {
+
+const size_t LOAD_LOCKS = 64; ///< Number of lock stripes serializing lazy loads.
+
+/**
+ * @brief Gets the lock that serializes lazy loading of a directory.
+ * @details Striped by address so directories need no mutex of their own for this.
+ * @param dir The directory being loaded.
+ * @return The stripe's mutex.
+ */
+std::mutex& loadLock(const Directory* dir) {
+    static std::mutex locks[LOAD_LOCKS];
+    return locks[std::hash<const Directory*>()(dir) % LOAD_LOCKS];
+}
+
+thread_local const Directory* loadingDirectory = nullptr; ///< The directory this thread is populating, if any.
+
+/**
+ * @brief Gets the lock that keeps changes to the totals from walking up past a directory being relinked.
+ * @details Held shared by account() and exclusively while a directory changes
+ * parent, so every change lands on the old ancestors before the move or on the
+ * new ones after it. Sharded, since every write takes it.
+ * @return The lock.
+ */
+ShardedSharedMutex& relinkLock() {
+    static ShardedSharedMutex lock;
+    return lock;
+}
+
+/**
+ * @brief Orders entries by name, a file before a directory of the same name.
+ * @param name The first entry's name.
+ * @param directory Whether the first entry is a directory.
+ * @param other The second entry.
+ * @return true if the first entry sorts before the second.
+ */
+bool sortsBefore(string_view name, bool directory, const DirectoryEntry& other) {
+    int order = name.compare(other.name);
+    return order < 0 || (order == 0 && !directory && other.directory);
+}
+
+} // namespace
 
 /**
  * @brief Constructor for the Directory class.
  * @param name The name of the directory.
  * @param parent A pointer to the parent directory. Defaults to nullptr.
  */
-Directory::Directory(const string& name, Directory* parent) : name(name), parentDirectory(parent) {}
+Directory::Directory(const string& name, Directory* parent)
+    : name(name), parentDirectory(parent), imageRecord(0), imagePending(false), snapshots(parent ? parent->snapshots : nullptr),
+      snapshotGeneration(snapshots ? snapshots->generation() : 0), subtreeBytes(0), subtreeFiles(0),
+      subtreeDirectories(0), nameIndex(parent ? parent->nameIndex : nullptr),
+      blockCounter(parent ? parent->blockCounter : nullptr) {} // A new directory is in no open snapshot
+
+/**
+ * @brief Connects the directory, and the directories created under it, to a snapshot registry.
+ * @details Call on the root of an empty tree.
+ * @param registry The registry.
+ */
+void Directory::setSnapshotRegistry(SnapshotRegistry* registry) {
+    snapshots = registry;
+    snapshotGeneration = registry ? registry->generation() : 0;
+}
+
+/**
+ * @brief Connects the directory, and the directories created under it, to a count of the pool blocks their files hold.
+ * @details Call on the root of an empty tree.
+ * @param counter The count, or nullptr.
+ */
+void Directory::setBlockCounter(atomic<size_t>* counter) {
+    blockCounter = counter;
+}
+
+/**
+ * @brief Connects the directory and its whole subtree to a name index, adding every entry below it.
+ * @details Loads any part of the subtree still waiting in an image. Passing
+ * nullptr disconnects the subtree without touching the index.
+ * @param index The index, or nullptr.
+ */
+void Directory::setNameIndex(NameIndex* index) {
+    ensureLoaded(); // Before connecting, so loading does not add the entries twice
+    nameIndex = index;
+    if (index) {
+        for (File* file : files) {
+            index->add({file->getName(), file, nullptr});
+        }
+    }
+    for (Directory* dir : subdirectories) {
+        if (index) {
+            index->add({dir->getName(), nullptr, dir});
+        }
+        dir->setNameIndex(index);
+    }
+}
+
+/**
+ * @brief Removes the directory's subtree from its name index.
+ */
+void Directory::unindex() {
+    for (File* file : files) {
+        nameIndex->remove(file);
+    }
+    for (Directory* dir : subdirectories) {
+        nameIndex->remove(dir);
+        dir->unindex(); // Nothing below a directory still in an image was indexed
+    }
+}
+
+/**
+ * @brief Takes the files of the directory's subtree out of the tree's block count, for good.
+ */
+void Directory::uncountBlocks() {
+    for (File* file : files) {
+        file->countBlocks(-static_cast<int64_t>(file->blocks.size()));
+    }
+    for (Directory* dir : subdirectories) {
+        dir->uncountBlocks(); // Nothing below a directory still in an image holds blocks
+    }
+    blockCounter = nullptr; // Later changes, and freeing the nodes, count nowhere
+}
+
+/**
+ * @brief Preserves the entries into any open snapshot that needs them; call before every change.
+ */
+void Directory::preserveForSnapshots() {
+    if (snapshots && loadingDirectory != this && snapshots->needsPreserve(snapshotGeneration)) { // Loading is not a change
+        snapshots->preserve(*this, snapshotGeneration);
+    }
+}
+
+/**
+ * @brief Connects a new file to the tree's snapshot registry.
+ * @param file The file just added.
+ * @return The file.
+ */
+File* Directory::adopt(File* file) {
+    file->snapshots = snapshots;
+    file->snapshotGeneration = snapshots ? snapshots->generation() : 0;
+    file->parent = this; // Later size changes are sent up from here
+    file->countBlocks(static_cast<int64_t>(file->blocks.size()));
+    account(static_cast<int64_t>(file->length), 1, 0);
+    if (nameIndex) {
+        nameIndex->add({file->getName(), file, nullptr});
+    }
+    return file;
+}
+
+/**
+ * @brief Takes the file at a position out of the entries, keeping the index in step.
+ * @param position The file's position in files.
+ * @return The file, still allocated.
+ */
+File* Directory::unlinkFile(size_t position) {
+    File* unlinked = files[position];
+    fileIndex.erase(unlinked->getName());
+    if (position != files.size() - 1) {
+        files[position] = files.back(); // Fill the gap with the last file
+        fileIndex[files[position]->getName()] = position; // Re-index the moved file
+    }
+    files.pop_back(); // Erase the file from the vector
+    entriesChanged();
+    return unlinked;
+}
+
+/**
+ * @brief Takes the subdirectory at a position out of the entries, keeping the index in step.
+ * @param position The subdirectory's position in subdirectories.
+ * @return The subdirectory, still allocated.
+ */
+Directory* Directory::unlinkDirectory(size_t position) {
+    Directory* unlinked = subdirectories[position];
+    directoryIndex.erase(unlinked->getName());
+    if (position != subdirectories.size() - 1) {
+        subdirectories[position] = subdirectories.back(); // Fill the gap with the last directory
+        directoryIndex[subdirectories[position]->getName()] = position; // Re-index the moved directory
+    }
+    subdirectories.pop_back(); // Erase the directory from the vector
+    entriesChanged();
+    return unlinked;
+}
+
+/**
+ * @brief Adds a change to the totals of this directory and every directory above it.
+ * @details Changes made while the directory is loaded from its image are
+ * already counted in the image, and are ignored. Waits while a directory is
+ * being moved, so the change cannot land on the wrong ancestors.
+ * @param bytes The change in bytes.
+ * @param files The change in the number of files.
+ * @param directories The change in the number of directories.
+ */
+void Directory::account(int64_t bytes, int64_t files, int64_t directories) {
+    if (loadingDirectory == this) {
+        return; // The totals came with the image record
+    }
+    std::shared_lock<ShardedSharedMutex> lock(relinkLock()); // File writes come in without the directory's lock
+    addToTotals(bytes, files, directories);
+}
 
 /**
- * @brief Adds a file to the directory.
+ * @brief Adds a change to the totals of this directory and every directory above it, without locking.
+ * @details For callers that hold the relink lock, exclusively while they move a directory.
+ * @param bytes The change in bytes.
+ * @param files The change in the number of files.
+ * @param directories The change in the number of directories.
+ */
+void Directory::addToTotals(int64_t bytes, int64_t files, int64_t directories) {
+    for (Directory* dir = this; dir; dir = dir->parentDirectory.load(std::memory_order_acquire)) {
+        // Unsigned wrap-around turns adding a negative change into subtracting it
+        dir->subtreeBytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+        dir->subtreeFiles.fetch_add(static_cast<uint64_t>(files), std::memory_order_relaxed);
+        dir->subtreeDirectories.fetch_add(static_cast<uint64_t>(directories), std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Drops the sorted view; call on every change to the entries.
+ */
+void Directory::entriesChanged() {
+    if (sortedEntries) {
+        sortedEntries.reset(); // No reader holds the directory while it changes, so no atomic store is needed
+    }
+}
+
+/**
+ * @brief Destructor for the Directory class; releases all child nodes.
+ */
+Directory::~Directory() {
+    clear();
+}
+
+/**
+ * @brief Loads the directory's contents from its image if that has not happened yet.
+ * @details Logically const: loading only materializes contents the directory already has.
+ */
+void Directory::ensureLoaded() const {
+    if (!imagePending.load(std::memory_order_acquire)) {
+        return; // Fast path once loaded
+    }
+    if (loadingDirectory == this) {
+        return; // populate adds entries through the public API, which lands back here
+    }
+    std::lock_guard<std::mutex> lock(loadLock(this)); // Readers holding a shared lock may race to load
+    if (image) {
+        Directory* self = const_cast<Directory*>(this);
+        shared_ptr<FileSystemImage> source = std::move(self->image);
+        const Directory* outer = loadingDirectory;
+        loadingDirectory = this;
+        try {
+            source->populate(*self, imageRecord);
+        } catch (...) {
+            loadingDirectory = outer;
+            throw;
+        }
+        loadingDirectory = outer;
+        self->imagePending.store(false, std::memory_order_release);
+    }
+}
+
+/**
+ * @brief Releases all child nodes and empties the directory.
+ */
+void Directory::clear() {
+    for (File* file : files) {
+        NodePool<File>::instance().destroy(file); // Return the file's slot to the pool
+    }
+    for (Directory* dir : subdirectories) {
+        NodePool<Directory>::instance().destroy(dir); // Recursively releases the subtree
+    }
+    files.clear();
+    subdirectories.clear();
+    fileIndex.clear();
+    directoryIndex.clear();
+    entriesChanged();
+    image.reset(); // Anything not yet loaded is discarded with the image reference
+    imagePending.store(false, std::memory_order_release);
+    subtreeBytes.store(0, std::memory_order_relaxed);
+    subtreeFiles.store(0, std::memory_order_relaxed);
+    subtreeDirectories.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Recursively copies the contents of another directory into this one.
+ * @param other The directory to copy from.
+ */
+void Directory::copyContents(const Directory& other) {
+    ensureLoaded();
+    other.ensureLoaded();
+    files.reserve(files.size() + other.files.size());
+    for (const File* file : other.files) {
+        addFile(*file); // Copy each file into a pooled node
+    }
+    subdirectories.reserve(subdirectories.size() + other.subdirectories.size());
+    for (const Directory* dir : other.subdirectories) {
+        addDirectory(*dir); // Deep copy each subdirectory
+    }
+}
+
+/**
+ * @brief Adds a copy of a file to the directory.
+ * @details Does nothing if a file with the same name already exists.
  * @param file The file to add.
+ * @return A pointer to the file stored under that name.
  */
-void Directory::addFile(const File& file) {
-    files.push_back(file); // Add the file to the files vector
+File* Directory::addFile(const File& file) {
+    ensureLoaded();
+    auto it = fileIndex.find(file.getName());
+    if (it != fileIndex.end()) { // Keep the existing file with this name
+        return files[it->second];
+    }
+    preserveForSnapshots();
+    files.push_back(adopt(NodePool<File>::instance().create(file))); // Copy the file into a pooled node
+    fileIndex[files.back()->getName()] = files.size() - 1; // Index the file by its position, keyed by the copy's name
+    entriesChanged();
+    return files.back();
+}
+
+/**
+ * @brief Creates an empty file in the directory.
+ * @details Does nothing if a file with the same name already exists.
+ * @param filename The name of the file to create.
+ * @return A pointer to the file stored under that name.
+ */
+File* Directory::createFile(const string& filename) {
+    ensureLoaded();
+    auto it = fileIndex.find(filename);
+    if (it != fileIndex.end()) { // Keep the existing file with this name
+        return files[it->second];
+    }
+    preserveForSnapshots();
+    files.push_back(adopt(NodePool<File>::instance().create(filename))); // Construct the file in place
+    fileIndex[files.back()->getName()] = files.size() - 1; // Index the file by its position, keyed by its own name
+    entriesChanged();
+    return files.back();
+}
+
+/**
+ * @brief Makes room for more entries, so adding them does not reallocate.
+ * @param fileCount The number of files about to be added.
+ * @param directoryCount The number of subdirectories about to be added.
+ */
+void Directory::reserve(size_t fileCount, size_t directoryCount) {
+    ensureLoaded();
+    if (fileCount) {
+        files.reserve(files.size() + fileCount);
+        fileIndex.reserve(files.size() + fileCount); // Also avoids rehashing as the index grows
+    }
+    if (directoryCount) {
+        subdirectories.reserve(subdirectories.size() + directoryCount);
+        directoryIndex.reserve(subdirectories.size() + directoryCount);
+    }
 }
 
 /**
  * @brief Removes a file from the directory.
  * @param filename The name of the file to remove.
  */
-void Directory::removeFile(const string& filename) {
-    files.erase(remove_if(files.begin(), files.end(), [&](const File& file) {
-        return file.getName() == filename; // Check if the file name matches
-    }), files.end()); // Erase the file from the vector
+void Directory::removeFile(string_view filename) {
+    ensureLoaded();
+    auto it = fileIndex.find(filename);
+    if (it == fileIndex.end()) { // Nothing to remove
+        return;
+    }
+    preserveForSnapshots();
+    File* removed = unlinkFile(it->second);
+    if (nameIndex) {
+        nameIndex->remove(removed);
+    }
+    removed->countBlocks(-static_cast<int64_t>(removed->blocks.size()));
+    removed->parent = nullptr; // A file kept for snapshots no longer counts here
+    account(-static_cast<int64_t>(removed->length), -1, 0);
+    if (snapshots) {
+        snapshots->retire(removed); // Kept while an open snapshot can still reach it
+    } else {
+        NodePool<File>::instance().destroy(removed); // Release the file node
+    }
 }
 
 /**
- * @brief Adds a subdirectory to the directory.
+ * @brief Adds a deep copy of a subdirectory to the directory.
+ * @details Does nothing if a subdirectory with the same name already exists.
  * @param dir The subdirectory to add.
+ * @return A pointer to the subdirectory stored under that name.
  */
-void Directory::addDirectory(const Directory& dir) {
-    subdirectories.push_back(dir); // Add the directory to the subdirectories vector
+Directory* Directory::addDirectory(const Directory& dir) {
+    ensureLoaded();
+    auto it = directoryIndex.find(dir.getName());
+    if (it != directoryIndex.end()) { // Keep the existing directory with this name
+        return subdirectories[it->second];
+    }
+    Directory* copy = createDirectory(dir.getName()); // Allocate the copy with this directory as its parent
+    copy->copyContents(dir); // Copy the subtree beneath it
+    return copy;
+}
+
+/**
+ * @brief Adds a copy of a file to the directory under a new name.
+ * @details The copy shares the file's blocks copy-on-write. Does nothing if a
+ * file with that name already exists.
+ * @param file The file to copy.
+ * @param filename The name of the copy.
+ * @return A pointer to the file stored under that name.
+ */
+File* Directory::cloneFile(const File& file, const string& filename) {
+    ensureLoaded();
+    auto it = fileIndex.find(filename);
+    if (it != fileIndex.end()) { // Keep the existing file with this name
+        return files[it->second];
+    }
+    preserveForSnapshots();
+    files.push_back(adopt(NodePool<File>::instance().create(filename, file))); // Share the blocks, not the bytes
+    fileIndex[files.back()->getName()] = files.size() - 1;
+    entriesChanged();
+    return files.back();
+}
+
+/**
+ * @brief Adds a copy of a directory tree to the directory under a new name.
+ * @details Files in the copy share their blocks copy-on-write. Does nothing if
+ * a subdirectory with that name already exists.
+ * @param dir The directory to copy.
+ * @param dirname The name of the copy.
+ * @return A pointer to the subdirectory stored under that name.
+ */
+Directory* Directory::cloneDirectory(const Directory& dir, const string& dirname) {
+    ensureLoaded();
+    auto it = directoryIndex.find(dirname);
+    if (it != directoryIndex.end()) { // Keep the existing directory with this name
+        return subdirectories[it->second];
+    }
+    Directory* copy = createDirectory(dirname);
+    copy->copyContents(dir); // File copies share their blocks
+    return copy;
+}
+
+/**
+ * @brief Creates an empty subdirectory in the directory.
+ * @details Does nothing if a subdirectory with the same name already exists.
+ * @param dirname The name of the subdirectory to create.
+ * @return A pointer to the subdirectory stored under that name.
+ */
+Directory* Directory::createDirectory(const string& dirname) {
+    ensureLoaded();
+    auto it = directoryIndex.find(dirname);
+    if (it != directoryIndex.end()) { // Keep the existing directory with this name
+        return subdirectories[it->second];
+    }
+    preserveForSnapshots();
+    subdirectories.push_back(NodePool<Directory>::instance().create(dirname, this)); // Construct the directory in place
+    directoryIndex[subdirectories.back()->getName()] = subdirectories.size() - 1; // Index the directory by its position, keyed by its own name
+    account(0, 0, 1);
+    entriesChanged();
+    if (nameIndex) {
+        nameIndex->add({subdirectories.back()->getName(), nullptr, subdirectories.back()});
+    }
+    return subdirectories.back();
 }
 
 /**
  * @brief Removes a subdirectory from the directory.
  * @param dirname The name of the subdirectory to remove.
  */
-void Directory::removeDirectory(const string& dirname) {
-    subdirectories.erase(remove_if(subdirectories.begin(), subdirectories.end(), [&](const Directory& dir) {
-        return dir.getName() == dirname; // Check if the directory name matches
-    }), subdirectories.end()); // Erase the directory from the vector
+void Directory::removeDirectory(string_view dirname) {
+    Directory* removed = detachDirectory(dirname);
+    if (!removed) { // Nothing to remove
+        return;
+    }
+    if (snapshots) {
+        snapshots->retire(removed); // Kept, subtree and all, while an open snapshot can still reach it
+    } else {
+        NodePool<Directory>::instance().destroy(removed); // Release the directory and its subtree
+    }
+}
+
+/**
+ * @brief Removes a subdirectory from this directory without freeing it.
+ * @param dirname The name of the subdirectory to remove.
+ * @return The subdirectory, with its subtree, now owned by the caller; nullptr if there was none.
+ */
+Directory* Directory::detachDirectory(string_view dirname) {
+    ensureLoaded();
+    auto it = directoryIndex.find(dirname);
+    if (it == directoryIndex.end()) {
+        return nullptr;
+    }
+    preserveForSnapshots();
+    Directory* removed = unlinkDirectory(it->second);
+    if (nameIndex) {
+        nameIndex->remove(removed);
+        removed->unindex();
+    }
+    removed->uncountBlocks(); // Its blocks, kept for snapshots or about to be freed, are no longer the tree's
+    std::unique_lock<ShardedSharedMutex> relink(relinkLock()); // Writes below it go up one side of the cut or the other
+    removed->parentDirectory.store(nullptr, std::memory_order_release); // Changes below it stop at the detached node
+    SubtreeUsage usage = removed->getUsage();
+    addToTotals(-static_cast<int64_t>(usage.bytes), -static_cast<int64_t>(usage.files), -static_cast<int64_t>(usage.directories) - 1);
+    return removed;
+}
+
+/**
+ * @brief Creates an empty directory to be attached to this one later.
+ * @details It shares this directory's snapshot registry but is reachable from
+ * nowhere and counted nowhere, so it can be filled without any lock.
+ * @param dirname The name it will have once attached.
+ * @return The directory, owned by the caller until attached.
+ */
+Directory* Directory::createDetachedDirectory(const string& dirname) {
+    Directory* dir = NodePool<Directory>::instance().create(dirname, this); // Inherits the snapshot registry
+    dir->parentDirectory.store(nullptr, std::memory_order_relaxed); // Changes below it stop at the detached node
+    dir->nameIndex = nullptr; // Indexed when attached
+    return dir;
+}
+
+/**
+ * @brief Links a directory made by createDetachedDirectory(), with its subtree, into this directory.
+ * @details Does nothing if a subdirectory with its name already exists.
+ * @param dir The directory to attach.
+ * @return The directory, now owned by this one; nullptr if nothing was attached.
+ */
+Directory* Directory::attachDirectory(Directory* dir) {
+    ensureLoaded();
+    if (directoryIndex.find(dir->getName()) != directoryIndex.end()) {
+        return nullptr;
+    }
+    preserveForSnapshots();
+    SubtreeUsage usage = dir->getUsage();
+    dir->parentDirectory.store(this, std::memory_order_release);
+    subdirectories.push_back(dir);
+    directoryIndex[dir->getName()] = subdirectories.size() - 1;
+    entriesChanged();
+    account(static_cast<int64_t>(usage.bytes), static_cast<int64_t>(usage.files), static_cast<int64_t>(usage.directories) + 1);
+    if (nameIndex) {
+        nameIndex->add({dir->getName(), nullptr, dir});
+        dir->setNameIndex(nameIndex); // Adds the entries below it
+    }
+    return dir;
+}
+
+/**
+ * @brief Moves a file to another directory, or renames it in place, without copying it.
+ * @details The node is relinked, so pointers to it stay valid. Does nothing if
+ * there is no such file or the target already holds another file by the new name.
+ * @param filename The name of the file to move.
+ * @param target The directory to move it to; may be this one. Must belong to the same tree.
+ * @param newName The file's name in the target.
+ * @return The file, or nullptr if nothing was moved.
+ */
+File* Directory::moveFile(string_view filename, Directory& target, const string& newName) {
+    ensureLoaded();
+    target.ensureLoaded();
+    auto it = fileIndex.find(filename);
+    if (it == fileIndex.end()) {
+        return nullptr;
+    }
+    File* file = files[it->second];
+    if (File* existing = target.findFile(newName)) {
+        return existing == file ? file : nullptr; // Moving a file onto itself changes nothing
+    }
+    preserveForSnapshots();
+    target.preserveForSnapshots();
+    unlinkFile(it->second);
+    if (nameIndex) {
+        nameIndex->remove(file); // It views the old name
+    }
+    account(-static_cast<int64_t>(file->length), -1, 0);
+    file->name = newName; // No index holds a view of the old name any more
+    file->parent = &target;
+    target.files.push_back(file);
+    target.fileIndex[file->getName()] = target.files.size() - 1;
+    target.entriesChanged();
+    target.account(static_cast<int64_t>(file->length), 1, 0);
+    if (target.nameIndex) {
+        target.nameIndex->add({file->getName(), file, nullptr});
+    }
+    return file;
+}
+
+/**
+ * @brief Moves a subdirectory and its subtree to another directory, or renames it in place.
+ * @details Only the subdirectory itself is relinked, so the cost does not depend on
+ * the size of its subtree. Does nothing if there is no such subdirectory or the
+ * target already holds another subdirectory by the new name.
+ * @param dirname The name of the subdirectory to move.
+ * @param target The directory to move it to; may be this one. Must belong to the same
+ * tree and must not lie inside the subdirectory.
+ * @param newName The subdirectory's name in the target.
+ * @return The subdirectory, or nullptr if nothing was moved.
+ */
+Directory* Directory::moveDirectory(string_view dirname, Directory& target, const string& newName) {
+    ensureLoaded();
+    target.ensureLoaded();
+    auto it = directoryIndex.find(dirname);
+    if (it == directoryIndex.end()) {
+        return nullptr;
+    }
+    Directory* dir = subdirectories[it->second];
+    if (Directory* existing = target.findDirectory(newName)) {
+        return existing == dir ? dir : nullptr; // Moving a directory onto itself changes nothing
+    }
+    preserveForSnapshots();
+    target.preserveForSnapshots();
+    unlinkDirectory(it->second);
+    if (nameIndex) {
+        nameIndex->remove(dir); // Entries below it are indexed by their own names, and stay
+    }
+    std::unique_lock<ShardedSharedMutex> relink(relinkLock()); // Writes below it land on the old ancestors or the new, never both
+    SubtreeUsage usage = dir->getUsage(); // A directory still in an image has its totals from its record
+    addToTotals(-static_cast<int64_t>(usage.bytes), -static_cast<int64_t>(usage.files), -static_cast<int64_t>(usage.directories) - 1);
+    dir->name = newName;
+    dir->parentDirectory.store(&target, std::memory_order_release);
+    target.subdirectories.push_back(dir);
+    target.directoryIndex[dir->getName()] = target.subdirectories.size() - 1;
+    target.entriesChanged();
+    target.addToTotals(static_cast<int64_t>(usage.bytes), static_cast<int64_t>(usage.files), static_cast<int64_t>(usage.directories) + 1);
+    if (target.nameIndex) {
+        target.nameIndex->add({dir->getName(), nullptr, dir});
+    }
+    return dir;
+}
+
+/**
+ * @brief Empties the subdirectory list without freeing the subdirectories.
+ * @details For tearing a detached subtree down in parallel; subdirectories
+ * still waiting in an image are freed with this directory as usual.
+ * @return The subdirectories, now owned by the caller.
+ */
+vector<Directory*> Directory::releaseSubdirectories() {
+    vector<Directory*> released;
+    released.swap(subdirectories);
+    directoryIndex.clear();
+    entriesChanged();
+    return released;
 }
 
 /**
@@ -49,37 +646,103 @@ void Directory::removeDirectory(const string& dirname) {
  * @return A vector of strings containing the names of files and subdirectories in the directory.
  */
 vector<string> Directory::listContents() const {
+    ensureLoaded();
     vector<string> contents;
-    for (const auto& file : files) {
-        contents.push_back(file.getName()); // Add the file name to contents
+    contents.reserve(files.size() + subdirectories.size());
+    for (const File* file : files) {
+        contents.push_back(file->getName()); // Add the file name to contents
     }
-    for (const auto& dir : subdirectories) {
-        contents.push_back(dir.getName()); // Add the directory name to contents
+    for (const Directory* dir : subdirectories) {
+        contents.push_back(dir->getName()); // Add the directory name to contents
     }
     return contents; // Return the list of contents
 }
 
+/**
+ * @brief Gets the entries of the directory, files first, without copying anything.
+ * @details The range is valid until the directory next changes.
+ * @return The entries, in no particular order.
+ */
+Directory::EntryRange Directory::entries() const {
+    ensureLoaded();
+    return {EntryIterator(this, 0), EntryIterator(this, files.size() + subdirectories.size())};
+}
+
+/**
+ * @brief Gets the number of entries in the directory.
+ * @return The number of files and subdirectories.
+ */
+size_t Directory::entryCount() const {
+    ensureLoaded();
+    return files.size() + subdirectories.size();
+}
+
+/**
+ * @brief Gets a page of the entries in name order, resuming after a cursor.
+ * @details Entries are ordered by name, a file before a directory of the same
+ * name. A first page is picked in O(n log limit). Resuming from a cursor
+ * sorts views of the entries once, and later pages cost O(log n + limit)
+ * until the directory next changes. The views are valid until then too.
+ * @param afterName The name of the last entry of the previous page; empty to start at the beginning.
+ * @param afterDirectory Whether that entry was a directory.
+ * @param limit The most entries to return.
+ * @param more Set to whether entries remain after the page.
+ * @return The entries of the page.
+ */
+vector<DirectoryEntry> Directory::listPage(string_view afterName, bool afterDirectory, size_t limit, bool& more) const {
+    ensureLoaded();
+    auto order = [](const DirectoryEntry& a, const DirectoryEntry& b) {
+        return sortsBefore(a.name, a.directory != nullptr, b);
+    };
+    shared_ptr<const vector<DirectoryEntry>> sorted = std::atomic_load(&sortedEntries); // Readers may race to build it
+    if (!sorted && afterName.empty()) {
+        vector<DirectoryEntry> view(entries().begin(), entries().end()); // Views only; no name is copied
+        size_t count = std::min(limit, view.size());
+        std::partial_sort(view.begin(), view.begin() + count, view.end(), order); // A first look need not sort everything
+        more = count < view.size();
+        view.resize(count);
+        return view;
+    }
+    if (!sorted) {
+        shared_ptr<vector<DirectoryEntry>> view = make_shared<vector<DirectoryEntry>>(entries().begin(), entries().end());
+        std::sort(view->begin(), view->end(), order); // Paging on, so sort once for every page that follows
+        sorted = view;
+        std::atomic_store(&sortedEntries, sorted);
+    }
+    auto first = sorted->begin();
+    if (!afterName.empty()) {
+        first = std::upper_bound(sorted->begin(), sorted->end(), afterName, [afterDirectory](string_view name, const DirectoryEntry& entry) {
+            return sortsBefore(name, afterDirectory, entry);
+        });
+    }
+    auto last = first + std::min<size_t>(limit, sorted->end() - first);
+    more = last != sorted->end();
+    return vector<DirectoryEntry>(first, last);
+}
+
 /**
  * @brief Gets the name of the directory.
  * @return The name of the directory.
  */
-string Directory::getName() const {
+const string& Directory::getName() const {
     return name;
 }
 
 /**
  * @brief Gets the files in the directory.
- * @return A reference to the vector of files.
+ * @return A reference to the vector of file pointers.
  */
-vector<File>& Directory::getFiles() {
+const vector<File*>& Directory::getFiles() const {
+    ensureLoaded();
     return files; // Return the vector of files
 }
 
 /**
  * @brief Gets the subdirectories in the directory.
- * @return A reference to the vector of subdirectories.
+ * @return A reference to the vector of subdirectory pointers.
  */
-vector<Directory>& Directory::getSubdirectories() {
+const vector<Directory*>& Directory::getSubdirectories() const {
+    ensureLoaded();
     return subdirectories; // Return the vector of subdirectories
 }
 
@@ -88,7 +751,17 @@ vector<Directory>& Directory::getSubdirectories() {
  * @return A pointer to the parent directory.
  */
 Directory* Directory::getParentDirectory() const {
-    return parentDirectory; // Return a pointer to the parent directory
+    return parentDirectory.load(std::memory_order_acquire); // Return a pointer to the parent directory
+}
+
+/**
+ * @brief Gets the totals for everything below the directory.
+ * @details O(1): the totals are kept up to date as the subtree changes.
+ * @return The bytes, files and directories below the directory.
+ */
+SubtreeUsage Directory::getUsage() const {
+    return {subtreeBytes.load(std::memory_order_relaxed), subtreeFiles.load(std::memory_order_relaxed),
+            subtreeDirectories.load(std::memory_order_relaxed)};
 }
 
 /**
@@ -96,11 +769,27 @@ Directory* Directory::getParentDirectory() const {
  * @param filename The name of the file to find.
  * @return A pointer to the file if found, nullptr otherwise.
  */
-File* Directory::findFile(const string& filename) {
-    for (auto& file : files) {
-        if (file.getName() == filename) { // Check if the file name matches
-            return &file; // Return a pointer to the file
-        }
-    }
-    return nullptr; // Return nullptr if the file is not found
+File* Directory::findFile(string_view filename) {
+    ensureLoaded();
+    auto it = fileIndex.find(filename); // Look the name up in the index
+    return it != fileIndex.end() ? files[it->second] : nullptr; // Return nullptr if the file is not found
+}
+
+/**
+ * @brief Finds a subdirectory in the directory.
+ * @param dirname The name of the subdirectory to find.
+ * @return A pointer to the subdirectory if found, nullptr otherwise.
+ */
+Directory* Directory::findDirectory(string_view dirname) {
+    ensureLoaded();
+    auto it = directoryIndex.find(dirname); // Look the name up in the index
+    return it != directoryIndex.end() ? subdirectories[it->second] : nullptr; // Return nullptr if the directory is not found
+}
+
+/**
+ * @brief Gets the reader/writer lock guarding the directory's entries.
+ * @return A reference to the directory's mutex.
+ */
+shared_mutex& Directory::getMutex() const {
+    return mutex;
 }
@@ -1,89 +1,517 @@
 #ifndef DIRECTORY_HPP
 #define DIRECTORY_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
 #include "File.hpp"
 
+class FileSystemImage;
+class NameIndex;
+class SnapshotRegistry;
+
 using namespace std;
 
+/**
+ * @brief The running totals a directory keeps for everything below it.
+ */
+struct SubtreeUsage {
+    uint64_t bytes; ///< Logical size of every file below the directory.
+    uint64_t files; ///< Files below the directory.
+    uint64_t directories; ///< Directories below the directory, not counting itself.
+};
+
+class Directory;
+
+/**
+ * @brief One entry of a directory, viewed without copying its name.
+ * @details Valid until the directory next changes.
+ */
+struct DirectoryEntry {
+    string_view name; ///< The entry's name, viewed in the file or directory itself.
+    File* file; ///< The file, or nullptr if the entry is a directory.
+    Directory* directory; ///< The subdirectory, or nullptr if the entry is a file.
+};
+
 /**
  * @class Directory
  * @brief A class representing a directory that can contain files and subdirectories.
+ *
+ * Child files and subdirectories are allocated from NodePool slabs and held by
+ * pointer, so a node never moves once created: parent pointers and pointers
+ * handed out by findFile/findDirectory stay valid until the node is removed.
+ *
+ * A directory loaded from a FileSystemImage reads its record from the image
+ * the first time its contents are accessed.
+ *
+ * Each directory keeps SubtreeUsage totals for its subtree. Adding, removing
+ * or resizing anything below it sends the change up the parent chain, so the
+ * totals are read in O(1) and never need a walk; a directory still waiting in
+ * an image takes its totals from its record.
+ *
+ * entries() iterates over the entries in place, without copying their names.
+ * listPage() pages through them in name order from a cursor; the sorted view
+ * behind it is built when a cursor is first resumed and kept until the
+ * directory next changes.
+ *
+ * A directory connected to a NameIndex adds and removes its entries there as
+ * they come and go, and so do the directories created under it.
+ *
+ * moveFile() and moveDirectory() relink a node under a new parent or name
+ * without copying it; a moved subdirectory takes its subtree, totals and all,
+ * along untouched.
+ *
+ * While snapshots are open, a directory preserves its entries into them
+ * before it first changes, and removed children are handed to the
+ * SnapshotRegistry instead of being freed.
+ *
+ * Directory methods do not lock. Callers sharing a directory between threads
+ * hold getMutex() shared to look entries up and exclusively to add or remove
+ * them, as FileSystem does. Lazy loading is safe under a shared lock.
  */
 class Directory {
 private:
     string name;  ///< The name of the directory.
-    vector<File> files;  ///< A vector containing the files in the directory.
-    vector<Directory> subdirectories;  ///< A vector containing the subdirectories in the directory.
-    Directory* parentDirectory;  ///< A pointer to the parent directory.
+    vector<File*> files;  ///< The files in the directory, owned by this directory.
+    vector<Directory*> subdirectories;  ///< The subdirectories in the directory, owned by this directory.
+    atomic<Directory*> parentDirectory;  ///< A pointer to the parent directory; nullptr for the root or once detached.
+    unordered_map<string_view, size_t> fileIndex;  ///< Maps file names, viewed in the files themselves, to their position in files.
+    unordered_map<string_view, size_t> directoryIndex;  ///< Maps subdirectory names, viewed in the subdirectories themselves, to their position in subdirectories.
+    shared_ptr<FileSystemImage> image;  ///< The image holding this directory's record until it is loaded, if any.
+    uint64_t imageRecord;  ///< Offset of this directory's record in the image.
+    atomic<bool> imagePending;  ///< True until the image record has been loaded.
+    mutable shared_mutex mutex;  ///< Guards the directory's entries between threads.
+    SnapshotRegistry* snapshots;  ///< The registry of the tree's snapshots, or nullptr outside a FileSystem.
+    uint64_t snapshotGeneration;  ///< The snapshot generation up to which the entries are preserved.
+    atomic<uint64_t> subtreeBytes;  ///< See SubtreeUsage.
+    atomic<uint64_t> subtreeFiles;  ///< See SubtreeUsage.
+    atomic<uint64_t> subtreeDirectories;  ///< See SubtreeUsage.
+    NameIndex* nameIndex;  ///< The tree's name index, or nullptr if it has none.
+    atomic<size_t>* blockCounter;  ///< The tree's count of pool blocks held by its files, or nullptr if it keeps none.
+    mutable shared_ptr<const vector<DirectoryEntry>> sortedEntries;  ///< The entries in name order, built by listPage(); reset by every change.
+
+    friend class File;
+    friend class FileSystemImage;
+
+    /**
+     * @brief Adds a change to the totals of this directory and every directory above it.
+     * @details Changes made while the directory is loaded from its image are
+     * already counted in the image, and are ignored. Waits while a directory is
+     * being moved, so the change cannot land on the wrong ancestors.
+     * @param bytes The change in bytes.
+     * @param files The change in the number of files.
+     * @param directories The change in the number of directories.
+     */
+    void account(int64_t bytes, int64_t files, int64_t directories);
+
+    /**
+     * @brief Adds a change to the totals of this directory and every directory above it, without locking.
+     * @details For callers that hold the relink lock, exclusively while they move a directory.
+     * @param bytes The change in bytes.
+     * @param files The change in the number of files.
+     * @param directories The change in the number of directories.
+     */
+    void addToTotals(int64_t bytes, int64_t files, int64_t directories);
+
+    /**
+     * @brief Preserves the entries into any open snapshot that needs them; call before every change.
+     */
+    void preserveForSnapshots();
+
+    /**
+     * @brief Connects a new file to the tree's snapshot registry.
+     * @param file The file just added.
+     * @return The file.
+     */
+    File* adopt(File* file);
+
+    /**
+     * @brief Takes the file at a position out of the entries, keeping the index in step.
+     * @param position The file's position in files.
+     * @return The file, still allocated.
+     */
+    File* unlinkFile(size_t position);
+
+    /**
+     * @brief Takes the subdirectory at a position out of the entries, keeping the index in step.
+     * @param position The subdirectory's position in subdirectories.
+     * @return The subdirectory, still allocated.
+     */
+    Directory* unlinkDirectory(size_t position);
+
+    /**
+     * @brief Removes the directory's subtree from its name index.
+     */
+    void unindex();
+
+    /**
+     * @brief Takes the files of the directory's subtree out of the tree's block count, for good.
+     */
+    void uncountBlocks();
+
+    /**
+     * @brief Drops the sorted view; call on every change to the entries.
+     */
+    void entriesChanged();
+
+    /**
+     * @brief Loads the directory's contents from its image if that has not happened yet.
+     * @details Logically const: loading only materializes contents the directory already has.
+     */
+    void ensureLoaded() const;
+
+    /**
+     * @brief Releases all child nodes and empties the directory.
+     */
+    void clear();
+
+    /**
+     * @brief Recursively copies the contents of another directory into this one.
+     * @param other The directory to copy from.
+     */
+    void copyContents(const Directory& other);
 
 public:
+    /**
+     * @brief Iterates over the files of a directory and then its subdirectories.
+     */
+    class EntryIterator {
+    private:
+        const Directory* dir; ///< The directory.
+        size_t position; ///< Index into the files, then past them into the subdirectories.
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = DirectoryEntry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = DirectoryEntry;
+
+        /**
+         * @brief Constructor for the EntryIterator class.
+         * @param dir The directory.
+         * @param position The entry to start at.
+         */
+        EntryIterator(const Directory* dir, size_t position) : dir(dir), position(position) {}
+
+        /**
+         * @brief Gets the current entry.
+         * @return A view of the entry.
+         */
+        DirectoryEntry operator*() const {
+            size_t fileCount = dir->files.size();
+            if (position < fileCount) {
+                return {dir->files[position]->getName(), dir->files[position], nullptr};
+            }
+            Directory* subdir = dir->subdirectories[position - fileCount];
+            return {subdir->getName(), nullptr, subdir};
+        }
+
+        /**
+         * @brief Moves to the next entry.
+         * @return A reference to this iterator.
+         */
+        EntryIterator& operator++() {
+            ++position;
+            return *this;
+        }
+
+        /**
+         * @brief Compares two iterators over the same directory.
+         * @param other The other iterator.
+         * @return true if both are at the same entry.
+         */
+        bool operator==(const EntryIterator& other) const {
+            return position == other.position;
+        }
+
+        /**
+         * @brief Compares two iterators over the same directory.
+         * @param other The other iterator.
+         * @return true if they are at different entries.
+         */
+        bool operator!=(const EntryIterator& other) const {
+            return position != other.position;
+        }
+    };
+
+    /**
+     * @brief The entries of a directory, for a range-based for loop.
+     */
+    struct EntryRange {
+        EntryIterator first; ///< The first entry.
+        EntryIterator last; ///< Past the last entry.
+
+        /**
+         * @brief Gets an iterator to the first entry.
+         * @return The iterator.
+         */
+        EntryIterator begin() const {
+            return first;
+        }
+
+        /**
+         * @brief Gets an iterator past the last entry.
+         * @return The iterator.
+         */
+        EntryIterator end() const {
+            return last;
+        }
+    };
+
     /**
      * @brief Constructor for the Directory class.
      * @param name The name of the directory.
      * @param parent A pointer to the parent directory. Defaults to nullptr.
      */
-    Directory(const string& name, Directory* parent = nullptr); 
+    Directory(const string& name, Directory* parent = nullptr);
+
+    /**
+     * @brief Destructor for the Directory class; releases all child nodes.
+     */
+    ~Directory();
+
+    Directory(const Directory&) = delete;
+    Directory& operator=(const Directory&) = delete;
+
+    /**
+     * @brief Connects the directory, and the directories created under it, to a snapshot registry.
+     * @details Call on the root of an empty tree.
+     * @param registry The registry.
+     */
+    void setSnapshotRegistry(SnapshotRegistry* registry);
+
+    /**
+     * @brief Connects the directory, and the directories created under it, to a count of the pool blocks their files hold.
+     * @details Call on the root of an empty tree.
+     * @param counter The count, or nullptr.
+     */
+    void setBlockCounter(atomic<size_t>* counter);
 
     /**
-     * @brief Adds a file to the directory.
+     * @brief Connects the directory and its whole subtree to a name index, adding every entry below it.
+     * @details Loads any part of the subtree still waiting in an image. Passing
+     * nullptr disconnects the subtree without touching the index.
+     * @param index The index, or nullptr.
+     */
+    void setNameIndex(NameIndex* index);
+
+    /**
+     * @brief Adds a copy of a file to the directory.
+     * @details Does nothing if a file with the same name already exists.
      * @param file The file to add.
+     * @return A pointer to the file stored under that name.
+     */
+    File* addFile(const File& file);
+
+    /**
+     * @brief Creates an empty file in the directory.
+     * @details Does nothing if a file with the same name already exists.
+     * @param filename The name of the file to create.
+     * @return A pointer to the file stored under that name.
      */
-    void addFile(const File& file);
+    File* createFile(const string& filename);
 
     /**
      * @brief Removes a file from the directory.
      * @param filename The name of the file to remove.
      */
-    void removeFile(const string& filename);
+    void removeFile(string_view filename);
+
+    /**
+     * @brief Makes room for more entries, so adding them does not reallocate.
+     * @param fileCount The number of files about to be added.
+     * @param directoryCount The number of subdirectories about to be added.
+     */
+    void reserve(size_t fileCount, size_t directoryCount);
 
     /**
-     * @brief Adds a subdirectory to the directory.
+     * @brief Adds a deep copy of a subdirectory to the directory.
+     * @details Does nothing if a subdirectory with the same name already exists.
      * @param dir The subdirectory to add.
+     * @return A pointer to the subdirectory stored under that name.
+     */
+    Directory* addDirectory(const Directory& dir);
+
+    /**
+     * @brief Adds a copy of a file to the directory under a new name.
+     * @details The copy shares the file's blocks copy-on-write. Does nothing if a
+     * file with that name already exists.
+     * @param file The file to copy.
+     * @param filename The name of the copy.
+     * @return A pointer to the file stored under that name.
+     */
+    File* cloneFile(const File& file, const string& filename);
+
+    /**
+     * @brief Adds a copy of a directory tree to the directory under a new name.
+     * @details Files in the copy share their blocks copy-on-write. Does nothing if
+     * a subdirectory with that name already exists.
+     * @param dir The directory to copy.
+     * @param dirname The name of the copy.
+     * @return A pointer to the subdirectory stored under that name.
+     */
+    Directory* cloneDirectory(const Directory& dir, const string& dirname);
+
+    /**
+     * @brief Creates an empty subdirectory in the directory.
+     * @details Does nothing if a subdirectory with the same name already exists.
+     * @param dirname The name of the subdirectory to create.
+     * @return A pointer to the subdirectory stored under that name.
      */
-    void addDirectory(const Directory& dir);
+    Directory* createDirectory(const string& dirname);
 
     /**
      * @brief Removes a subdirectory from the directory.
      * @param dirname The name of the subdirectory to remove.
      */
-    void removeDirectory(const string& dirname);
+    void removeDirectory(string_view dirname);
+
+    /**
+     * @brief Removes a subdirectory from this directory without freeing it.
+     * @param dirname The name of the subdirectory to remove.
+     * @return The subdirectory, with its subtree, now owned by the caller; nullptr if there was none.
+     */
+    Directory* detachDirectory(string_view dirname);
+
+    /**
+     * @brief Creates an empty directory to be attached to this one later.
+     * @details It shares this directory's snapshot registry but is reachable from
+     * nowhere and counted nowhere, so it can be filled without any lock.
+     * @param dirname The name it will have once attached.
+     * @return The directory, owned by the caller until attached.
+     */
+    Directory* createDetachedDirectory(const string& dirname);
+
+    /**
+     * @brief Links a directory made by createDetachedDirectory(), with its subtree, into this directory.
+     * @details Does nothing if a subdirectory with its name already exists.
+     * @param dir The directory to attach.
+     * @return The directory, now owned by this one; nullptr if nothing was attached.
+     */
+    Directory* attachDirectory(Directory* dir);
+
+    /**
+     * @brief Moves a file to another directory, or renames it in place, without copying it.
+     * @details The node is relinked, so pointers to it stay valid. Does nothing if
+     * there is no such file or the target already holds another file by the new name.
+     * @param filename The name of the file to move.
+     * @param target The directory to move it to; may be this one. Must belong to the same tree.
+     * @param newName The file's name in the target.
+     * @return The file, or nullptr if nothing was moved.
+     */
+    File* moveFile(string_view filename, Directory& target, const string& newName);
+
+    /**
+     * @brief Moves a subdirectory and its subtree to another directory, or renames it in place.
+     * @details Only the subdirectory itself is relinked, so the cost does not depend on
+     * the size of its subtree. Does nothing if there is no such subdirectory or the
+     * target already holds another subdirectory by the new name.
+     * @param dirname The name of the subdirectory to move.
+     * @param target The directory to move it to; may be this one. Must belong to the same
+     * tree and must not lie inside the subdirectory.
+     * @param newName The subdirectory's name in the target.
+     * @return The subdirectory, or nullptr if nothing was moved.
+     */
+    Directory* moveDirectory(string_view dirname, Directory& target, const string& newName);
+
+    /**
+     * @brief Empties the subdirectory list without freeing the subdirectories.
+     * @details For tearing a detached subtree down in parallel; subdirectories
+     * still waiting in an image are freed with this directory as usual.
+     * @return The subdirectories, now owned by the caller.
+     */
+    vector<Directory*> releaseSubdirectories();
 
     /**
      * @brief Lists the contents of the directory.
+     * @details Copies every name; use entries() or listPage() for large directories.
      * @return A vector of strings containing the names of files and subdirectories in the directory.
      */
     vector<string> listContents() const;
 
+    /**
+     * @brief Gets the entries of the directory, files first, without copying anything.
+     * @details The range is valid until the directory next changes.
+     * @return The entries, in no particular order.
+     */
+    EntryRange entries() const;
+
+    /**
+     * @brief Gets the number of entries in the directory.
+     * @return The number of files and subdirectories.
+     */
+    size_t entryCount() const;
+
+    /**
+     * @brief Gets a page of the entries in name order, resuming after a cursor.
+     * @details Entries are ordered by name, a file before a directory of the same
+     * name. A first page is picked in O(n log limit). Resuming from a cursor
+     * sorts views of the entries once, and later pages cost O(log n + limit)
+     * until the directory next changes. The views are valid until then too.
+     * @param afterName The name of the last entry of the previous page; empty to start at the beginning.
+     * @param afterDirectory Whether that entry was a directory.
+     * @param limit The most entries to return.
+     * @param more Set to whether entries remain after the page.
+     * @return The entries of the page.
+     */
+    vector<DirectoryEntry> listPage(string_view afterName, bool afterDirectory, size_t limit, bool& more) const;
+
     /**
      * @brief Gets the name of the directory.
      * @return The name of the directory.
      */
-    string getName() const;
+    const string& getName() const;
 
     /**
      * @brief Gets the files in the directory.
-     * @return A reference to the vector of files.
+     * @return A reference to the vector of file pointers.
      */
-    vector<File>& getFiles(); 
+    const vector<File*>& getFiles() const;
 
     /**
      * @brief Gets the subdirectories in the directory.
-     * @return A reference to the vector of subdirectories.
+     * @return A reference to the vector of subdirectory pointers.
      */
-    vector<Directory>& getSubdirectories(); 
+    const vector<Directory*>& getSubdirectories() const;
 
     /**
      * @brief Gets the parent directory.
      * @return A pointer to the parent directory.
      */
-    Directory* getParentDirectory() const; 
+    Directory* getParentDirectory() const;
+
+    /**
+     * @brief Gets the totals for everything below the directory.
+     * @details O(1): the totals are kept up to date as the subtree changes.
+     * @return The bytes, files and directories below the directory.
+     */
+    SubtreeUsage getUsage() const;
 
     /**
      * @brief Finds a file in the directory.
      * @param filename The name of the file to find.
      * @return A pointer to the file if found, nullptr otherwise.
      */
-    File* findFile(const string& filename); 
+    File* findFile(string_view filename);
+
+    /**
+     * @brief Finds a subdirectory in the directory.
+     * @param dirname The name of the subdirectory to find.
+     * @return A pointer to the subdirectory if found, nullptr otherwise.
+     */
+    Directory* findDirectory(string_view dirname);
+
+    /**
+     * @brief Gets the reader/writer lock guarding the directory's entries.
+     * @return A reference to the directory's mutex.
+     */
+    shared_mutex& getMutex() const;
 };
 
-#endif 
+#endif
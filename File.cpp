@@ -1,25 +1,248 @@
 #include "File.hpp"
+#include "BlockPool.hpp"
+#include "CompressedBlocks.hpp"
+#include "Directory.hpp"
+#include "FileSystemImage.hpp"
+#include "Snapshot.hpp"
+#include "SpillFile.hpp"
+#include <algorithm>
+#include <cstring>
 
 /**
  * @brief Constructor for the File class.
  * @param name The name of the file.
  */
-File::File(const std::string& name) : name(name) {}
+File::File(const std::string& name)
+    : name(name), length(0), imageExtents(0), imageExtentCount(0), snapshots(nullptr), snapshotGeneration(0),
+      lastAccess(std::chrono::steady_clock::now().time_since_epoch().count()), parent(nullptr) {}
+
+/**
+ * @brief Constructs a copy of a file under another name.
+ * @details The copy shares the original's blocks until either is modified.
+ * @param name The name of the copy.
+ * @param contents The file to copy.
+ */
+File::File(const std::string& name, const File& contents) : File(contents) {
+    this->name = name;
+}
+
+/**
+ * @brief Copy constructor; shares the file's blocks copy-on-write.
+ * @param other The file to copy.
+ */
+File::File(const File& other)
+    : name(other.name), length(0), imageExtents(0), imageExtentCount(0), snapshots(nullptr), snapshotGeneration(0),
+      lastAccess(0), parent(nullptr) {
+    *this = other; // The copy is in no directory until one adopts it
+}
+
+/**
+ * @brief Copy assignment; replaces this file's blocks with shared references to another's.
+ * @param other The file to copy.
+ * @return A reference to this file.
+ */
+File& File::operator=(const File& other) {
+    if (this == &other) {
+        return *this;
+    }
+    preserveForSnapshots();
+    name = other.name;
+    releaseBlocks();
+    image = other.image; // Image-backed contents are shared until either file is written
+    imageExtents = other.imageExtents;
+    imageExtentCount = other.imageExtentCount;
+    compressed = other.compressed; // Packed contents are immutable, so copies share them too
+    spilled = other.spilled;
+    lastAccess.store(other.lastAccess.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (const auto& entry : other.blocks) { // Holes stay holes in the copy
+        BlockPool::instance().retain(entry.second); // Shared until one side writes to it
+        blocks.emplace_hint(blocks.end(), entry.first, entry.second);
+    }
+    countBlocks(static_cast<int64_t>(blocks.size()));
+    setLength(other.length);
+    return *this;
+}
+
+/**
+ * @brief Destructor for the File class; returns its blocks to the pool.
+ */
+File::~File() {
+    releaseBlocks();
+}
+
+/**
+ * @brief Sets the logical size of the file and sends the change up to its directory's totals.
+ * @param newLength The new length of the file.
+ */
+void File::setLength(size_t newLength) {
+    if (parent && newLength != length) {
+        parent->account(static_cast<int64_t>(newLength) - static_cast<int64_t>(length), 0, 0);
+    }
+    length = newLength;
+}
+
+/**
+ * @brief Returns every block to the pool.
+ * @details The length is left alone; callers set it as they need.
+ */
+void File::releaseBlocks() {
+    for (const auto& entry : blocks) {
+        BlockPool::instance().release(entry.second);
+    }
+    countBlocks(-static_cast<int64_t>(blocks.size()));
+    blocks.clear();
+    image.reset();
+    compressed.reset();
+    spilled.reset();
+    imageExtentCount = 0;
+}
+
+/**
+ * @brief Copies blocks still served from an image, unpacks compressed blocks, or faults spilled blocks into the pool.
+ * @details Called before the first modification of a file loaded from an image, compressed or spilled.
+ */
+void File::materialize() {
+    if (spilled) {
+        std::map<size_t, char*> faulted;
+        try {
+            for (size_t i = 0; i < spilled->blockCount(); ++i) {
+                char* block = BlockPool::instance().allocate();
+                faulted.emplace_hint(faulted.end(), spilled->blockIndex(i), block);
+                spilled->read(i, 0, block, BlockPool::BLOCK_SIZE);
+            }
+        } catch (...) {
+            for (const auto& entry : faulted) {
+                BlockPool::instance().release(entry.second); // Stay spilled rather than half faulted
+            }
+            throw;
+        }
+        blocks.swap(faulted);
+        countBlocks(static_cast<int64_t>(blocks.size()));
+        spilled.reset(); // Frees the slots with its last sharer
+        return;
+    }
+    if (compressed) {
+        for (size_t i = 0; i < compressed->blockCount(); ++i) {
+            char* block = BlockPool::instance().allocate();
+            compressed->decompress(i, block);
+            blocks.emplace_hint(blocks.end(), compressed->blockIndex(i), block);
+        }
+        countBlocks(static_cast<int64_t>(compressed->blockCount()));
+        compressed.reset(); // Dropped with its last sharer
+        return;
+    }
+    if (!image) {
+        return;
+    }
+    for (size_t i = 0; i < imageExtentCount; ++i) {
+        char* block = BlockPool::instance().allocate();
+        std::memcpy(block, image->extentData(imageExtents, i), BlockPool::BLOCK_SIZE);
+        blocks.emplace_hint(blocks.end(), image->extentBlock(imageExtents, i), block);
+    }
+    countBlocks(static_cast<int64_t>(imageExtentCount));
+    image.reset(); // From now on the file owns its data
+    imageExtentCount = 0;
+}
+
+/**
+ * @brief Adds a change in the file's pool blocks to its tree's count.
+ * @param delta The number of blocks taken, or given back if negative.
+ */
+void File::countBlocks(int64_t delta) {
+    if (delta && parent && parent->blockCounter) {
+        parent->blockCounter->fetch_add(static_cast<size_t>(delta), std::memory_order_relaxed); // Wraps back for negative deltas
+    }
+}
+
+/**
+ * @brief Preserves a copy into any open snapshot that needs one; call before every change.
+ */
+void File::preserveForSnapshots() {
+    if (snapshots && snapshots->needsPreserve(snapshotGeneration)) {
+        snapshots->preserve(*this, snapshotGeneration);
+    }
+}
+
+/**
+ * @brief Records that the file was just read or written.
+ */
+void File::touch() const {
+    std::chrono::steady_clock::rep now = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::chrono::steady_clock::rep granularity = std::chrono::steady_clock::duration(std::chrono::milliseconds(1)).count();
+    if (now - lastAccess.load(std::memory_order_relaxed) > granularity) { // Spares readers of a hot file from all writing one cache line
+        lastAccess.store(now, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Makes a block safe to modify, copying it first if another file shares it.
+ * @param it The block's entry in blocks.
+ * @return The block's data, now owned by this file alone.
+ */
+char* File::writableBlock(std::map<size_t, char*>::iterator it) {
+    if (BlockPool::isShared(it->second)) {
+        char* copy = BlockPool::instance().allocate();
+        std::memcpy(copy, it->second, BlockPool::BLOCK_SIZE);
+        BlockPool::instance().release(it->second); // The other owners keep the original
+        it->second = copy;
+    }
+    return it->second;
+}
+
+/**
+ * @brief Grows or shrinks the file to a new length.
+ * @details Growing only moves the end of the file (the new range is a hole);
+ * blocks past a new, smaller end are returned to the pool.
+ * @param newLength The new length of the file.
+ */
+void File::resize(size_t newLength) {
+    const size_t blockSize = BlockPool::BLOCK_SIZE;
+    materialize();
+    if (newLength < length) {
+        auto it = blocks.lower_bound((newLength + blockSize - 1) / blockSize);
+        int64_t dropped = 0;
+        for (auto drop = it; drop != blocks.end(); ++drop) { // Drop blocks past the new end
+            BlockPool::instance().release(drop->second);
+            ++dropped;
+        }
+        blocks.erase(it, blocks.end());
+        countBlocks(-dropped);
+        auto last = blocks.find(newLength / blockSize);
+        if (last != blocks.end()) {
+            // Zero the tail of the last block so a later grow reads zeros there
+            std::memset(writableBlock(last) + newLength % blockSize, 0, blockSize - newLength % blockSize);
+        }
+    }
+    setLength(newLength); // Growing just extends the trailing hole
+}
 
 /**
  * @brief Gets the name of the file.
  * @return The name of the file.
  */
-std::string File::getName() const {
+const std::string& File::getName() const {
     return name;
 }
 
+/**
+ * @brief Gets the directory holding the file.
+ * @return A pointer to the directory, or nullptr once the file has been removed from it.
+ */
+Directory* File::getParentDirectory() const {
+    return parent;
+}
+
 /**
  * @brief Writes data to the file.
  * @param newData The data to write to the file.
  */
 void File::write(const std::vector<char>& newData) {
-    data = newData; // Overwrite the existing data with new data
+    preserveForSnapshots();
+    if (image || compressed || spilled) {
+        releaseBlocks(); // Everything is replaced, so there is nothing to copy out, unpack or fault in
+    }
+    resize(newData.size()); // Keep only as many blocks as the new data needs
+    writeAt(0, newData.data(), newData.size()); // Overwrite the existing data with new data
 }
 
 /**
@@ -27,13 +250,395 @@ void File::write(const std::vector<char>& newData) {
  * @return The data contained in the file.
  */
 std::vector<char> File::read() const {
+    std::vector<char> data(length);
+    readAt(0, data.data(), length); // Gather the blocks into one buffer
     return data; // Return the data stored in the file
 }
 
 /**
- * @brief Gets a reference to the data in the file.
- * @return A reference to the vector of data.
+ * @brief Gets the data in the file as one contiguous vector.
+ * @details Compatibility path for callers that expect flat storage; equivalent to read().
+ * @return A copy of the data in the file.
+ */
+std::vector<char> File::getData() const {
+    return read();
+}
+
+/**
+ * @brief Gets the logical size of the file.
+ * @return The number of bytes in the file, including holes.
+ */
+size_t File::size() const {
+    return length;
+}
+
+/**
+ * @brief Gets the number of bytes actually allocated to the file.
+ * @return The size of the allocated blocks in bytes; holes are not counted.
+ */
+size_t File::allocatedSize() const {
+    return blockCount() * BlockPool::BLOCK_SIZE;
+}
+
+/**
+ * @brief Copies bytes from the file into a caller-provided buffer.
+ * @details Holes read back as zeros.
+ * @param offset The position in the file to start reading from.
+ * @param buffer The buffer to copy the bytes into.
+ * @param length The maximum number of bytes to read.
+ * @return The number of bytes actually read (0 at or past the end of the file).
+ */
+size_t File::readAt(size_t offset, char* buffer, size_t length) const {
+    if (offset >= this->length) { // Nothing to read at or past the end of the file
+        return 0;
+    }
+    if (length > this->length - offset) {
+        length = this->length - offset; // Clamp the read to the available data
+    }
+    touch();
+    if (image) {
+        return readImage(offset, buffer, length);
+    }
+    if (compressed) {
+        return readCompressed(offset, buffer, length);
+    }
+    if (spilled) {
+        return readSpilled(offset, buffer, length);
+    }
+    auto it = blocks.lower_bound(offset / BlockPool::BLOCK_SIZE); // Walk the blocks in order from the first one touched
+    size_t done = 0;
+    while (done < length) {
+        size_t index = (offset + done) / BlockPool::BLOCK_SIZE;
+        size_t blockOffset = (offset + done) % BlockPool::BLOCK_SIZE;
+        size_t chunk = std::min(length - done, BlockPool::BLOCK_SIZE - blockOffset);
+        if (it != blocks.end() && it->first == index) {
+            std::memcpy(buffer + done, it->second + blockOffset, chunk); // Copy straight out of the block
+            ++it;
+        } else {
+            std::memset(buffer + done, 0, chunk); // Holes read as zeros
+        }
+        done += chunk;
+    }
+    return length;
+}
+
+/**
+ * @brief Copies bytes from a caller-provided buffer into the file.
+ * @details The file is grown if the write extends past its end; any gap left
+ * between the old end and the write becomes a hole. Only the blocks covered
+ * by the write are allocated.
+ * @param offset The position in the file to start writing at.
+ * @param buffer The buffer holding the bytes to write.
+ * @param length The number of bytes to write.
+ * @return The number of bytes written.
+ */
+size_t File::writeAt(size_t offset, const char* buffer, size_t length) {
+    ConstIoVec vector = {buffer, length};
+    return writeAtv(offset, &vector, 1);
+}
+
+/**
+ * @brief Copies bytes from the file into several buffers, filling each in turn.
+ * @details Holes read back as zeros.
+ * @param offset The position in the file to start reading from.
+ * @param vectors The buffers to fill.
+ * @param count The number of buffers.
+ * @return The total number of bytes read; stops early at the end of the file.
+ */
+size_t File::readAtv(size_t offset, const IoVec* vectors, size_t count) const {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t read = readAt(offset + total, vectors[i].data, vectors[i].length);
+        total += read;
+        if (read < vectors[i].length) {
+            break; // Reached the end of the file
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Copies bytes from several buffers into the file, back to back.
+ * @details The file grows at most once, to the end of the last buffer, and
+ * the blocks covered are walked once for all the buffers.
+ * @param offset The position in the file to start writing at.
+ * @param vectors The buffers to write.
+ * @param count The number of buffers.
+ * @return The total number of bytes written.
+ */
+size_t File::writeAtv(size_t offset, const ConstIoVec* vectors, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += vectors[i].length;
+    }
+    preserveForSnapshots();
+    materialize();
+    touch();
+    if (offset + total > this->length) {
+        resize(offset + total); // Move the end of the file once; no blocks are allocated yet
+    }
+    auto it = blocks.lower_bound(offset / BlockPool::BLOCK_SIZE);
+    size_t position = offset;
+    for (size_t i = 0; i < count; ++i) {
+        const char* buffer = vectors[i].data;
+        size_t length = vectors[i].length;
+        size_t done = 0;
+        while (done < length) { // Patch only the blocks covered by the write
+            size_t index = position / BlockPool::BLOCK_SIZE;
+            size_t blockOffset = position % BlockPool::BLOCK_SIZE;
+            size_t chunk = std::min(length - done, BlockPool::BLOCK_SIZE - blockOffset);
+            if (it == blocks.end() || it->first != index) {
+                it = blocks.emplace_hint(it, index, BlockPool::instance().allocate()); // Fill in a hole
+                countBlocks(1);
+            }
+            std::memcpy(writableBlock(it) + blockOffset, buffer + done, chunk);
+            if (blockOffset + chunk == BlockPool::BLOCK_SIZE) {
+                ++it; // Otherwise the next buffer carries on in the same block
+            }
+            position += chunk;
+            done += chunk;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Gets the number of blocks holding the file data.
+ * @return The number of blocks allocated to the file; holes are not counted.
+ */
+size_t File::blockCount() const {
+    if (compressed) {
+        return compressed->blockCount();
+    }
+    if (spilled) {
+        return spilled->blockCount();
+    }
+    return image ? imageExtentCount : blocks.size();
+}
+
+/**
+ * @brief Reads a range of a file whose contents are still in an image.
+ * @param offset The position in the file to start reading from.
+ * @param buffer The buffer to copy the bytes into.
+ * @param length The number of bytes to read; already clamped to the file size.
+ * @return The number of bytes read.
+ */
+size_t File::readImage(size_t offset, char* buffer, size_t length) const {
+    size_t extent = image->findExtent(imageExtents, imageExtentCount, offset / BlockPool::BLOCK_SIZE);
+    size_t done = 0;
+    while (done < length) {
+        size_t index = (offset + done) / BlockPool::BLOCK_SIZE;
+        size_t blockOffset = (offset + done) % BlockPool::BLOCK_SIZE;
+        size_t chunk = std::min(length - done, BlockPool::BLOCK_SIZE - blockOffset);
+        if (extent < imageExtentCount && image->extentBlock(imageExtents, extent) == index) {
+            std::memcpy(buffer + done, image->extentData(imageExtents, extent) + blockOffset, chunk); // Serve straight from the mapping
+            ++extent;
+        } else {
+            std::memset(buffer + done, 0, chunk); // Holes read as zeros
+        }
+        done += chunk;
+    }
+    return length;
+}
+
+/**
+ * @brief Reads a range of a compressed file, decompressing only the blocks it covers.
+ * @param offset The position in the file to start reading from.
+ * @param buffer The buffer to copy the bytes into.
+ * @param length The number of bytes to read; already clamped to the file size.
+ * @return The number of bytes read.
+ */
+size_t File::readCompressed(size_t offset, char* buffer, size_t length) const {
+    char block[BlockPool::BLOCK_SIZE];
+    size_t position = compressed->find(offset / BlockPool::BLOCK_SIZE);
+    size_t done = 0;
+    while (done < length) {
+        size_t index = (offset + done) / BlockPool::BLOCK_SIZE;
+        size_t blockOffset = (offset + done) % BlockPool::BLOCK_SIZE;
+        size_t chunk = std::min(length - done, BlockPool::BLOCK_SIZE - blockOffset);
+        if (position < compressed->blockCount() && compressed->blockIndex(position) == index) {
+            if (blockOffset == 0 && chunk == BlockPool::BLOCK_SIZE) {
+                compressed->decompress(position, buffer + done); // Whole blocks go straight into the caller's buffer
+            } else {
+                compressed->decompress(position, block);
+                std::memcpy(buffer + done, block + blockOffset, chunk);
+            }
+            ++position;
+        } else {
+            std::memset(buffer + done, 0, chunk); // Holes read as zeros
+        }
+        done += chunk;
+    }
+    return length;
+}
+
+/**
+ * @brief Reads a range of a spilled file straight from the spill file.
+ * @param offset The position in the file to start reading from.
+ * @param buffer The buffer to copy the bytes into.
+ * @param length The number of bytes to read; already clamped to the file size.
+ * @return The number of bytes read.
+ * @throws std::runtime_error if the spill file cannot be read.
+ */
+size_t File::readSpilled(size_t offset, char* buffer, size_t length) const {
+    size_t position = spilled->find(offset / BlockPool::BLOCK_SIZE);
+    size_t done = 0;
+    while (done < length) {
+        size_t index = (offset + done) / BlockPool::BLOCK_SIZE;
+        size_t blockOffset = (offset + done) % BlockPool::BLOCK_SIZE;
+        size_t chunk = std::min(length - done, BlockPool::BLOCK_SIZE - blockOffset);
+        if (position < spilled->blockCount() && spilled->blockIndex(position) == index) {
+            spilled->read(position, blockOffset, buffer + done, chunk); // Only the bytes asked for
+            ++position;
+        } else {
+            std::memset(buffer + done, 0, chunk); // Holes read as zeros
+        }
+        done += chunk;
+    }
+    return length;
+}
+
+/**
+ * @brief Visits each allocated block of the file in order.
+ * @param visit Called with each block's index and its BLOCK_SIZE bytes of data.
+ */
+void File::forEachBlock(const std::function<void(size_t, const char*)>& visit) const {
+    if (image) {
+        for (size_t i = 0; i < imageExtentCount; ++i) {
+            visit(image->extentBlock(imageExtents, i), image->extentData(imageExtents, i));
+        }
+        return;
+    }
+    if (compressed) {
+        char block[BlockPool::BLOCK_SIZE];
+        for (size_t i = 0; i < compressed->blockCount(); ++i) {
+            compressed->decompress(i, block);
+            visit(compressed->blockIndex(i), block);
+        }
+        return;
+    }
+    if (spilled) {
+        char block[BlockPool::BLOCK_SIZE];
+        for (size_t i = 0; i < spilled->blockCount(); ++i) {
+            spilled->read(i, 0, block, BlockPool::BLOCK_SIZE);
+            visit(spilled->blockIndex(i), block);
+        }
+        return;
+    }
+    for (const auto& entry : blocks) {
+        visit(entry.first, entry.second);
+    }
+}
+
+/**
+ * @brief Packs the file's blocks with LzCodec and returns them to the pool.
+ * @details The caller holds the file exclusively. Files still served from an
+ * image, already compressed, empty, or whose data does not compress are left as they are.
+ * @return true if the file was compressed.
+ */
+bool File::compress() {
+    if (image || compressed || spilled || blocks.empty()) {
+        return false;
+    }
+    std::shared_ptr<const CompressedBlocks> packed = CompressedBlocks::compress(blocks);
+    if (!packed) {
+        return false;
+    }
+    for (const auto& entry : blocks) {
+        BlockPool::instance().release(entry.second); // Blocks shared with other files stay with them
+    }
+    countBlocks(-static_cast<int64_t>(blocks.size()));
+    blocks.clear();
+    compressed = std::move(packed); // The contents do not change, so snapshots need nothing preserved
+    return true;
+}
+
+/**
+ * @brief Determines if the file is held compressed.
+ * @return true if the file's blocks are packed.
+ */
+bool File::isCompressed() const {
+    return compressed != nullptr;
+}
+
+/**
+ * @brief Gets when the file was last read or written.
+ * @return The time of the last access, to within a millisecond.
+ */
+std::chrono::steady_clock::time_point File::lastAccessed() const {
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastAccess.load(std::memory_order_relaxed)));
+}
+
+/**
+ * @brief Evicts the file's blocks to a spill file and returns them to the pool.
+ * @details The caller holds the file exclusively. Only files whose blocks are
+ * all in the pool are spilled; the name, size and place in the tree stay in memory.
+ * @param to The spill file to write to.
+ * @return true if the file was spilled.
+ * @throws std::runtime_error if the spill file cannot be written; the file is left as it was.
+ */
+bool File::spill(const std::shared_ptr<SpillFile>& to) {
+    if (image || compressed || spilled || blocks.empty()) {
+        return false;
+    }
+    std::vector<size_t> indices;
+    std::vector<uint64_t> slots;
+    indices.reserve(blocks.size());
+    slots.reserve(blocks.size());
+    try {
+        for (const auto& entry : blocks) {
+            slots.push_back(to->write(entry.second));
+            indices.push_back(entry.first);
+        }
+    } catch (...) {
+        for (uint64_t slot : slots) {
+            to->free(slot);
+        }
+        throw;
+    }
+    spilled = std::make_shared<const SpilledBlocks>(to, std::move(indices), std::move(slots));
+    for (const auto& entry : blocks) {
+        BlockPool::instance().release(entry.second); // Blocks shared with other files stay with them
+    }
+    countBlocks(-static_cast<int64_t>(blocks.size()));
+    blocks.clear(); // The contents do not change, so snapshots need nothing preserved
+    return true;
+}
+
+/**
+ * @brief Faults a spilled file's blocks back into the pool.
+ * @details The caller holds the file exclusively.
+ * @return true if the file was spilled.
+ * @throws std::runtime_error if the spill file cannot be read.
+ */
+bool File::restore() {
+    if (!spilled) {
+        return false;
+    }
+    materialize();
+    return true;
+}
+
+/**
+ * @brief Determines if the file's blocks are evicted to a spill file.
+ * @return true if the file is spilled.
+ */
+bool File::isSpilled() const {
+    return spilled != nullptr;
+}
+
+/**
+ * @brief Gets the number of pool blocks the file holds in memory.
+ * @return The number of blocks; 0 while the file is image-backed, compressed or spilled.
+ */
+size_t File::residentBlocks() const {
+    return blocks.size();
+}
+
+/**
+ * @brief Gets the reader/writer lock guarding the file's contents.
+ * @return A reference to the file's mutex.
  */
-std::vector<char>& File::getData() { 
-    return data; // Return a reference to the data vector
+std::shared_mutex& File::getMutex() const {
+    return mutex;
 }
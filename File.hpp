@@ -1,17 +1,166 @@
 #ifndef FILE_HPP
 #define FILE_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
+class CompressedBlocks;
+class Directory;
+class FileSystemImage;
+class SpillFile;
+class SpilledBlocks;
+class SnapshotRegistry;
+
+/**
+ * @brief One buffer of a scatter read.
+ */
+struct IoVec {
+    char* data; ///< Where to put the bytes.
+    size_t length; ///< How many bytes the buffer holds.
+};
+
+/**
+ * @brief One buffer of a gather write.
+ */
+struct ConstIoVec {
+    const char* data; ///< The bytes to write.
+    size_t length; ///< How many bytes to write.
+};
+
 /**
  * @class File
  * @brief A class representing a file that contains a name and data.
+ *
+ * The contents are stored as fixed-size blocks drawn from the shared BlockPool,
+ * keyed by block index, so writes only touch the blocks they cover and growing
+ * a file never copies the data already stored. Files may be sparse: blocks that
+ * were never written are holes that take no memory and read back as zeros.
+ *
+ * A file loaded from a FileSystemImage reads its blocks straight from the
+ * mapped image and only copies them into the pool when it is first modified.
+ *
+ * Copies of a file share its blocks copy-on-write, so copying costs only the
+ * block map; a shared block is duplicated when either copy first changes it.
+ * The same mechanism preserves a file into open snapshots before it changes.
+ *
+ * A file left alone for a while can be packed with compress(): its blocks are
+ * replaced by a CompressedBlocks copy, reads decompress just the blocks they
+ * cover, and the first modification unpacks it back into the pool.
+ *
+ * Under memory pressure a file's blocks can likewise be evicted to a SpillFile
+ * with spill(). Reads are then served from disk, and the first modification,
+ * or restore(), faults the blocks back into the pool.
+ *
+ * A file in a directory reports every change of its size to the directory,
+ * which keeps the totals of its subtree.
+ *
+ * File methods do not lock. Callers sharing a file between threads hold
+ * getMutex() shared to read and exclusively to modify, as FileSystem and
+ * FileDescriptor do.
  */
 class File {
 private:
     std::string name; ///< The name of the file.
-    std::vector<char> data; ///< The data contained in the file.
+    std::map<size_t, char*> blocks; ///< The allocated blocks, keyed by block index; missing indices are holes.
+    size_t length; ///< The logical size of the file in bytes, including holes.
+    std::shared_ptr<FileSystemImage> image; ///< The image holding the contents until the first write, if any.
+    uint64_t imageExtents; ///< Offset of the file's extent table in the image.
+    size_t imageExtentCount; ///< Number of extents in the image's extent table.
+    mutable std::shared_mutex mutex; ///< Guards the file's contents between threads.
+    SnapshotRegistry* snapshots; ///< The registry of the tree's snapshots, or nullptr outside a FileSystem.
+    uint64_t snapshotGeneration; ///< The snapshot generation up to which the contents are preserved.
+    std::shared_ptr<const CompressedBlocks> compressed; ///< The packed contents, from compress() until the next change.
+    std::shared_ptr<const SpilledBlocks> spilled; ///< The evicted contents, from spill() until restored or changed.
+    mutable std::atomic<std::chrono::steady_clock::rep> lastAccess; ///< When the file was last read or written.
+    Directory* parent; ///< The directory holding the file, whose totals follow its size; nullptr outside a tree.
+
+    friend class BlockStore;
+    friend class Directory;
+    friend class FileSystemImage;
+
+    /**
+     * @brief Preserves a copy into any open snapshot that needs one; call before every change.
+     */
+    void preserveForSnapshots();
+
+    /**
+     * @brief Records that the file was just read or written.
+     */
+    void touch() const;
+
+    /**
+     * @brief Grows or shrinks the file to a new length.
+     * @details Growing only moves the end of the file (the new range is a hole);
+     * blocks past a new, smaller end are returned to the pool.
+     * @param newLength The new length of the file.
+     */
+    void resize(size_t newLength);
+
+    /**
+     * @brief Sets the logical size of the file and sends the change up to its directory's totals.
+     * @param newLength The new length of the file.
+     */
+    void setLength(size_t newLength);
+
+    /**
+     * @brief Returns every block to the pool.
+     * @details The length is left alone; callers set it as they need.
+     */
+    void releaseBlocks();
+
+    /**
+     * @brief Adds a change in the file's pool blocks to its tree's count.
+     * @param delta The number of blocks taken, or given back if negative.
+     */
+    void countBlocks(int64_t delta);
+
+    /**
+     * @brief Copies blocks still served from an image, unpacks compressed blocks, or faults spilled blocks into the pool.
+     * @details Called before the first modification of a file loaded from an image, compressed or spilled.
+     */
+    void materialize();
+
+    /**
+     * @brief Makes a block safe to modify, copying it first if another file shares it.
+     * @param it The block's entry in blocks.
+     * @return The block's data, now owned by this file alone.
+     */
+    char* writableBlock(std::map<size_t, char*>::iterator it);
+
+    /**
+     * @brief Reads a range of a file whose contents are still in an image.
+     * @param offset The position in the file to start reading from.
+     * @param buffer The buffer to copy the bytes into.
+     * @param length The number of bytes to read; already clamped to the file size.
+     * @return The number of bytes read.
+     */
+    size_t readImage(size_t offset, char* buffer, size_t length) const;
+
+    /**
+     * @brief Reads a range of a compressed file, decompressing only the blocks it covers.
+     * @param offset The position in the file to start reading from.
+     * @param buffer The buffer to copy the bytes into.
+     * @param length The number of bytes to read; already clamped to the file size.
+     * @return The number of bytes read.
+     */
+    size_t readCompressed(size_t offset, char* buffer, size_t length) const;
+
+    /**
+     * @brief Reads a range of a spilled file straight from the spill file.
+     * @param offset The position in the file to start reading from.
+     * @param buffer The buffer to copy the bytes into.
+     * @param length The number of bytes to read; already clamped to the file size.
+     * @return The number of bytes read.
+     * @throws std::runtime_error if the spill file cannot be read.
+     */
+    size_t readSpilled(size_t offset, char* buffer, size_t length) const;
 
 public:
     /**
@@ -20,11 +169,43 @@ public:
      */
     File(const std::string& name);
 
+    /**
+     * @brief Constructs a copy of a file under another name.
+     * @details The copy shares the original's blocks until either is modified.
+     * @param name The name of the copy.
+     * @param contents The file to copy.
+     */
+    File(const std::string& name, const File& contents);
+
+    /**
+     * @brief Copy constructor; shares the file's blocks copy-on-write.
+     * @param other The file to copy.
+     */
+    File(const File& other);
+
+    /**
+     * @brief Copy assignment; replaces this file's blocks with shared references to another's.
+     * @param other The file to copy.
+     * @return A reference to this file.
+     */
+    File& operator=(const File& other);
+
+    /**
+     * @brief Destructor for the File class; returns its blocks to the pool.
+     */
+    ~File();
+
     /**
      * @brief Gets the name of the file.
      * @return The name of the file.
      */
-    std::string getName() const;
+    const std::string& getName() const;
+
+    /**
+     * @brief Gets the directory holding the file.
+     * @return A pointer to the directory, or nullptr once the file has been removed from it.
+     */
+    Directory* getParentDirectory() const;
 
     /**
      * @brief Writes data to the file.
@@ -39,10 +220,134 @@ public:
     std::vector<char> read() const;
 
     /**
-     * @brief Gets a reference to the data in the file.
-     * @return A reference to the vector of data.
+     * @brief Gets the data in the file as one contiguous vector.
+     * @details Compatibility path for callers that expect flat storage; equivalent to read().
+     * @return A copy of the data in the file.
+     */
+    std::vector<char> getData() const;
+
+    /**
+     * @brief Gets the logical size of the file.
+     * @return The number of bytes in the file, including holes.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Gets the number of bytes actually allocated to the file.
+     * @return The size of the allocated blocks in bytes; holes are not counted.
+     */
+    size_t allocatedSize() const;
+
+    /**
+     * @brief Copies bytes from the file into a caller-provided buffer.
+     * @details Holes read back as zeros.
+     * @param offset The position in the file to start reading from.
+     * @param buffer The buffer to copy the bytes into.
+     * @param length The maximum number of bytes to read.
+     * @return The number of bytes actually read (0 at or past the end of the file).
+     */
+    size_t readAt(size_t offset, char* buffer, size_t length) const;
+
+    /**
+     * @brief Copies bytes from a caller-provided buffer into the file.
+     * @details The file is grown if the write extends past its end; any gap left
+     * between the old end and the write becomes a hole. Only the blocks covered
+     * by the write are allocated.
+     * @param offset The position in the file to start writing at.
+     * @param buffer The buffer holding the bytes to write.
+     * @param length The number of bytes to write.
+     * @return The number of bytes written.
+     */
+    size_t writeAt(size_t offset, const char* buffer, size_t length);
+
+    /**
+     * @brief Copies bytes from the file into several buffers, filling each in turn.
+     * @details Holes read back as zeros.
+     * @param offset The position in the file to start reading from.
+     * @param vectors The buffers to fill.
+     * @param count The number of buffers.
+     * @return The total number of bytes read; stops early at the end of the file.
+     */
+    size_t readAtv(size_t offset, const IoVec* vectors, size_t count) const;
+
+    /**
+     * @brief Copies bytes from several buffers into the file, back to back.
+     * @details The file grows at most once, to the end of the last buffer, and
+     * the blocks covered are walked once for all the buffers.
+     * @param offset The position in the file to start writing at.
+     * @param vectors The buffers to write.
+     * @param count The number of buffers.
+     * @return The total number of bytes written.
+     */
+    size_t writeAtv(size_t offset, const ConstIoVec* vectors, size_t count);
+
+    /**
+     * @brief Gets the number of blocks holding the file data.
+     * @return The number of blocks allocated to the file; holes are not counted.
+     */
+    size_t blockCount() const;
+
+    /**
+     * @brief Visits each allocated block of the file in order.
+     * @param visit Called with each block's index and its BLOCK_SIZE bytes of data.
+     */
+    void forEachBlock(const std::function<void(size_t, const char*)>& visit) const;
+
+    /**
+     * @brief Packs the file's blocks with LzCodec and returns them to the pool.
+     * @details The caller holds the file exclusively. Files still served from an
+     * image, already compressed, empty, or whose data does not compress are left as they are.
+     * @return true if the file was compressed.
+     */
+    bool compress();
+
+    /**
+     * @brief Determines if the file is held compressed.
+     * @return true if the file's blocks are packed.
+     */
+    bool isCompressed() const;
+
+    /**
+     * @brief Gets when the file was last read or written.
+     * @return The time of the last access, to within a millisecond.
+     */
+    std::chrono::steady_clock::time_point lastAccessed() const;
+
+    /**
+     * @brief Evicts the file's blocks to a spill file and returns them to the pool.
+     * @details The caller holds the file exclusively. Only files whose blocks are
+     * all in the pool are spilled; the name, size and place in the tree stay in memory.
+     * @param to The spill file to write to.
+     * @return true if the file was spilled.
+     * @throws std::runtime_error if the spill file cannot be written; the file is left as it was.
+     */
+    bool spill(const std::shared_ptr<SpillFile>& to);
+
+    /**
+     * @brief Faults a spilled file's blocks back into the pool.
+     * @details The caller holds the file exclusively.
+     * @return true if the file was spilled.
+     * @throws std::runtime_error if the spill file cannot be read.
+     */
+    bool restore();
+
+    /**
+     * @brief Determines if the file's blocks are evicted to a spill file.
+     * @return true if the file is spilled.
+     */
+    bool isSpilled() const;
+
+    /**
+     * @brief Gets the number of pool blocks the file holds in memory.
+     * @return The number of blocks; 0 while the file is image-backed, compressed or spilled.
+     */
+    size_t residentBlocks() const;
+
+    /**
+     * @brief Gets the reader/writer lock guarding the file's contents.
+     * @return A reference to the file's mutex.
      */
-    std::vector<char>& getData(); 
+    std::shared_mutex& getMutex() const;
 };
 
-#endif 
\ No newline at end of file
+#endif
@@ -1,10 +1,13 @@
 #include "FileDescriptor.hpp"
+#include <mutex>
+#include <shared_mutex>
 
 /**
  * @brief Constructor for the FileDescriptor class.
  * @param file The file to associate with this file descriptor.
+ * @param stats The counters to record reads and writes in, or nullptr to record nothing.
  */
-FileDescriptor::FileDescriptor(File& file) : file(file), position(0) {}
+FileDescriptor::FileDescriptor(File& file, OperationStats* stats) : file(file), position(0), stats(stats) {}
 
 /**
  * @brief Sets the current position within the file.
@@ -20,13 +23,12 @@ void FileDescriptor::seek(size_t pos) {
  * @return A vector containing the bytes read from the file.
  */
 std::vector<char> FileDescriptor::read(size_t length) {
-    std::vector<char> data = file.read(); // Read the entire file data
-    if (position + length > data.size()) { // Check if the read length exceeds the file size
-        length = data.size() - position; // Adjust the length to read only available data
-    }
-    // Extract the requested portion of data starting from the current position
-    std::vector<char> result(data.begin() + position, data.begin() + position + length);
-    position += length; // Update the current position
+    OperationStats::Timer timer(stats, StatsOp::Read);
+    std::shared_lock<std::shared_mutex> lock(file.getMutex());
+    size_t available = file.size() > position ? file.size() - position : 0; // Bytes left from the current position
+    std::vector<char> result(length < available ? length : available); // Size the result to what can be read
+    position += file.readAt(position, result.data(), result.size()); // Read straight from the file and advance the position
+    timer.setBytes(result.size());
     return result; // Return the extracted data
 }
 
@@ -35,13 +37,95 @@ std::vector<char> FileDescriptor::read(size_t length) {
  * @param data The data to write to the file.
  */
 void FileDescriptor::write(const std::vector<char>& data) {
-    std::vector<char> currentData = file.read(); // Read the current file data
-    // Check if the write operation exceeds the current file size
-    if (position + data.size() > currentData.size()) {
-        currentData.resize(position + data.size()); // Resize the file data to accommodate new data
-    }
-    // Copy the new data into the current data starting from the current position
-    std::copy(data.begin(), data.end(), currentData.begin() + position);
-    file.write(currentData); // Write the updated data back to the file
-    position += data.size(); // Update the current position
+    position += pwrite(data.data(), data.size(), position); // Patch the file in place and advance the position
+}
+
+/**
+ * @brief Reads bytes at a given offset into a caller-provided buffer.
+ * @details Works directly on the file storage and does not move the current position.
+ * @param buffer The buffer to read into.
+ * @param length The maximum number of bytes to read.
+ * @param offset The position in the file to read from.
+ * @return The number of bytes read.
+ */
+size_t FileDescriptor::pread(char* buffer, size_t length, size_t offset) const {
+    OperationStats::Timer timer(stats, StatsOp::Read);
+    std::shared_lock<std::shared_mutex> lock(file.getMutex()); // Readers of the same file run in parallel
+    size_t read = file.readAt(offset, buffer, length); // Copy only the requested range
+    timer.setBytes(read);
+    return read;
+}
+
+/**
+ * @brief Writes bytes from a caller-provided buffer at a given offset.
+ * @details Works directly on the file storage and does not move the current position.
+ * @param buffer The buffer holding the bytes to write.
+ * @param length The number of bytes to write.
+ * @param offset The position in the file to write at.
+ * @return The number of bytes written.
+ */
+size_t FileDescriptor::pwrite(const char* buffer, size_t length, size_t offset) {
+    OperationStats::Timer timer(stats, StatsOp::Write);
+    std::unique_lock<std::shared_mutex> lock(file.getMutex());
+    size_t written = file.writeAt(offset, buffer, length); // Copy only the written range
+    timer.setBytes(written);
+    return written;
+}
+
+/**
+ * @brief Reads from the current position into several buffers, filling each in turn.
+ * @param vectors The buffers to fill.
+ * @param count The number of buffers.
+ * @return The total number of bytes read; the position advances by this much.
+ */
+size_t FileDescriptor::readv(const IoVec* vectors, size_t count) {
+    size_t read = preadv(vectors, count, position);
+    position += read;
+    return read;
+}
+
+/**
+ * @brief Writes several buffers back to back at the current position.
+ * @param vectors The buffers to write.
+ * @param count The number of buffers.
+ * @return The total number of bytes written; the position advances by this much.
+ */
+size_t FileDescriptor::writev(const ConstIoVec* vectors, size_t count) {
+    size_t written = pwritev(vectors, count, position);
+    position += written;
+    return written;
+}
+
+/**
+ * @brief Reads from a given offset into several buffers, filling each in turn.
+ * @details Locks the file once for all the buffers and does not move the current position.
+ * @param vectors The buffers to fill.
+ * @param count The number of buffers.
+ * @param offset The position in the file to read from.
+ * @return The total number of bytes read.
+ */
+size_t FileDescriptor::preadv(const IoVec* vectors, size_t count, size_t offset) const {
+    OperationStats::Timer timer(stats, StatsOp::Read);
+    std::shared_lock<std::shared_mutex> lock(file.getMutex());
+    size_t read = file.readAtv(offset, vectors, count);
+    timer.setBytes(read);
+    return read;
+}
+
+/**
+ * @brief Writes several buffers back to back at a given offset.
+ * @details Locks the file once and grows it at most once, so a header, payload
+ * and trailer land together without being joined into one buffer first.
+ * Does not move the current position.
+ * @param vectors The buffers to write.
+ * @param count The number of buffers.
+ * @param offset The position in the file to write at.
+ * @return The total number of bytes written.
+ */
+size_t FileDescriptor::pwritev(const ConstIoVec* vectors, size_t count, size_t offset) {
+    OperationStats::Timer timer(stats, StatsOp::Write);
+    std::unique_lock<std::shared_mutex> lock(file.getMutex());
+    size_t written = file.writeAtv(offset, vectors, count);
+    timer.setBytes(written);
+    return written;
 }
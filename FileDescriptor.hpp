@@ -3,22 +3,30 @@
 
 #include <vector>
 #include "File.hpp"
+#include "OperationStats.hpp"
 
 /**
  * @class FileDescriptor
  * @brief A class that provides an interface to read from and write to a File object.
+ *
+ * Each call locks the file, so descriptors on the same file may be used from
+ * different threads. A single descriptor's position is not synchronized.
+ * Descriptors opened through FileSystem::openDescriptor() record their reads
+ * and writes in the filesystem's statistics.
  */
 class FileDescriptor {
 private:
     File& file; ///< Reference to the associated file.
     size_t position; ///< Current position within the file for reading/writing.
+    OperationStats* stats; ///< Where reads and writes are recorded, or nullptr.
 
 public:
     /**
      * @brief Constructor for the FileDescriptor class.
      * @param file The file to associate with this file descriptor.
+     * @param stats The counters to record reads and writes in, or nullptr to record nothing.
      */
-    FileDescriptor(File& file);
+    FileDescriptor(File& file, OperationStats* stats = nullptr);
 
     /**
      * @brief Sets the current position within the file.
@@ -38,6 +46,64 @@ public:
      * @param data The data to write to the file.
      */
     void write(const std::vector<char>& data);
+
+    /**
+     * @brief Reads bytes at a given offset into a caller-provided buffer.
+     * @details Works directly on the file storage and does not move the current position.
+     * @param buffer The buffer to read into.
+     * @param length The maximum number of bytes to read.
+     * @param offset The position in the file to read from.
+     * @return The number of bytes read.
+     */
+    size_t pread(char* buffer, size_t length, size_t offset) const;
+
+    /**
+     * @brief Writes bytes from a caller-provided buffer at a given offset.
+     * @details Works directly on the file storage and does not move the current position.
+     * @param buffer The buffer holding the bytes to write.
+     * @param length The number of bytes to write.
+     * @param offset The position in the file to write at.
+     * @return The number of bytes written.
+     */
+    size_t pwrite(const char* buffer, size_t length, size_t offset);
+
+    /**
+     * @brief Reads from the current position into several buffers, filling each in turn.
+     * @param vectors The buffers to fill.
+     * @param count The number of buffers.
+     * @return The total number of bytes read; the position advances by this much.
+     */
+    size_t readv(const IoVec* vectors, size_t count);
+
+    /**
+     * @brief Writes several buffers back to back at the current position.
+     * @param vectors The buffers to write.
+     * @param count The number of buffers.
+     * @return The total number of bytes written; the position advances by this much.
+     */
+    size_t writev(const ConstIoVec* vectors, size_t count);
+
+    /**
+     * @brief Reads from a given offset into several buffers, filling each in turn.
+     * @details Locks the file once for all the buffers and does not move the current position.
+     * @param vectors The buffers to fill.
+     * @param count The number of buffers.
+     * @param offset The position in the file to read from.
+     * @return The total number of bytes read.
+     */
+    size_t preadv(const IoVec* vectors, size_t count, size_t offset) const;
+
+    /**
+     * @brief Writes several buffers back to back at a given offset.
+     * @details Locks the file once and grows it at most once, so a header, payload
+     * and trailer land together without being joined into one buffer first.
+     * Does not move the current position.
+     * @param vectors The buffers to write.
+     * @param count The number of buffers.
+     * @param offset The position in the file to write at.
+     * @return The total number of bytes written.
+     */
+    size_t pwritev(const ConstIoVec* vectors, size_t count, size_t offset);
 };
 
 #endif 
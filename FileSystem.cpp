@@ -1,47 +1,98 @@
 #include "FileSystem.hpp"
+#include "BlockPool.hpp"
+#include "FileSystemImage.hpp"
+#include "PathTokenizer.hpp"
+#include <algorithm>
+#include <cstdio>
 #include <stdexcept>
-#include <sstream>
 
 /**
- * @brief Helper function to split a path into its components.
- * @param path The file path to split.
- * @return A vector of strings representing the parts of the path.
+ * @brief Helper function to walk a path from a starting directory.
+ * @details Components are read with a PathTokenizer, so the walk does not allocate.
+ * Absolute paths start from the root; ".." steps up, and stays put at the root.
+ * @param start The directory relative paths start from.
+ * @param path The path to walk.
+ * @return A pointer to the directory if found.
+ * @throws std::runtime_error if the directory is not found.
  */
-std::vector<std::string> FileSystem::splitPath(const std::string& path) const {
-    std::vector<std::string> parts;
-    std::stringstream ss(path);
-    std::string part;
-    while (std::getline(ss, part, '/')) { // Split the path by '/'
-        if (!part.empty()) { // Ignore empty parts (e.g., consecutive slashes)
-            parts.push_back(part);
+Directory* FileSystem::traverseToDirectory(Directory& start, std::string_view path) {
+    Directory* currentDir = isAbsolutePath(path) ? &rootDirectory : &start; // Start traversal from the root for absolute paths
+    PathTokenizer tokenizer(path);
+    std::string_view part;
+    while (tokenizer.next(part)) {
+        if (part == "..") {
+            if (currentDir->getParentDirectory()) {
+                currentDir = currentDir->getParentDirectory(); // Step up, but never past the root
+            }
+            continue;
         }
+        Directory* nextDir;
+        {
+            std::shared_lock<std::shared_mutex> lock(currentDir->getMutex()); // Readers of the same directory share it
+            nextDir = currentDir->findDirectory(part); // Look up the next part in the subdirectory index
+        }
+        if (!nextDir) {
+            throw std::runtime_error("Directory not found: " + std::string(part)); // Directory not found
+        }
+        currentDir = nextDir;
     }
-    return parts;
+    return currentDir; // Return the final directory reached
 }
 
 /**
- * @brief Helper function to traverse to a directory given a root directory and a vector of path parts.
- * @param root The root directory to start from.
- * @param pathParts The parts of the path to traverse.
- * @return A pointer to the directory if found.
+ * @brief Helper function to resolve a directory path, through the dentry cache when the path is absolute.
+ * @param start The directory relative paths start from.
+ * @param path The path to resolve.
+ * @return A pointer to the directory.
  * @throws std::runtime_error if the directory is not found.
  */
-Directory* FileSystem::traverseToDirectory(Directory& root, const std::vector<std::string>& pathParts) const {
-    Directory* currentDir = &root; // Start traversal from the root directory
-    for (const auto& part : pathParts) {
-        bool found = false;
-        for (auto& subDir : currentDir->getSubdirectories()) { // Search for the next part in subdirectories
-            if (subDir.getName() == part) {
-                currentDir = &subDir; // Move to the found subdirectory
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            throw std::runtime_error("Directory not found: " + part); // Directory not found
-        }
+Directory* FileSystem::resolveDirectory(Directory& start, std::string_view path) {
+    OperationStats::Timer timer(stats, StatsOp::Lookup);
+    if (!DentryCache::isCanonical(path)) {
+        return traverseToDirectory(start, path); // Relative or unusual paths take the long way
     }
-    return currentDir; // Return the final directory reached
+    if (Directory* cached = dentryCache.lookup(path)) {
+        return cached; // One probe instead of a walk
+    }
+    Directory* dir = traverseToDirectory(rootDirectory, path);
+    dentryCache.insert(path, dir);
+    return dir;
+}
+
+/**
+ * @brief Helper function to resolve the directory holding the last component of a path.
+ * @param start The directory relative paths start from.
+ * @param path The path of an entry.
+ * @param leaf Set to the entry's name, a view into path.
+ * @return A pointer to the directory that holds, or would hold, the entry.
+ * @throws std::runtime_error if the directory is not found or path names no entry.
+ */
+Directory* FileSystem::resolveParent(Directory& start, std::string_view path, std::string_view& leaf) {
+    std::string_view parentPath = splitParent(path, leaf);
+    if (parentPath.empty()) {
+        return &start; // A bare name lives in the starting directory
+    }
+    return resolveDirectory(start, parentPath);
+}
+
+/**
+ * @brief Helper function to split a path into the path of its parent directory and its last component.
+ * @param path The path of an entry.
+ * @param leaf Set to the entry's name, a view into path.
+ * @return The parent's path, a view into path; empty for a bare name.
+ * @throws std::runtime_error if path names no entry.
+ */
+std::string_view FileSystem::splitParent(std::string_view path, std::string_view& leaf) const {
+    size_t last = path.find_last_not_of('/'); // Ignore trailing slashes
+    size_t slash = last == std::string_view::npos ? std::string_view::npos : path.find_last_of('/', last);
+    leaf = last == std::string_view::npos ? std::string_view() : path.substr(slash + 1, last - slash); // npos + 1 wraps to 0
+    if (leaf.empty() || leaf == "." || leaf == "..") {
+        throw std::runtime_error("Invalid path: " + std::string(path));
+    }
+    if (slash == std::string_view::npos) {
+        return std::string_view();
+    }
+    return slash == 0 ? path.substr(0, 1) : path.substr(0, slash);
 }
 
 /**
@@ -49,76 +100,616 @@ Directory* FileSystem::traverseToDirectory(Directory& root, const std::vector<st
  * @param path The path to check.
  * @return true if the path is absolute, false otherwise.
  */
-bool FileSystem::isAbsolutePath(const std::string& path) const {
+bool FileSystem::isAbsolutePath(std::string_view path) const {
     return !path.empty() && path[0] == '/'; // Absolute path starts with '/'
 }
 
+/**
+ * @brief Helper function to build the absolute path of an entry in a directory.
+ * @param dir The directory holding the entry.
+ * @param name The name of the entry.
+ * @return The absolute path, e.g. "/home/user/file.txt".
+ */
+std::string FileSystem::absolutePath(const Directory* dir, std::string_view name) const {
+    std::string path = "/";
+    path += name;
+    for (; dir && dir != &rootDirectory; dir = dir->getParentDirectory()) {
+        path = "/" + dir->getName() + path; // Prepend each ancestor up to the root
+    }
+    return path;
+}
+
+/**
+ * @brief Helper function to append a mutation that has just been applied to the journal.
+ * @details Does nothing unless the filesystem is persistent. Call it while still
+ * holding the lock on the node changed, so the log order matches the apply order.
+ * @param op The mutation applied.
+ * @param dir The directory holding the entry.
+ * @param name The name of the entry.
+ * @param data The data written, for JournalOp::WriteFile.
+ * @return The LSN of the record, or 0 if nothing was logged.
+ */
+uint64_t FileSystem::logMutation(JournalOp op, const Directory* dir, std::string_view name, const std::vector<char>* data) {
+    if (!journal) {
+        return 0;
+    }
+    return data ? journal->append(op, absolutePath(dir, name), data->data(), data->size())
+                : journal->append(op, absolutePath(dir, name));
+}
+
+/**
+ * @brief Helper function to wait for a logged mutation to be durable.
+ * @details Call it after releasing the node locks so that concurrent commits share
+ * one fsync, but while still holding the namespace lock shared.
+ * @param lsn The LSN returned by logMutation().
+ */
+void FileSystem::commitMutation(uint64_t lsn) {
+    if (!journal || lsn == 0) {
+        return;
+    }
+    journal->commit(lsn); // Batched with any other writers committing at the same time
+    if (journal->size() >= checkpointBytes) {
+        std::lock_guard<std::mutex> wake(checkpointMutex);
+        checkpointRequested = true;
+        checkpointWake.notify_one(); // Let the background thread fold the journal into the image
+    }
+}
+
+/**
+ * @brief Helper function to determine if any session's current directory is a directory or lies below it.
+ * @details Call it with the namespace lock held exclusively.
+ * @param dir The directory to check.
+ * @return true if a session is working inside dir.
+ */
+bool FileSystem::isInUse(const Directory* dir) {
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    for (Session* session : sessions) {
+        for (const Directory* d = session->currentDirectory; d; d = d->getParentDirectory()) {
+            if (d == dir) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Helper function to move every session back to the root directory.
+ * @details Call it with the namespace lock held exclusively.
+ */
+void FileSystem::resetSessions() {
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    for (Session* session : sessions) {
+        session->currentDirectory = &rootDirectory;
+    }
+}
+
+/**
+ * @brief Helper function to rebuild the name index, if enabled, after the tree has been replaced.
+ * @details Call it with the namespace lock held exclusively.
+ */
+void FileSystem::reindexNames() {
+    if (nameIndex) {
+        nameIndex->clear(); // Forget the nodes of the old tree
+        rootDirectory.setNameIndex(nameIndex.get());
+    }
+}
+
+/**
+ * @brief Helper function to resolve the directory holding the last component of a journaled path, bypassing the dentry cache.
+ * @details Replay deletes and moves directories without telling the cache, so it must not use it.
+ * @param path The absolute path of an entry.
+ * @param leaf Set to the entry's name, a view into path.
+ * @return A pointer to the directory that holds, or would hold, the entry.
+ * @throws std::runtime_error if the directory is not found or path names no entry.
+ */
+Directory* FileSystem::resolveRecordParent(std::string_view path, std::string_view& leaf) {
+    return traverseToDirectory(rootDirectory, splitParent(path, leaf)); // An empty parent path is the root
+}
+
+/**
+ * @brief Helper function to re-apply a journal record to the tree.
+ * @param record The record to apply.
+ */
+void FileSystem::applyRecord(const JournalRecord& record) {
+    std::string_view leaf;
+    Directory* parent;
+    try {
+        parent = resolveRecordParent(record.path, leaf);
+    } catch (const std::runtime_error&) {
+        return; // The parent never made it to disk, so neither did this change
+    }
+    std::string name(leaf);
+    switch (record.op) {
+        case JournalOp::CreateFile:
+            parent->createFile(name);
+            break;
+        case JournalOp::DeleteFile:
+            parent->removeFile(name);
+            break;
+        case JournalOp::WriteFile:
+            if (File* file = parent->findFile(name)) {
+                file->write(record.data);
+            }
+            break;
+        case JournalOp::CreateDirectory:
+            parent->createDirectory(name);
+            break;
+        case JournalOp::DeleteDirectory:
+            parent->removeDirectory(name);
+            break;
+        case JournalOp::CloneFile:
+        case JournalOp::CloneDirectory:
+        case JournalOp::RenameFile:
+        case JournalOp::RenameDirectory: {
+            std::string_view sourceLeaf;
+            std::string sourcePath(record.data.begin(), record.data.end());
+            Directory* sourceParent;
+            try {
+                sourceParent = resolveRecordParent(sourcePath, sourceLeaf);
+            } catch (const std::runtime_error&) {
+                return;
+            }
+            if (record.op == JournalOp::CloneFile) {
+                if (File* file = sourceParent->findFile(sourceLeaf)) {
+                    parent->cloneFile(*file, name);
+                }
+            } else if (record.op == JournalOp::CloneDirectory) {
+                if (Directory* dir = sourceParent->findDirectory(sourceLeaf)) {
+                    parent->cloneDirectory(*dir, name);
+                }
+            } else if (record.op == JournalOp::RenameFile) {
+                sourceParent->moveFile(sourceLeaf, *parent, name);
+            } else {
+                sourceParent->moveDirectory(sourceLeaf, *parent, name);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Helper function that runs the background checkpoint thread.
+ */
+void FileSystem::runCheckpointer() {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    while (true) {
+        checkpointWake.wait(lock, [this] { return stopCheckpointer || checkpointRequested; });
+        if (stopCheckpointer) {
+            return;
+        }
+        checkpointRequested = false;
+        lock.unlock();
+        try {
+            checkpoint();
+        } catch (const std::runtime_error&) {
+            // The rotated log is kept until an image covers it; the next request retries
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Helper function to deduplicate the files of a directory and, recursively, its subdirectories.
+ * @param dir The directory.
+ * @return The number of blocks merged.
+ */
+size_t FileSystem::deduplicateDirectory(Directory& dir) {
+    size_t merged = 0;
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex()); // Keeps the files from being deleted under us
+        for (File* file : dir.getFiles()) {
+            std::unique_lock<std::shared_mutex> fileLock(file->getMutex());
+            merged += blockStore.deduplicate(*file);
+        }
+        subdirectories = dir.getSubdirectories();
+    }
+    for (Directory* subdir : subdirectories) { // Safe unlocked: directories go only under the exclusive namespace lock
+        merged += deduplicateDirectory(*subdir);
+    }
+    return merged;
+}
+
+/**
+ * @brief Helper function that runs the background deduplication thread.
+ */
+void FileSystem::runDeduplicator() {
+    std::unique_lock<std::mutex> lock(deduplicatorMutex);
+    while (true) {
+        deduplicatorWake.wait_for(lock, deduplicationInterval, [this] { return stopDeduplicator; });
+        if (stopDeduplicator) {
+            return;
+        }
+        lock.unlock();
+        deduplicate();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Helper function to compress the cold files of a directory and, recursively, its subdirectories.
+ * @param dir The directory.
+ * @param cutoff Files last accessed before this are compressed.
+ * @return The number of files compressed.
+ */
+size_t FileSystem::compressDirectory(Directory& dir, std::chrono::steady_clock::time_point cutoff) {
+    size_t packed = 0;
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex()); // Keeps the files from being deleted under us
+        for (File* file : dir.getFiles()) {
+            if (file->lastAccessed() >= cutoff) {
+                continue; // The access time is atomic, so warm files are passed over without locking
+            }
+            std::unique_lock<std::shared_mutex> fileLock(file->getMutex(), std::try_to_lock);
+            if (fileLock.owns_lock() && file->lastAccessed() < cutoff && file->compress()) { // A busy file is not cold
+                ++packed;
+            }
+        }
+        subdirectories = dir.getSubdirectories();
+    }
+    for (Directory* subdir : subdirectories) { // Safe unlocked: directories go only under the exclusive namespace lock
+        packed += compressDirectory(*subdir, cutoff);
+    }
+    return packed;
+}
+
+/**
+ * @brief Helper function that runs the background compression thread.
+ */
+void FileSystem::runCompressor() {
+    std::unique_lock<std::mutex> lock(compressorMutex);
+    while (true) {
+        compressorWake.wait_for(lock, compressionInterval, [this] { return stopCompressor; });
+        if (stopCompressor) {
+            return;
+        }
+        lock.unlock();
+        compressColdFiles(compressionIdle);
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Helper function to gather the last access time and resident block count of every file in memory.
+ * @param dir The directory to start from; its subdirectories are visited too.
+ * @param files Receives one entry per file holding pool blocks.
+ */
+void FileSystem::collectResidentFiles(Directory& dir, std::vector<std::pair<std::chrono::steady_clock::time_point, size_t>>& files) {
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex());
+        for (File* file : dir.getFiles()) {
+            std::shared_lock<std::shared_mutex> fileLock(file->getMutex());
+            if (size_t blocks = file->residentBlocks()) {
+                files.emplace_back(file->lastAccessed(), blocks);
+            }
+        }
+        subdirectories = dir.getSubdirectories();
+    }
+    for (Directory* subdir : subdirectories) { // Safe unlocked: directories go only under the exclusive namespace lock
+        collectResidentFiles(*subdir, files);
+    }
+}
+
+/**
+ * @brief Helper function to spill the least recently used files of a directory and, recursively, its subdirectories.
+ * @param dir The directory.
+ * @param cutoff Files last accessed at or before this are spilled.
+ * @param to The spill file.
+ * @param excess Blocks still to evict; reduced by each file spilled, and the walk stops at 0.
+ * @return The number of files spilled.
+ */
+size_t FileSystem::spillDirectory(Directory& dir, std::chrono::steady_clock::time_point cutoff, const std::shared_ptr<SpillFile>& to,
+                                  size_t& excess) {
+    size_t spilled = 0;
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex()); // Keeps the files from being deleted under us
+        for (File* file : dir.getFiles()) {
+            if (excess == 0) {
+                return spilled;
+            }
+            if (file->lastAccessed() > cutoff) {
+                continue; // Recently used; checked without locking
+            }
+            std::unique_lock<std::shared_mutex> fileLock(file->getMutex(), std::try_to_lock);
+            if (!fileLock.owns_lock() || file->lastAccessed() > cutoff) {
+                continue; // A busy file is not cold
+            }
+            size_t blocks = file->residentBlocks();
+            if (file->spill(to)) {
+                excess -= std::min(excess, blocks);
+                ++spilled;
+            }
+        }
+        subdirectories = dir.getSubdirectories();
+    }
+    for (Directory* subdir : subdirectories) { // Safe unlocked: directories go only under the exclusive namespace lock
+        spilled += spillDirectory(*subdir, cutoff, to, excess);
+    }
+    return spilled;
+}
+
+/**
+ * @brief Helper function to fault recently read spilled files of a directory and, recursively, its subdirectories back into memory.
+ * @param dir The directory.
+ * @param since Files accessed after this are restored.
+ * @param headroom Blocks that fit under the budget; reduced by each file restored.
+ * @return The number of files restored.
+ */
+size_t FileSystem::restoreDirectory(Directory& dir, std::chrono::steady_clock::time_point since, size_t& headroom) {
+    size_t restored = 0;
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex());
+        for (File* file : dir.getFiles()) {
+            if (file->lastAccessed() <= since) {
+                continue; // Not touched since the last pass
+            }
+            std::unique_lock<std::shared_mutex> fileLock(file->getMutex(), std::try_to_lock);
+            if (!fileLock.owns_lock() || !file->isSpilled() || file->blockCount() > headroom) {
+                continue;
+            }
+            headroom -= file->blockCount();
+            file->restore();
+            ++restored;
+        }
+        subdirectories = dir.getSubdirectories();
+    }
+    for (Directory* subdir : subdirectories) { // Safe unlocked: directories go only under the exclusive namespace lock
+        restored += restoreDirectory(*subdir, since, headroom);
+    }
+    return restored;
+}
+
+/**
+ * @brief Helper function that runs the background spill thread.
+ */
+void FileSystem::runSpiller() {
+    std::unique_lock<std::mutex> lock(spillerMutex);
+    while (true) {
+        spillerWake.wait_for(lock, spillInterval, [this] { return stopSpiller; });
+        if (stopSpiller) {
+            return;
+        }
+        lock.unlock();
+        try {
+            enforceMemoryBudget();
+        } catch (const std::exception&) {
+            // The disk is full or failing; files stay in memory and the next pass tries again
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Helper function to get the pool recursive tree operations run on.
+ * @return The pool set with setWorkPool(), or the process-wide pool.
+ */
+WorkStealingPool& FileSystem::treePool() {
+    return workPool ? *workPool : WorkStealingPool::instance(); // The shared pool starts its threads on first use
+}
+
 /**
  * @brief Constructor for the FileSystem class.
  */
-FileSystem::FileSystem() : rootDirectory("root") {
-    currentDirectory = &rootDirectory; // Set the initial current directory to the root
+FileSystem::FileSystem()
+    : residentBlocks(0), rootDirectory("root"), defaultSession(*this), checkpointBytes(0), checkpointRequested(false), stopCheckpointer(false),
+      deduplicationInterval(1000), stopDeduplicator(false), compressionIdle(30000), compressionInterval(1000),
+      stopCompressor(false), memoryBudget(0), spillInterval(100), stopSpiller(false), workPool(nullptr) {
+    rootDirectory.setSnapshotRegistry(&snapshots); // Inherited by every directory created under the root
+    rootDirectory.setBlockCounter(&residentBlocks);
+}
+
+/**
+ * @brief Destructor for the FileSystem class; closes the journal if persistent.
+ */
+FileSystem::~FileSystem() {
+    setDeduplication(false);
+    setCompression(false);
+    setMemoryBudget(0);
+    closePersistent();
 }
 
 /**
- * @brief Creates a file in the current directory.
- * @param filename The name of the file to create.
+ * @brief Creates a file.
+ * @param filename The path of the file to create, absolute or relative to the current directory.
  */
 void FileSystem::createFile(const std::string& filename) {
-    currentDirectory->addFile(File(filename)); // Add a new file to the current directory
+    defaultSession.createFile(filename);
 }
 
 /**
- * @brief Deletes a file from the current directory.
- * @param filename The name of the file to delete.
+ * @brief Deletes a file.
+ * @param filename The path of the file to delete, absolute or relative to the current directory.
  */
 void FileSystem::deleteFile(const std::string& filename) {
-    currentDirectory->removeFile(filename); // Remove the file from the current directory
+    defaultSession.deleteFile(filename);
 }
 
 /**
- * @brief Reads data from a file in the current directory.
- * @param filename The name of the file to read.
+ * @brief Reads data from a file.
+ * @param filename The path of the file to read, absolute or relative to the current directory.
  * @return A vector of characters containing the file data.
  * @throws std::runtime_error if the file is not found.
  */
 std::vector<char> FileSystem::readFile(const std::string& filename) {
-    File* file = currentDirectory->findFile(filename); // Find the file in the current directory
-    if (file) {
-        return file->read(); // Return the file data
-    }
-    throw std::runtime_error("File not found: " + filename); // File not found
+    return defaultSession.readFile(filename);
 }
 
 /**
- * @brief Writes data to a file in the current directory.
- * @param filename The name of the file to write to.
+ * @brief Writes data to a file.
+ * @param filename The path of the file to write to, absolute or relative to the current directory.
  * @param data The data to write to the file.
  * @throws std::runtime_error if the file is not found.
  */
 void FileSystem::writeFile(const std::string& filename, const std::vector<char>& data) {
-    File* file = currentDirectory->findFile(filename); // Find the file in the current directory
-    if (file) {
-        file->write(data); // Write the data to the file
-        return;
-    }
-    throw std::runtime_error("File not found: " + filename); // File not found
+    defaultSession.writeFile(filename, data);
 }
 
 /**
- * @brief Creates a directory in the current directory.
- * @param dirname The name of the directory to create.
+ * @brief Creates a directory.
+ * @param dirname The path of the directory to create, absolute or relative to the current directory.
  */
 void FileSystem::createDirectory(const std::string& dirname) {
-    currentDirectory->addDirectory(Directory(dirname, currentDirectory)); // Add a new directory with the current directory as its parent
+    defaultSession.createDirectory(dirname);
 }
 
 /**
- * @brief Deletes a directory from the current directory.
- * @param dirname The name of the directory to delete.
+ * @brief Deletes a directory.
+ * @param dirname The path of the directory to delete, absolute or relative to the current directory.
+ * @throws std::runtime_error if another session's current directory is inside it.
  */
 void FileSystem::deleteDirectory(const std::string& dirname) {
-    currentDirectory->removeDirectory(dirname); // Remove the directory from the current directory
+    defaultSession.deleteDirectory(dirname);
+}
+
+/**
+ * @brief Copies a file; the copy shares its blocks until either file is written.
+ * @param source The path of the file to copy.
+ * @param destination The path of the copy.
+ * @throws std::runtime_error if the source is not found or the destination already exists.
+ */
+void FileSystem::cloneFile(const std::string& source, const std::string& destination) {
+    defaultSession.cloneFile(source, destination);
+}
+
+/**
+ * @brief Copies a directory tree; files in the copy share their blocks until written.
+ * @param source The path of the directory to copy.
+ * @param destination The path of the copy.
+ * @throws std::runtime_error if the source is not found, the destination already
+ * exists, or the destination lies inside the source.
+ */
+void FileSystem::cloneDirectory(const std::string& source, const std::string& destination) {
+    defaultSession.cloneDirectory(source, destination);
+}
+
+/**
+ * @brief Renames or moves a file or directory in place; nothing is copied.
+ * @param source The path of the file or directory to move.
+ * @param destination Its new path.
+ * @throws std::runtime_error if the source is not found, the destination already
+ * exists, or a directory would be moved inside itself.
+ */
+void FileSystem::rename(const std::string& source, const std::string& destination) {
+    defaultSession.rename(source, destination);
+}
+
+/**
+ * @brief Visits every file and directory below a directory, subtrees in parallel.
+ * @details The visitor is called concurrently from the pool's threads, in no particular order.
+ * @param dirname The path of the directory to walk, absolute or relative to the current directory.
+ * @param visit Called with each entry's absolute path, and the file or nullptr for a directory.
+ * @throws std::runtime_error if the directory is not found, or whatever the visitor throws.
+ */
+void FileSystem::walk(const std::string& dirname, const TreeVisitor& visit) {
+    defaultSession.walk(dirname, visit);
+}
+
+/**
+ * @brief Totals the files, directories and bytes below a directory, subtrees in parallel.
+ * @param dirname The path of the directory, absolute or relative to the current directory.
+ * @return The totals.
+ * @throws std::runtime_error if the directory is not found.
+ */
+TreeUsage FileSystem::diskUsage(const std::string& dirname) {
+    return defaultSession.diskUsage(dirname);
+}
+
+/**
+ * @brief Gets the bytes, files and directories below a directory in O(1), from its running totals.
+ * @details Each directory keeps the totals of its subtree as it changes, so
+ * quota checks need no walk. Use diskUsage() for allocated bytes.
+ * @param dirname The path of the directory, absolute or relative to the current directory.
+ * @return The totals.
+ * @throws std::runtime_error if the directory is not found.
+ */
+SubtreeUsage FileSystem::usage(const std::string& dirname) {
+    return defaultSession.usage(dirname);
+}
+
+/**
+ * @brief Runs recursive tree operations (walk, diskUsage, cloneDirectory and
+ * deleteDirectory) on a given pool instead of the process-wide one.
+ * @details Call before sharing the filesystem between threads.
+ * @param pool The pool; must outlive the filesystem.
+ */
+void FileSystem::setWorkPool(WorkStealingPool& pool) {
+    workPool = &pool;
+}
+
+/**
+ * @brief Enables or disables the name index behind glob() and search().
+ * @details Enabling indexes every file and directory in the tree, loading
+ * anything still in an image; the directories keep it up to date from then
+ * on. Without the index, queries walk the tree instead.
+ * @param enabled true to build and keep the index, false to drop it.
+ */
+void FileSystem::setNameIndex(bool enabled) {
+    std::unique_lock<ShardedSharedMutex> lock(namespaceLock);
+    if (enabled == (nameIndex != nullptr)) {
+        return;
+    }
+    if (enabled) {
+        nameIndex.reset(new NameIndex());
+        rootDirectory.setNameIndex(nameIndex.get());
+    } else {
+        rootDirectory.setNameIndex(nullptr);
+        nameIndex.reset();
+    }
+}
+
+/**
+ * @brief Finds every file and directory in the tree whose name matches a glob pattern.
+ * @details '*' matches any run of characters and '?' any one character. With
+ * the name index enabled, the cost follows the number of candidate names.
+ * @param pattern The pattern, matched against whole names.
+ * @return The matches, sorted by path.
+ */
+std::vector<NameMatch> FileSystem::glob(const std::string& pattern) {
+    return defaultSession.glob(pattern);
+}
+
+/**
+ * @brief Finds every file and directory in the tree whose name contains some text.
+ * @details With the name index enabled, the cost follows the number of candidate names.
+ * @param text The text.
+ * @return The matches, sorted by path.
+ */
+std::vector<NameMatch> FileSystem::search(const std::string& text) {
+    return defaultSession.search(text);
+}
+
+/**
+ * @brief Applies a batch of namespace mutations.
+ * @param ops The operations, applied in order.
+ * @return The outcome of each operation, in the same order.
+ */
+std::vector<BatchResult> FileSystem::applyBatch(const std::vector<BatchOp>& ops) {
+    return defaultSession.applyBatch(ops);
+}
+
+/**
+ * @brief Lists the contents of the current directory.
+ * @return The names of the files and subdirectories in the current directory.
+ */
+std::vector<std::string> FileSystem::listContents() {
+    return defaultSession.listContents();
+}
+
+/**
+ * @brief Lists one page of the current directory in name order.
+ * @details Only the names on the page are copied, so paging through a huge
+ * directory does not allocate a string per entry up front.
+ * @param after Where the previous page left off; default-constructed for the first page.
+ * @param limit The most entries to return.
+ * @return The page, and the cursor for the next one.
+ */
+ListPage FileSystem::listPage(const ListCursor& after, size_t limit) {
+    return defaultSession.listPage(after, limit);
 }
 
 /**
@@ -134,7 +725,7 @@ Directory& FileSystem::getRootDirectory() {
  * @return A pointer to the current working directory.
  */
 Directory* FileSystem::getCurrentDirectory() {
-    return currentDirectory;
+    return defaultSession.getCurrentDirectory();
 }
 
 /**
@@ -143,13 +734,383 @@ Directory* FileSystem::getCurrentDirectory() {
  * @throws std::runtime_error if the directory is not found.
  */
 void FileSystem::changeDirectory(const std::string& path) {
-    if (path == "..") { // Handle changing to parent directory
-        if (currentDirectory->getParentDirectory()) {
-            currentDirectory = currentDirectory->getParentDirectory(); // Move to the parent directory
+    defaultSession.changeDirectory(path);
+}
+
+/**
+ * @brief Saves the whole tree to a binary image file.
+ * @param path The path of the image file to write.
+ * @throws std::runtime_error if the image cannot be written.
+ */
+void FileSystem::save(const std::string& path) const {
+    std::unique_lock<ShardedSharedMutex> lock(namespaceLock); // Nothing may change while the tree is written
+    FileSystemImage::save(rootDirectory, path, journal ? journal->lastLsn() : 0); // Write the tree from the root down
+}
+
+/**
+ * @brief Replaces the tree with the contents of an image file.
+ * @details The image is memory-mapped; directories are read from it as they are
+ * first accessed and file contents are served from the mapping until written.
+ * The current directory of every session is reset to the root.
+ * @param path The path of the image file to load.
+ * @throws std::runtime_error if the image cannot be mapped or is invalid, or
+ * if the filesystem is persistent.
+ */
+void FileSystem::load(const std::string& path) {
+    std::unique_lock<ShardedSharedMutex> lock(namespaceLock);
+    if (journal) {
+        throw std::runtime_error("Cannot load an image into a persistent filesystem");
+    }
+    if (snapshots.isActive()) {
+        throw std::runtime_error("Cannot replace the tree while a snapshot is open");
+    }
+    std::shared_ptr<FileSystemImage> image = FileSystemImage::open(path); // Map and validate before touching the tree
+    image->attachRoot(rootDirectory);
+    reindexNames();
+    dentryCache.clear();
+    resetSessions(); // The old tree is gone, start again from the root
+}
+
+/**
+ * @brief Makes the filesystem durable, backed by an image and a write-ahead journal.
+ * @details Loads the image if it exists and replays the journal at path + ".journal"
+ * on top of it, recovering every mutation committed before a crash. The recovered
+ * tree is written back as the new base image, the journal is restarted, and a
+ * background thread checkpoints whenever the journal grows past checkpointBytes.
+ * @param path The path of the base image.
+ * @param checkpointBytes Journal size that triggers a checkpoint. Defaults to 16 MB.
+ * @throws std::runtime_error if the image or journal cannot be read or written.
+ */
+void FileSystem::openPersistent(const std::string& path, uint64_t checkpointBytes) {
+    closePersistent();
+    std::unique_lock<ShardedSharedMutex> lock(namespaceLock);
+    if (snapshots.isActive()) {
+        throw std::runtime_error("Cannot replace the tree while a snapshot is open");
+    }
+    uint64_t imageLsn = 0;
+    std::FILE* probe = std::fopen(path.c_str(), "rb");
+    bool imageExists = probe != nullptr;
+    if (probe) {
+        std::fclose(probe);
+        std::shared_ptr<FileSystemImage> image = FileSystemImage::open(path);
+        image->attachRoot(rootDirectory);
+        imageLsn = image->checkpointLsn();
+        reindexNames();
+    }
+    dentryCache.clear();
+    resetSessions();
+
+    std::string journalPath = path + ".journal";
+    uint64_t lastLsn = Journal::replay(journalPath, imageLsn, [this](const JournalRecord& record) {
+        applyRecord(record); // Redo everything committed since the image was written
+    });
+    if (!imageExists || lastLsn > imageLsn) {
+        FileSystemImage::save(rootDirectory, path, lastLsn); // Fold the recovered state into a fresh base image
+    }
+    journal.reset(new Journal(journalPath, lastLsn)); // Safe to discard the old journal now
+
+    imagePath = path;
+    this->checkpointBytes = checkpointBytes;
+    checkpointRequested = false;
+    stopCheckpointer = false;
+    checkpointer = std::thread(&FileSystem::runCheckpointer, this);
+}
+
+/**
+ * @brief Folds the journal into the base image.
+ * @details Operations on the tree wait only while the journal is rotated; the
+ * image is then written from a snapshot while they carry on.
+ * @throws std::runtime_error if the filesystem is not persistent or the image cannot be written.
+ */
+void FileSystem::checkpoint() {
+    std::lock_guard<std::mutex> saving(checkpointSaveMutex); // Checkpoints share the temporary image file
+    std::shared_lock<ShardedSharedMutex> lock(namespaceLock, std::defer_lock); // Taken after the exclusive part, and released after the view
+    std::shared_ptr<Snapshot> view;
+    uint64_t lsn;
+    std::string path;
+    {
+        std::unique_lock<ShardedSharedMutex> exclusive(namespaceLock); // No namespace operation is half applied
+        if (!journal) {
+            throw std::runtime_error("Filesystem is not persistent");
         }
-    } else {
-        auto pathParts = splitPath(path); // Split the path into parts
-        Directory* newCurrentDirectory = isAbsolutePath(path) ? traverseToDirectory(rootDirectory, pathParts) : traverseToDirectory(*currentDirectory, pathParts); // Traverse to the target directory
-        currentDirectory = newCurrentDirectory; // Set the new current directory
+        lsn = journal->lastLsn(); // Everything up to here is in the tree
+        journal->rotate(); // Later records go to a fresh log
+        view = snapshots.take(rootDirectory); // The tree as of lsn, kept while writers carry on
+        path = imagePath;
+    }
+    lock.lock(); // Keeps the journal in place; the tree cannot be replaced while the view is open
+    FileSystemImage::save(*view, path, lsn);
+    if (journal) { // Unless closed meanwhile, in which case reopening discards the rotated log
+        journal->removeRotated(); // The image now covers the rotated log
     }
 }
+
+/**
+ * @brief Stops journaling; everything committed so far stays durable.
+ */
+void FileSystem::closePersistent() {
+    if (checkpointer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(checkpointMutex);
+            stopCheckpointer = true;
+        }
+        checkpointWake.notify_one();
+        checkpointer.join();
+    }
+    std::unique_lock<ShardedSharedMutex> lock(namespaceLock); // Wait for in-flight commits
+    journal.reset(); // Flushes anything still pending
+}
+
+/**
+ * @brief Determines if the filesystem is journaling its mutations.
+ * @return true after openPersistent() and until closePersistent().
+ */
+bool FileSystem::isPersistent() const {
+    std::shared_lock<ShardedSharedMutex> lock(namespaceLock);
+    return journal != nullptr;
+}
+
+/**
+ * @brief Gets the dentry cache's hit and miss counters.
+ * @return A snapshot of the counters and the number of cached paths.
+ */
+DentryCache::Stats FileSystem::getDentryCacheStats() {
+    return dentryCache.stats();
+}
+
+/**
+ * @brief Merges identical blocks across every file in the tree.
+ * @details Runs alongside other operations, locking one file at a time. Blocks
+ * are stored in the filesystem's BlockStore by content hash; a file's block that
+ * matches a stored one is replaced by a shared reference to it.
+ * @return The number of blocks merged by this pass.
+ */
+size_t FileSystem::deduplicate() {
+    size_t merged;
+    {
+        std::shared_lock<ShardedSharedMutex> lock(namespaceLock);
+        merged = deduplicateDirectory(rootDirectory);
+    }
+    blockStore.sweep(); // Let go of blocks whose files were deleted or rewritten since
+    return merged;
+}
+
+/**
+ * @brief Turns background deduplication on or off; it starts off.
+ * @details While on, a background thread runs deduplicate() every interval, so
+ * writes never wait for hashing.
+ * @param enabled true to run the background thread.
+ * @param interval The time between passes.
+ */
+void FileSystem::setDeduplication(bool enabled, std::chrono::milliseconds interval) {
+    if (deduplicator.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(deduplicatorMutex);
+            stopDeduplicator = true;
+        }
+        deduplicatorWake.notify_one();
+        deduplicator.join();
+    }
+    if (enabled) {
+        deduplicationInterval = interval;
+        stopDeduplicator = false;
+        deduplicator = std::thread(&FileSystem::runDeduplicator, this);
+    }
+}
+
+/**
+ * @brief Gets the deduplication counters: blocks scanned, duplicates merged and bytes saved.
+ * @return A snapshot of the counters.
+ */
+BlockStore::Stats FileSystem::getDeduplicationStats() const {
+    return blockStore.stats();
+}
+
+/**
+ * @brief Compresses every file not read or written for a while.
+ * @details Runs alongside other operations, locking one file at a time. Reads of a
+ * compressed file decompress the blocks they cover; its first write unpacks it.
+ * @param idle How long a file must have gone unaccessed.
+ * @return The number of files compressed by this pass.
+ */
+size_t FileSystem::compressColdFiles(std::chrono::milliseconds idle) {
+    std::shared_lock<ShardedSharedMutex> lock(namespaceLock);
+    return compressDirectory(rootDirectory, std::chrono::steady_clock::now() - idle);
+}
+
+/**
+ * @brief Turns background compression of cold files on or off; it starts off.
+ * @details While on, a background thread runs compressColdFiles(idle) every interval.
+ * @param enabled true to run the background thread.
+ * @param idle How long a file must go unaccessed before it is compressed.
+ * @param interval The time between passes.
+ */
+void FileSystem::setCompression(bool enabled, std::chrono::milliseconds idle, std::chrono::milliseconds interval) {
+    if (compressor.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(compressorMutex);
+            stopCompressor = true;
+        }
+        compressorWake.notify_one();
+        compressor.join();
+    }
+    if (enabled) {
+        compressionIdle = idle;
+        compressionInterval = interval;
+        stopCompressor = false;
+        compressor = std::thread(&FileSystem::runCompressor, this);
+    }
+}
+
+/**
+ * @brief Gets the compression counters: ratio of the data held compressed, and decompression time.
+ * @details The counters cover every filesystem in the process.
+ * @return A snapshot of the counters.
+ */
+CompressedBlocks::Stats FileSystem::getCompressionStats() const {
+    return CompressedBlocks::stats();
+}
+
+/**
+ * @brief Caps the memory held by file contents, evicting cold files to disk; off by default.
+ * @details While a budget is set, a background thread runs enforceMemoryBudget() every
+ * interval, so callers never wait for eviction or write-back. The budget covers the
+ * pool blocks held by this tree's files; a block shared by two files counts for each.
+ * Files stay in the tree, with their names and sizes, whether their contents are in
+ * memory or not.
+ * @param bytes The bytes of file blocks to keep in memory, or 0 to lift the budget.
+ * @param spillPath The local file to evict to; created, and removed once nothing is spilled to it.
+ * @param interval The time between passes.
+ * @throws std::runtime_error if the spill file cannot be created.
+ */
+void FileSystem::setMemoryBudget(size_t bytes, const std::string& spillPath, std::chrono::milliseconds interval) {
+    if (spiller.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(spillerMutex);
+            stopSpiller = true;
+        }
+        spillerWake.notify_one();
+        spiller.join();
+    }
+    std::shared_ptr<SpillFile> to = bytes ? std::make_shared<SpillFile>(spillPath) : nullptr;
+    std::lock_guard<std::mutex> lock(spillerMutex);
+    spillFile = std::move(to); // Files already spilled keep the old file alive until they are restored
+    memoryBudget = bytes;
+    spillInterval = interval;
+    lastBudgetPass = std::chrono::steady_clock::now();
+    if (bytes) {
+        stopSpiller = false;
+        spiller = std::thread(&FileSystem::runSpiller, this);
+    }
+}
+
+/**
+ * @brief Runs one eviction pass against the memory budget.
+ * @details Over budget, the least recently used files are spilled until the excess
+ * is covered. Under budget, spilled files read since the previous pass are faulted
+ * back in while they fit. Runs alongside other operations, locking one file at a time.
+ * @return The number of files spilled by this pass.
+ */
+size_t FileSystem::enforceMemoryBudget() {
+    std::shared_ptr<SpillFile> to;
+    size_t budgetBlocks;
+    std::chrono::steady_clock::time_point since;
+    {
+        std::lock_guard<std::mutex> lock(spillerMutex);
+        if (!spillFile) {
+            return 0;
+        }
+        to = spillFile;
+        budgetBlocks = memoryBudget / BlockPool::BLOCK_SIZE;
+        since = lastBudgetPass;
+        lastBudgetPass = std::chrono::steady_clock::now();
+    }
+
+    std::shared_lock<ShardedSharedMutex> lock(namespaceLock);
+    size_t inUse = residentBlocks.load(std::memory_order_relaxed); // Other trees and open snapshots do not count
+    if (inUse <= budgetBlocks) {
+        size_t headroom = budgetBlocks - inUse;
+        restoreDirectory(rootDirectory, since, headroom);
+        return 0;
+    }
+
+    std::vector<std::pair<std::chrono::steady_clock::time_point, size_t>> resident;
+    collectResidentFiles(rootDirectory, resident);
+    if (resident.empty()) {
+        return 0;
+    }
+    std::sort(resident.begin(), resident.end()); // Least recently used first
+    size_t excess = inUse - budgetBlocks;
+    size_t covered = 0;
+    std::chrono::steady_clock::time_point cutoff = resident.front().first;
+    for (const auto& file : resident) { // Find the access time that evicts just enough
+        cutoff = file.first;
+        covered += file.second;
+        if (covered >= excess) {
+            break;
+        }
+    }
+    return spillDirectory(rootDirectory, cutoff, to, excess);
+}
+
+/**
+ * @brief Gets the spill file's counters: blocks on disk, written and read back.
+ * @return A snapshot of the counters; all zero while no budget is set.
+ */
+SpillFile::Stats FileSystem::getSpillStats() const {
+    std::lock_guard<std::mutex> lock(spillerMutex);
+    return spillFile ? spillFile->stats() : SpillFile::Stats{0, 0, 0, 0};
+}
+
+/**
+ * @brief Zeroes the dentry cache's hit and miss counters.
+ */
+void FileSystem::resetDentryCacheStats() {
+    dentryCache.resetStats();
+}
+
+/**
+ * @brief Turns per-operation statistics on or off; they start off.
+ * @param enabled true to record call counts, bytes and latencies.
+ */
+void FileSystem::setStatsEnabled(bool enabled) {
+    stats.setEnabled(enabled);
+}
+
+/**
+ * @brief Gets the per-operation statistics recorded so far, merged across threads.
+ * @return A snapshot of the counters and latency histograms.
+ */
+OperationStats::Snapshot FileSystem::getStats() const {
+    return stats.snapshot();
+}
+
+/**
+ * @brief Zeroes the per-operation statistics.
+ */
+void FileSystem::resetStats() {
+    stats.reset();
+}
+
+/**
+ * @brief Opens a descriptor on a file whose reads and writes count in getStats().
+ * @param file A file in this filesystem's tree.
+ * @return A descriptor positioned at the start of the file.
+ */
+FileDescriptor FileSystem::openDescriptor(File& file) {
+    return FileDescriptor(file, &stats);
+}
+
+/**
+ * @brief Takes a read-only, point-in-time view of the whole tree.
+ * @details Takes O(1) time: nodes are copied into the snapshot only as they
+ * change afterwards. Waits for namespace operations in progress to finish, so
+ * the snapshot never sees one half done. Writes made through FileDescriptors
+ * at that moment may or may not be included. The snapshot must be released
+ * before the filesystem is destroyed.
+ * @return The snapshot; the view lasts as long as the pointer is held.
+ */
+std::shared_ptr<Snapshot> FileSystem::snapshot() {
+    std::unique_lock<ShardedSharedMutex> lock(namespaceLock); // No namespace operation is half applied
+    return snapshots.take(rootDirectory);
+}
\ No newline at end of file
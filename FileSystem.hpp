@@ -1,42 +1,275 @@
 #ifndef FILESYSTEM_HPP
 #define FILESYSTEM_HPP
 
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
 #include <vector>
+#include "BlockStore.hpp"
+#include "CompressedBlocks.hpp"
+#include "DentryCache.hpp"
 #include "Directory.hpp"
 #include "File.hpp"
+#include "FileDescriptor.hpp"
+#include "Journal.hpp"
+#include "NameIndex.hpp"
+#include "OperationStats.hpp"
+#include "Session.hpp"
+#include "ShardedSharedMutex.hpp"
+#include "Snapshot.hpp"
+#include "SpillFile.hpp"
+#include "WorkStealingPool.hpp"
 
 /**
  * @class FileSystem
  * @brief A class representing a simple file system with basic file and directory operations.
+ *
+ * After openPersistent(), every mutation made through the FileSystem API is
+ * appended to a write-ahead Journal and is durable when the call returns. A
+ * background thread folds the journal into the base image once it grows past
+ * a threshold. Changes made directly through Directory, File or FileDescriptor
+ * objects bypass the journal and only become durable at the next checkpoint.
+ *
+ * The FileSystem may be shared between threads. Each thread should open its own
+ * Session, which has its own current directory; the FileSystem's own file and
+ * directory operations act through a default session. Every operation holds the
+ * namespace lock shared and locks only the directories and files it touches, so
+ * only deleting a directory or replacing the whole tree waits for everyone else.
+ *
+ * Absolute directory paths resolved by changeDirectory() are remembered in a
+ * DentryCache. Directories removed directly through Directory objects are not
+ * seen by the cache, so remove them through the FileSystem API.
  */
 class FileSystem {
 private:
+    std::atomic<size_t> residentBlocks; ///< Pool blocks held by the tree's files, counted by the files as they take and return them.
     Directory rootDirectory; ///< The root directory of the file system.
-    Directory* currentDirectory; ///< The current working directory.
+    SnapshotRegistry snapshots; ///< The open snapshots of the tree.
+    mutable ShardedSharedMutex namespaceLock; ///< Held shared by every operation; exclusively to delete or move a directory, take a snapshot, checkpoint, or replace the tree.
+    std::shared_mutex cloneLock; ///< Held shared to clone or move a file; exclusively to clone a directory, whose locks cannot follow the fixed order.
+    std::mutex sessionsMutex; ///< Guards the set of open sessions.
+    std::unordered_set<Session*> sessions; ///< Every open session, to check and reset their current directories.
+    Session defaultSession; ///< The session used by the FileSystem's own operations.
+    DentryCache dentryCache; ///< Resolved absolute directory paths.
+    OperationStats stats; ///< Per-operation counters and latency histograms.
+    std::string imagePath; ///< The base image of a persistent filesystem.
+    std::unique_ptr<Journal> journal; ///< The write-ahead journal, while persistent.
+    uint64_t checkpointBytes; ///< Journal size that triggers a background checkpoint.
+    std::thread checkpointer; ///< Background thread running checkpoints.
+    std::mutex checkpointMutex; ///< Guards the checkpointer's wake-up state.
+    std::mutex checkpointSaveMutex; ///< Lets one checkpoint at a time write the image.
+    std::condition_variable checkpointWake; ///< Wakes the checkpointer.
+    bool checkpointRequested; ///< Set when the journal has outgrown checkpointBytes.
+    bool stopCheckpointer; ///< Set to shut the checkpointer down.
+    BlockStore blockStore; ///< Content-addressed blocks shared between files by deduplicate().
+    std::thread deduplicator; ///< Background thread running deduplicate(), while enabled.
+    std::mutex deduplicatorMutex; ///< Guards the deduplicator's wake-up state.
+    std::condition_variable deduplicatorWake; ///< Wakes the deduplicator to stop.
+    std::chrono::milliseconds deduplicationInterval; ///< Time between background passes.
+    bool stopDeduplicator; ///< Set to shut the deduplicator down.
+    std::thread compressor; ///< Background thread running compressColdFiles(), while enabled.
+    std::mutex compressorMutex; ///< Guards the compressor's wake-up state.
+    std::condition_variable compressorWake; ///< Wakes the compressor to stop.
+    std::chrono::milliseconds compressionIdle; ///< How long a file must go unread and unwritten to be compressed.
+    std::chrono::milliseconds compressionInterval; ///< Time between background passes.
+    bool stopCompressor; ///< Set to shut the compressor down.
+    std::shared_ptr<SpillFile> spillFile; ///< Where files are evicted to, while a memory budget is set.
+    size_t memoryBudget; ///< Bytes of pool blocks to keep resident, or 0 for no budget.
+    std::thread spiller; ///< Background thread running enforceMemoryBudget(), while a budget is set.
+    mutable std::mutex spillerMutex; ///< Guards the budget, the spill file and the spiller's wake-up state.
+    std::condition_variable spillerWake; ///< Wakes the spiller to stop.
+    std::chrono::milliseconds spillInterval; ///< Time between background passes.
+    std::chrono::steady_clock::time_point lastBudgetPass; ///< When enforceMemoryBudget() last ran.
+    bool stopSpiller; ///< Set to shut the spiller down.
+    WorkStealingPool* workPool; ///< Runs recursive tree operations; nullptr for the shared pool.
+    std::unique_ptr<NameIndex> nameIndex; ///< Indexes every name in the tree for glob() and search(), while enabled.
 
     /**
-     * @brief Splits a file path into its component parts.
-     * @param path The file path to split.
-     * @return A vector of strings representing the parts of the path.
+     * @brief Walks a path from a starting directory.
+     * @details Components are read with a PathTokenizer, so the walk does not allocate.
+     * Absolute paths start from the root; ".." steps up, and stays put at the root.
+     * @param start The directory relative paths start from.
+     * @param path The path to walk.
+     * @return A pointer to the directory if found.
+     * @throws std::runtime_error if the directory is not found.
      */
-    std::vector<std::string> splitPath(const std::string& path) const;
+    Directory* traverseToDirectory(Directory& start, std::string_view path);
 
     /**
-     * @brief Traverses to a directory given a root directory and a vector of path parts.
-     * @param root The root directory to start from.
-     * @param pathParts The parts of the path to traverse.
-     * @return A pointer to the directory if found.
+     * @brief Resolves a directory path, through the dentry cache when the path is absolute.
+     * @param start The directory relative paths start from.
+     * @param path The path to resolve.
+     * @return A pointer to the directory.
      * @throws std::runtime_error if the directory is not found.
      */
-    Directory* traverseToDirectory(Directory& root, const std::vector<std::string>& pathParts) const;
+    Directory* resolveDirectory(Directory& start, std::string_view path);
+
+    /**
+     * @brief Resolves the directory holding the last component of a path.
+     * @param start The directory relative paths start from.
+     * @param path The path of an entry.
+     * @param leaf Set to the entry's name, a view into path.
+     * @return A pointer to the directory that holds, or would hold, the entry.
+     * @throws std::runtime_error if the directory is not found or path names no entry.
+     */
+    Directory* resolveParent(Directory& start, std::string_view path, std::string_view& leaf);
+
+    /**
+     * @brief Splits a path into the path of its parent directory and its last component.
+     * @param path The path of an entry.
+     * @param leaf Set to the entry's name, a view into path.
+     * @return The parent's path, a view into path; empty for a bare name.
+     * @throws std::runtime_error if path names no entry.
+     */
+    std::string_view splitParent(std::string_view path, std::string_view& leaf) const;
 
     /**
      * @brief Determines if a given path is absolute.
      * @param path The path to check.
      * @return true if the path is absolute, false otherwise.
      */
-    bool isAbsolutePath(const std::string& path) const;
+    bool isAbsolutePath(std::string_view path) const;
+
+    /**
+     * @brief Builds the absolute path of an entry in a directory.
+     * @param dir The directory holding the entry.
+     * @param name The name of the entry.
+     * @return The absolute path, e.g. "/home/user/file.txt".
+     */
+    std::string absolutePath(const Directory* dir, std::string_view name) const;
+
+    /**
+     * @brief Appends a mutation that has just been applied to the journal.
+     * @details Does nothing unless the filesystem is persistent. Call it while still
+     * holding the lock on the node changed, so the log order matches the apply order.
+     * @param op The mutation applied.
+     * @param dir The directory holding the entry.
+     * @param name The name of the entry.
+     * @param data The data written, for JournalOp::WriteFile.
+     * @return The LSN of the record, or 0 if nothing was logged.
+     */
+    uint64_t logMutation(JournalOp op, const Directory* dir, std::string_view name, const std::vector<char>* data = nullptr);
+
+    /**
+     * @brief Waits for a logged mutation to be durable.
+     * @details Call it after releasing the node locks so that concurrent commits share
+     * one fsync, but while still holding the namespace lock shared.
+     * @param lsn The LSN returned by logMutation().
+     */
+    void commitMutation(uint64_t lsn);
+
+    /**
+     * @brief Determines if any session's current directory is a directory or lies below it.
+     * @details Call it with the namespace lock held exclusively.
+     * @param dir The directory to check.
+     * @return true if a session is working inside dir.
+     */
+    bool isInUse(const Directory* dir);
+
+    /**
+     * @brief Moves every session back to the root directory.
+     * @details Call it with the namespace lock held exclusively.
+     */
+    void resetSessions();
+
+    /**
+     * @brief Rebuilds the name index, if enabled, after the tree has been replaced.
+     * @details Call it with the namespace lock held exclusively.
+     */
+    void reindexNames();
+
+    /**
+     * @brief Resolves the directory holding the last component of a journaled path, bypassing the dentry cache.
+     * @details Replay deletes and moves directories without telling the cache, so it must not use it.
+     * @param path The absolute path of an entry.
+     * @param leaf Set to the entry's name, a view into path.
+     * @return A pointer to the directory that holds, or would hold, the entry.
+     * @throws std::runtime_error if the directory is not found or path names no entry.
+     */
+    Directory* resolveRecordParent(std::string_view path, std::string_view& leaf);
+
+    /**
+     * @brief Re-applies a journal record to the tree.
+     * @param record The record to apply.
+     */
+    void applyRecord(const JournalRecord& record);
+
+    /**
+     * @brief Body of the background checkpoint thread.
+     */
+    void runCheckpointer();
+
+    /**
+     * @brief Deduplicates the files of a directory and, recursively, its subdirectories.
+     * @param dir The directory.
+     * @return The number of blocks merged.
+     */
+    size_t deduplicateDirectory(Directory& dir);
+
+    /**
+     * @brief Body of the background deduplication thread.
+     */
+    void runDeduplicator();
+
+    /**
+     * @brief Compresses the cold files of a directory and, recursively, its subdirectories.
+     * @param dir The directory.
+     * @param cutoff Files last accessed before this are compressed.
+     * @return The number of files compressed.
+     */
+    size_t compressDirectory(Directory& dir, std::chrono::steady_clock::time_point cutoff);
+
+    /**
+     * @brief Body of the background compression thread.
+     */
+    void runCompressor();
+
+    /**
+     * @brief Gathers the last access time and resident block count of every file in memory.
+     * @param dir The directory to start from; its subdirectories are visited too.
+     * @param files Receives one entry per file holding pool blocks.
+     */
+    void collectResidentFiles(Directory& dir, std::vector<std::pair<std::chrono::steady_clock::time_point, size_t>>& files);
+
+    /**
+     * @brief Spills the least recently used files of a directory and, recursively, its subdirectories.
+     * @param dir The directory.
+     * @param cutoff Files last accessed at or before this are spilled.
+     * @param to The spill file.
+     * @param excess Blocks still to evict; reduced by each file spilled, and the walk stops at 0.
+     * @return The number of files spilled.
+     */
+    size_t spillDirectory(Directory& dir, std::chrono::steady_clock::time_point cutoff, const std::shared_ptr<SpillFile>& to,
+                          size_t& excess);
+
+    /**
+     * @brief Faults recently read spilled files of a directory and, recursively, its subdirectories back into memory.
+     * @param dir The directory.
+     * @param since Files accessed after this are restored.
+     * @param headroom Blocks that fit under the budget; reduced by each file restored.
+     * @return The number of files restored.
+     */
+    size_t restoreDirectory(Directory& dir, std::chrono::steady_clock::time_point since, size_t& headroom);
+
+    /**
+     * @brief Body of the background spill thread.
+     */
+    void runSpiller();
+
+    /**
+     * @brief Gets the pool recursive tree operations run on.
+     * @return The pool set with setWorkPool(), or the process-wide pool.
+     */
+    WorkStealingPool& treePool();
+
+    friend class Session;
 
 public:
     /**
@@ -45,45 +278,166 @@ public:
     FileSystem();
 
     /**
-     * @brief Creates a file in the current directory.
-     * @param filename The name of the file to create.
+     * @brief Destructor for the FileSystem class; closes the journal if persistent.
+     */
+    ~FileSystem();
+
+    FileSystem(const FileSystem&) = delete;
+    FileSystem& operator=(const FileSystem&) = delete;
+
+    /**
+     * @brief Creates a file.
+     * @param filename The path of the file to create, absolute or relative to the current directory.
      */
     void createFile(const std::string& filename);
 
     /**
-     * @brief Deletes a file from the current directory.
-     * @param filename The name of the file to delete.
+     * @brief Deletes a file.
+     * @param filename The path of the file to delete, absolute or relative to the current directory.
      */
     void deleteFile(const std::string& filename);
 
     /**
-     * @brief Reads data from a file in the current directory.
-     * @param filename The name of the file to read.
+     * @brief Reads data from a file.
+     * @param filename The path of the file to read, absolute or relative to the current directory.
      * @return A vector of characters containing the file data.
      * @throws std::runtime_error if the file is not found.
      */
     std::vector<char> readFile(const std::string& filename);
 
     /**
-     * @brief Writes data to a file in the current directory.
-     * @param filename The name of the file to write to.
+     * @brief Writes data to a file.
+     * @param filename The path of the file to write to, absolute or relative to the current directory.
      * @param data The data to write to the file.
      * @throws std::runtime_error if the file is not found.
      */
     void writeFile(const std::string& filename, const std::vector<char>& data);
 
     /**
-     * @brief Creates a directory in the current directory.
-     * @param dirname The name of the directory to create.
+     * @brief Creates a directory.
+     * @param dirname The path of the directory to create, absolute or relative to the current directory.
      */
     void createDirectory(const std::string& dirname);
 
     /**
-     * @brief Deletes a directory from the current directory.
-     * @param dirname The name of the directory to delete.
+     * @brief Deletes a directory.
+     * @param dirname The path of the directory to delete, absolute or relative to the current directory.
+     * @throws std::runtime_error if another session's current directory is inside it.
      */
     void deleteDirectory(const std::string& dirname);
 
+    /**
+     * @brief Copies a file; the copy shares its blocks until either file is written.
+     * @param source The path of the file to copy.
+     * @param destination The path of the copy.
+     * @throws std::runtime_error if the source is not found or the destination already exists.
+     */
+    void cloneFile(const std::string& source, const std::string& destination);
+
+    /**
+     * @brief Copies a directory tree; files in the copy share their blocks until written.
+     * @param source The path of the directory to copy.
+     * @param destination The path of the copy.
+     * @throws std::runtime_error if the source is not found, the destination already
+     * exists, or the destination lies inside the source.
+     */
+    void cloneDirectory(const std::string& source, const std::string& destination);
+
+    /**
+     * @brief Renames or moves a file or directory in place; nothing is copied.
+     * @details The node is relinked under its new parent, so the cost does not
+     * depend on the size of a moved subtree. Lookups never see it half moved.
+     * @param source The path of the file or directory to move.
+     * @param destination Its new path.
+     * @throws std::runtime_error if the source is not found, the destination already
+     * exists, or a directory would be moved inside itself.
+     */
+    void rename(const std::string& source, const std::string& destination);
+
+    /**
+     * @brief Visits every file and directory below a directory, subtrees in parallel.
+     * @details The visitor is called concurrently from the pool's threads, in no particular order.
+     * @param dirname The path of the directory to walk, absolute or relative to the current directory.
+     * @param visit Called with each entry's absolute path, and the file or nullptr for a directory.
+     * @throws std::runtime_error if the directory is not found, or whatever the visitor throws.
+     */
+    void walk(const std::string& dirname, const TreeVisitor& visit);
+
+    /**
+     * @brief Totals the files, directories and bytes below a directory, subtrees in parallel.
+     * @param dirname The path of the directory, absolute or relative to the current directory.
+     * @return The totals.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    TreeUsage diskUsage(const std::string& dirname);
+
+    /**
+     * @brief Gets the bytes, files and directories below a directory in O(1), from its running totals.
+     * @details Each directory keeps the totals of its subtree as it changes, so
+     * quota checks need no walk. Use diskUsage() for allocated bytes.
+     * @param dirname The path of the directory, absolute or relative to the current directory.
+     * @return The totals.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    SubtreeUsage usage(const std::string& dirname);
+
+    /**
+     * @brief Runs recursive tree operations (walk, diskUsage, cloneDirectory and
+     * deleteDirectory) on a given pool instead of the process-wide one.
+     * @details Call before sharing the filesystem between threads.
+     * @param pool The pool; must outlive the filesystem.
+     */
+    void setWorkPool(WorkStealingPool& pool);
+
+    /**
+     * @brief Enables or disables the name index behind glob() and search().
+     * @details Enabling indexes every file and directory in the tree, loading
+     * anything still in an image; the directories keep it up to date from then
+     * on. Without the index, queries walk the tree instead.
+     * @param enabled true to build and keep the index, false to drop it.
+     */
+    void setNameIndex(bool enabled);
+
+    /**
+     * @brief Finds every file and directory in the tree whose name matches a glob pattern.
+     * @details '*' matches any run of characters and '?' any one character. With
+     * the name index enabled, the cost follows the number of candidate names.
+     * @param pattern The pattern, matched against whole names.
+     * @return The matches, sorted by path.
+     */
+    std::vector<NameMatch> glob(const std::string& pattern);
+
+    /**
+     * @brief Finds every file and directory in the tree whose name contains some text.
+     * @details With the name index enabled, the cost follows the number of candidate names.
+     * @param text The text.
+     * @return The matches, sorted by path.
+     */
+    std::vector<NameMatch> search(const std::string& text);
+
+    /**
+     * @brief Applies a batch of namespace mutations.
+     * @param ops The operations, applied in order.
+     * @return The outcome of each operation, in the same order.
+     */
+    std::vector<BatchResult> applyBatch(const std::vector<BatchOp>& ops);
+
+    /**
+     * @brief Lists the contents of the current directory.
+     * @return The names of the files and subdirectories in the current directory.
+     */
+    std::vector<std::string> listContents();
+
+    /**
+     * @brief Lists one page of the current directory in name order.
+     * @details Only the names on the page are copied, so paging through a huge
+     * directory does not allocate a string per entry up front.
+     * @param after Where the previous page left off; default-constructed for the first page.
+     * @param limit The most entries to return.
+     * @return The page, and the cursor for the next one.
+     */
+    ListPage listPage(const ListCursor& after, size_t limit);
+
     /**
      * @brief Gets the root directory of the file system.
      * @return A reference to the root directory.
@@ -102,6 +456,182 @@ public:
      * @throws std::runtime_error if the directory is not found.
      */
     void changeDirectory(const std::string& path);
+
+    /**
+     * @brief Saves the whole tree to a binary image file.
+     * @param path The path of the image file to write.
+     * @throws std::runtime_error if the image cannot be written.
+     */
+    void save(const std::string& path) const;
+
+    /**
+     * @brief Replaces the tree with the contents of an image file.
+     * @details The image is memory-mapped; directories are read from it as they are
+     * first accessed and file contents are served from the mapping until written.
+     * The current directory of every session is reset to the root.
+     * @param path The path of the image file to load.
+     * @throws std::runtime_error if the image cannot be mapped or is invalid, if
+     * the filesystem is persistent, or if a snapshot is open.
+     */
+    void load(const std::string& path);
+
+    /**
+     * @brief Makes the filesystem durable, backed by an image and a write-ahead journal.
+     * @details Loads the image if it exists and replays the journal at path + ".journal"
+     * on top of it, recovering every mutation committed before a crash. The recovered
+     * tree is written back as the new base image, the journal is restarted, and a
+     * background thread checkpoints whenever the journal grows past checkpointBytes.
+     * @param path The path of the base image.
+     * @param checkpointBytes Journal size that triggers a checkpoint. Defaults to 16 MB.
+     * @throws std::runtime_error if the image or journal cannot be read or written,
+     * or if a snapshot is open.
+     */
+    void openPersistent(const std::string& path, uint64_t checkpointBytes = 16 << 20);
+
+    /**
+     * @brief Folds the journal into the base image.
+     * @details Operations on the tree wait only while the journal is rotated; the
+     * image is then written from a snapshot while they carry on.
+     * @throws std::runtime_error if the filesystem is not persistent or the image cannot be written.
+     */
+    void checkpoint();
+
+    /**
+     * @brief Stops journaling; everything committed so far stays durable.
+     */
+    void closePersistent();
+
+    /**
+     * @brief Determines if the filesystem is journaling its mutations.
+     * @return true after openPersistent() and until closePersistent().
+     */
+    bool isPersistent() const;
+
+    /**
+     * @brief Gets the dentry cache's hit and miss counters.
+     * @return A snapshot of the counters and the number of cached paths.
+     */
+    DentryCache::Stats getDentryCacheStats();
+
+    /**
+     * @brief Zeroes the dentry cache's hit and miss counters.
+     */
+    void resetDentryCacheStats();
+
+    /**
+     * @brief Merges identical blocks across every file in the tree.
+     * @details Runs alongside other operations, locking one file at a time. Blocks
+     * are stored in the filesystem's BlockStore by content hash; a file's block that
+     * matches a stored one is replaced by a shared reference to it.
+     * @return The number of blocks merged by this pass.
+     */
+    size_t deduplicate();
+
+    /**
+     * @brief Turns background deduplication on or off; it starts off.
+     * @details While on, a background thread runs deduplicate() every interval, so
+     * writes never wait for hashing.
+     * @param enabled true to run the background thread.
+     * @param interval The time between passes.
+     */
+    void setDeduplication(bool enabled, std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief Gets the deduplication counters: blocks scanned, duplicates merged and bytes saved.
+     * @return A snapshot of the counters.
+     */
+    BlockStore::Stats getDeduplicationStats() const;
+
+    /**
+     * @brief Compresses every file not read or written for a while.
+     * @details Runs alongside other operations, locking one file at a time. Reads of a
+     * compressed file decompress the blocks they cover; its first write unpacks it.
+     * @param idle How long a file must have gone unaccessed.
+     * @return The number of files compressed by this pass.
+     */
+    size_t compressColdFiles(std::chrono::milliseconds idle);
+
+    /**
+     * @brief Turns background compression of cold files on or off; it starts off.
+     * @details While on, a background thread runs compressColdFiles(idle) every interval.
+     * @param enabled true to run the background thread.
+     * @param idle How long a file must go unaccessed before it is compressed.
+     * @param interval The time between passes.
+     */
+    void setCompression(bool enabled, std::chrono::milliseconds idle = std::chrono::milliseconds(30000),
+                        std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+
+    /**
+     * @brief Gets the compression counters: ratio of the data held compressed, and decompression time.
+     * @details The counters cover every filesystem in the process.
+     * @return A snapshot of the counters.
+     */
+    CompressedBlocks::Stats getCompressionStats() const;
+
+    /**
+     * @brief Caps the memory held by file contents, evicting cold files to disk; off by default.
+     * @details While a budget is set, a background thread runs enforceMemoryBudget() every
+     * interval, so callers never wait for eviction or write-back. The budget covers the
+     * pool blocks held by this tree's files; a block shared by two files counts for each.
+     * Files stay in the tree, with their names and sizes, whether their contents are in
+     * memory or not.
+     * @param bytes The bytes of file blocks to keep in memory, or 0 to lift the budget.
+     * @param spillPath The local file to evict to; created, and removed once nothing is spilled to it.
+     * @param interval The time between passes.
+     * @throws std::runtime_error if the spill file cannot be created.
+     */
+    void setMemoryBudget(size_t bytes, const std::string& spillPath = "filesystem.spill",
+                         std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+
+    /**
+     * @brief Runs one eviction pass against the memory budget.
+     * @details Over budget, the least recently used files are spilled until the excess
+     * is covered. Under budget, spilled files read since the previous pass are faulted
+     * back in while they fit. Runs alongside other operations, locking one file at a time.
+     * @return The number of files spilled by this pass.
+     */
+    size_t enforceMemoryBudget();
+
+    /**
+     * @brief Gets the spill file's counters: blocks on disk, written and read back.
+     * @return A snapshot of the counters; all zero while no budget is set.
+     */
+    SpillFile::Stats getSpillStats() const;
+
+    /**
+     * @brief Turns per-operation statistics on or off; they start off.
+     * @param enabled true to record call counts, bytes and latencies.
+     */
+    void setStatsEnabled(bool enabled);
+
+    /**
+     * @brief Gets the per-operation statistics recorded so far, merged across threads.
+     * @return A snapshot of the counters and latency histograms.
+     */
+    OperationStats::Snapshot getStats() const;
+
+    /**
+     * @brief Zeroes the per-operation statistics.
+     */
+    void resetStats();
+
+    /**
+     * @brief Opens a descriptor on a file whose reads and writes count in getStats().
+     * @param file A file in this filesystem's tree.
+     * @return A descriptor positioned at the start of the file.
+     */
+    FileDescriptor openDescriptor(File& file);
+
+    /**
+     * @brief Takes a read-only, point-in-time view of the whole tree.
+     * @details Takes O(1) time: nodes are copied into the snapshot only as they
+     * change afterwards. Waits for namespace operations in progress to finish, so
+     * the snapshot never sees one half done. Writes made through FileDescriptors
+     * at that moment may or may not be included. The snapshot must be released
+     * before the filesystem is destroyed.
+     * @return The snapshot; the view lasts as long as the pointer is held.
+     */
+    std::shared_ptr<Snapshot> snapshot();
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,531 @@
+#include "FileSystemImage.hpp"
+#include "BlockPool.hpp"
+#include "Directory.hpp"
+#include "Snapshot.hpp"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint32_t FileSystemImage::VERSION;
+
+namespace {
+
+const char MAGIC[8] = {'C', 'W', '3', 'F', 'S', 'I', 'M', 'G'}; ///< Identifies an image file.
+const size_t HEADER_SIZE = 32; ///< Magic, version, block size, root record offset and checkpoint LSN.
+const size_t EXTENT_SIZE = 16; ///< Block index and data offset.
+
+/**
+ * @brief Buffered little-endian writer that tracks its output offset.
+ */
+class ImageWriter {
+private:
+    std::FILE* out; ///< The file being written.
+    uint64_t offset; ///< The offset of the next byte written.
+
+public:
+    /**
+     * @brief Constructor for the ImageWriter class.
+     * @param out The file to write to, positioned at its start.
+     */
+    explicit ImageWriter(std::FILE* out) : out(out), offset(0) {}
+
+    /**
+     * @brief Writes raw bytes.
+     * @param data The bytes to write.
+     * @param size The number of bytes to write.
+     * @throws std::runtime_error if the write fails.
+     */
+    void bytes(const void* data, size_t size) {
+        if (size && std::fwrite(data, 1, size, out) != size) {
+            throw std::runtime_error("Failed to write filesystem image");
+        }
+        offset += size;
+    }
+
+    /**
+     * @brief Writes a 32-bit integer in little-endian order.
+     * @param value The value to write.
+     */
+    void u32(uint32_t value) {
+        unsigned char buffer[4];
+        for (int i = 0; i < 4; ++i) {
+            buffer[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+        bytes(buffer, sizeof(buffer));
+    }
+
+    /**
+     * @brief Writes a 64-bit integer in little-endian order.
+     * @param value The value to write.
+     */
+    void u64(uint64_t value) {
+        unsigned char buffer[8];
+        for (int i = 0; i < 8; ++i) {
+            buffer[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+        bytes(buffer, sizeof(buffer));
+    }
+
+    /**
+     * @brief Writes a length-prefixed name.
+     * @param name The name to write.
+     */
+    void name(const std::string& name) {
+        u32(static_cast<uint32_t>(name.size()));
+        bytes(name.data(), name.size());
+    }
+
+    /**
+     * @brief Gets the offset of the next byte written.
+     * @return The current output offset.
+     */
+    uint64_t position() const {
+        return offset;
+    }
+};
+
+/**
+ * @brief Writes a directory's subtree and then its own record.
+ * @param writer The image writer.
+ * @param dir The directory to write.
+ * @param view The snapshot to write the directory as it was in, or nullptr to
+ * write the live tree, which the caller keeps from changing.
+ * @param usage Receives the totals of the subtree as written.
+ * @return The offset of the directory's record.
+ */
+uint64_t writeDirectory(ImageWriter& writer, const Directory& dir, const Snapshot* view, SubtreeUsage& usage) {
+    std::vector<std::pair<std::string, const File*>> files;
+    std::vector<std::pair<std::string, const Directory*>> subdirectories;
+    if (view) {
+        view->listEntries(dir, files, subdirectories);
+    } else {
+        for (const File* file : dir.getFiles()) {
+            files.emplace_back(file->getName(), file);
+        }
+        for (const Directory* subdir : dir.getSubdirectories()) {
+            subdirectories.emplace_back(subdir->getName(), subdir);
+        }
+    }
+    std::vector<uint64_t> childRecords;
+    childRecords.reserve(subdirectories.size());
+    usage = {0, 0, subdirectories.size()};
+    for (const auto& subdir : subdirectories) {
+        SubtreeUsage child;
+        childRecords.push_back(writeDirectory(writer, *subdir.second, view, child)); // Children are written before their parent
+        usage.bytes += child.bytes;
+        usage.files += child.files;
+        usage.directories += child.directories;
+    }
+
+    std::vector<std::vector<std::pair<uint64_t, uint64_t>>> fileExtents(files.size());
+    std::vector<uint64_t> fileSizes(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto writeFile = [&](const File& file) {
+            fileSizes[i] = file.size(); // Read with the blocks, so the two agree
+            file.forEachBlock([&](size_t index, const char* data) {
+                fileExtents[i].emplace_back(index, writer.position()); // Remember where each block landed
+                writer.bytes(data, BlockPool::BLOCK_SIZE);
+            });
+        };
+        if (view) {
+            view->readFile(*files[i].second, writeFile);
+        } else {
+            writeFile(*files[i].second);
+        }
+    }
+
+    usage.files += files.size();
+    for (uint64_t size : fileSizes) {
+        usage.bytes += size;
+    }
+
+    uint64_t record = writer.position();
+    writer.u64(files.size());
+    writer.u64(subdirectories.size());
+    writer.u64(usage.bytes); // Counted from what is written, not the live totals, which may be moving
+    writer.u64(usage.files);
+    writer.u64(usage.directories);
+    for (size_t i = 0; i < files.size(); ++i) {
+        writer.name(files[i].first);
+        writer.u64(fileSizes[i]);
+        writer.u64(fileExtents[i].size());
+        for (const auto& extent : fileExtents[i]) {
+            writer.u64(extent.first);
+            writer.u64(extent.second);
+        }
+    }
+    for (size_t i = 0; i < subdirectories.size(); ++i) {
+        writer.name(subdirectories[i].first);
+        writer.u64(childRecords[i]);
+    }
+    return record;
+}
+
+/**
+ * @brief Writes a directory tree, live or as a snapshot saw it, to an image file.
+ * @details The image is written to a temporary file that is then renamed over path.
+ * @param root The root directory of the tree to write.
+ * @param view The snapshot to write the tree as it was in, or nullptr.
+ * @param path The path of the image file.
+ * @param lsn The last journal record reflected in the tree.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void writeImage(const Directory& root, const Snapshot* view, const std::string& path, uint64_t lsn) {
+    std::string tempPath = path + ".tmp";
+    std::FILE* out = std::fopen(tempPath.c_str(), "wb");
+    if (!out) {
+        throw std::runtime_error("Cannot create filesystem image: " + tempPath);
+    }
+    try {
+        ImageWriter writer(out);
+        writer.bytes(MAGIC, sizeof(MAGIC));
+        writer.u32(FileSystemImage::VERSION);
+        writer.u32(static_cast<uint32_t>(BlockPool::BLOCK_SIZE));
+        writer.u64(0); // Patched once the root record has been written
+        writer.u64(lsn);
+        SubtreeUsage usage;
+        uint64_t record = writeDirectory(writer, root, view, usage);
+
+        std::fseek(out, 16, SEEK_SET);
+        ImageWriter header(out);
+        header.u64(record);
+        bool flushed = std::fflush(out) == 0;
+#ifdef _WIN32
+        flushed = flushed && _commit(_fileno(out)) == 0;
+#else
+        flushed = flushed && fsync(fileno(out)) == 0; // Make the image durable before it replaces the old one
+#endif
+        if (!flushed) {
+            throw std::runtime_error("Failed to write filesystem image");
+        }
+    } catch (...) {
+        std::fclose(out);
+        std::remove(tempPath.c_str());
+        throw;
+    }
+    std::fclose(out);
+#ifdef _WIN32
+    bool renamed = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Cannot replace filesystem image: " + path);
+    }
+}
+
+/**
+ * @brief Decodes a little-endian integer from unaligned bytes.
+ * @param bytes The bytes to decode.
+ * @param size The number of bytes in the integer.
+ * @return The decoded value.
+ */
+uint64_t decode(const char* bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+/**
+ * @brief Maps an image file into memory and validates its header.
+ * @param path The path of the image file.
+ * @throws std::runtime_error if the file cannot be mapped or is not a valid image.
+ */
+FileSystemImage::FileSystemImage(const std::string& path) : base(nullptr), length(0), rootRecord(0), lsn(0) {
+#ifdef _WIN32
+    fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    mappingHandle = nullptr;
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot open filesystem image: " + path);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(fileHandle, &fileSize);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length > 0) {
+        mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        base = mappingHandle ? static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    }
+    if (!base) {
+        unmap();
+        throw std::runtime_error("Cannot map filesystem image: " + path);
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open filesystem image: " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        length = static_cast<size_t>(info.st_size);
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        base = mapping == MAP_FAILED ? nullptr : static_cast<const char*>(mapping);
+    }
+    ::close(fd); // The mapping keeps the file contents reachable
+    if (!base) {
+        throw std::runtime_error("Cannot map filesystem image: " + path);
+    }
+#endif
+    if (length < HEADER_SIZE || std::memcmp(base, MAGIC, sizeof(MAGIC)) != 0 ||
+        decode(base + 8, 4) != VERSION || decode(base + 12, 4) != BlockPool::BLOCK_SIZE) {
+        unmap();
+        throw std::runtime_error("Not a filesystem image: " + path);
+    }
+    rootRecord = decode(base + 16, 8);
+    lsn = decode(base + 24, 8);
+}
+
+/**
+ * @brief Destructor for the FileSystemImage class; unmaps the image.
+ */
+FileSystemImage::~FileSystemImage() {
+    unmap();
+}
+
+/**
+ * @brief Releases the mapping and any handles held for it.
+ */
+void FileSystemImage::unmap() {
+#ifdef _WIN32
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+    }
+    base = nullptr;
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (base) {
+        munmap(const_cast<char*>(base), length);
+        base = nullptr;
+    }
+#endif
+}
+
+/**
+ * @brief Maps an image file into memory.
+ * @param path The path of the image file.
+ * @return A shared handle to the mapped image.
+ * @throws std::runtime_error if the file cannot be mapped or is not a valid image.
+ */
+std::shared_ptr<FileSystemImage> FileSystemImage::open(const std::string& path) {
+    return std::shared_ptr<FileSystemImage>(new FileSystemImage(path));
+}
+
+/**
+ * @brief Writes a directory tree to an image file.
+ * @details The image is written to a temporary file that is then renamed over
+ * path, so an image that is currently mapped stays valid.
+ * @param root The root directory of the tree to write.
+ * @param path The path of the image file.
+ * @param lsn The last journal record reflected in the tree. Defaults to 0.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void FileSystemImage::save(const Directory& root, const std::string& path, uint64_t lsn) {
+    writeImage(root, nullptr, path, lsn);
+}
+
+/**
+ * @brief Writes the tree a snapshot views, as it was when the snapshot was taken, to an image file.
+ * @details Writers carry on while the image is written.
+ * @param snapshot The snapshot.
+ * @param path The path of the image file.
+ * @param lsn The last journal record reflected in the snapshot.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void FileSystemImage::save(const Snapshot& snapshot, const std::string& path, uint64_t lsn) {
+    writeImage(snapshot.getRoot(), &snapshot, path, lsn);
+}
+
+/**
+ * @brief Attaches an image's root directory record to a directory.
+ * @details Any existing contents of the directory are discarded; the new
+ * contents are loaded lazily on first access.
+ * @param dir The directory to attach.
+ */
+void FileSystemImage::attachRoot(Directory& dir) {
+    dir.clear();
+    attach(dir, rootRecord);
+}
+
+/**
+ * @brief Attaches a directory record to a directory, to be loaded on first access.
+ * @details Sets the directory's subtree totals from the record.
+ * @param dir The directory to attach.
+ * @param record The offset of the directory record.
+ * @throws std::runtime_error if the record runs past the end of the image.
+ */
+void FileSystemImage::attach(Directory& dir, uint64_t record) {
+    uint64_t offset = record + 16; // Past the entry counts
+    dir.subtreeBytes.store(read64(offset), std::memory_order_relaxed);
+    dir.subtreeFiles.store(read64(offset), std::memory_order_relaxed);
+    dir.subtreeDirectories.store(read64(offset), std::memory_order_relaxed);
+    dir.image = shared_from_this();
+    dir.imageRecord = record;
+    dir.imagePending.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief Loads a directory record into a directory.
+ * @details Files in the record are attached to their extents in the image and
+ * subdirectories are attached to their own records, to be loaded on first access.
+ * @param dir The directory to fill in.
+ * @param record The offset of the directory record.
+ */
+void FileSystemImage::populate(Directory& dir, uint64_t record) {
+    std::shared_ptr<FileSystemImage> self = shared_from_this();
+    uint64_t offset = record;
+    uint64_t fileCount = read64(offset);
+    uint64_t directoryCount = read64(offset);
+    offset += 24; // The subtree totals, read when the directory was attached
+    if (fileCount > (length - offset) / 28 || directoryCount > (length - offset) / 12) { // Smallest possible entries
+        throw std::runtime_error("Corrupt filesystem image");
+    }
+    dir.files.reserve(fileCount);
+    dir.subdirectories.reserve(directoryCount);
+    for (uint64_t i = 0; i < fileCount; ++i) {
+        File* file = dir.createFile(readName(offset));
+        file->length = read64(offset);
+        file->imageExtentCount = read64(offset);
+        file->imageExtents = offset;
+        if (file->imageExtentCount > (length - offset) / EXTENT_SIZE) {
+            throw std::runtime_error("Corrupt filesystem image");
+        }
+        offset += file->imageExtentCount * EXTENT_SIZE;
+        file->image = self; // Contents stay in the mapping until first written
+    }
+    for (uint64_t i = 0; i < directoryCount; ++i) {
+        Directory* subdir = dir.createDirectory(readName(offset));
+        attach(*subdir, read64(offset)); // Loaded on first access
+    }
+}
+
+/**
+ * @brief Finds the first extent at or after a block index.
+ * @param extents The offset of the file's extent table.
+ * @param count The number of extents in the table.
+ * @param blockIndex The block index to search for.
+ * @return The position of the first extent whose block index is not less than blockIndex.
+ */
+size_t FileSystemImage::findExtent(uint64_t extents, size_t count, size_t blockIndex) const {
+    size_t low = 0, high = count;
+    while (low < high) { // Binary search over the sorted extent table
+        size_t middle = low + (high - low) / 2;
+        if (extentBlock(extents, middle) < blockIndex) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Gets the block index of an extent.
+ * @param extents The offset of the file's extent table.
+ * @param position The position of the extent in the table.
+ * @return The block index the extent covers.
+ */
+size_t FileSystemImage::extentBlock(uint64_t extents, size_t position) const {
+    return static_cast<size_t>(decode(base + extents + position * EXTENT_SIZE, 8));
+}
+
+/**
+ * @brief Gets the data of an extent.
+ * @param extents The offset of the file's extent table.
+ * @param position The position of the extent in the table.
+ * @return A pointer to the block's BLOCK_SIZE bytes inside the mapping.
+ */
+const char* FileSystemImage::extentData(uint64_t extents, size_t position) const {
+    uint64_t offset = decode(base + extents + position * EXTENT_SIZE + 8, 8);
+    checkRange(offset, BlockPool::BLOCK_SIZE);
+    return base + offset;
+}
+
+/**
+ * @brief Gets the last journal record folded into the image.
+ * @return The checkpoint LSN stored in the header.
+ */
+uint64_t FileSystemImage::checkpointLsn() const {
+    return lsn;
+}
+
+/**
+ * @brief Gets the size of the mapped image.
+ * @return The size of the image in bytes.
+ */
+size_t FileSystemImage::size() const {
+    return length;
+}
+
+/**
+ * @brief Reads a 32-bit integer from the image.
+ * @param offset The offset to read at; advanced past the value.
+ * @return The value read.
+ * @throws std::runtime_error if the read runs past the end of the image.
+ */
+uint32_t FileSystemImage::read32(uint64_t& offset) const {
+    checkRange(offset, 4);
+    uint32_t value = static_cast<uint32_t>(decode(base + offset, 4));
+    offset += 4;
+    return value;
+}
+
+/**
+ * @brief Reads a 64-bit integer from the image.
+ * @param offset The offset to read at; advanced past the value.
+ * @return The value read.
+ * @throws std::runtime_error if the read runs past the end of the image.
+ */
+uint64_t FileSystemImage::read64(uint64_t& offset) const {
+    checkRange(offset, 8);
+    uint64_t value = decode(base + offset, 8);
+    offset += 8;
+    return value;
+}
+
+/**
+ * @brief Reads a length-prefixed name from the image.
+ * @param offset The offset to read at; advanced past the name.
+ * @return The name read.
+ * @throws std::runtime_error if the read runs past the end of the image.
+ */
+std::string FileSystemImage::readName(uint64_t& offset) const {
+    uint32_t size = read32(offset);
+    checkRange(offset, size);
+    std::string name(base + offset, size);
+    offset += size;
+    return name;
+}
+
+/**
+ * @brief Checks that a range lies inside the image.
+ * @param offset The start of the range.
+ * @param size The size of the range.
+ * @throws std::runtime_error if the range runs past the end of the image.
+ */
+void FileSystemImage::checkRange(uint64_t offset, uint64_t size) const {
+    if (offset > length || size > length - offset) {
+        throw std::runtime_error("Corrupt filesystem image");
+    }
+}
@@ -0,0 +1,191 @@
+#ifndef FILESYSTEMIMAGE_HPP
+#define FILESYSTEMIMAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class Directory;
+class Snapshot;
+
+/**
+ * @class FileSystemImage
+ * @brief A memory-mapped, read-only binary image of a directory tree.
+ *
+ * Image layout (all integers little-endian, unaligned):
+ *  - Header: magic "CW3FSIMG", u32 version, u32 block size, u64 root record offset,
+ *    u64 checkpoint LSN (the last Journal record folded into the image).
+ *  - Data blocks: raw BLOCK_SIZE-byte blocks referenced by file extents.
+ *  - Directory records: u64 file count, u64 subdirectory count, the subtree's
+ *    u64 total bytes, u64 file count and u64 directory count, then for each
+ *    file u32 name length, name, u64 size, u64 extent count and that many
+ *    (u64 block index, u64 data offset) pairs sorted by block index, then for
+ *    each subdirectory u32 name length, name, u64 record offset.
+ *
+ * Directories attached to an image read their record the first time their
+ * contents are needed, and files read their extents straight from the mapping
+ * until they are first written, so opening an image costs the same however
+ * large it is. A directory takes its subtree totals from its record as soon as
+ * it is attached, so they are right before it is loaded.
+ */
+class FileSystemImage : public std::enable_shared_from_this<FileSystemImage> {
+private:
+    const char* base; ///< Start of the mapped image.
+    size_t length; ///< Size of the mapped image in bytes.
+    uint64_t rootRecord; ///< Offset of the root directory record.
+    uint64_t lsn; ///< The last journal record folded into the image.
+#ifdef _WIN32
+    void* fileHandle; ///< Handle of the open image file.
+    void* mappingHandle; ///< Handle of the file mapping object.
+#endif
+
+    /**
+     * @brief Maps an image file into memory and validates its header.
+     * @param path The path of the image file.
+     * @throws std::runtime_error if the file cannot be mapped or is not a valid image.
+     */
+    explicit FileSystemImage(const std::string& path);
+
+    /**
+     * @brief Releases the mapping and any handles held for it.
+     */
+    void unmap();
+
+    /**
+     * @brief Reads a 32-bit integer from the image.
+     * @param offset The offset to read at; advanced past the value.
+     * @return The value read.
+     * @throws std::runtime_error if the read runs past the end of the image.
+     */
+    uint32_t read32(uint64_t& offset) const;
+
+    /**
+     * @brief Reads a 64-bit integer from the image.
+     * @param offset The offset to read at; advanced past the value.
+     * @return The value read.
+     * @throws std::runtime_error if the read runs past the end of the image.
+     */
+    uint64_t read64(uint64_t& offset) const;
+
+    /**
+     * @brief Reads a length-prefixed name from the image.
+     * @param offset The offset to read at; advanced past the name.
+     * @return The name read.
+     * @throws std::runtime_error if the read runs past the end of the image.
+     */
+    std::string readName(uint64_t& offset) const;
+
+    /**
+     * @brief Checks that a range lies inside the image.
+     * @param offset The start of the range.
+     * @param size The size of the range.
+     * @throws std::runtime_error if the range runs past the end of the image.
+     */
+    void checkRange(uint64_t offset, uint64_t size) const;
+
+    /**
+     * @brief Attaches a directory record to a directory, to be loaded on first access.
+     * @details Sets the directory's subtree totals from the record.
+     * @param dir The directory to attach.
+     * @param record The offset of the directory record.
+     * @throws std::runtime_error if the record runs past the end of the image.
+     */
+    void attach(Directory& dir, uint64_t record);
+
+public:
+    static const uint32_t VERSION = 3; ///< The image format version written by save().
+
+    FileSystemImage(const FileSystemImage&) = delete;
+    FileSystemImage& operator=(const FileSystemImage&) = delete;
+
+    /**
+     * @brief Destructor for the FileSystemImage class; unmaps the image.
+     */
+    ~FileSystemImage();
+
+    /**
+     * @brief Maps an image file into memory.
+     * @param path The path of the image file.
+     * @return A shared handle to the mapped image.
+     * @throws std::runtime_error if the file cannot be mapped or is not a valid image.
+     */
+    static std::shared_ptr<FileSystemImage> open(const std::string& path);
+
+    /**
+     * @brief Writes a directory tree to an image file.
+     * @details The image is written to a temporary file that is then renamed over
+     * path, so an image that is currently mapped stays valid.
+     * @param root The root directory of the tree to write.
+     * @param path The path of the image file.
+     * @param lsn The last journal record reflected in the tree. Defaults to 0.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    static void save(const Directory& root, const std::string& path, uint64_t lsn = 0);
+
+    /**
+     * @brief Writes the tree a snapshot views, as it was when the snapshot was taken, to an image file.
+     * @details Writers carry on while the image is written.
+     * @param snapshot The snapshot.
+     * @param path The path of the image file.
+     * @param lsn The last journal record reflected in the snapshot.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    static void save(const Snapshot& snapshot, const std::string& path, uint64_t lsn);
+
+    /**
+     * @brief Attaches an image's root directory record to a directory.
+     * @details Any existing contents of the directory are discarded; the new
+     * contents are loaded lazily on first access.
+     * @param dir The directory to attach.
+     */
+    void attachRoot(Directory& dir);
+
+    /**
+     * @brief Loads a directory record into a directory.
+     * @details Files in the record are attached to their extents in the image and
+     * subdirectories are attached to their own records, to be loaded on first access.
+     * @param dir The directory to fill in.
+     * @param record The offset of the directory record.
+     */
+    void populate(Directory& dir, uint64_t record);
+
+    /**
+     * @brief Finds the first extent at or after a block index.
+     * @param extents The offset of the file's extent table.
+     * @param count The number of extents in the table.
+     * @param blockIndex The block index to search for.
+     * @return The position of the first extent whose block index is not less than blockIndex.
+     */
+    size_t findExtent(uint64_t extents, size_t count, size_t blockIndex) const;
+
+    /**
+     * @brief Gets the block index of an extent.
+     * @param extents The offset of the file's extent table.
+     * @param position The position of the extent in the table.
+     * @return The block index the extent covers.
+     */
+    size_t extentBlock(uint64_t extents, size_t position) const;
+
+    /**
+     * @brief Gets the data of an extent.
+     * @param extents The offset of the file's extent table.
+     * @param position The position of the extent in the table.
+     * @return A pointer to the block's BLOCK_SIZE bytes inside the mapping.
+     */
+    const char* extentData(uint64_t extents, size_t position) const;
+
+    /**
+     * @brief Gets the last journal record folded into the image.
+     * @return The checkpoint LSN stored in the header.
+     */
+    uint64_t checkpointLsn() const;
+
+    /**
+     * @brief Gets the size of the mapped image.
+     * @return The size of the image in bytes.
+     */
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include "IoRing.hpp"
+#include "FileDescriptor.hpp"
+#include "FileSystem.hpp"
+#include "Session.hpp"
+#include <stdexcept>
+
+/**
+ * @brief Constructor for the IoRing class; starts the workers.
+ * @param fileSystem The filesystem to run requests against; must outlive the ring.
+ * @param entries The submission ring size, rounded up to a power of two.
+ * @param workerCount The number of worker threads.
+ */
+IoRing::IoRing(FileSystem& fileSystem, size_t entries, size_t workerCount)
+    : fileSystem(fileSystem), submitHead(0), submitTail(0), completeHead(0), completeTail(0), stopping(false) {
+    size_t size = 1;
+    while (size < entries) {
+        size <<= 1;
+    }
+    mask = size - 1;
+    submissions.resize(size);
+    completions.resize(2 * size); // Room for a full submission ring's worth of completions, and then some
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < (workerCount ? workerCount : 1); ++i) {
+        workers.emplace_back(&IoRing::runWorker, this);
+    }
+}
+
+/**
+ * @brief Destructor for the IoRing class; runs what was submitted, then stops the workers.
+ * @details Completions that do not fit in the completion ring are dropped.
+ */
+IoRing::~IoRing() {
+    {
+        std::scoped_lock lock(submitMutex, completeMutex); // Workers read the flag under either lock
+        stopping = true;
+    }
+    submitReady.notify_all();
+    completeSpace.notify_all(); // Nobody may reap again, so let blocked workers drop their completions
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Body of each worker thread.
+ */
+void IoRing::runWorker() {
+    Session session(fileSystem);
+    std::unique_lock<std::mutex> lock(submitMutex);
+    while (true) {
+        submitReady.wait(lock, [this] { return stopping || submitHead != submitTail; });
+        if (submitHead == submitTail) {
+            return; // Stopping, and everything submitted has run
+        }
+        Submission submission = submissions[submitHead++ & mask]; // Copy out so the slot can be reused at once
+        lock.unlock();
+        IoCompletion completion = {submission.request.userData, execute(session, submission.request)};
+        if (submission.promise) {
+            submission.promise->set_value(completion);
+            delete submission.promise;
+        } else {
+            complete(completion);
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Runs one request.
+ * @param session The worker's session.
+ * @param request The request to run.
+ * @return The request's result.
+ */
+int64_t IoRing::execute(Session& session, const IoRequest& request) {
+    try {
+        switch (request.op) {
+            case IoOp::Read: {
+                FileDescriptor fd = fileSystem.openDescriptor(*request.file);
+                return static_cast<int64_t>(fd.pread(static_cast<char*>(request.buffer), request.length, request.offset));
+            }
+            case IoOp::Write: {
+                FileDescriptor fd = fileSystem.openDescriptor(*request.file);
+                return static_cast<int64_t>(fd.pwrite(static_cast<const char*>(request.buffer), request.length, request.offset));
+            }
+            case IoOp::CreateFile:
+                session.createFile(request.path);
+                return 0;
+            case IoOp::DeleteFile:
+                session.deleteFile(request.path);
+                return 0;
+            case IoOp::CreateDirectory:
+                session.createDirectory(request.path);
+                return 0;
+            case IoOp::DeleteDirectory:
+                session.deleteDirectory(request.path);
+                return 0;
+        }
+    } catch (const std::exception&) {
+        // Reported through the result; the caller still gets a completion
+    }
+    return -1;
+}
+
+/**
+ * @brief Posts a completion, waiting while the completion ring is full.
+ * @param completion The completion to post.
+ */
+void IoRing::complete(const IoCompletion& completion) {
+    std::unique_lock<std::mutex> lock(completeMutex);
+    completeSpace.wait(lock, [this] { return completeTail - completeHead < completions.size() || stopping; });
+    if (completeTail - completeHead == completions.size()) {
+        return; // Shutting down with nobody reaping
+    }
+    completions[completeTail++ % completions.size()] = completion;
+    completeReady.notify_all();
+}
+
+/**
+ * @brief Copies up to max completions out of the ring while holding its lock.
+ * @param out Where to copy the completions.
+ * @param max The most completions to copy.
+ * @return The number copied.
+ */
+size_t IoRing::reap(IoCompletion* out, size_t max) {
+    size_t count = 0;
+    while (count < max && completeHead != completeTail) {
+        out[count++] = completions[completeHead++ % completions.size()];
+    }
+    if (count) {
+        completeSpace.notify_all();
+    }
+    return count;
+}
+
+/**
+ * @brief Submits one request.
+ * @param request The request.
+ * @return false if the submission ring is full.
+ */
+bool IoRing::submit(const IoRequest& request) {
+    return submit(&request, 1) == 1;
+}
+
+/**
+ * @brief Submits a batch of requests under one lock.
+ * @param requests The requests.
+ * @param count The number of requests.
+ * @return The number submitted, from the front; fewer than count if the ring filled up.
+ */
+size_t IoRing::submit(const IoRequest* requests, size_t count) {
+    size_t submitted = 0;
+    {
+        std::lock_guard<std::mutex> lock(submitMutex);
+        while (submitted < count && submitTail - submitHead <= mask) {
+            submissions[submitTail++ & mask] = {requests[submitted++], nullptr};
+        }
+    }
+    if (submitted == 1) {
+        submitReady.notify_one();
+    } else if (submitted > 1) {
+        submitReady.notify_all(); // Wake every worker for a batch
+    }
+    return submitted;
+}
+
+/**
+ * @brief Submits one request whose result is delivered through a future.
+ * @details The future's shared state is allocated, unlike the rings; its
+ * completion does not go through the completion ring.
+ * @param request The request.
+ * @return A future for the request's completion.
+ * @throws std::runtime_error if the submission ring is full.
+ */
+std::future<IoCompletion> IoRing::submitAsync(const IoRequest& request) {
+    std::promise<IoCompletion>* promise = new std::promise<IoCompletion>();
+    std::future<IoCompletion> future = promise->get_future();
+    {
+        std::lock_guard<std::mutex> lock(submitMutex);
+        if (submitTail - submitHead > mask) {
+            delete promise;
+            throw std::runtime_error("Submission queue is full");
+        }
+        submissions[submitTail++ & mask] = {request, promise};
+    }
+    submitReady.notify_one();
+    return future;
+}
+
+/**
+ * @brief Collects completions without waiting.
+ * @param completions Where to copy the completions.
+ * @param max The most completions to collect.
+ * @return The number collected, possibly 0.
+ */
+size_t IoRing::poll(IoCompletion* completions, size_t max) {
+    std::lock_guard<std::mutex> lock(completeMutex);
+    return reap(completions, max);
+}
+
+/**
+ * @brief Collects completions, waiting until at least min are available.
+ * @param completions Where to copy the completions.
+ * @param max The most completions to collect.
+ * @param min The fewest completions to wait for; at most max.
+ * @return The number collected.
+ */
+size_t IoRing::wait(IoCompletion* completions, size_t max, size_t min) {
+    if (min > max) {
+        min = max;
+    }
+    std::unique_lock<std::mutex> lock(completeMutex);
+    completeReady.wait(lock, [this, min] { return completeTail - completeHead >= min; });
+    return reap(completions, max);
+}
@@ -0,0 +1,181 @@
+#ifndef IORING_HPP
+#define IORING_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class File;
+class FileSystem;
+class Session;
+
+/**
+ * @brief The kinds of request an IoRing runs.
+ */
+enum class IoOp : uint8_t {
+    Read, ///< Read length bytes of file at offset into buffer.
+    Write, ///< Write length bytes from buffer into file at offset.
+    CreateFile, ///< Create the file at path.
+    DeleteFile, ///< Delete the file at path.
+    CreateDirectory, ///< Create the directory at path.
+    DeleteDirectory ///< Delete the directory at path.
+};
+
+/**
+ * @brief One submission queue entry.
+ *
+ * The request only points at the caller's buffer and path; both must stay
+ * valid until the request completes.
+ */
+struct IoRequest {
+    IoOp op; ///< What to do.
+    File* file; ///< The file to read or write, for Read and Write.
+    void* buffer; ///< The bytes to read into or write from, for Read and Write.
+    size_t length; ///< The number of bytes, for Read and Write.
+    uint64_t offset; ///< The position in the file, for Read and Write.
+    const char* path; ///< The path, absolute or relative to the root, for the namespace operations.
+    uint64_t userData; ///< Copied into the completion so the caller can match it up.
+};
+
+/**
+ * @brief One completion queue entry.
+ */
+struct IoCompletion {
+    uint64_t userData; ///< The userData of the request.
+    int64_t result; ///< Bytes moved for Read and Write, 0 for the others, or -1 if the request failed.
+};
+
+/**
+ * @class IoRing
+ * @brief Runs filesystem requests on a pool of worker threads, io_uring style.
+ *
+ * Callers push IoRequests onto a fixed-size submission ring and collect
+ * IoCompletions from a fixed-size completion ring, by polling or by waiting.
+ * Both rings are allocated up front, so submitting and reaping do not
+ * allocate. Requests run in parallel and may complete in any order.
+ *
+ * Namespace requests go through one Session per worker, so relative paths
+ * are taken from the root. Writes through Write requests are not journaled.
+ */
+class IoRing {
+private:
+    /**
+     * @brief A submission ring slot.
+     */
+    struct Submission {
+        IoRequest request; ///< The request.
+        std::promise<IoCompletion>* promise; ///< Fulfilled instead of posting a completion, for submitAsync().
+    };
+
+    FileSystem& fileSystem; ///< The filesystem requests run against.
+    size_t mask; ///< Ring size minus one; ring sizes are powers of two.
+
+    std::vector<Submission> submissions; ///< The submission ring.
+    uint64_t submitHead; ///< Counter of the next submission to run.
+    uint64_t submitTail; ///< Counter of the next free submission slot.
+    std::mutex submitMutex; ///< Guards the submission ring.
+    std::condition_variable submitReady; ///< Signalled when requests are submitted or the ring stops.
+
+    std::vector<IoCompletion> completions; ///< The completion ring, twice the submission ring's size.
+    uint64_t completeHead; ///< Counter of the next completion to reap.
+    uint64_t completeTail; ///< Counter of the next free completion slot.
+    std::mutex completeMutex; ///< Guards the completion ring.
+    std::condition_variable completeReady; ///< Signalled when completions are posted.
+    std::condition_variable completeSpace; ///< Signalled when completions are reaped.
+
+    bool stopping; ///< Set to shut the workers down; written under both mutexes.
+    std::vector<std::thread> workers; ///< The worker threads.
+
+    /**
+     * @brief Body of each worker thread.
+     */
+    void runWorker();
+
+    /**
+     * @brief Runs one request.
+     * @param session The worker's session.
+     * @param request The request to run.
+     * @return The request's result.
+     */
+    int64_t execute(Session& session, const IoRequest& request);
+
+    /**
+     * @brief Posts a completion, waiting while the completion ring is full.
+     * @param completion The completion to post.
+     */
+    void complete(const IoCompletion& completion);
+
+    /**
+     * @brief Copies up to max completions out of the ring while holding its lock.
+     * @param out Where to copy the completions.
+     * @param max The most completions to copy.
+     * @return The number copied.
+     */
+    size_t reap(IoCompletion* out, size_t max);
+
+public:
+    /**
+     * @brief Constructor for the IoRing class; starts the workers.
+     * @param fileSystem The filesystem to run requests against; must outlive the ring.
+     * @param entries The submission ring size, rounded up to a power of two.
+     * @param workerCount The number of worker threads.
+     */
+    IoRing(FileSystem& fileSystem, size_t entries = 256, size_t workerCount = 4);
+
+    /**
+     * @brief Destructor for the IoRing class; runs what was submitted, then stops the workers.
+     * @details Completions that do not fit in the completion ring are dropped.
+     */
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    /**
+     * @brief Submits one request.
+     * @param request The request.
+     * @return false if the submission ring is full.
+     */
+    bool submit(const IoRequest& request);
+
+    /**
+     * @brief Submits a batch of requests under one lock.
+     * @param requests The requests.
+     * @param count The number of requests.
+     * @return The number submitted, from the front; fewer than count if the ring filled up.
+     */
+    size_t submit(const IoRequest* requests, size_t count);
+
+    /**
+     * @brief Submits one request whose result is delivered through a future.
+     * @details The future's shared state is allocated, unlike the rings; its
+     * completion does not go through the completion ring.
+     * @param request The request.
+     * @return A future for the request's completion.
+     * @throws std::runtime_error if the submission ring is full.
+     */
+    std::future<IoCompletion> submitAsync(const IoRequest& request);
+
+    /**
+     * @brief Collects completions without waiting.
+     * @param completions Where to copy the completions.
+     * @param max The most completions to collect.
+     * @return The number collected, possibly 0.
+     */
+    size_t poll(IoCompletion* completions, size_t max);
+
+    /**
+     * @brief Collects completions, waiting until at least min are available.
+     * @param completions Where to copy the completions.
+     * @param max The most completions to collect.
+     * @param min The fewest completions to wait for; at most max.
+     * @return The number collected.
+     */
+    size_t wait(IoCompletion* completions, size_t max, size_t min = 1);
+};
+
+#endif
@@ -0,0 +1,362 @@
+#include "Journal.hpp"
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const size_t FRAME_SIZE = 8; ///< Payload length and checksum.
+const size_t PAYLOAD_HEADER_SIZE = 8 + 1 + 4 + 8; ///< LSN, operation, path length and data length.
+
+/**
+ * @brief Computes the CRC-32 (IEEE) of a buffer.
+ * @param data The bytes to checksum.
+ * @param size The number of bytes.
+ * @return The checksum.
+ */
+uint32_t crc32(const char* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] { // Built once, on first use
+        std::array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+/**
+ * @brief Appends a little-endian integer to a buffer.
+ * @param out The buffer to append to.
+ * @param value The value to append.
+ * @param size The number of bytes to append.
+ */
+void put(std::vector<char>& out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+/**
+ * @brief Decodes a little-endian integer.
+ * @param bytes The bytes to decode.
+ * @param size The number of bytes in the integer.
+ * @return The decoded value.
+ */
+uint64_t get(const char* bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief Replays the intact records of one log file.
+ * @param path The path of the log file; a missing file has no records.
+ * @param afterLsn Records at or below this LSN are skipped.
+ * @param apply Called with each record to replay.
+ * @return The highest LSN seen in the file, or afterLsn.
+ */
+uint64_t replayFile(const std::string& path, uint64_t afterLsn, const std::function<void(const JournalRecord&)>& apply) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        return afterLsn;
+    }
+    uint64_t lastLsn = afterLsn;
+    std::vector<char> payload;
+    char frame[FRAME_SIZE];
+    while (std::fread(frame, 1, FRAME_SIZE, in) == FRAME_SIZE) {
+        uint64_t length = get(frame, 4);
+        if (length < PAYLOAD_HEADER_SIZE) {
+            break; // Corrupt frame, nothing after it can be trusted
+        }
+        payload.resize(length);
+        if (std::fread(payload.data(), 1, length, in) != length || crc32(payload.data(), length) != get(frame + 4, 4)) {
+            break; // Torn write at the tail of the log
+        }
+        JournalRecord record;
+        record.lsn = get(payload.data(), 8);
+        record.op = static_cast<JournalOp>(payload[8]);
+        uint64_t pathLength = get(payload.data() + 9, 4);
+        if (PAYLOAD_HEADER_SIZE + pathLength > length) {
+            break;
+        }
+        record.path.assign(payload.data() + 13, pathLength);
+        uint64_t dataLength = get(payload.data() + 13 + pathLength, 8);
+        if (PAYLOAD_HEADER_SIZE + pathLength + dataLength != length) {
+            break;
+        }
+        const char* data = payload.data() + PAYLOAD_HEADER_SIZE + pathLength;
+        record.data.assign(data, data + dataLength);
+        if (record.lsn > afterLsn) {
+            apply(record); // Only records newer than the base image
+        }
+        if (record.lsn > lastLsn) {
+            lastLsn = record.lsn;
+        }
+    }
+    std::fclose(in);
+    return lastLsn;
+}
+
+} // namespace
+
+/**
+ * @brief Opens a journal, truncating any existing log at path.
+ * @details Call replay() first if the existing log still has to be applied.
+ * @param path The path of the log file.
+ * @param lastLsn The LSN already covered by the base image; new records follow it.
+ * @throws std::runtime_error if the file cannot be opened.
+ */
+Journal::Journal(const std::string& path, uint64_t lastLsn)
+    : path(path), fd(-1), lastAppended(lastLsn), durableLsn(lastLsn), flushing(false), failed(false), fileBytes(0) {
+    std::remove((path + ".prev").c_str()); // Anything rotated out is covered by the base image
+    std::remove(path.c_str());
+    openFile();
+}
+
+/**
+ * @brief Destructor for the Journal class; flushes pending records and closes the log.
+ */
+Journal::~Journal() {
+    try {
+        std::unique_lock<std::mutex> lock(mutex);
+        flushAll(lock);
+    } catch (const std::exception&) {
+        // Nothing sensible to do while tearing down; unflushed records are lost
+    }
+    if (fd >= 0) {
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+}
+
+/**
+ * @brief Opens (creating if needed) the active log file for appending.
+ * @throws std::runtime_error if the file cannot be opened.
+ */
+void Journal::openFile() {
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, 0644);
+#else
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+#endif
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open journal: " + path);
+    }
+    fileBytes = 0;
+}
+
+/**
+ * @brief Writes and fsyncs a batch of encoded records.
+ * @param batch The encoded records.
+ * @throws std::runtime_error if the write or fsync fails.
+ */
+void Journal::writeBatch(const std::vector<char>& batch) {
+    size_t done = 0;
+    while (done < batch.size()) {
+#ifdef _WIN32
+        int written = _write(fd, batch.data() + done, static_cast<unsigned>(batch.size() - done));
+#else
+        ssize_t written = ::write(fd, batch.data() + done, batch.size() - done);
+#endif
+        if (written <= 0) {
+            throw std::runtime_error("Failed to write journal: " + path);
+        }
+        done += static_cast<size_t>(written);
+    }
+#ifdef _WIN32
+    bool synced = _commit(fd) == 0;
+#else
+    bool synced = fsync(fd) == 0;
+#endif
+    if (!synced) {
+        throw std::runtime_error("Failed to sync journal: " + path);
+    }
+}
+
+/**
+ * @brief Throws if an earlier flush failed.
+ * @throws std::runtime_error if the journal is marked failed.
+ */
+void Journal::checkFailed() const {
+    if (failed) {
+        throw std::runtime_error("Journal failed earlier and must be reopened: " + path);
+    }
+}
+
+/**
+ * @brief Flushes every pending record while holding the lock.
+ * @param lock The held journal lock; released while waiting for another flusher.
+ */
+void Journal::flushAll(std::unique_lock<std::mutex>& lock) {
+    flushed.wait(lock, [this] { return !flushing; }); // Let an in-flight flush finish first
+    checkFailed();
+    if (!pending.empty()) {
+        try {
+            writeBatch(pending);
+        } catch (...) {
+            failed = true;
+            flushed.notify_all();
+            throw;
+        }
+        pending.clear();
+    }
+    durableLsn = lastAppended;
+    flushed.notify_all(); // Wake committers whose records were in this batch
+}
+
+/**
+ * @brief Appends a record to the in-memory tail of the log.
+ * @param op The mutation to record.
+ * @param path The absolute path the mutation applies to.
+ * @param data The data written, or nullptr.
+ * @param size The number of bytes of data.
+ * @return The LSN assigned to the record; pass it to commit() to make it durable.
+ * @throws std::runtime_error if an earlier flush failed.
+ */
+uint64_t Journal::append(JournalOp op, const std::string& path, const char* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    checkFailed(); // Records after a torn one would never be replayed
+    uint64_t lsn = ++lastAppended;
+    size_t start = pending.size();
+    size_t payloadLength = PAYLOAD_HEADER_SIZE + path.size() + size;
+    pending.reserve(start + FRAME_SIZE + payloadLength);
+    put(pending, payloadLength, 4);
+    put(pending, 0, 4); // Checksum, filled in below
+    put(pending, lsn, 8);
+    pending.push_back(static_cast<char>(op));
+    put(pending, path.size(), 4);
+    pending.insert(pending.end(), path.begin(), path.end());
+    put(pending, size, 8);
+    if (size) {
+        pending.insert(pending.end(), data, data + size);
+    }
+    uint32_t checksum = crc32(pending.data() + start + FRAME_SIZE, payloadLength);
+    for (size_t i = 0; i < 4; ++i) {
+        pending[start + 4 + i] = static_cast<char>(checksum >> (8 * i));
+    }
+    fileBytes += FRAME_SIZE + payloadLength;
+    return lsn;
+}
+
+/**
+ * @brief Waits until a record and every record before it are durable.
+ * @param lsn The LSN returned by append().
+ * @throws std::runtime_error if the log cannot be written, now or by an earlier flush.
+ */
+void Journal::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (durableLsn < lsn) {
+        checkFailed(); // Our record went down with a failed batch, or would follow a torn one
+        if (flushing) {
+            flushed.wait(lock); // Someone else is flushing; our record may ride along with the next batch
+            continue;
+        }
+        flushing = true; // Become the leader for everything appended so far
+        std::vector<char> batch;
+        batch.swap(pending);
+        uint64_t target = lastAppended;
+        lock.unlock();
+        try {
+            writeBatch(batch); // One write and one fsync for the whole group
+        } catch (...) {
+            lock.lock();
+            flushing = false;
+            failed = true; // The batch is lost, and the log may end in a torn record
+            flushed.notify_all();
+            throw;
+        }
+        lock.lock();
+        flushing = false;
+        durableLsn = target;
+        flushed.notify_all();
+    }
+}
+
+/**
+ * @brief Flushes the log and moves it aside to start a new one.
+ * @details The old log is renamed to path + ".prev" and stays there until removeRotated().
+ * If an earlier rotated log is still there, no image covers it yet, so it is
+ * kept and the active log carries on unrotated.
+ * @throws std::runtime_error if the log cannot be flushed or renamed.
+ */
+void Journal::rotate() {
+    std::unique_lock<std::mutex> lock(mutex);
+    flushAll(lock);
+    std::string rotated = path + ".prev";
+    if (std::FILE* kept = std::fopen(rotated.c_str(), "rb")) {
+        std::fclose(kept);
+        return; // Left by a failed checkpoint; replaying it and then the active log still gives every record
+    }
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+    fd = -1;
+    if (std::rename(path.c_str(), rotated.c_str()) != 0) {
+        openFile(); // Keep logging to the old file rather than losing records
+        throw std::runtime_error("Cannot rotate journal: " + path);
+    }
+    openFile();
+}
+
+/**
+ * @brief Deletes the log moved aside by rotate().
+ */
+void Journal::removeRotated() {
+    std::remove((path + ".prev").c_str());
+}
+
+/**
+ * @brief Gets the LSN of the most recently appended record.
+ * @return The last LSN handed out.
+ */
+uint64_t Journal::lastLsn() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastAppended;
+}
+
+/**
+ * @brief Gets the size of the active log.
+ * @return The number of bytes in the log, including records not yet flushed.
+ */
+uint64_t Journal::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fileBytes;
+}
+
+/**
+ * @brief Reads back the records of a journal that have not reached the base image.
+ * @details Reads path + ".prev" and then path. Each file is read up to its first
+ * torn or corrupt record, which marks where a crash interrupted it.
+ * @param path The path of the log file.
+ * @param afterLsn Records at or below this LSN are already in the base image and skipped.
+ * @param apply Called with each record to replay, in LSN order.
+ * @return The highest LSN seen, or afterLsn if there was nothing to replay.
+ */
+uint64_t Journal::replay(const std::string& path, uint64_t afterLsn, const std::function<void(const JournalRecord&)>& apply) {
+    uint64_t lastLsn = replayFile(path + ".prev", afterLsn, apply);
+    uint64_t currentLsn = replayFile(path, lastLsn, apply); // The active log continues where the rotated one ended
+    return currentLsn > lastLsn ? currentLsn : lastLsn;
+}
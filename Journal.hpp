@@ -0,0 +1,168 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The kinds of namespace mutation recorded in the journal.
+ */
+enum class JournalOp : uint8_t {
+    CreateFile = 1, ///< Create an empty file at path.
+    DeleteFile = 2, ///< Delete the file at path.
+    WriteFile = 3, ///< Replace the contents of the file at path with data.
+    CreateDirectory = 4, ///< Create an empty directory at path.
+    DeleteDirectory = 5, ///< Delete the directory at path and everything under it.
+    CloneFile = 6, ///< Create a copy at path of the file whose path is data.
+    CloneDirectory = 7, ///< Create a copy at path of the directory tree whose path is data.
+    RenameFile = 8, ///< Move the file whose path is data to path.
+    RenameDirectory = 9 ///< Move the directory tree whose path is data to path.
+};
+
+/**
+ * @brief One decoded journal record.
+ */
+struct JournalRecord {
+    uint64_t lsn; ///< The log sequence number of the record.
+    JournalOp op; ///< The mutation recorded.
+    std::string path; ///< The absolute path of the node the mutation applies to.
+    std::vector<char> data; ///< The data written, for WriteFile records.
+};
+
+/**
+ * @class Journal
+ * @brief An append-only, checksummed log of filesystem mutations with group commit.
+ *
+ * Each record is framed as u32 payload length, u32 CRC-32 of the payload, then
+ * the payload: u64 LSN, u8 operation, u32 path length, path, u64 data length,
+ * data. append() only encodes into memory; commit() makes a record durable.
+ * Writers that commit while another writer's fsync is in flight are picked up
+ * by the next flush, so concurrent commits share one write and one fsync.
+ *
+ * A failed write or fsync may leave a torn record at the end of the log, which
+ * replay stops at. The journal is then marked failed: every commit of a record
+ * not yet durable throws, and so does every append, until it is reopened.
+ *
+ * A checkpoint rotates the log to path + ".prev" before writing the base image
+ * and deletes the rotated log once the image is safely in place. A rotated log
+ * left behind by a failed checkpoint is kept, and the active log is not rotated
+ * again until an image covers both.
+ */
+class Journal {
+private:
+    std::string path; ///< The path of the active log file.
+    int fd; ///< Descriptor of the active log file.
+    mutable std::mutex mutex; ///< Guards everything below.
+    std::condition_variable flushed; ///< Signalled whenever a flush completes.
+    std::vector<char> pending; ///< Encoded records not yet handed to the operating system.
+    uint64_t lastAppended; ///< LSN of the most recently appended record.
+    uint64_t durableLsn; ///< Every record up to this LSN has been fsynced.
+    bool flushing; ///< True while one writer is flushing on behalf of the others.
+    bool failed; ///< Set once a flush fails; nothing more may be logged after a possibly torn record.
+    uint64_t fileBytes; ///< Size of the active log including pending records.
+
+    /**
+     * @brief Opens (creating if needed) the active log file for appending.
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    void openFile();
+
+    /**
+     * @brief Writes and fsyncs a batch of encoded records.
+     * @param batch The encoded records.
+     * @throws std::runtime_error if the write or fsync fails.
+     */
+    void writeBatch(const std::vector<char>& batch);
+
+    /**
+     * @brief Throws if an earlier flush failed.
+     * @throws std::runtime_error if the journal is marked failed.
+     */
+    void checkFailed() const;
+
+    /**
+     * @brief Flushes every pending record while holding the lock.
+     * @param lock The held journal lock; released while waiting for another flusher.
+     */
+    void flushAll(std::unique_lock<std::mutex>& lock);
+
+public:
+    /**
+     * @brief Opens a journal, truncating any existing log at path.
+     * @details Call replay() first if the existing log still has to be applied.
+     * @param path The path of the log file.
+     * @param lastLsn The LSN already covered by the base image; new records follow it.
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    Journal(const std::string& path, uint64_t lastLsn);
+
+    /**
+     * @brief Destructor for the Journal class; flushes pending records and closes the log.
+     */
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /**
+     * @brief Appends a record to the in-memory tail of the log.
+     * @param op The mutation to record.
+     * @param path The absolute path the mutation applies to.
+     * @param data The data written, or nullptr.
+     * @param size The number of bytes of data.
+     * @return The LSN assigned to the record; pass it to commit() to make it durable.
+     * @throws std::runtime_error if an earlier flush failed.
+     */
+    uint64_t append(JournalOp op, const std::string& path, const char* data = nullptr, size_t size = 0);
+
+    /**
+     * @brief Waits until a record and every record before it are durable.
+     * @param lsn The LSN returned by append().
+     * @throws std::runtime_error if the log cannot be written, now or by an earlier flush.
+     */
+    void commit(uint64_t lsn);
+
+    /**
+     * @brief Flushes the log and moves it aside to start a new one.
+     * @details The old log is renamed to path + ".prev" and stays there until removeRotated().
+     * If an earlier rotated log is still there, no image covers it yet, so it is
+     * kept and the active log carries on unrotated.
+     * @throws std::runtime_error if the log cannot be flushed or renamed.
+     */
+    void rotate();
+
+    /**
+     * @brief Deletes the log moved aside by rotate().
+     */
+    void removeRotated();
+
+    /**
+     * @brief Gets the LSN of the most recently appended record.
+     * @return The last LSN handed out.
+     */
+    uint64_t lastLsn() const;
+
+    /**
+     * @brief Gets the size of the active log.
+     * @return The number of bytes in the log, including records not yet flushed.
+     */
+    uint64_t size() const;
+
+    /**
+     * @brief Reads back the records of a journal that have not reached the base image.
+     * @details Reads path + ".prev" and then path. Each file is read up to its first
+     * torn or corrupt record, which marks where a crash interrupted it.
+     * @param path The path of the log file.
+     * @param afterLsn Records at or below this LSN are already in the base image and skipped.
+     * @param apply Called with each record to replay, in LSN order.
+     * @return The highest LSN seen, or afterLsn if there was nothing to replay.
+     */
+    static uint64_t replay(const std::string& path, uint64_t afterLsn, const std::function<void(const JournalRecord&)>& apply);
+};
+
+#endif
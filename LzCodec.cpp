@@ -0,0 +1,184 @@
+#include "LzCodec.hpp"
+#include <cstdint>
+#include <cstring>
+
+const size_t LzCodec::MIN_MATCH;
+const size_t LzCodec::MAX_OFFSET;
+const size_t LzCodec::HASH_BITS;
+
+namespace {
+
+/**
+ * @brief Helper function to read four bytes at any alignment.
+ * @param p The bytes.
+ * @return The bytes as an integer.
+ */
+uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Helper function to write the extra bytes of a length that does not fit its nibble.
+ * @param out Where to write.
+ * @param length The length left over after the nibble's 15.
+ * @return Just past the bytes written.
+ */
+unsigned char* writeLength(unsigned char* out, size_t length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<unsigned char>(length);
+    return out;
+}
+
+/**
+ * @brief Helper function to read the extra bytes of a length whose nibble was 15.
+ * @param in Where to read; advanced past the bytes read.
+ * @param end The end of the input.
+ * @param length The length so far; the bytes read are added to it.
+ * @return false if the input ran out.
+ */
+bool readLength(const unsigned char*& in, const unsigned char* end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (in == end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+/**
+ * @brief Gets the largest compressed size of an input.
+ * @param length The size of the input in bytes.
+ * @return The size of buffer compress() may need.
+ */
+size_t LzCodec::bound(size_t length) {
+    return length + length / 255 + 16; // All literals, plus their length bytes and a token
+}
+
+/**
+ * @brief Compresses a buffer.
+ * @param input The bytes to compress.
+ * @param length The number of bytes to compress.
+ * @param output The buffer to compress into; must hold bound(length) bytes.
+ * @return The compressed size in bytes.
+ */
+size_t LzCodec::compress(const char* input, size_t length, char* output) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(input);
+    unsigned char* out = reinterpret_cast<unsigned char*>(output);
+    uint32_t table[size_t(1) << HASH_BITS];
+    std::memset(table, 0xFF, sizeof(table)); // Every slot empty
+
+    size_t anchor = 0; // Start of the literals not yet written
+    size_t position = 0;
+    while (position + MIN_MATCH <= length) {
+        uint32_t sequence = read32(in + position);
+        uint32_t& slot = table[(sequence * 2654435761u) >> (32 - HASH_BITS)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+        if (candidate == UINT32_MAX || position - candidate > MAX_OFFSET || read32(in + candidate) != sequence) {
+            ++position;
+            continue;
+        }
+        size_t match = MIN_MATCH;
+        while (position + match < length && in[candidate + match] == in[position + match]) {
+            ++match; // Overlapping matches are fine; they decode as runs
+        }
+
+        size_t literals = position - anchor;
+        unsigned char* token = out++;
+        *token = static_cast<unsigned char>((literals < 15 ? literals : 15) << 4);
+        if (literals >= 15) {
+            out = writeLength(out, literals - 15);
+        }
+        std::memcpy(out, in + anchor, literals);
+        out += literals;
+        size_t offset = position - candidate;
+        *out++ = static_cast<unsigned char>(offset);
+        *out++ = static_cast<unsigned char>(offset >> 8);
+        size_t extra = match - MIN_MATCH;
+        *token |= static_cast<unsigned char>(extra < 15 ? extra : 15);
+        if (extra >= 15) {
+            out = writeLength(out, extra - 15);
+        }
+        position += match;
+        anchor = position;
+    }
+
+    size_t literals = length - anchor; // The last sequence has literals only
+    *out++ = static_cast<unsigned char>((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+        out = writeLength(out, literals - 15);
+    }
+    if (literals) { // in may be null for empty data
+        std::memcpy(out, in + anchor, literals);
+    }
+    out += literals;
+    return out - reinterpret_cast<unsigned char*>(output);
+}
+
+/**
+ * @brief Decompresses a buffer produced by compress().
+ * @param input The compressed bytes.
+ * @param length The number of compressed bytes.
+ * @param output The buffer to decompress into.
+ * @param outputLength The size of the original data.
+ * @return true if the input decoded to exactly outputLength bytes; false if it is corrupt.
+ */
+bool LzCodec::decompress(const char* input, size_t length, char* output, size_t outputLength) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(input);
+    const unsigned char* end = in + length;
+    unsigned char* out = reinterpret_cast<unsigned char*>(output);
+    unsigned char* outEnd = out + outputLength;
+    while (in < end) {
+        unsigned char token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(in, end, literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(end - in) || literals > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        if (literals) { // out may be null for empty data
+            std::memcpy(out, in, literals);
+        }
+        in += literals;
+        out += literals;
+        if (in == end) {
+            break; // The last sequence
+        }
+
+        if (end - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+        size_t match = token & 15;
+        if (match == 15 && !readLength(in, end, match)) {
+            return false;
+        }
+        match += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(out - reinterpret_cast<unsigned char*>(output)) ||
+            match > static_cast<size_t>(outEnd - out)) {
+            return false;
+        }
+        const unsigned char* from = out - offset;
+        if (offset >= match) {
+            std::memcpy(out, from, match);
+            out += match;
+        } else {
+            for (size_t i = 0; i < match; ++i) {
+                *out++ = from[i]; // Overlapping copy repeats the last offset bytes
+            }
+        }
+    }
+    return out == outEnd;
+}
@@ -0,0 +1,52 @@
+#ifndef LZCODEC_HPP
+#define LZCODEC_HPP
+
+#include <cstddef>
+
+/**
+ * @class LzCodec
+ * @brief A small, fast LZ77-family codec used to compress cold file blocks.
+ *
+ * The format is a run of sequences, each a token byte (high nibble: literal
+ * count, low nibble: match length minus 4; 15 in either means more length
+ * bytes follow, each added until one is below 255), the literals, and then a
+ * two-byte little-endian match offset and the match length bytes. The last
+ * sequence carries literals only. Matches are found through a single-probe
+ * hash table, trading some ratio for speed, so compressing a block costs about
+ * as much as copying it a few times and decompressing it less.
+ */
+class LzCodec {
+private:
+    static const size_t MIN_MATCH = 4; ///< Shortest match worth encoding.
+    static const size_t MAX_OFFSET = 65535; ///< Furthest back a match may start.
+    static const size_t HASH_BITS = 12; ///< log2 of the number of hash table slots.
+
+public:
+    /**
+     * @brief Gets the largest compressed size of an input.
+     * @param length The size of the input in bytes.
+     * @return The size of buffer compress() may need.
+     */
+    static size_t bound(size_t length);
+
+    /**
+     * @brief Compresses a buffer.
+     * @param input The bytes to compress.
+     * @param length The number of bytes to compress.
+     * @param output The buffer to compress into; must hold bound(length) bytes.
+     * @return The compressed size in bytes.
+     */
+    static size_t compress(const char* input, size_t length, char* output);
+
+    /**
+     * @brief Decompresses a buffer produced by compress().
+     * @param input The compressed bytes.
+     * @param length The number of compressed bytes.
+     * @param output The buffer to decompress into.
+     * @param outputLength The size of the original data.
+     * @return true if the input decoded to exactly outputLength bytes; false if it is corrupt.
+     */
+    static bool decompress(const char* input, size_t length, char* output, size_t outputLength);
+};
+
+#endif
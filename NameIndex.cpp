@@ -0,0 +1,240 @@
+#include "NameIndex.hpp"
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+namespace {
+
+const size_t REBUILD_MINIMUM = 1024; ///< Dead slots tolerated before a rebuild is considered.
+
+/**
+ * @brief Packs three bytes into a trigram key.
+ * @param a The first byte.
+ * @param b The second byte.
+ * @param c The third byte.
+ * @return The key.
+ */
+uint32_t trigram(char a, char b, char c) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(a)) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(b)) << 8 | static_cast<unsigned char>(c);
+}
+
+/**
+ * @brief Collects the trigrams of some text, skipping any that span a wildcard.
+ * @param text The text, already padded with markers where it is anchored.
+ * @param wildcards Whether '*' and '?' are wildcards rather than literal bytes.
+ * @param keys Receives the keys, sorted and without duplicates.
+ */
+void trigrams(std::string_view text, bool wildcards, std::vector<uint32_t>& keys) {
+    for (size_t i = 0; i + 2 < text.size(); ++i) {
+        if (wildcards && (text.substr(i, 3).find_first_of("*?") != std::string_view::npos)) {
+            continue; // Only the bytes between wildcards are known
+        }
+        keys.push_back(trigram(text[i], text[i + 1], text[i + 2]));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+/**
+ * @brief Pads a name with two boundary markers at either end.
+ * @param name The name.
+ * @return The padded name.
+ */
+std::string padded(std::string_view name) {
+    std::string text(2, '\0'); // Names never hold NUL, so the markers match only at the ends
+    text.append(name);
+    text.append(2, '\0');
+    return text;
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for the NameIndex class; the index starts empty.
+ */
+NameIndex::NameIndex() : deadSlots(0) {}
+
+/**
+ * @brief Adds an entry's trigrams to the postings.
+ * @param id The entry's id.
+ */
+void NameIndex::post(uint32_t id) {
+    std::vector<uint32_t> keys;
+    trigrams(padded(slots[id].entry.name), false, keys);
+    for (uint32_t key : keys) {
+        postings[key].push_back(id);
+    }
+}
+
+/**
+ * @brief Drops dead slots, renumbers the live ones and rebuilds the postings.
+ */
+void NameIndex::rebuild() {
+    std::vector<Slot> live;
+    live.reserve(slots.size() - deadSlots);
+    for (const Slot& slot : slots) {
+        if (slot.live) {
+            live.push_back(slot);
+        }
+    }
+    slots.swap(live);
+    postings.clear();
+    for (uint32_t id = 0; id < slots.size(); ++id) {
+        const DirectoryEntry& entry = slots[id].entry;
+        ids[entry.file ? static_cast<const void*>(entry.file) : entry.directory] = id;
+        post(id);
+    }
+    deadSlots = 0;
+}
+
+/**
+ * @brief Adds a file or directory.
+ * @details The name is viewed, not copied; it must stay put until the entry is removed.
+ * @param entry The entry.
+ */
+void NameIndex::add(const DirectoryEntry& entry) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    const void* node = entry.file ? static_cast<const void*>(entry.file) : entry.directory;
+    if (ids.count(node)) {
+        return;
+    }
+    uint32_t id = static_cast<uint32_t>(slots.size()); // Ids are never reused, so postings hold no duplicates
+    slots.push_back({entry, true});
+    ids[node] = id;
+    post(id);
+}
+
+/**
+ * @brief Removes a file or directory; does nothing if it is not indexed.
+ * @param node The File or Directory.
+ */
+void NameIndex::remove(const void* node) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    auto it = ids.find(node);
+    if (it == ids.end()) {
+        return;
+    }
+    slots[it->second].live = false; // Its postings go stale and are skipped
+    ids.erase(it);
+    ++deadSlots;
+    if (deadSlots > REBUILD_MINIMUM && deadSlots > slots.size() / 2) {
+        rebuild(); // Amortized over the removals that made it necessary
+    }
+}
+
+/**
+ * @brief Removes every entry.
+ */
+void NameIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    slots.clear();
+    ids.clear();
+    postings.clear();
+    deadSlots = 0;
+}
+
+/**
+ * @brief Gets the number of entries indexed.
+ * @return The number of live entries.
+ */
+size_t NameIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return ids.size();
+}
+
+/**
+ * @brief Visits the live entries listed under the rarest of some trigrams that pass a test.
+ * @param keys The trigrams every match must contain; if empty, every entry is a candidate.
+ * @param matches Tests a candidate's name.
+ * @param visit Called for each entry that passes.
+ */
+void NameIndex::query(const std::vector<uint32_t>& keys, const std::function<bool(std::string_view)>& matches,
+                      const Visitor& visit) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const std::vector<uint32_t>* rarest = nullptr;
+    for (uint32_t key : keys) {
+        auto it = postings.find(key);
+        if (it == postings.end()) {
+            return; // No name holds this trigram, so nothing can match
+        }
+        if (!rarest || it->second.size() < rarest->size()) {
+            rarest = &it->second;
+        }
+    }
+    if (!rarest) {
+        for (const Slot& slot : slots) { // Nothing to narrow the search with
+            if (slot.live && matches(slot.entry.name)) {
+                visit(slot.entry);
+            }
+        }
+        return;
+    }
+    for (uint32_t id : *rarest) {
+        const Slot& slot = slots[id];
+        if (slot.live && matches(slot.entry.name)) { // The trigram alone does not make a match
+            visit(slot.entry);
+        }
+    }
+}
+
+/**
+ * @brief Visits every entry whose name matches a glob pattern.
+ * @details '*' matches any run of bytes and '?' any one byte; the pattern
+ * is matched against the whole name.
+ * @param pattern The pattern.
+ * @param visit Called for each match, in no particular order.
+ */
+void NameIndex::glob(std::string_view pattern, const Visitor& visit) const {
+    std::string anchored;
+    if (pattern.empty() || pattern.front() != '*') {
+        anchored.append(2, '\0'); // The match starts at the start of the name
+    }
+    anchored.append(pattern);
+    if (pattern.empty() || pattern.back() != '*') {
+        anchored.append(2, '\0'); // ...and ends at its end
+    }
+    std::vector<uint32_t> keys;
+    trigrams(anchored, true, keys);
+    query(keys, [pattern](std::string_view name) { return matchesGlob(name, pattern); }, visit);
+}
+
+/**
+ * @brief Visits every entry whose name contains some text.
+ * @param text The text.
+ * @param visit Called for each match, in no particular order.
+ */
+void NameIndex::search(std::string_view text, const Visitor& visit) const {
+    std::vector<uint32_t> keys;
+    trigrams(text, false, keys);
+    query(keys, [text](std::string_view name) { return name.find(text) != std::string_view::npos; }, visit);
+}
+
+/**
+ * @brief Determines if a name matches a glob pattern.
+ * @param name The name.
+ * @param pattern The pattern; '*' matches any run of bytes and '?' any one byte.
+ * @return true if the whole name matches.
+ */
+bool NameIndex::matchesGlob(std::string_view name, std::string_view pattern) {
+    size_t n = 0, p = 0;
+    size_t star = std::string_view::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++n;
+            ++p;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++; // Try matching nothing first
+            resume = n;
+        } else if (star != std::string_view::npos) {
+            p = star + 1; // Let the last '*' swallow one more byte
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
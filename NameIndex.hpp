@@ -0,0 +1,132 @@
+#ifndef NAMEINDEX_HPP
+#define NAMEINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Directory.hpp"
+
+/**
+ * @class NameIndex
+ * @brief A trigram index over the names of every file and directory in a tree.
+ *
+ * Each name is padded with two boundary markers at either end and split into
+ * overlapping three-byte trigrams; every trigram maps to the entries whose
+ * name contains it. A query takes the trigrams its pattern requires, visits
+ * only the entries under the rarest one and checks each against the pattern,
+ * so its cost follows the number of candidates rather than the size of the
+ * tree. The markers let an anchored glob such as "*.c" use the trigram "c" +
+ * end + end, which only names ending in "c" have. Patterns yielding no
+ * trigram (a lone "*", or text shorter than three bytes) scan every entry.
+ *
+ * Removing an entry only marks it dead; its postings are dropped when dead
+ * entries outnumber live ones and the index is rebuilt.
+ *
+ * Directories connected to the index keep it up to date themselves. The
+ * index locks internally and may be used from any thread.
+ */
+class NameIndex {
+public:
+    /**
+     * @brief Called for each entry a query matches, while the index is locked.
+     */
+    using Visitor = std::function<void(const DirectoryEntry& entry)>;
+
+private:
+    /**
+     * @brief One indexed entry.
+     */
+    struct Slot {
+        DirectoryEntry entry; ///< The file or directory, and a view of its name.
+        bool live; ///< false once removed; the slot is reclaimed by the next rebuild.
+    };
+
+    mutable std::shared_mutex mutex; ///< Guards everything below.
+    std::vector<Slot> slots; ///< The entries, by id.
+    std::unordered_map<const void*, uint32_t> ids; ///< Maps each live node to its id.
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings; ///< Maps each trigram to the ids of the names containing it.
+    size_t deadSlots; ///< Slots removed since the last rebuild.
+
+    /**
+     * @brief Adds an entry's trigrams to the postings.
+     * @param id The entry's id.
+     */
+    void post(uint32_t id);
+
+    /**
+     * @brief Drops dead slots, renumbers the live ones and rebuilds the postings.
+     */
+    void rebuild();
+
+    /**
+     * @brief Visits the live entries listed under the rarest of some trigrams that pass a test.
+     * @param keys The trigrams every match must contain; if empty, every entry is a candidate.
+     * @param matches Tests a candidate's name.
+     * @param visit Called for each entry that passes.
+     */
+    void query(const std::vector<uint32_t>& keys, const std::function<bool(std::string_view)>& matches,
+               const Visitor& visit) const;
+
+public:
+    /**
+     * @brief Constructor for the NameIndex class; the index starts empty.
+     */
+    NameIndex();
+
+    NameIndex(const NameIndex&) = delete;
+    NameIndex& operator=(const NameIndex&) = delete;
+
+    /**
+     * @brief Adds a file or directory.
+     * @details The name is viewed, not copied; it must stay put until the entry is removed.
+     * @param entry The entry.
+     */
+    void add(const DirectoryEntry& entry);
+
+    /**
+     * @brief Removes a file or directory; does nothing if it is not indexed.
+     * @param node The File or Directory.
+     */
+    void remove(const void* node);
+
+    /**
+     * @brief Removes every entry.
+     */
+    void clear();
+
+    /**
+     * @brief Gets the number of entries indexed.
+     * @return The number of live entries.
+     */
+    size_t size() const;
+
+    /**
+     * @brief Visits every entry whose name matches a glob pattern.
+     * @details '*' matches any run of bytes and '?' any one byte; the pattern
+     * is matched against the whole name.
+     * @param pattern The pattern.
+     * @param visit Called for each match, in no particular order.
+     */
+    void glob(std::string_view pattern, const Visitor& visit) const;
+
+    /**
+     * @brief Visits every entry whose name contains some text.
+     * @param text The text.
+     * @param visit Called for each match, in no particular order.
+     */
+    void search(std::string_view text, const Visitor& visit) const;
+
+    /**
+     * @brief Determines if a name matches a glob pattern.
+     * @param name The name.
+     * @param pattern The pattern; '*' matches any run of bytes and '?' any one byte.
+     * @return true if the whole name matches.
+     */
+    static bool matchesGlob(std::string_view name, std::string_view pattern);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef NODEPOOL_HPP
+#define NODEPOOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class NodePool
+ * @brief A slab allocator that hands out fixed-size slots for tree nodes.
+ *
+ * Nodes are constructed in place inside slabs of SLAB_SIZE slots, so a node
+ * never moves once created and building a tree costs one allocation per slab
+ * rather than one per node. Freed slots go on an intrusive free list and are
+ * reused by the next create(); slabs are only released with the pool itself.
+ * create() and destroy() may be called from any thread.
+ *
+ * @tparam T The node type stored in the pool.
+ */
+template <typename T>
+class NodePool {
+private:
+    /**
+     * @brief Storage for one node, or a link in the free list while unused.
+     */
+    union Slot {
+        Slot* next; ///< The next free slot when this slot is unused.
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage; ///< Raw storage for the node.
+    };
+
+    static const size_t SLAB_SIZE = 256; ///< Number of slots allocated at a time.
+
+    std::vector<std::unique_ptr<Slot[]>> slabs; ///< The slabs owned by the pool.
+    Slot* freeList; ///< The head of the free slot list.
+    size_t liveNodes; ///< Number of nodes currently constructed in the pool.
+    mutable std::mutex mutex; ///< Guards the slabs and the free list.
+
+    /**
+     * @brief Allocates a new slab and threads its slots onto the free list.
+     */
+    void grow() {
+        std::unique_ptr<Slot[]> slab(new Slot[SLAB_SIZE]);
+        for (size_t i = 0; i < SLAB_SIZE; ++i) {
+            slab[i].next = freeList; // Push each slot onto the free list
+            freeList = &slab[i];
+        }
+        slabs.push_back(std::move(slab));
+    }
+
+    /**
+     * @brief Puts an unused slot back on the free list.
+     * @param slot The slot to release.
+     */
+    void release(Slot* slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot->next = freeList; // Make the slot available for reuse
+        freeList = slot;
+        --liveNodes;
+    }
+
+public:
+    /**
+     * @brief Constructor for the NodePool class.
+     */
+    NodePool() : freeList(nullptr), liveNodes(0) {}
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    /**
+     * @brief Gets the process-wide pool for T.
+     * @details The pool is never destroyed, so nodes owned by static objects can still be released at exit.
+     * @return A reference to the shared pool.
+     */
+    static NodePool& instance() {
+        static NodePool* pool = new NodePool();
+        return *pool;
+    }
+
+    /**
+     * @brief Constructs a node in a free slot.
+     * @param args The arguments forwarded to T's constructor.
+     * @return A pointer to the new node, stable until it is destroyed.
+     */
+    template <typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!freeList) {
+                grow(); // Out of slots, allocate another slab
+            }
+            slot = freeList;
+            freeList = slot->next; // Unlink before the node overwrites the link
+            ++liveNodes;
+        }
+        try {
+            return new (&slot->storage) T(std::forward<Args>(args)...); // Constructed outside the lock
+        } catch (...) {
+            release(slot); // Give the slot back if construction fails
+            throw;
+        }
+    }
+
+    /**
+     * @brief Destroys a node and returns its slot to the free list.
+     * @param node The node to destroy; must have come from this pool.
+     */
+    void destroy(T* node) {
+        if (!node) {
+            return;
+        }
+        node->~T(); // May destroy child nodes, so runs outside the lock
+        release(reinterpret_cast<Slot*>(node));
+    }
+
+    /**
+     * @brief Gets the number of live nodes in the pool.
+     * @return The number of nodes created and not yet destroyed.
+     */
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return liveNodes;
+    }
+
+    /**
+     * @brief Gets the number of slots the pool has allocated.
+     * @return The total number of slots across all slabs.
+     */
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return slabs.size() * SLAB_SIZE;
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "OperationStats.hpp"
+
+namespace {
+
+/**
+ * @brief Gets the shard used by the calling thread.
+ * @param shards The number of shards.
+ * @return The index of the thread's shard, fixed for the thread's lifetime.
+ */
+size_t threadShard(size_t shards) {
+    static std::atomic<size_t> nextIndex(0);
+    thread_local size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed); // Spread threads round-robin
+    return index % shards;
+}
+
+/**
+ * @brief Gets the histogram bucket for a latency.
+ * @param nanos The latency in nanoseconds.
+ * @param buckets The number of buckets.
+ * @return The number of significant bits in nanos, capped at the last bucket.
+ */
+size_t bucketFor(uint64_t nanos, size_t buckets) {
+    size_t bucket = 0;
+    while (nanos) {
+        nanos >>= 1;
+        ++bucket;
+    }
+    return bucket < buckets ? bucket : buckets - 1;
+}
+
+} // namespace
+
+/**
+ * @brief Estimates a latency percentile from the histogram.
+ * @param fraction The percentile as a fraction, e.g. 0.99.
+ * @return The upper bound, in nanoseconds, of the bucket holding that percentile; 0 if nothing was recorded.
+ */
+uint64_t OperationStats::OpSnapshot::percentile(double fraction) const {
+    if (calls == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(fraction * calls);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return (uint64_t(1) << i) - 1; // Every latency in bucket i is below 2^i
+        }
+    }
+    return (uint64_t(1) << (BUCKETS - 1)) - 1;
+}
+
+/**
+ * @brief Constructor for the OperationStats class; recording starts off.
+ */
+OperationStats::OperationStats() : enabled(false) {}
+
+/**
+ * @brief Turns recording on or off.
+ * @param on true to record.
+ */
+void OperationStats::setEnabled(bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Determines if recording is on.
+ * @return true while recording.
+ */
+bool OperationStats::isEnabled() const {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Records one call.
+ * @param op The operation.
+ * @param nanos Its latency in nanoseconds.
+ * @param bytes The bytes it moved.
+ */
+void OperationStats::record(StatsOp op, uint64_t nanos, uint64_t bytes) {
+    OpCounters& counters = shards[threadShard(SHARDS)].ops[static_cast<size_t>(op)];
+    counters.calls.fetch_add(1, std::memory_order_relaxed); // Only this thread writes the shard, barring collisions
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+    counters.buckets[bucketFor(nanos, BUCKETS)].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Merges the counters of every shard.
+ * @return The merged counters.
+ */
+OperationStats::Snapshot OperationStats::snapshot() const {
+    Snapshot result = {};
+    for (const Shard& shard : shards) {
+        for (size_t op = 0; op < OPS; ++op) {
+            const OpCounters& counters = shard.ops[op];
+            OpSnapshot& merged = result.ops[op];
+            merged.calls += counters.calls.load(std::memory_order_relaxed);
+            merged.bytes += counters.bytes.load(std::memory_order_relaxed);
+            merged.totalNanos += counters.totalNanos.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                merged.buckets[i] += counters.buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Zeroes every counter.
+ */
+void OperationStats::reset() {
+    for (Shard& shard : shards) {
+        for (OpCounters& counters : shard.ops) {
+            counters.calls.store(0, std::memory_order_relaxed);
+            counters.bytes.store(0, std::memory_order_relaxed);
+            counters.totalNanos.store(0, std::memory_order_relaxed);
+            for (auto& bucket : counters.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Gets a printable name for an operation.
+ * @param op The operation.
+ * @return Its name, e.g. "create".
+ */
+const char* OperationStats::name(StatsOp op) {
+    switch (op) {
+        case StatsOp::Create:
+            return "create";
+        case StatsOp::Delete:
+            return "delete";
+        case StatsOp::Read:
+            return "read";
+        case StatsOp::Write:
+            return "write";
+        case StatsOp::Lookup:
+            return "lookup";
+        case StatsOp::ChangeDirectory:
+            return "chdir";
+        case StatsOp::Rename:
+            return "rename";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,195 @@
+#ifndef OPERATIONSTATS_HPP
+#define OPERATIONSTATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief The kinds of operation OperationStats keeps counters for.
+ */
+enum class StatsOp : size_t {
+    Create, ///< Creating a file or directory.
+    Delete, ///< Deleting a file or directory.
+    Read, ///< Reading a file.
+    Write, ///< Writing a file.
+    Lookup, ///< Resolving a directory path.
+    ChangeDirectory, ///< Changing a session's current directory.
+    Rename, ///< Renaming or moving a file or directory.
+    Count ///< Number of operation kinds; not an operation.
+};
+
+/**
+ * @class OperationStats
+ * @brief Call counts, bytes moved and latency histograms for each kind of operation.
+ *
+ * Latencies are bucketed by powers of two: bucket i counts calls that took
+ * between 2^(i-1) and 2^i nanoseconds. Each thread records into one of SHARDS
+ * separately padded shards with relaxed atomic adds, so recording costs two
+ * clock reads and a few uncontended increments. snapshot() merges the shards.
+ *
+ * Recording is off until setEnabled(true); while off, timers do not read the clock.
+ */
+class OperationStats {
+public:
+    static const size_t BUCKETS = 48; ///< Latency buckets; the last one also holds anything slower.
+    static const size_t OPS = static_cast<size_t>(StatsOp::Count); ///< Number of operation kinds.
+
+    /**
+     * @brief Merged counters for one kind of operation.
+     */
+    struct OpSnapshot {
+        uint64_t calls; ///< Number of calls recorded.
+        uint64_t bytes; ///< Bytes read or written by those calls.
+        uint64_t totalNanos; ///< Sum of their latencies.
+        std::array<uint64_t, BUCKETS> buckets; ///< Latency histogram.
+
+        /**
+         * @brief Estimates a latency percentile from the histogram.
+         * @param fraction The percentile as a fraction, e.g. 0.99.
+         * @return The upper bound, in nanoseconds, of the bucket holding that percentile; 0 if nothing was recorded.
+         */
+        uint64_t percentile(double fraction) const;
+    };
+
+    /**
+     * @brief Merged counters for every kind of operation.
+     */
+    struct Snapshot {
+        std::array<OpSnapshot, OPS> ops; ///< Indexed by StatsOp.
+
+        /**
+         * @brief Gets the counters for one kind of operation.
+         * @param op The kind of operation.
+         * @return Its merged counters.
+         */
+        const OpSnapshot& operator[](StatsOp op) const { return ops[static_cast<size_t>(op)]; }
+    };
+
+    /**
+     * @class Timer
+     * @brief Times one operation from construction to destruction.
+     */
+    class Timer {
+    private:
+        OperationStats* stats; ///< Where to record, or nullptr when recording is off.
+        StatsOp op; ///< The operation being timed.
+        uint64_t bytes; ///< Bytes moved by the operation.
+        std::chrono::steady_clock::time_point start; ///< When the operation began.
+
+    public:
+        /**
+         * @brief Starts timing an operation.
+         * @param stats The counters to record into.
+         * @param op The operation being timed.
+         */
+        Timer(OperationStats& stats, StatsOp op) : Timer(&stats, op) {}
+
+        /**
+         * @brief Starts timing an operation that may have nowhere to record.
+         * @param stats The counters to record into, or nullptr to record nothing.
+         * @param op The operation being timed.
+         */
+        Timer(OperationStats* stats, StatsOp op)
+            : stats(stats && stats->isEnabled() ? stats : nullptr), op(op), bytes(0) {
+            if (this->stats) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        /**
+         * @brief Records the operation's latency, including when it throws.
+         */
+        ~Timer() {
+            if (stats) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+                stats->record(op, static_cast<uint64_t>(elapsed.count()), bytes);
+            }
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        /**
+         * @brief Sets the number of bytes the operation moved.
+         * @param count The number of bytes.
+         */
+        void setBytes(uint64_t count) {
+            bytes = count;
+        }
+    };
+
+private:
+    static const size_t SHARDS = 16; ///< Number of per-thread shards.
+
+    /**
+     * @brief Counters for one kind of operation within a shard.
+     */
+    struct OpCounters {
+        std::atomic<uint64_t> calls{0}; ///< Number of calls recorded.
+        std::atomic<uint64_t> bytes{0}; ///< Bytes moved.
+        std::atomic<uint64_t> totalNanos{0}; ///< Sum of latencies.
+        std::atomic<uint64_t> buckets[BUCKETS] = {}; ///< Latency histogram.
+    };
+
+    /**
+     * @brief One thread's counters, padded to its own cache lines.
+     */
+    struct alignas(64) Shard {
+        OpCounters ops[OPS]; ///< Indexed by StatsOp.
+    };
+
+    Shard shards[SHARDS]; ///< The per-thread shards.
+    std::atomic<bool> enabled; ///< True while recording.
+
+public:
+    /**
+     * @brief Constructor for the OperationStats class; recording starts off.
+     */
+    OperationStats();
+
+    OperationStats(const OperationStats&) = delete;
+    OperationStats& operator=(const OperationStats&) = delete;
+
+    /**
+     * @brief Turns recording on or off.
+     * @param on true to record.
+     */
+    void setEnabled(bool on);
+
+    /**
+     * @brief Determines if recording is on.
+     * @return true while recording.
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Records one call.
+     * @param op The operation.
+     * @param nanos Its latency in nanoseconds.
+     * @param bytes The bytes it moved.
+     */
+    void record(StatsOp op, uint64_t nanos, uint64_t bytes);
+
+    /**
+     * @brief Merges the counters of every shard.
+     * @return The merged counters.
+     */
+    Snapshot snapshot() const;
+
+    /**
+     * @brief Zeroes every counter.
+     */
+    void reset();
+
+    /**
+     * @brief Gets a printable name for an operation.
+     * @param op The operation.
+     * @return Its name, e.g. "create".
+     */
+    static const char* name(StatsOp op);
+};
+
+#endif
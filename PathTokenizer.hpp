@@ -0,0 +1,48 @@
+#ifndef PATHTOKENIZER_HPP
+#define PATHTOKENIZER_HPP
+
+#include <cstring>
+#include <string_view>
+
+/**
+ * @class PathTokenizer
+ * @brief Splits a path into its components without allocating.
+ *
+ * Components are returned as views into the caller's string, which must
+ * outlive the tokenizer. Empty components (from leading, trailing or repeated
+ * slashes) and "." are skipped; ".." is returned so the caller can step up.
+ * Separators are found with memchr, which the C library vectorizes.
+ */
+class PathTokenizer {
+private:
+    const char* cursor; ///< Start of the text not yet tokenized.
+    const char* end; ///< One past the last character of the path.
+
+public:
+    /**
+     * @brief Constructor for the PathTokenizer class.
+     * @param path The path to split.
+     */
+    explicit PathTokenizer(std::string_view path) : cursor(path.data()), end(path.data() + path.size()) {}
+
+    /**
+     * @brief Gets the next component of the path.
+     * @param component Set to the component found.
+     * @return true if a component was found, false at the end of the path.
+     */
+    bool next(std::string_view& component) {
+        while (cursor < end) {
+            const char* slash = static_cast<const char*>(std::memchr(cursor, '/', end - cursor));
+            const char* stop = slash ? slash : end;
+            std::string_view part(cursor, stop - cursor);
+            cursor = slash ? slash + 1 : end;
+            if (!part.empty() && part != ".") { // Repeated slashes and "." name nothing new
+                component = part;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
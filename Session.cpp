@@ -0,0 +1,809 @@
+#include "Session.hpp"
+#include "FileSystem.hpp"
+#include "BlockPool.hpp"
+#include "NodePool.hpp"
+#include "WorkStealingPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+const size_t FILES_PER_TASK = 4096; ///< Files a walk visits per task; wider directories are split.
+
+/**
+ * @brief Running totals shared by the tasks of one diskUsage().
+ */
+struct UsageCounters {
+    std::atomic<uint64_t> files{0}; ///< See TreeUsage.
+    std::atomic<uint64_t> directories{0}; ///< See TreeUsage.
+    std::atomic<uint64_t> bytes{0}; ///< See TreeUsage.
+    std::atomic<uint64_t> allocatedBytes{0}; ///< See TreeUsage.
+};
+
+/**
+ * @brief Helper function to visit a range of a directory's files.
+ * @param dir The directory.
+ * @param path The directory's absolute path, without a trailing slash.
+ * @param begin The first file to visit.
+ * @param end One past the last file; clamped to the files still there.
+ * @param visit The visitor.
+ */
+void walkFiles(Directory& dir, const std::string& path, size_t begin, size_t end, const TreeVisitor& visit) {
+    std::shared_lock<std::shared_mutex> lock(dir.getMutex());
+    const std::vector<File*>& files = dir.getFiles();
+    for (size_t i = begin; i < end && i < files.size(); ++i) {
+        std::shared_lock<std::shared_mutex> fileLock(files[i]->getMutex());
+        visit(path + "/" + files[i]->getName(), files[i]);
+    }
+}
+
+/**
+ * @brief Helper function to walk a subtree, spawning a task per subdirectory and per slice of a wide directory.
+ * @param pool The pool running the walk.
+ * @param dir The directory.
+ * @param path The directory's absolute path, without a trailing slash.
+ * @param visit The visitor.
+ */
+void walkTree(WorkStealingPool& pool, Directory& dir, const std::string& path, const TreeVisitor& visit) {
+    size_t fileCount;
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex());
+        fileCount = dir.getFiles().size();
+        subdirectories = dir.getSubdirectories();
+    }
+    for (size_t begin = FILES_PER_TASK; begin < fileCount; begin += FILES_PER_TASK) {
+        pool.spawn([&pool, &dir, path, begin, &visit] { walkFiles(dir, path, begin, begin + FILES_PER_TASK, visit); });
+    }
+    for (Directory* subdir : subdirectories) { // Safe unlocked: directories go only under the exclusive namespace lock
+        std::string subpath = path + "/" + subdir->getName();
+        visit(subpath, nullptr);
+        pool.spawn([&pool, subdir, subpath, &visit] { walkTree(pool, *subdir, subpath, visit); });
+    }
+    walkFiles(dir, path, 0, FILES_PER_TASK, visit); // The first slice ourselves, while thieves take the rest
+}
+
+/**
+ * @brief Helper function to total a range of a directory's files.
+ * @param dir The directory.
+ * @param begin The first file.
+ * @param end One past the last file; clamped to the files still there.
+ * @param totals The totals to add to.
+ */
+void measureFiles(Directory& dir, size_t begin, size_t end, UsageCounters& totals) {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t allocated = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex());
+        const std::vector<File*>& entries = dir.getFiles();
+        for (size_t i = begin; i < end && i < entries.size(); ++i) {
+            std::shared_lock<std::shared_mutex> fileLock(entries[i]->getMutex());
+            ++files;
+            bytes += entries[i]->size();
+            allocated += entries[i]->blockCount() * BlockPool::BLOCK_SIZE;
+        }
+    }
+    totals.files.fetch_add(files, std::memory_order_relaxed); // Once per slice, not per file
+    totals.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    totals.allocatedBytes.fetch_add(allocated, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Helper function to total a subtree, spawning a task per subdirectory and per slice of a wide directory.
+ * @param pool The pool running the walk.
+ * @param dir The directory.
+ * @param totals The totals to add to.
+ */
+void measureTree(WorkStealingPool& pool, Directory& dir, UsageCounters& totals) {
+    size_t fileCount;
+    std::vector<Directory*> subdirectories;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir.getMutex());
+        fileCount = dir.getFiles().size();
+        subdirectories = dir.getSubdirectories();
+    }
+    for (size_t begin = FILES_PER_TASK; begin < fileCount; begin += FILES_PER_TASK) {
+        pool.spawn([&dir, begin, &totals] { measureFiles(dir, begin, begin + FILES_PER_TASK, totals); });
+    }
+    totals.directories.fetch_add(subdirectories.size(), std::memory_order_relaxed);
+    for (Directory* subdir : subdirectories) {
+        pool.spawn([&pool, subdir, &totals] { measureTree(pool, *subdir, totals); });
+    }
+    measureFiles(dir, 0, FILES_PER_TASK, totals);
+}
+
+/**
+ * @brief Helper function to lock a subtree's directories and files shared, each directory before its entries.
+ * @details Nothing in the subtree can change until the locks are released.
+ * @param dir The root of the subtree.
+ * @param locks Receives the locks; they must be released by the same thread.
+ */
+void lockTree(Directory& dir, std::vector<std::shared_lock<std::shared_mutex>>& locks) {
+    locks.emplace_back(dir.getMutex());
+    for (File* file : dir.getFiles()) {
+        locks.emplace_back(file->getMutex()); // Descriptors write without their directory's lock
+    }
+    for (Directory* subdir : dir.getSubdirectories()) {
+        lockTree(*subdir, locks);
+    }
+}
+
+/**
+ * @brief Helper function to copy a subtree, spawning a task per subdirectory.
+ * @details The caller holds the source subtree locked with lockTree(), and the
+ * copy is detached, so nothing needs locking here.
+ * @param pool The pool running the copy.
+ * @param from The directory to copy.
+ * @param to The empty directory to copy into.
+ */
+void copyTree(WorkStealingPool& pool, const Directory& from, Directory& to) {
+    const std::vector<File*>& files = from.getFiles();
+    const std::vector<Directory*>& subdirectories = from.getSubdirectories();
+    to.reserve(files.size(), subdirectories.size());
+    for (const File* file : files) {
+        to.addFile(*file); // Shares the blocks
+    }
+    for (const Directory* subdir : subdirectories) {
+        Directory* copy = to.createDirectory(subdir->getName());
+        pool.spawn([&pool, subdir, copy] { copyTree(pool, *subdir, *copy); });
+    }
+}
+
+/**
+ * @brief Helper function to free a detached subtree, spawning a task per subdirectory.
+ * @param pool The pool running the teardown.
+ * @param dir The root of the subtree; no longer reachable from the tree.
+ */
+void destroyTree(WorkStealingPool& pool, Directory* dir) {
+    for (Directory* subdir : dir->releaseSubdirectories()) {
+        pool.spawn([&pool, subdir] { destroyTree(pool, subdir); });
+    }
+    NodePool<Directory>::instance().destroy(dir); // Frees the files; the subdirectories are freed by their own tasks
+}
+
+} // namespace
+
+/**
+ * @brief Opens a session on a filesystem, starting at its root.
+ * @param fileSystem The filesystem to work on; must outlive the session.
+ */
+Session::Session(FileSystem& fileSystem) : fileSystem(fileSystem), currentDirectory(&fileSystem.rootDirectory) {
+    std::lock_guard<std::mutex> lock(fileSystem.sessionsMutex);
+    fileSystem.sessions.insert(this); // Registered so deleteDirectory() and load() can see our directory
+}
+
+/**
+ * @brief Closes the session.
+ */
+Session::~Session() {
+    std::lock_guard<std::mutex> lock(fileSystem.sessionsMutex);
+    fileSystem.sessions.erase(this);
+}
+
+/**
+ * @brief Creates a file.
+ * @param filename The path of the file to create, absolute or relative to the current directory.
+ */
+void Session::createFile(const std::string& filename) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Create);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::string_view name;
+    Directory* parent = fileSystem.resolveParent(*currentDirectory, filename, name);
+    uint64_t lsn;
+    {
+        std::unique_lock<std::shared_mutex> lock(parent->getMutex());
+        parent->createFile(std::string(name)); // Add a new file to the directory
+        lsn = fileSystem.logMutation(JournalOp::CreateFile, parent, name);
+    }
+    fileSystem.commitMutation(lsn);
+}
+
+/**
+ * @brief Deletes a file.
+ * @param filename The path of the file to delete, absolute or relative to the current directory.
+ */
+void Session::deleteFile(const std::string& filename) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Delete);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::string_view name;
+    Directory* parent = fileSystem.resolveParent(*currentDirectory, filename, name);
+    uint64_t lsn;
+    {
+        std::unique_lock<std::shared_mutex> lock(parent->getMutex());
+        if (File* file = parent->findFile(name)) {
+            std::unique_lock<std::shared_mutex> fileLock(file->getMutex()); // Wait for anyone still reading or writing it
+        }
+        parent->removeFile(name); // Remove the file from the directory
+        lsn = fileSystem.logMutation(JournalOp::DeleteFile, parent, name);
+    }
+    fileSystem.commitMutation(lsn);
+}
+
+/**
+ * @brief Reads data from a file.
+ * @param filename The path of the file to read, absolute or relative to the current directory.
+ * @return A vector of characters containing the file data.
+ * @throws std::runtime_error if the file is not found.
+ */
+std::vector<char> Session::readFile(const std::string& filename) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Read);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::string_view name;
+    Directory* parent = fileSystem.resolveParent(*currentDirectory, filename, name);
+    File* file;
+    std::shared_lock<std::shared_mutex> fileLock;
+    {
+        std::shared_lock<std::shared_mutex> lock(parent->getMutex());
+        file = parent->findFile(name); // Find the file in its directory
+        if (!file) {
+            throw std::runtime_error("File not found: " + filename); // File not found
+        }
+        fileLock = std::shared_lock<std::shared_mutex>(file->getMutex()); // Taken before the directory is released, so the file cannot be deleted under us
+    }
+    std::vector<char> data = file->read();
+    timer.setBytes(data.size());
+    return data; // Return the file data
+}
+
+/**
+ * @brief Writes data to a file.
+ * @param filename The path of the file to write to, absolute or relative to the current directory.
+ * @param data The data to write to the file.
+ * @throws std::runtime_error if the file is not found.
+ */
+void Session::writeFile(const std::string& filename, const std::vector<char>& data) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Write);
+    timer.setBytes(data.size());
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::string_view name;
+    Directory* parent = fileSystem.resolveParent(*currentDirectory, filename, name);
+    File* file;
+    std::unique_lock<std::shared_mutex> fileLock;
+    {
+        std::shared_lock<std::shared_mutex> lock(parent->getMutex());
+        file = parent->findFile(name); // Find the file in its directory
+        if (!file) {
+            throw std::runtime_error("File not found: " + filename); // File not found
+        }
+        fileLock = std::unique_lock<std::shared_mutex>(file->getMutex());
+    }
+    file->write(data); // Write the data to the file
+    uint64_t lsn = fileSystem.logMutation(JournalOp::WriteFile, parent, name, &data);
+    fileLock.unlock();
+    fileSystem.commitMutation(lsn);
+}
+
+/**
+ * @brief Creates a directory.
+ * @param dirname The path of the directory to create, absolute or relative to the current directory.
+ */
+void Session::createDirectory(const std::string& dirname) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Create);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::string_view name;
+    Directory* parent = fileSystem.resolveParent(*currentDirectory, dirname, name);
+    uint64_t lsn;
+    {
+        std::unique_lock<std::shared_mutex> lock(parent->getMutex());
+        parent->createDirectory(std::string(name)); // Add a new directory under its parent
+        lsn = fileSystem.logMutation(JournalOp::CreateDirectory, parent, name);
+    }
+    fileSystem.commitMutation(lsn);
+}
+
+/**
+ * @brief Deletes a directory.
+ * @details Takes the namespace lock exclusively, since the subtree removed may be
+ * in use by any other session.
+ * @param dirname The path of the directory to delete, absolute or relative to the current directory.
+ * @throws std::runtime_error if another session's current directory is inside it.
+ */
+void Session::deleteDirectory(const std::string& dirname) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Delete);
+    uint64_t lsn;
+    Directory* removed;
+    {
+        std::unique_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+        std::string_view name;
+        Directory* parent = fileSystem.resolveParent(*currentDirectory, dirname, name);
+        Directory* target = parent->findDirectory(name);
+        if (target && fileSystem.isInUse(target)) {
+            throw std::runtime_error("Directory is in use: " + dirname);
+        }
+        if (target) {
+            fileSystem.dentryCache.invalidate(fileSystem.absolutePath(parent, name)); // Before the nodes are freed
+        }
+        removed = parent->detachDirectory(name); // Remove the directory from its parent
+        if (removed && fileSystem.snapshots.isActive()) {
+            fileSystem.snapshots.retire(removed); // Kept, subtree and all, while an open snapshot can still reach it
+            removed = nullptr;
+        }
+        lsn = fileSystem.logMutation(JournalOp::DeleteDirectory, parent, name);
+    }
+    if (removed) { // Unreachable now, so freed without holding any lock
+        WorkStealingPool& pool = fileSystem.treePool();
+        pool.run([&pool, removed] { destroyTree(pool, removed); });
+    }
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    fileSystem.commitMutation(lsn); // Other sessions may carry on while we wait for the fsync
+}
+
+/**
+ * @brief Visits every file and directory below a directory, subtrees in parallel.
+ * @details Runs on the filesystem's WorkStealingPool, so the visitor is called
+ * concurrently and in no particular order. Directories cannot be deleted while
+ * the walk runs; entries created or deleted in them meanwhile may or may not be seen.
+ * @param dirname The path of the directory to walk, absolute or relative to the current directory.
+ * @param visit Called for each entry below the directory.
+ * @throws std::runtime_error if the directory is not found, or whatever the visitor throws.
+ */
+void Session::walk(const std::string& dirname, const TreeVisitor& visit) {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock); // Holds every directory in place
+    Directory* dir = fileSystem.resolveDirectory(*currentDirectory, dirname);
+    std::string path;
+    if (dir != &fileSystem.rootDirectory) {
+        path = fileSystem.absolutePath(dir->getParentDirectory(), dir->getName());
+    }
+    WorkStealingPool& pool = fileSystem.treePool();
+    pool.run([&pool, dir, &path, &visit] { walkTree(pool, *dir, path, visit); });
+}
+
+/**
+ * @brief Totals the files, directories and bytes below a directory, subtrees in parallel.
+ * @param dirname The path of the directory, absolute or relative to the current directory.
+ * @return The totals.
+ * @throws std::runtime_error if the directory is not found.
+ */
+TreeUsage Session::diskUsage(const std::string& dirname) {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    Directory* dir = fileSystem.resolveDirectory(*currentDirectory, dirname);
+    UsageCounters totals;
+    WorkStealingPool& pool = fileSystem.treePool();
+    pool.run([&pool, dir, &totals] { measureTree(pool, *dir, totals); });
+    return {totals.files.load(), totals.directories.load(), totals.bytes.load(), totals.allocatedBytes.load()};
+}
+
+/**
+ * @brief Gets the bytes, files and directories below a directory in O(1), from its running totals.
+ * @param dirname The path of the directory, absolute or relative to the current directory.
+ * @return The totals.
+ * @throws std::runtime_error if the directory is not found.
+ */
+SubtreeUsage Session::usage(const std::string& dirname) {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    return fileSystem.resolveDirectory(*currentDirectory, dirname)->getUsage();
+}
+
+/**
+ * @brief Finds every file and directory in the tree whose name matches a glob pattern.
+ * @details Served by the filesystem's NameIndex when enabled, or else by a
+ * parallel walk of the whole tree.
+ * @param pattern The pattern; '*' matches any run of characters and '?' any one character.
+ * @return The matches, sorted by path.
+ */
+std::vector<NameMatch> Session::glob(const std::string& pattern) {
+    return findNames(pattern, true);
+}
+
+/**
+ * @brief Finds every file and directory in the tree whose name contains some text.
+ * @details Served by the filesystem's NameIndex when enabled, or else by a
+ * parallel walk of the whole tree.
+ * @param text The text.
+ * @return The matches, sorted by path.
+ */
+std::vector<NameMatch> Session::search(const std::string& text) {
+    return findNames(text, false);
+}
+
+/**
+ * @brief Finds every file and directory in the tree whose name matches a glob pattern or contains some text.
+ * @param pattern The glob pattern or the text.
+ * @param isGlob true to match pattern as a glob, false to look for it as text.
+ * @return The matches, sorted by path.
+ */
+std::vector<NameMatch> Session::findNames(const std::string& pattern, bool isGlob) {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock); // Holds every directory, and its name, in place
+    std::vector<NameMatch> matches;
+    if (const NameIndex* index = fileSystem.nameIndex.get()) {
+        NameIndex::Visitor collect = [this, &matches](const DirectoryEntry& entry) {
+            // Called with the index locked, so a file cannot be removed before its path is built
+            const Directory* parent = entry.file ? entry.file->getParentDirectory() : entry.directory->getParentDirectory();
+            matches.push_back({fileSystem.absolutePath(parent, entry.name), entry.directory != nullptr});
+        };
+        if (isGlob) {
+            index->glob(pattern, collect);
+        } else {
+            index->search(pattern, collect);
+        }
+    } else {
+        std::mutex mutex;
+        TreeVisitor collect = [&](const std::string& path, const File* file) {
+            std::string_view name = std::string_view(path).substr(path.rfind('/') + 1);
+            if (isGlob ? NameIndex::matchesGlob(name, pattern) : name.find(pattern) != std::string_view::npos) {
+                std::lock_guard<std::mutex> lock(mutex); // Called from the pool's threads
+                matches.push_back({path, file == nullptr});
+            }
+        };
+        WorkStealingPool& pool = fileSystem.treePool();
+        Directory* root = &fileSystem.rootDirectory;
+        pool.run([&pool, root, &collect] { walkTree(pool, *root, std::string(), collect); });
+    }
+    std::sort(matches.begin(), matches.end(), [](const NameMatch& a, const NameMatch& b) { return a.path < b.path; });
+    return matches;
+}
+
+/**
+ * @brief Copies a file; the copy shares its blocks until either file is written.
+ * @details Locks the two directories, in a fixed order, under the shared namespace lock.
+ * @param source The path of the file to copy.
+ * @param destination The path of the copy.
+ * @throws std::runtime_error if the source is not found or the destination already exists.
+ */
+void Session::cloneFile(const std::string& source, const std::string& destination) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Create);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    uint64_t lsn;
+    {
+        std::shared_lock<std::shared_mutex> cloneLock(fileSystem.cloneLock); // Directory clones lock out of order
+        std::string_view sourceName;
+        Directory* sourceParent = fileSystem.resolveParent(*currentDirectory, source, sourceName);
+        std::string_view name;
+        Directory* parent = fileSystem.resolveParent(*currentDirectory, destination, name);
+        std::unique_lock<std::shared_mutex> lock;
+        std::shared_lock<std::shared_mutex> sourceLock;
+        if (sourceParent == parent) {
+            lock = std::unique_lock<std::shared_mutex>(parent->getMutex());
+        } else if (std::less<Directory*>()(sourceParent, parent)) { // Lowest address first, so two clones never wait on each other
+            sourceLock = std::shared_lock<std::shared_mutex>(sourceParent->getMutex());
+            lock = std::unique_lock<std::shared_mutex>(parent->getMutex());
+        } else {
+            lock = std::unique_lock<std::shared_mutex>(parent->getMutex());
+            sourceLock = std::shared_lock<std::shared_mutex>(sourceParent->getMutex());
+        }
+        File* file = sourceParent->findFile(sourceName);
+        if (!file) {
+            throw std::runtime_error("File not found: " + source);
+        }
+        if (parent->findFile(name)) {
+            throw std::runtime_error("File already exists: " + destination);
+        }
+        std::shared_lock<std::shared_mutex> fileLock(file->getMutex()); // Held until logged, so the journal replays the same contents
+        parent->cloneFile(*file, std::string(name));
+        std::string sourcePath = fileSystem.absolutePath(sourceParent, sourceName);
+        std::vector<char> data(sourcePath.begin(), sourcePath.end());
+        lsn = fileSystem.logMutation(JournalOp::CloneFile, parent, name, &data);
+    }
+    fileSystem.commitMutation(lsn); // Other sessions may carry on while we wait for the fsync
+}
+
+/**
+ * @brief Copies a directory tree; files in the copy share their blocks until written.
+ * @details The copy is made detached, under the shared namespace lock and shared
+ * locks on the source subtree, then linked into the destination directory under
+ * its own lock. The source stays locked until the copy is logged, so the journal
+ * replays the same copy.
+ * @param source The path of the directory to copy.
+ * @param destination The path of the copy.
+ * @throws std::runtime_error if the source is not found, the destination already
+ * exists, or the destination lies inside the source.
+ */
+void Session::cloneDirectory(const std::string& source, const std::string& destination) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Create);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    uint64_t lsn;
+    {
+        std::unique_lock<std::shared_mutex> cloneLock(fileSystem.cloneLock); // Locks a whole subtree, then the destination
+        Directory* dir = fileSystem.resolveDirectory(*currentDirectory, source);
+        std::string_view name;
+        Directory* parent = fileSystem.resolveParent(*currentDirectory, destination, name);
+        for (Directory* ancestor = parent; ancestor; ancestor = ancestor->getParentDirectory()) {
+            if (ancestor == dir) { // The copy would keep growing as it is made
+                throw std::runtime_error("Cannot clone a directory into itself: " + destination);
+            }
+        }
+        {
+            std::shared_lock<std::shared_mutex> lock(parent->getMutex());
+            if (parent->findDirectory(name)) { // Checked again when linking; this saves a wasted copy
+                throw std::runtime_error("Directory already exists: " + destination);
+            }
+        }
+        std::vector<std::shared_lock<std::shared_mutex>> sourceLocks;
+        lockTree(*dir, sourceLocks);
+        Directory* copy = parent->createDetachedDirectory(std::string(name));
+        try {
+            WorkStealingPool& pool = fileSystem.treePool();
+            pool.run([&pool, dir, copy] { copyTree(pool, *dir, *copy); });
+        } catch (...) {
+            NodePool<Directory>::instance().destroy(copy);
+            throw;
+        }
+        std::unique_lock<std::shared_mutex> lock(parent->getMutex());
+        if (!parent->attachDirectory(copy)) { // Created while we copied
+            NodePool<Directory>::instance().destroy(copy);
+            throw std::runtime_error("Directory already exists: " + destination);
+        }
+        std::string sourcePath = fileSystem.absolutePath(dir->getParentDirectory(), dir->getName()); // Never the root, which holds every destination
+        std::vector<char> data(sourcePath.begin(), sourcePath.end());
+        lsn = fileSystem.logMutation(JournalOp::CloneDirectory, parent, name, &data);
+    }
+    fileSystem.commitMutation(lsn); // Other sessions may carry on while we wait for the fsync
+}
+
+/**
+ * @brief Helper function to rename or move a file, if the source is one, under the shared namespace lock.
+ * @details Locks the two directories, in a fixed order, like cloneFile().
+ * @param source The path of the file to move.
+ * @param destination Its new path.
+ * @return false if there is no file at source, so nothing was moved.
+ * @throws std::runtime_error if a parent directory is not found or the destination already holds another file.
+ */
+bool Session::renameFile(const std::string& source, const std::string& destination) {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    uint64_t lsn;
+    {
+        std::shared_lock<std::shared_mutex> cloneLock(fileSystem.cloneLock); // Directory clones lock out of order
+        std::string_view sourceName;
+        Directory* sourceParent = fileSystem.resolveParent(*currentDirectory, source, sourceName);
+        std::string_view name;
+        Directory* parent = fileSystem.resolveParent(*currentDirectory, destination, name);
+        std::unique_lock<std::shared_mutex> lock;
+        std::unique_lock<std::shared_mutex> sourceLock;
+        if (sourceParent == parent) {
+            lock = std::unique_lock<std::shared_mutex>(parent->getMutex());
+        } else if (std::less<Directory*>()(sourceParent, parent)) { // Lowest address first, so two moves never wait on each other
+            sourceLock = std::unique_lock<std::shared_mutex>(sourceParent->getMutex());
+            lock = std::unique_lock<std::shared_mutex>(parent->getMutex());
+        } else {
+            lock = std::unique_lock<std::shared_mutex>(parent->getMutex());
+            sourceLock = std::unique_lock<std::shared_mutex>(sourceParent->getMutex());
+        }
+        File* file = sourceParent->findFile(sourceName);
+        if (!file) {
+            return false;
+        }
+        File* existing = parent->findFile(name);
+        if (existing && existing != file) {
+            throw std::runtime_error("File already exists: " + destination);
+        }
+        std::string sourcePath = fileSystem.absolutePath(sourceParent, sourceName);
+        {
+            std::unique_lock<std::shared_mutex> fileLock(file->getMutex()); // Descriptors send size changes to its parent without the directory's lock
+            sourceParent->moveFile(sourceName, *parent, std::string(name));
+        }
+        std::vector<char> data(sourcePath.begin(), sourcePath.end());
+        lsn = fileSystem.logMutation(JournalOp::RenameFile, parent, name, &data);
+    }
+    fileSystem.commitMutation(lsn); // Other sessions may carry on while we wait for the fsync
+    return true;
+}
+
+/**
+ * @brief Renames or moves a file or directory in place; nothing is copied.
+ * @details A file is looked for first, then a directory. Only the node itself
+ * is relinked, so moving a directory costs the same whatever lies below it;
+ * sessions working inside it stay there. A file is moved under the shared
+ * namespace lock with its two directories locked; a directory move takes the
+ * namespace lock exclusively, so no lookup sees it in both places or in neither.
+ * @param source The path of the file or directory to move.
+ * @param destination Its new path.
+ * @throws std::runtime_error if the source is not found, the destination already
+ * exists, or a directory would be moved inside itself.
+ */
+void Session::rename(const std::string& source, const std::string& destination) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::Rename);
+    if (renameFile(source, destination)) {
+        return;
+    }
+    uint64_t lsn;
+    {
+        std::unique_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock); // Lookups must not see a directory half moved
+        std::string_view sourceName;
+        Directory* sourceParent = fileSystem.resolveParent(*currentDirectory, source, sourceName);
+        std::string_view name;
+        Directory* parent = fileSystem.resolveParent(*currentDirectory, destination, name);
+        Directory* dir = sourceParent->findDirectory(sourceName);
+        if (!dir) {
+            throw std::runtime_error("File or directory not found: " + source);
+        }
+        Directory* existing = parent->findDirectory(name);
+        if (existing && existing != dir) {
+            throw std::runtime_error("Directory already exists: " + destination);
+        }
+        for (Directory* ancestor = parent; ancestor; ancestor = ancestor->getParentDirectory()) {
+            if (ancestor == dir) { // It would be cut off from the root
+                throw std::runtime_error("Cannot move a directory into itself: " + destination);
+            }
+        }
+        std::string sourcePath = fileSystem.absolutePath(sourceParent, sourceName);
+        fileSystem.dentryCache.invalidate(sourcePath); // Paths through it now lead elsewhere
+        sourceParent->moveDirectory(sourceName, *parent, std::string(name));
+        std::vector<char> data(sourcePath.begin(), sourcePath.end());
+        lsn = fileSystem.logMutation(JournalOp::RenameDirectory, parent, name, &data);
+    }
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    fileSystem.commitMutation(lsn);
+}
+
+/**
+ * @brief Applies a batch of namespace mutations.
+ * @details Each parent path is resolved once per batch, every parent is
+ * presized for the entries the batch adds to it, runs of operations on the
+ * same parent share one lock, and the journal is committed once at the end.
+ * A failed operation does not stop the rest.
+ * @param ops The operations, applied in order.
+ * @return The outcome of each operation, in the same order.
+ */
+std::vector<BatchResult> Session::applyBatch(const std::vector<BatchOp>& ops) {
+    struct Parent { // A parent directory named in the batch
+        std::string_view path; ///< The parent's path as written in the batch.
+        size_t files = 0; ///< Files the batch creates in it.
+        size_t directories = 0; ///< Subdirectories the batch creates in it.
+        bool resolved = false; ///< true once resolution has been tried.
+        Directory* dir = nullptr; ///< The directory, once resolved.
+        std::string error; ///< Why resolution failed, if it did.
+    };
+    std::vector<BatchResult> results(ops.size(), BatchResult{true, std::string()});
+    std::vector<std::string_view> leaves(ops.size());
+    std::vector<Parent*> parents(ops.size(), nullptr);
+    std::unordered_map<std::string_view, Parent> byPath; // Nodes stay put, so the pointers above stay valid
+
+    for (size_t i = 0; i < ops.size(); ++i) { // Split every path first so each parent can be presized
+        try {
+            std::string_view parentPath = fileSystem.splitParent(ops[i].path, leaves[i]);
+            Parent& parent = byPath[parentPath];
+            parent.path = parentPath;
+            parent.files += ops[i].type == BatchOpType::CreateFile;
+            parent.directories += ops[i].type == BatchOpType::CreateDirectory;
+            parents[i] = &parent;
+        } catch (const std::runtime_error& e) {
+            results[i] = {false, e.what()};
+        }
+    }
+
+    uint64_t lastLsn = 0;
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock); // Keeps resolved parents alive
+    std::unique_lock<std::shared_mutex> lock;
+    Directory* locked = nullptr;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        if (!parents[i]) {
+            continue;
+        }
+        Parent& parent = *parents[i];
+        if (!parent.resolved) { // Resolved on first use, so directories created earlier in the batch are found
+            if (lock.owns_lock()) {
+                lock.unlock(); // The walk takes shared locks, possibly on this very directory
+                locked = nullptr;
+            }
+            parent.resolved = true;
+            try {
+                parent.dir = parent.path.empty() ? currentDirectory : fileSystem.resolveDirectory(*currentDirectory, parent.path);
+            } catch (const std::runtime_error& e) {
+                parent.error = e.what();
+            }
+        }
+        if (!parent.dir) {
+            results[i] = {false, parent.error};
+            continue;
+        }
+        if (locked != parent.dir) {
+            if (lock.owns_lock()) {
+                lock.unlock();
+            }
+            lock = std::unique_lock<std::shared_mutex>(parent.dir->getMutex());
+            locked = parent.dir;
+            if (parent.files || parent.directories) {
+                parent.dir->reserve(parent.files, parent.directories);
+                parent.files = parent.directories = 0; // Only once per batch
+            }
+        }
+
+        const BatchOp& op = ops[i];
+        std::string_view name = leaves[i];
+        uint64_t lsn = 0;
+        try {
+            switch (op.type) {
+                case BatchOpType::CreateFile: {
+                    OperationStats::Timer timer(fileSystem.stats, StatsOp::Create);
+                    parent.dir->createFile(std::string(name));
+                    lsn = fileSystem.logMutation(JournalOp::CreateFile, parent.dir, name);
+                    break;
+                }
+                case BatchOpType::WriteFile: {
+                    OperationStats::Timer timer(fileSystem.stats, StatsOp::Write);
+                    timer.setBytes(op.data.size());
+                    File* file = parent.dir->findFile(name);
+                    if (!file) {
+                        throw std::runtime_error("File not found: " + op.path);
+                    }
+                    std::unique_lock<std::shared_mutex> fileLock(file->getMutex());
+                    file->write(op.data);
+                    lsn = fileSystem.logMutation(JournalOp::WriteFile, parent.dir, name, &op.data);
+                    break;
+                }
+                case BatchOpType::DeleteFile: {
+                    OperationStats::Timer timer(fileSystem.stats, StatsOp::Delete);
+                    if (File* file = parent.dir->findFile(name)) {
+                        std::unique_lock<std::shared_mutex> fileLock(file->getMutex()); // Wait for anyone still reading or writing it
+                    }
+                    parent.dir->removeFile(name);
+                    lsn = fileSystem.logMutation(JournalOp::DeleteFile, parent.dir, name);
+                    break;
+                }
+                case BatchOpType::CreateDirectory: {
+                    OperationStats::Timer timer(fileSystem.stats, StatsOp::Create);
+                    parent.dir->createDirectory(std::string(name));
+                    lsn = fileSystem.logMutation(JournalOp::CreateDirectory, parent.dir, name);
+                    break;
+                }
+            }
+        } catch (const std::runtime_error& e) {
+            results[i] = {false, e.what()};
+        }
+        if (lsn) {
+            lastLsn = lsn;
+        }
+    }
+    if (lock.owns_lock()) {
+        lock.unlock();
+    }
+    fileSystem.commitMutation(lastLsn); // One commit covers every record the batch logged
+    return results;
+}
+
+/**
+ * @brief Lists the contents of the current directory.
+ * @return The names of the files and subdirectories.
+ */
+std::vector<std::string> Session::listContents() {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::shared_lock<std::shared_mutex> lock(currentDirectory->getMutex());
+    return currentDirectory->listContents();
+}
+
+/**
+ * @brief Lists one page of the current directory in name order.
+ * @details Only the names on the page are copied. Entries added or removed
+ * between pages are seen or skipped by where they sort relative to the cursor.
+ * @param after Where the previous page left off; default-constructed for the first page.
+ * @param limit The most entries to return.
+ * @return The page, and the cursor for the next one.
+ */
+ListPage Session::listPage(const ListCursor& after, size_t limit) {
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    std::shared_lock<std::shared_mutex> lock(currentDirectory->getMutex());
+    ListPage page;
+    std::vector<DirectoryEntry> entries = currentDirectory->listPage(after.name, after.directory, limit, page.more);
+    page.entries.reserve(entries.size());
+    for (const DirectoryEntry& entry : entries) {
+        page.entries.push_back({std::string(entry.name), entry.directory != nullptr}); // Copied before the lock is released
+    }
+    page.next = entries.empty() ? after : ListCursor{page.entries.back().name, page.entries.back().directory};
+    return page;
+}
+
+/**
+ * @brief Gets the current working directory.
+ * @return A pointer to the current working directory.
+ */
+Directory* Session::getCurrentDirectory() const {
+    return currentDirectory;
+}
+
+/**
+ * @brief Changes the current working directory.
+ * @param path The path of the directory to change to.
+ * @throws std::runtime_error if the directory is not found.
+ */
+void Session::changeDirectory(const std::string& path) {
+    OperationStats::Timer timer(fileSystem.stats, StatsOp::ChangeDirectory);
+    std::shared_lock<ShardedSharedMutex> namespaceLock(fileSystem.namespaceLock);
+    currentDirectory = fileSystem.resolveDirectory(*currentDirectory, path); // ".." steps up to the parent directory
+}
@@ -0,0 +1,305 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Directory;
+class File;
+class FileSystem;
+struct SubtreeUsage;
+
+/**
+ * @brief The kinds of mutation a batch can hold.
+ */
+enum class BatchOpType {
+    CreateFile, ///< Create an empty file.
+    WriteFile, ///< Replace the contents of an existing file.
+    DeleteFile, ///< Delete a file.
+    CreateDirectory ///< Create a directory.
+};
+
+/**
+ * @brief One mutation in a batch.
+ */
+struct BatchOp {
+    BatchOpType type; ///< What to do.
+    std::string path; ///< The path of the entry, absolute or relative to the current directory.
+    std::vector<char> data; ///< The data to write, for WriteFile.
+};
+
+/**
+ * @brief The outcome of one mutation in a batch.
+ */
+struct BatchResult {
+    bool ok; ///< true if the mutation was applied.
+    std::string error; ///< Why it was not, if it was not.
+};
+
+/**
+ * @brief Where a paged listing left off.
+ */
+struct ListCursor {
+    std::string name; ///< The name of the last entry listed; empty before the first page.
+    bool directory; ///< Whether that entry was a directory.
+};
+
+/**
+ * @brief One entry of a paged listing.
+ */
+struct ListEntry {
+    std::string name; ///< The entry's name.
+    bool directory; ///< true for a subdirectory, false for a file.
+};
+
+/**
+ * @brief One page of a directory listing, in name order.
+ */
+struct ListPage {
+    std::vector<ListEntry> entries; ///< The entries of the page.
+    ListCursor next; ///< Pass to listPage() for the page after this one.
+    bool more; ///< true if entries remain after this page.
+};
+
+/**
+ * @brief A file or directory found by glob() or search().
+ */
+struct NameMatch {
+    std::string path; ///< The absolute path of the entry.
+    bool directory; ///< true for a directory, false for a file.
+};
+
+/**
+ * @brief The totals diskUsage() gathers over a subtree.
+ */
+struct TreeUsage {
+    uint64_t files; ///< Files in the subtree.
+    uint64_t directories; ///< Directories below the root of the subtree.
+    uint64_t bytes; ///< Total logical size of the files.
+    uint64_t allocatedBytes; ///< Total size of the blocks holding them; holes are not counted.
+};
+
+/**
+ * @brief Called by walk() for each entry of a subtree, from any of the pool's threads.
+ * @details Receives the entry's absolute path, and the file held under a shared
+ * lock, or nullptr for a directory.
+ */
+using TreeVisitor = std::function<void(const std::string& path, const File* file)>;
+
+/**
+ * @class Session
+ * @brief A handle on a FileSystem with its own current working directory.
+ *
+ * Sessions let many threads share one FileSystem: each thread opens its own
+ * session, and operations from different sessions run concurrently. Lookups
+ * take shared locks on the directories and files they visit, so reads in
+ * different subtrees (or the same one) do not block each other; creating,
+ * writing and deleting lock only the directory or file changed. A session
+ * itself is not meant to be used from more than one thread at a time.
+ */
+class Session {
+private:
+    FileSystem& fileSystem; ///< The filesystem this session works on.
+    Directory* currentDirectory; ///< The session's current working directory.
+
+    friend class FileSystem;
+
+    /**
+     * @brief Finds every file and directory in the tree whose name matches a glob pattern or contains some text.
+     * @param pattern The glob pattern or the text.
+     * @param isGlob true to match pattern as a glob, false to look for it as text.
+     * @return The matches, sorted by path.
+     */
+    std::vector<NameMatch> findNames(const std::string& pattern, bool isGlob);
+
+    /**
+     * @brief Renames or moves a file, if the source is one, under the shared namespace lock.
+     * @param source The path of the file to move.
+     * @param destination Its new path.
+     * @return false if there is no file at source, so nothing was moved.
+     * @throws std::runtime_error if a parent directory is not found or the destination already holds another file.
+     */
+    bool renameFile(const std::string& source, const std::string& destination);
+
+public:
+    /**
+     * @brief Opens a session on a filesystem, starting at its root.
+     * @param fileSystem The filesystem to work on; must outlive the session.
+     */
+    explicit Session(FileSystem& fileSystem);
+
+    /**
+     * @brief Closes the session.
+     */
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    /**
+     * @brief Creates a file.
+     * @param filename The path of the file to create, absolute or relative to the current directory.
+     */
+    void createFile(const std::string& filename);
+
+    /**
+     * @brief Deletes a file.
+     * @param filename The path of the file to delete, absolute or relative to the current directory.
+     */
+    void deleteFile(const std::string& filename);
+
+    /**
+     * @brief Reads data from a file.
+     * @param filename The path of the file to read, absolute or relative to the current directory.
+     * @return A vector of characters containing the file data.
+     * @throws std::runtime_error if the file is not found.
+     */
+    std::vector<char> readFile(const std::string& filename);
+
+    /**
+     * @brief Writes data to a file.
+     * @param filename The path of the file to write to, absolute or relative to the current directory.
+     * @param data The data to write to the file.
+     * @throws std::runtime_error if the file is not found.
+     */
+    void writeFile(const std::string& filename, const std::vector<char>& data);
+
+    /**
+     * @brief Creates a directory.
+     * @param dirname The path of the directory to create, absolute or relative to the current directory.
+     */
+    void createDirectory(const std::string& dirname);
+
+    /**
+     * @brief Deletes a directory.
+     * @details The subtree is unlinked under the namespace lock and then freed, in
+     * parallel on the filesystem's WorkStealingPool, after the lock is released.
+     * @param dirname The path of the directory to delete, absolute or relative to the current directory.
+     * @throws std::runtime_error if another session's current directory is inside it.
+     */
+    void deleteDirectory(const std::string& dirname);
+
+    /**
+     * @brief Visits every file and directory below a directory, subtrees in parallel.
+     * @details Runs on the filesystem's WorkStealingPool, so the visitor is called
+     * concurrently and in no particular order. Directories cannot be deleted while
+     * the walk runs; entries created or deleted in them meanwhile may or may not be seen.
+     * @param dirname The path of the directory to walk, absolute or relative to the current directory.
+     * @param visit Called for each entry below the directory.
+     * @throws std::runtime_error if the directory is not found, or whatever the visitor throws.
+     */
+    void walk(const std::string& dirname, const TreeVisitor& visit);
+
+    /**
+     * @brief Totals the files, directories and bytes below a directory, subtrees in parallel.
+     * @param dirname The path of the directory, absolute or relative to the current directory.
+     * @return The totals.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    TreeUsage diskUsage(const std::string& dirname);
+
+    /**
+     * @brief Gets the bytes, files and directories below a directory in O(1), from its running totals.
+     * @param dirname The path of the directory, absolute or relative to the current directory.
+     * @return The totals.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    SubtreeUsage usage(const std::string& dirname);
+
+    /**
+     * @brief Finds every file and directory in the tree whose name matches a glob pattern.
+     * @details Served by the filesystem's NameIndex when enabled, or else by a
+     * parallel walk of the whole tree.
+     * @param pattern The pattern; '*' matches any run of characters and '?' any one character.
+     * @return The matches, sorted by path.
+     */
+    std::vector<NameMatch> glob(const std::string& pattern);
+
+    /**
+     * @brief Finds every file and directory in the tree whose name contains some text.
+     * @details Served by the filesystem's NameIndex when enabled, or else by a
+     * parallel walk of the whole tree.
+     * @param text The text.
+     * @return The matches, sorted by path.
+     */
+    std::vector<NameMatch> search(const std::string& text);
+
+    /**
+     * @brief Copies a file; the copy shares its blocks until either file is written.
+     * @details Locks the two directories, in a fixed order, under the shared namespace lock.
+     * @param source The path of the file to copy.
+     * @param destination The path of the copy.
+     * @throws std::runtime_error if the source is not found or the destination already exists.
+     */
+    void cloneFile(const std::string& source, const std::string& destination);
+
+    /**
+     * @brief Copies a directory tree; files in the copy share their blocks until written.
+     * @details Subtrees are copied in parallel on the filesystem's WorkStealingPool,
+     * under the shared namespace lock; writes below the source wait for the copy,
+     * and the destination directory is locked only to link the copy in.
+     * @param source The path of the directory to copy.
+     * @param destination The path of the copy.
+     * @throws std::runtime_error if the source is not found, the destination already
+     * exists, or the destination lies inside the source.
+     */
+    void cloneDirectory(const std::string& source, const std::string& destination);
+
+    /**
+     * @brief Renames or moves a file or directory in place; nothing is copied.
+     * @details A file is looked for first, then a directory. Only the node itself
+     * is relinked, so moving a directory costs the same whatever lies below it;
+     * sessions working inside it stay there. A file is moved under the shared
+     * namespace lock with its two directories locked; a directory move takes the
+     * namespace lock exclusively, so no lookup sees it in both places or in neither.
+     * @param source The path of the file or directory to move.
+     * @param destination Its new path.
+     * @throws std::runtime_error if the source is not found, the destination already
+     * exists, or a directory would be moved inside itself.
+     */
+    void rename(const std::string& source, const std::string& destination);
+
+    /**
+     * @brief Applies a batch of namespace mutations.
+     * @details Each parent path is resolved once per batch, every parent is
+     * presized for the entries the batch adds to it, runs of operations on the
+     * same parent share one lock, and the journal is committed once at the end.
+     * A failed operation does not stop the rest.
+     * @param ops The operations, applied in order.
+     * @return The outcome of each operation, in the same order.
+     */
+    std::vector<BatchResult> applyBatch(const std::vector<BatchOp>& ops);
+
+    /**
+     * @brief Lists the contents of the current directory.
+     * @return The names of the files and subdirectories in the current directory.
+     */
+    std::vector<std::string> listContents();
+
+    /**
+     * @brief Lists one page of the current directory in name order.
+     * @details Only the names on the page are copied. Entries added or removed
+     * between pages are seen or skipped by where they sort relative to the cursor.
+     * @param after Where the previous page left off; default-constructed for the first page.
+     * @param limit The most entries to return.
+     * @return The page, and the cursor for the next one.
+     */
+    ListPage listPage(const ListCursor& after, size_t limit);
+
+    /**
+     * @brief Gets the current working directory.
+     * @return A pointer to the current working directory.
+     */
+    Directory* getCurrentDirectory() const;
+
+    /**
+     * @brief Changes the current working directory.
+     * @param path The path of the directory to change to.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    void changeDirectory(const std::string& path);
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef SHARDEDSHAREDMUTEX_HPP
+#define SHARDEDSHAREDMUTEX_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <shared_mutex>
+
+/**
+ * @class ShardedSharedMutex
+ * @brief A reader/writer lock whose readers do not share a cache line.
+ *
+ * Each thread takes shared ownership of one of SHARDS separately padded
+ * shared mutexes, so threads that only read never write to the same memory.
+ * Exclusive ownership locks every shard in order, which makes it expensive;
+ * use it for rare operations that must exclude all readers.
+ *
+ * Satisfies SharedMutex, so it works with std::shared_lock and std::unique_lock.
+ */
+class ShardedSharedMutex {
+private:
+    static const size_t SHARDS = 64; ///< Number of reader shards.
+
+    /**
+     * @brief One shard, padded to its own cache line.
+     */
+    struct alignas(64) Shard {
+        std::shared_mutex mutex; ///< The shard's lock.
+    };
+
+    Shard shards[SHARDS]; ///< The reader shards.
+
+    /**
+     * @brief Gets the shard used by the calling thread.
+     * @return The index of the thread's shard, fixed for the thread's lifetime.
+     */
+    static size_t shardIndex() {
+        static std::atomic<size_t> nextIndex(0);
+        thread_local size_t index = nextIndex.fetch_add(1, std::memory_order_relaxed) % SHARDS; // Spread threads round-robin
+        return index;
+    }
+
+public:
+    ShardedSharedMutex() = default;
+    ShardedSharedMutex(const ShardedSharedMutex&) = delete;
+    ShardedSharedMutex& operator=(const ShardedSharedMutex&) = delete;
+
+    /**
+     * @brief Takes exclusive ownership, waiting for every reader to leave.
+     */
+    void lock() {
+        for (size_t i = 0; i < SHARDS; ++i) {
+            shards[i].mutex.lock(); // Always in the same order, so writers cannot deadlock
+        }
+    }
+
+    /**
+     * @brief Tries to take exclusive ownership without waiting.
+     * @return true if the lock was taken.
+     */
+    bool try_lock() {
+        for (size_t i = 0; i < SHARDS; ++i) {
+            if (!shards[i].mutex.try_lock()) {
+                while (i > 0) {
+                    shards[--i].mutex.unlock(); // Back out the shards already taken
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Releases exclusive ownership.
+     */
+    void unlock() {
+        for (size_t i = SHARDS; i > 0; --i) {
+            shards[i - 1].mutex.unlock();
+        }
+    }
+
+    /**
+     * @brief Takes shared ownership through the calling thread's shard.
+     */
+    void lock_shared() {
+        shards[shardIndex()].mutex.lock_shared();
+    }
+
+    /**
+     * @brief Tries to take shared ownership without waiting.
+     * @return true if the lock was taken.
+     */
+    bool try_lock_shared() {
+        return shards[shardIndex()].mutex.try_lock_shared();
+    }
+
+    /**
+     * @brief Releases shared ownership taken by the calling thread.
+     */
+    void unlock_shared() {
+        shards[shardIndex()].mutex.unlock_shared();
+    }
+};
+
+#endif
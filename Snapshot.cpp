@@ -0,0 +1,376 @@
+#include "Snapshot.hpp"
+#include "Directory.hpp"
+#include "NodePool.hpp"
+#include "PathTokenizer.hpp"
+#include <limits>
+#include <shared_mutex>
+#include <stdexcept>
+
+/**
+ * @brief Constructor for the Snapshot class; called by SnapshotRegistry::take().
+ * @param registry The registry the snapshot is registered with.
+ * @param root The root of the tree.
+ * @param generation The snapshot's generation.
+ */
+Snapshot::Snapshot(SnapshotRegistry& registry, Directory& root, uint64_t generation)
+    : registry(registry), root(root), generation(generation) {}
+
+/**
+ * @brief Destructor for the Snapshot class; releases everything it preserved.
+ */
+Snapshot::~Snapshot() {
+    registry.release(this);
+}
+
+/**
+ * @brief Gets the preserved state of a directory.
+ * @param dir The live directory.
+ * @return Its state when the snapshot was taken, or nullptr if it has not changed since.
+ */
+std::shared_ptr<const Snapshot::DirectoryState> Snapshot::preserved(const Directory* dir) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = directories.find(dir);
+    return it != directories.end() ? it->second : nullptr;
+}
+
+/**
+ * @brief Gets the preserved copy of a file.
+ * @param file The live file.
+ * @return Its copy from when the snapshot was taken, or nullptr if it has not changed since.
+ */
+std::shared_ptr<const File> Snapshot::preserved(const File* file) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = files.find(file);
+    return it != files.end() ? it->second : nullptr;
+}
+
+/**
+ * @brief Looks up a subdirectory as it was when the snapshot was taken.
+ * @param dir The directory to look in.
+ * @param name The name of the subdirectory.
+ * @return The subdirectory's node, or nullptr if there was none.
+ */
+Directory* Snapshot::findDirectory(Directory& dir, std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock(dir.getMutex()); // Writers preserve under the exclusive lock, so this check holds
+    if (std::shared_ptr<const DirectoryState> state = preserved(&dir)) {
+        auto it = state->directoryIndex.find(name);
+        return it != state->directoryIndex.end() ? state->subdirectories[it->second].second : nullptr;
+    }
+    return dir.findDirectory(name); // Unchanged since the snapshot
+}
+
+/**
+ * @brief Resolves a directory path as it was when the snapshot was taken.
+ * @param path The path, taken from the root whether or not it starts with '/'.
+ * @return The directory's node.
+ * @throws std::runtime_error if the directory is not found.
+ */
+Directory* Snapshot::resolve(std::string_view path) const {
+    std::vector<Directory*> trail = {&root}; // Lets ".." step back without trusting live parent pointers
+    PathTokenizer tokenizer(path);
+    std::string_view part;
+    while (tokenizer.next(part)) {
+        if (part == "..") {
+            if (trail.size() > 1) {
+                trail.pop_back();
+            }
+            continue;
+        }
+        Directory* next = findDirectory(*trail.back(), part);
+        if (!next) {
+            throw std::runtime_error("Directory not found: " + std::string(part));
+        }
+        trail.push_back(next);
+    }
+    return trail.back();
+}
+
+/**
+ * @brief Lists a directory as it was when the snapshot was taken.
+ * @param path The path of the directory, taken from the root.
+ * @return The names of the files and subdirectories in the directory.
+ * @throws std::runtime_error if the directory is not found.
+ */
+std::vector<std::string> Snapshot::listContents(const std::string& path) const {
+    Directory* dir = resolve(path);
+    std::shared_lock<std::shared_mutex> lock(dir->getMutex());
+    std::shared_ptr<const DirectoryState> state = preserved(dir);
+    if (!state) {
+        return dir->listContents();
+    }
+    std::vector<std::string> contents;
+    contents.reserve(state->files.size() + state->subdirectories.size());
+    for (const auto& entry : state->files) {
+        contents.push_back(entry.first);
+    }
+    for (const auto& entry : state->subdirectories) {
+        contents.push_back(entry.first);
+    }
+    return contents;
+}
+
+/**
+ * @brief Reads a file as it was when the snapshot was taken.
+ * @param path The path of the file, taken from the root.
+ * @return The file's data.
+ * @throws std::runtime_error if the file is not found.
+ */
+std::vector<char> Snapshot::readFile(const std::string& path) const {
+    size_t last = path.find_last_not_of('/');
+    size_t slash = last == std::string::npos ? std::string::npos : path.find_last_of('/', last);
+    std::string_view name = last == std::string::npos ? std::string_view() : std::string_view(path).substr(slash + 1, last - slash);
+    Directory* dir = slash == std::string::npos ? &root : resolve(std::string_view(path).substr(0, slash));
+
+    File* file = nullptr;
+    std::shared_lock<std::shared_mutex> fileLock;
+    {
+        std::shared_lock<std::shared_mutex> lock(dir->getMutex());
+        if (std::shared_ptr<const DirectoryState> state = preserved(dir)) {
+            auto it = state->fileIndex.find(name);
+            file = it != state->fileIndex.end() ? state->files[it->second].second : nullptr;
+        } else {
+            file = dir->findFile(name);
+        }
+        if (!file) {
+            throw std::runtime_error("File not found: " + path);
+        }
+        fileLock = std::shared_lock<std::shared_mutex>(file->getMutex());
+    }
+    if (std::shared_ptr<const File> copy = preserved(file)) {
+        return copy->read();
+    }
+    return file->read(); // Unchanged since the snapshot
+}
+
+/**
+ * @brief Gets the number of nodes preserved so far.
+ * @return The number of directories and files copied into the snapshot.
+ */
+size_t Snapshot::preservedCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return directories.size() + files.size();
+}
+
+/**
+ * @brief Gets the root of the tree the snapshot views.
+ * @return The root directory.
+ */
+const Directory& Snapshot::getRoot() const {
+    return root;
+}
+
+/**
+ * @brief Lists a directory's entries as they were when the snapshot was taken.
+ * @param dir A directory reached through the snapshot, starting at getRoot().
+ * @param files Receives the files' names and nodes; pass each node to readFile(const File&, ...).
+ * @param subdirectories Receives the subdirectories' names and nodes.
+ */
+void Snapshot::listEntries(const Directory& dir, std::vector<std::pair<std::string, const File*>>& files,
+                           std::vector<std::pair<std::string, const Directory*>>& subdirectories) const {
+    std::shared_lock<std::shared_mutex> lock(dir.getMutex()); // Writers preserve under the exclusive lock, so this check holds
+    if (std::shared_ptr<const DirectoryState> state = preserved(&dir)) {
+        files.assign(state->files.begin(), state->files.end());
+        subdirectories.assign(state->subdirectories.begin(), state->subdirectories.end());
+        return;
+    }
+    for (const File* file : dir.getFiles()) { // Unchanged since the snapshot; removed nodes are retired, not freed
+        files.emplace_back(file->getName(), file);
+    }
+    for (const Directory* subdir : dir.getSubdirectories()) {
+        subdirectories.emplace_back(subdir->getName(), subdir);
+    }
+}
+
+/**
+ * @brief Reads a file as it was when the snapshot was taken.
+ * @details The live file is held shared for the call, so it cannot change meanwhile.
+ * @param file A file node from listEntries().
+ * @param read Called with the file's state.
+ */
+void Snapshot::readFile(const File& file, const std::function<void(const File&)>& read) const {
+    std::shared_lock<std::shared_mutex> lock(file.getMutex());
+    if (std::shared_ptr<const File> copy = preserved(&file)) {
+        read(*copy);
+    } else {
+        read(file); // Unchanged since the snapshot
+    }
+}
+
+/**
+ * @brief Constructor for the SnapshotRegistry class.
+ */
+SnapshotRegistry::SnapshotRegistry() : latest(0), nextGeneration(1) {}
+
+/**
+ * @brief Destructor for the SnapshotRegistry class; frees every retired node.
+ */
+SnapshotRegistry::~SnapshotRegistry() {
+    destroy(retired);
+}
+
+/**
+ * @brief Frees retired nodes.
+ * @param nodes The nodes to free; must no longer be reachable from any snapshot.
+ */
+void SnapshotRegistry::destroy(const std::vector<Retired>& nodes) {
+    for (const Retired& node : nodes) {
+        if (node.file) {
+            NodePool<File>::instance().destroy(node.file);
+        } else {
+            NodePool<Directory>::instance().destroy(node.directory); // Frees the subtree with it
+        }
+    }
+}
+
+/**
+ * @brief Takes a snapshot of a tree.
+ * @details The caller must make sure no change is half applied.
+ * @param root The root of the tree.
+ * @return The snapshot.
+ */
+std::shared_ptr<Snapshot> SnapshotRegistry::take(Directory& root) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<Snapshot> snapshot(new Snapshot(*this, root, nextGeneration++));
+    snapshots.push_back(snapshot.get());
+    latest.store(snapshot->generation, std::memory_order_release); // From now on every change preserves first
+    return snapshot;
+}
+
+/**
+ * @brief Unregisters a closing snapshot and frees retired nodes no snapshot can reach any more.
+ * @param snapshot The snapshot.
+ */
+void SnapshotRegistry::release(Snapshot* snapshot) {
+    std::vector<Retired> unreachable;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = snapshots.begin(); it != snapshots.end(); ++it) {
+            if (*it == snapshot) {
+                snapshots.erase(it);
+                break;
+            }
+        }
+        latest.store(snapshots.empty() ? 0 : snapshots.back()->generation, std::memory_order_release);
+        uint64_t oldest = snapshots.empty() ? std::numeric_limits<uint64_t>::max() : snapshots.front()->generation;
+        size_t kept = 0;
+        for (const Retired& node : retired) {
+            if (node.generation < oldest) {
+                unreachable.push_back(node); // Removed before every open snapshot was taken
+            } else {
+                retired[kept++] = node;
+            }
+        }
+        retired.resize(kept);
+    }
+    destroy(unreachable); // Outside the lock; freeing a subtree can take a while
+}
+
+/**
+ * @brief Determines if any snapshot is open.
+ * @return true if at least one snapshot is open.
+ */
+bool SnapshotRegistry::isActive() const {
+    return latest.load(std::memory_order_acquire) != 0;
+}
+
+/**
+ * @brief Gets the generation to give a node created now.
+ * @return The newest open snapshot's generation; no open snapshot contains the node.
+ */
+uint64_t SnapshotRegistry::generation() const {
+    return latest.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Determines if a node must be preserved before it changes.
+ * @param nodeGeneration The generation up to which the node is preserved.
+ * @return true if a snapshot newer than that is open.
+ */
+bool SnapshotRegistry::needsPreserve(uint64_t nodeGeneration) const {
+    return latest.load(std::memory_order_acquire) > nodeGeneration;
+}
+
+/**
+ * @brief Preserves a directory's entries into every open snapshot that lacks them.
+ * @details Call while holding the directory exclusively, before changing it.
+ * @param dir The directory.
+ * @param nodeGeneration The directory's generation; updated.
+ */
+void SnapshotRegistry::preserve(const Directory& dir, uint64_t& nodeGeneration) {
+    std::shared_ptr<Snapshot::DirectoryState> state = std::make_shared<Snapshot::DirectoryState>();
+    const std::vector<File*>& files = dir.getFiles();
+    const std::vector<Directory*>& subdirectories = dir.getSubdirectories();
+    state->files.reserve(files.size());
+    for (File* file : files) {
+        state->files.emplace_back(file->getName(), file);
+    }
+    state->subdirectories.reserve(subdirectories.size());
+    for (Directory* subdir : subdirectories) {
+        state->subdirectories.emplace_back(subdir->getName(), subdir);
+    }
+    state->fileIndex.reserve(state->files.size());
+    for (size_t i = 0; i < state->files.size(); ++i) {
+        state->fileIndex.emplace(state->files[i].first, i); // Keyed by the state's own copy of the name
+    }
+    state->directoryIndex.reserve(state->subdirectories.size());
+    for (size_t i = 0; i < state->subdirectories.size(); ++i) {
+        state->directoryIndex.emplace(state->subdirectories[i].first, i);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Snapshot* snapshot : snapshots) {
+        if (snapshot->generation > nodeGeneration) { // Older snapshots already have an earlier state
+            std::lock_guard<std::mutex> snapshotLock(snapshot->mutex);
+            snapshot->directories.emplace(&dir, state);
+        }
+    }
+    nodeGeneration = latest.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Preserves a copy of a file into every open snapshot that lacks one.
+ * @details Call while holding the file exclusively, before changing it.
+ * @param file The file.
+ * @param nodeGeneration The file's generation; updated.
+ */
+void SnapshotRegistry::preserve(const File& file, uint64_t& nodeGeneration) {
+    std::shared_ptr<const File> copy = std::make_shared<const File>(file); // Shares the blocks, not the bytes
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Snapshot* snapshot : snapshots) {
+        if (snapshot->generation > nodeGeneration) {
+            std::lock_guard<std::mutex> snapshotLock(snapshot->mutex);
+            snapshot->files.emplace(&file, copy);
+        }
+    }
+    nodeGeneration = latest.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Frees a file removed from the tree, or keeps it while snapshots may reach it.
+ * @param file The file.
+ */
+void SnapshotRegistry::retire(File* file) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!snapshots.empty()) {
+            retired.push_back({latest.load(std::memory_order_relaxed), file, nullptr});
+            return;
+        }
+    }
+    NodePool<File>::instance().destroy(file);
+}
+
+/**
+ * @brief Frees a directory removed from the tree, or keeps it while snapshots may reach it.
+ * @param dir The directory, with its subtree.
+ */
+void SnapshotRegistry::retire(Directory* dir) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!snapshots.empty()) {
+            retired.push_back({latest.load(std::memory_order_relaxed), nullptr, dir});
+            return;
+        }
+    }
+    NodePool<Directory>::instance().destroy(dir);
+}
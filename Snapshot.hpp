@@ -0,0 +1,257 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Directory;
+class File;
+class SnapshotRegistry;
+
+/**
+ * @class Snapshot
+ * @brief A read-only, point-in-time view of a filesystem tree.
+ *
+ * Taking a snapshot copies nothing. The live tree keeps changing underneath;
+ * just before a directory or file first changes after the snapshot was taken,
+ * its old state is preserved into the snapshot, which reads preserved state
+ * where there is some and the live node everywhere else. Preserved files share
+ * their blocks copy-on-write, so a snapshot costs memory only for the nodes
+ * changed since it was taken.
+ *
+ * A snapshot may be read from any thread while writers carry on. It must not
+ * outlive the filesystem it was taken from.
+ */
+class Snapshot {
+private:
+    /**
+     * @brief The entries of a directory as they were when the snapshot was taken.
+     */
+    struct DirectoryState {
+        std::vector<std::pair<std::string, File*>> files; ///< The files, in the directory's order.
+        std::vector<std::pair<std::string, Directory*>> subdirectories; ///< The subdirectories, in the directory's order.
+        std::unordered_map<std::string_view, size_t> fileIndex; ///< Maps file names, viewed in files, to their position.
+        std::unordered_map<std::string_view, size_t> directoryIndex; ///< Maps subdirectory names, viewed in subdirectories, to their position.
+    };
+
+    SnapshotRegistry& registry; ///< The registry the snapshot is registered with.
+    Directory& root; ///< The root of the tree.
+    uint64_t generation; ///< Orders snapshots; newer snapshots have larger generations.
+    mutable std::mutex mutex; ///< Guards the preserved state.
+    std::unordered_map<const Directory*, std::shared_ptr<const DirectoryState>> directories; ///< Directories changed since the snapshot.
+    std::unordered_map<const File*, std::shared_ptr<const File>> files; ///< Copies of files changed since the snapshot.
+
+    friend class SnapshotRegistry;
+
+    /**
+     * @brief Constructor for the Snapshot class; called by SnapshotRegistry::take().
+     * @param registry The registry the snapshot is registered with.
+     * @param root The root of the tree.
+     * @param generation The snapshot's generation.
+     */
+    Snapshot(SnapshotRegistry& registry, Directory& root, uint64_t generation);
+
+    /**
+     * @brief Gets the preserved state of a directory.
+     * @param dir The live directory.
+     * @return Its state when the snapshot was taken, or nullptr if it has not changed since.
+     */
+    std::shared_ptr<const DirectoryState> preserved(const Directory* dir) const;
+
+    /**
+     * @brief Gets the preserved copy of a file.
+     * @param file The live file.
+     * @return Its copy from when the snapshot was taken, or nullptr if it has not changed since.
+     */
+    std::shared_ptr<const File> preserved(const File* file) const;
+
+    /**
+     * @brief Looks up a subdirectory as it was when the snapshot was taken.
+     * @param dir The directory to look in.
+     * @param name The name of the subdirectory.
+     * @return The subdirectory's node, or nullptr if there was none.
+     */
+    Directory* findDirectory(Directory& dir, std::string_view name) const;
+
+    /**
+     * @brief Resolves a directory path as it was when the snapshot was taken.
+     * @param path The path, taken from the root whether or not it starts with '/'.
+     * @return The directory's node.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    Directory* resolve(std::string_view path) const;
+
+public:
+    /**
+     * @brief Destructor for the Snapshot class; releases everything it preserved.
+     */
+    ~Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    /**
+     * @brief Lists a directory as it was when the snapshot was taken.
+     * @param path The path of the directory, taken from the root.
+     * @return The names of the files and subdirectories in the directory.
+     * @throws std::runtime_error if the directory is not found.
+     */
+    std::vector<std::string> listContents(const std::string& path) const;
+
+    /**
+     * @brief Reads a file as it was when the snapshot was taken.
+     * @param path The path of the file, taken from the root.
+     * @return The file's data.
+     * @throws std::runtime_error if the file is not found.
+     */
+    std::vector<char> readFile(const std::string& path) const;
+
+    /**
+     * @brief Gets the number of nodes preserved so far.
+     * @return The number of directories and files copied into the snapshot.
+     */
+    size_t preservedCount() const;
+
+    /**
+     * @brief Gets the root of the tree the snapshot views.
+     * @return The root directory.
+     */
+    const Directory& getRoot() const;
+
+    /**
+     * @brief Lists a directory's entries as they were when the snapshot was taken.
+     * @param dir A directory reached through the snapshot, starting at getRoot().
+     * @param files Receives the files' names and nodes; pass each node to readFile(const File&, ...).
+     * @param subdirectories Receives the subdirectories' names and nodes.
+     */
+    void listEntries(const Directory& dir, std::vector<std::pair<std::string, const File*>>& files,
+                     std::vector<std::pair<std::string, const Directory*>>& subdirectories) const;
+
+    /**
+     * @brief Reads a file as it was when the snapshot was taken.
+     * @details The live file is held shared for the call, so it cannot change meanwhile.
+     * @param file A file node from listEntries().
+     * @param read Called with the file's state.
+     */
+    void readFile(const File& file, const std::function<void(const File&)>& read) const;
+};
+
+/**
+ * @class SnapshotRegistry
+ * @brief Tracks a filesystem's open snapshots and preserves nodes into them.
+ *
+ * Every directory and file carries the generation up to which its state has
+ * been preserved. Before a node changes it calls needsPreserve(), a single
+ * atomic load, and only when that says so takes the slow path through
+ * preserve(). Nodes removed from the tree while snapshots are open are
+ * retired rather than freed, and freed once no snapshot can reach them.
+ */
+class SnapshotRegistry {
+private:
+    /**
+     * @brief A node removed from the tree that an open snapshot may still reach.
+     */
+    struct Retired {
+        uint64_t generation; ///< The newest snapshot generation when the node was removed.
+        File* file; ///< The file removed, or nullptr.
+        Directory* directory; ///< The directory removed, or nullptr.
+    };
+
+    mutable std::mutex mutex; ///< Guards the snapshot list and the retired nodes.
+    std::vector<Snapshot*> snapshots; ///< The open snapshots, oldest first.
+    std::atomic<uint64_t> latest; ///< The generation of the newest open snapshot, or 0 if none.
+    uint64_t nextGeneration; ///< The generation of the next snapshot.
+    std::vector<Retired> retired; ///< Removed nodes kept for the open snapshots.
+
+    /**
+     * @brief Frees retired nodes.
+     * @param nodes The nodes to free; must no longer be reachable from any snapshot.
+     */
+    static void destroy(const std::vector<Retired>& nodes);
+
+public:
+    /**
+     * @brief Constructor for the SnapshotRegistry class.
+     */
+    SnapshotRegistry();
+
+    /**
+     * @brief Destructor for the SnapshotRegistry class; frees every retired node.
+     */
+    ~SnapshotRegistry();
+
+    SnapshotRegistry(const SnapshotRegistry&) = delete;
+    SnapshotRegistry& operator=(const SnapshotRegistry&) = delete;
+
+    /**
+     * @brief Takes a snapshot of a tree.
+     * @details The caller must make sure no change is half applied.
+     * @param root The root of the tree.
+     * @return The snapshot.
+     */
+    std::shared_ptr<Snapshot> take(Directory& root);
+
+    /**
+     * @brief Unregisters a closing snapshot and frees retired nodes no snapshot can reach any more.
+     * @param snapshot The snapshot.
+     */
+    void release(Snapshot* snapshot);
+
+    /**
+     * @brief Determines if any snapshot is open.
+     * @return true if at least one snapshot is open.
+     */
+    bool isActive() const;
+
+    /**
+     * @brief Gets the generation to give a node created now.
+     * @return The newest open snapshot's generation; no open snapshot contains the node.
+     */
+    uint64_t generation() const;
+
+    /**
+     * @brief Determines if a node must be preserved before it changes.
+     * @param nodeGeneration The generation up to which the node is preserved.
+     * @return true if a snapshot newer than that is open.
+     */
+    bool needsPreserve(uint64_t nodeGeneration) const;
+
+    /**
+     * @brief Preserves a directory's entries into every open snapshot that lacks them.
+     * @details Call while holding the directory exclusively, before changing it.
+     * @param dir The directory.
+     * @param nodeGeneration The directory's generation; updated.
+     */
+    void preserve(const Directory& dir, uint64_t& nodeGeneration);
+
+    /**
+     * @brief Preserves a copy of a file into every open snapshot that lacks one.
+     * @details Call while holding the file exclusively, before changing it.
+     * @param file The file.
+     * @param nodeGeneration The file's generation; updated.
+     */
+    void preserve(const File& file, uint64_t& nodeGeneration);
+
+    /**
+     * @brief Frees a file removed from the tree, or keeps it while snapshots may reach it.
+     * @param file The file.
+     */
+    void retire(File* file);
+
+    /**
+     * @brief Frees a directory removed from the tree, or keeps it while snapshots may reach it.
+     * @param dir The directory, with its subtree.
+     */
+    void retire(Directory* dir);
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "SpillFile.hpp"
+#include "BlockPool.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Creates a spill file, truncating anything already at its path.
+ * @param path The path of the file.
+ * @throws std::runtime_error if the file cannot be created.
+ */
+SpillFile::SpillFile(const std::string& path) : path(path), fd(-1), slotCount(0), blocksWritten(0), blocksRead(0) {
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, 0600);
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+#endif
+    if (fd < 0) {
+        throw std::runtime_error("Cannot create spill file: " + path);
+    }
+#ifndef _WIN32
+    ::unlink(path.c_str()); // Lives on through the descriptor, and leaves nothing behind after a crash
+#endif
+}
+
+/**
+ * @brief Destructor for the SpillFile class; closes and removes the file.
+ */
+SpillFile::~SpillFile() {
+#ifdef _WIN32
+    _close(fd);
+    std::remove(path.c_str());
+#else
+    ::close(fd);
+#endif
+}
+
+/**
+ * @brief Writes a block to a free slot.
+ * @param block BLOCK_SIZE bytes.
+ * @return The slot written.
+ * @throws std::runtime_error if the write fails.
+ */
+uint64_t SpillFile::write(const char* block) {
+    const size_t blockSize = BlockPool::BLOCK_SIZE;
+    uint64_t slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) {
+            slot = slotCount++; // Grow the file by one slot
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+    }
+#ifdef _WIN32
+    bool written;
+    {
+        std::lock_guard<std::mutex> lock(mutex); // The file position is shared
+        written = _lseeki64(fd, static_cast<__int64>(slot * blockSize), SEEK_SET) >= 0 &&
+                  _write(fd, block, static_cast<unsigned>(blockSize)) == static_cast<int>(blockSize);
+    }
+#else
+    bool written = ::pwrite(fd, block, blockSize, static_cast<off_t>(slot * blockSize)) == static_cast<ssize_t>(blockSize);
+#endif
+    if (!written) {
+        free(slot);
+        throw std::runtime_error("Failed to write spill file: " + path);
+    }
+    blocksWritten.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+/**
+ * @brief Reads part of a slot.
+ * @param slot The slot.
+ * @param offset The position in the slot to start reading from.
+ * @param buffer The buffer to copy the bytes into.
+ * @param length The number of bytes to read; offset + length is at most BLOCK_SIZE.
+ * @throws std::runtime_error if the read fails.
+ */
+void SpillFile::read(uint64_t slot, size_t offset, char* buffer, size_t length) const {
+    uint64_t position = slot * BlockPool::BLOCK_SIZE + offset;
+#ifdef _WIN32
+    bool complete;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        complete = _lseeki64(fd, static_cast<__int64>(position), SEEK_SET) >= 0 &&
+                   _read(fd, buffer, static_cast<unsigned>(length)) == static_cast<int>(length);
+    }
+#else
+    bool complete = ::pread(fd, buffer, length, static_cast<off_t>(position)) == static_cast<ssize_t>(length);
+#endif
+    if (!complete) {
+        throw std::runtime_error("Failed to read spill file: " + path);
+    }
+    blocksRead.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Returns a slot to the free list.
+ * @param slot The slot.
+ */
+void SpillFile::free(uint64_t slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    freeSlots.push_back(slot); // The bytes stay on disk until the slot is reused
+}
+
+/**
+ * @brief Gets the spill file's counters.
+ * @return A snapshot of the counters.
+ */
+SpillFile::Stats SpillFile::stats() const {
+    Stats result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.capacity = slotCount;
+        result.blocksOnDisk = slotCount - freeSlots.size();
+    }
+    result.blocksWritten = blocksWritten.load(std::memory_order_relaxed);
+    result.blocksRead = blocksRead.load(std::memory_order_relaxed);
+    return result;
+}
+
+/**
+ * @brief Constructor for the SpilledBlocks class.
+ * @param file The spill file holding the blocks.
+ * @param indices The block indices, ascending.
+ * @param slots The slot holding each block.
+ */
+SpilledBlocks::SpilledBlocks(std::shared_ptr<SpillFile> file, std::vector<size_t> indices, std::vector<uint64_t> slots)
+    : file(std::move(file)), indices(std::move(indices)), slots(std::move(slots)) {}
+
+/**
+ * @brief Destructor for the SpilledBlocks class; frees the slots.
+ */
+SpilledBlocks::~SpilledBlocks() {
+    for (uint64_t slot : slots) {
+        file->free(slot);
+    }
+}
+
+/**
+ * @brief Gets the number of blocks spilled.
+ * @return The number of blocks.
+ */
+size_t SpilledBlocks::blockCount() const {
+    return indices.size();
+}
+
+/**
+ * @brief Finds the first spilled block at or after a block index.
+ * @param index The block index.
+ * @return The block's position, or blockCount() if there is none.
+ */
+size_t SpilledBlocks::find(size_t index) const {
+    return std::lower_bound(indices.begin(), indices.end(), index) - indices.begin();
+}
+
+/**
+ * @brief Gets the block index of a spilled block.
+ * @param position The block's position, below blockCount().
+ * @return Its block index in the file.
+ */
+size_t SpilledBlocks::blockIndex(size_t position) const {
+    return indices[position];
+}
+
+/**
+ * @brief Reads part of a spilled block back from disk.
+ * @param position The block's position, below blockCount().
+ * @param offset The position in the block to start reading from.
+ * @param buffer The buffer to copy the bytes into.
+ * @param length The number of bytes to read.
+ * @throws std::runtime_error if the read fails.
+ */
+void SpilledBlocks::read(size_t position, size_t offset, char* buffer, size_t length) const {
+    file->read(slots[position], offset, buffer, length);
+}
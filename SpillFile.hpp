@@ -0,0 +1,151 @@
+#ifndef SPILLFILE_HPP
+#define SPILLFILE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class SpillFile
+ * @brief A local file on disk holding the blocks of files evicted from memory.
+ *
+ * The file is divided into BLOCK_SIZE slots handed out from a free list, so
+ * space freed by one evicted file is reused by the next. Slots are read and
+ * written with positioned I/O and may be used from any thread. The file is
+ * scratch space: it is truncated when opened and removed when closed (on
+ * POSIX systems, as soon as it is open, so a crash leaves nothing behind).
+ */
+class SpillFile {
+public:
+    /**
+     * @brief Counters describing the spill file's use.
+     */
+    struct Stats {
+        size_t blocksOnDisk; ///< Slots currently holding evicted blocks.
+        size_t capacity; ///< Slots the file has grown to.
+        uint64_t blocksWritten; ///< Blocks written out so far.
+        uint64_t blocksRead; ///< Blocks, or parts of blocks, read back so far.
+    };
+
+private:
+    std::string path; ///< The path of the file.
+    int fd; ///< Descriptor of the open file.
+    mutable std::mutex mutex; ///< Guards the free list (and, on Windows, the file position).
+    std::vector<uint64_t> freeSlots; ///< Slots available for reuse.
+    uint64_t slotCount; ///< Slots the file has grown to.
+    std::atomic<uint64_t> blocksWritten; ///< See Stats.
+    mutable std::atomic<uint64_t> blocksRead; ///< See Stats.
+
+public:
+    /**
+     * @brief Creates a spill file, truncating anything already at its path.
+     * @param path The path of the file.
+     * @throws std::runtime_error if the file cannot be created.
+     */
+    explicit SpillFile(const std::string& path);
+
+    /**
+     * @brief Destructor for the SpillFile class; closes and removes the file.
+     */
+    ~SpillFile();
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    /**
+     * @brief Writes a block to a free slot.
+     * @param block BLOCK_SIZE bytes.
+     * @return The slot written.
+     * @throws std::runtime_error if the write fails.
+     */
+    uint64_t write(const char* block);
+
+    /**
+     * @brief Reads part of a slot.
+     * @param slot The slot.
+     * @param offset The position in the slot to start reading from.
+     * @param buffer The buffer to copy the bytes into.
+     * @param length The number of bytes to read; offset + length is at most BLOCK_SIZE.
+     * @throws std::runtime_error if the read fails.
+     */
+    void read(uint64_t slot, size_t offset, char* buffer, size_t length) const;
+
+    /**
+     * @brief Returns a slot to the free list.
+     * @param slot The slot.
+     */
+    void free(uint64_t slot);
+
+    /**
+     * @brief Gets the spill file's counters.
+     * @return A snapshot of the counters.
+     */
+    Stats stats() const;
+};
+
+/**
+ * @class SpilledBlocks
+ * @brief The blocks of one file, evicted to a SpillFile.
+ *
+ * Immutable, so copies of a file share it like any other block; the slots go
+ * back to the spill file when the last sharer lets go.
+ */
+class SpilledBlocks {
+private:
+    std::shared_ptr<SpillFile> file; ///< The spill file holding the blocks.
+    std::vector<size_t> indices; ///< The block indices, ascending.
+    std::vector<uint64_t> slots; ///< The slot holding each block.
+
+public:
+    /**
+     * @brief Constructor for the SpilledBlocks class.
+     * @param file The spill file holding the blocks.
+     * @param indices The block indices, ascending.
+     * @param slots The slot holding each block.
+     */
+    SpilledBlocks(std::shared_ptr<SpillFile> file, std::vector<size_t> indices, std::vector<uint64_t> slots);
+
+    /**
+     * @brief Destructor for the SpilledBlocks class; frees the slots.
+     */
+    ~SpilledBlocks();
+
+    SpilledBlocks(const SpilledBlocks&) = delete;
+    SpilledBlocks& operator=(const SpilledBlocks&) = delete;
+
+    /**
+     * @brief Gets the number of blocks spilled.
+     * @return The number of blocks.
+     */
+    size_t blockCount() const;
+
+    /**
+     * @brief Finds the first spilled block at or after a block index.
+     * @param index The block index.
+     * @return The block's position, or blockCount() if there is none.
+     */
+    size_t find(size_t index) const;
+
+    /**
+     * @brief Gets the block index of a spilled block.
+     * @param position The block's position, below blockCount().
+     * @return Its block index in the file.
+     */
+    size_t blockIndex(size_t position) const;
+
+    /**
+     * @brief Reads part of a spilled block back from disk.
+     * @param position The block's position, below blockCount().
+     * @param offset The position in the block to start reading from.
+     * @param buffer The buffer to copy the bytes into.
+     * @param length The number of bytes to read.
+     * @throws std::runtime_error if the read fails.
+     */
+    void read(size_t position, size_t offset, char* buffer, size_t length) const;
+};
+
+#endif
@@ -1,7 +1,27 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 #include "FileSystem.hpp"
+#include "FileDescriptor.hpp"
+#include "BlockPool.hpp"
+#include "PathTokenizer.hpp"
+#include "IoRing.hpp"
+#include "LzCodec.hpp"
+#include "NameIndex.hpp"
+#include "NodePool.hpp"
+#include "WorkStealingPool.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // Test for creating a directory
 TEST_CASE("Create Directory", "[filesystem]") {
@@ -152,3 +172,1836 @@ TEST_CASE("Change Directory to Parent from Root", "[filesystem]") {
     fs.changeDirectory("..");
     REQUIRE(fs.getCurrentDirectory()->getName() == "root");
 }
+
+// Test for positional reads and writes through a file descriptor
+TEST_CASE("FileDescriptor Positional Read and Write", "[filedescriptor]") {
+    File file("data.bin");
+    FileDescriptor fd(file);
+    const char hello[] = "Hello, World";
+    REQUIRE(fd.pwrite(hello, 12, 0) == 12);
+    REQUIRE(fd.pwrite("Earth", 5, 7) == 5);
+
+    char buffer[16] = {};
+    REQUIRE(fd.pread(buffer, sizeof(buffer), 0) == 12);
+    REQUIRE(std::string(buffer, 12) == "Hello, Earth");
+    REQUIRE(fd.pread(buffer, 4, 100) == 0);
+
+    // Positional calls leave the current position alone
+    std::vector<char> head = fd.read(5);
+    REQUIRE(std::string(head.begin(), head.end()) == "Hello");
+}
+
+// Test for writing past the end of a file through a file descriptor
+TEST_CASE("FileDescriptor Write Past End", "[filedescriptor]") {
+    File file("data.bin");
+    FileDescriptor fd(file);
+    fd.seek(3);
+    fd.write(std::vector<char>{'a', 'b'});
+    REQUIRE(file.size() == 5);
+    REQUIRE(file.read() == std::vector<char>({0, 0, 0, 'a', 'b'}));
+    REQUIRE(fd.read(10).empty());
+}
+
+// Test for indexed lookups staying in sync with additions and removals
+TEST_CASE("Directory Index Lookups", "[directory]") {
+    Directory dir("root");
+    for (int i = 0; i < 100; ++i) {
+        dir.addFile(File("file" + std::to_string(i)));
+        dir.addDirectory(Directory("dir" + std::to_string(i), &dir));
+    }
+    dir.addFile(File("file7")); // Duplicate names are ignored
+    REQUIRE(dir.listContents().size() == 200);
+
+    dir.removeFile("file0");
+    dir.removeDirectory("dir42");
+    REQUIRE(dir.findFile("file0") == nullptr);
+    REQUIRE(dir.findDirectory("dir42") == nullptr);
+    REQUIRE(dir.findFile("file99")->getName() == "file99");
+    REQUIRE(dir.findDirectory("dir99")->getName() == "dir99");
+    REQUIRE(dir.listContents().size() == 198);
+}
+
+// Test for node addresses staying stable while siblings are added and removed
+TEST_CASE("Stable Directory Nodes", "[directory]") {
+    FileSystem fs;
+    fs.createDirectory("home");
+    fs.changeDirectory("home");
+    fs.createDirectory("user");
+    fs.changeDirectory("user");
+    Directory* user = fs.getCurrentDirectory();
+    Directory* home = user->getParentDirectory();
+
+    fs.changeDirectory("/");
+    for (int i = 0; i < 1000; ++i) {
+        fs.createDirectory("sibling" + std::to_string(i));
+    }
+    fs.deleteDirectory("sibling0");
+
+    REQUIRE(fs.getRootDirectory().findDirectory("home") == home);
+    REQUIRE(home->findDirectory("user") == user);
+    REQUIRE(user->getParentDirectory() == home);
+    REQUIRE(home->getParentDirectory() == &fs.getRootDirectory());
+
+    fs.changeDirectory("/home/user");
+    REQUIRE(fs.getCurrentDirectory() == user);
+    fs.changeDirectory("..");
+    REQUIRE(fs.getCurrentDirectory() == home);
+}
+
+// Test for deep-copying a subtree into a directory
+TEST_CASE("Add Directory Copies Subtree", "[directory]") {
+    Directory source("src");
+    source.createDirectory("nested")->createFile("a.txt")->write(std::vector<char>{'x'});
+
+    Directory target("root");
+    Directory* copy = target.addDirectory(source);
+    REQUIRE(copy->getParentDirectory() == &target);
+    Directory* nested = copy->findDirectory("nested");
+    REQUIRE(nested->getParentDirectory() == copy);
+    REQUIRE(nested->findFile("a.txt")->read() == std::vector<char>{'x'});
+    REQUIRE(nested != source.findDirectory("nested"));
+}
+
+// Test for file data spanning several blocks
+TEST_CASE("File Block Storage", "[file]") {
+    const size_t blockSize = BlockPool::BLOCK_SIZE;
+    File file("big.bin");
+    FileDescriptor fd(file);
+    std::vector<char> chunk(blockSize + 10, 'a');
+    fd.write(chunk);
+    REQUIRE(file.blockCount() == 2);
+
+    // Overwrite across a block boundary and append a third block
+    std::string patch = "boundary";
+    REQUIRE(fd.pwrite(patch.data(), patch.size(), blockSize - 4) == patch.size());
+    fd.seek(2 * blockSize);
+    fd.write(std::vector<char>{'z'});
+    REQUIRE(file.blockCount() == 3);
+    REQUIRE(file.size() == 2 * blockSize + 1);
+
+    std::vector<char> data = file.read();
+    REQUIRE(std::string(data.begin() + blockSize - 4, data.begin() + blockSize + 4) == patch);
+    REQUIRE(data[blockSize + 10] == 0); // Gap reads back as zeros
+    REQUIRE(data.back() == 'z');
+    REQUIRE(file.getData() == data);
+
+    // Shrinking releases blocks and the tail reads as zeros when regrown
+    file.write(std::vector<char>{'x', 'y'});
+    REQUIRE(file.blockCount() == 1);
+    fd.pwrite("!", 1, 5);
+    REQUIRE(file.read() == std::vector<char>({'x', 'y', 0, 0, 0, '!'}));
+}
+
+// Test for sparse files with holes
+TEST_CASE("Sparse File Holes", "[file]") {
+    const size_t blockSize = BlockPool::BLOCK_SIZE;
+    const size_t farOffset = size_t(10) << 30; // 10 GB
+    File file("sparse.idx");
+    FileDescriptor fd(file);
+    fd.pwrite("head", 4, 0);
+    fd.pwrite("tail", 4, farOffset);
+    REQUIRE(file.size() == farOffset + 4);
+    REQUIRE(file.blockCount() == 2);
+    REQUIRE(file.allocatedSize() == 2 * blockSize);
+
+    char buffer[8];
+    REQUIRE(fd.pread(buffer, 8, farOffset - 4) == 8);
+    REQUIRE(std::string(buffer, 8) == std::string(4, '\0') + "tail");
+    REQUIRE(fd.pread(buffer, 8, blockSize * 1000) == 8);
+    REQUIRE(std::string(buffer, 8) == std::string(8, '\0'));
+
+    // Truncating drops the far block and leaves only the first
+    file.write(std::vector<char>{'a'});
+    REQUIRE(file.size() == 1);
+    REQUIRE(file.allocatedSize() == blockSize);
+}
+
+// Test for saving a tree to an image and loading it back
+TEST_CASE("Save and Load Filesystem Image", "[image]") {
+    const std::string imagePath = "test_image.fsimg";
+    {
+        FileSystem fs;
+        fs.createDirectory("home");
+        fs.changeDirectory("home");
+        fs.createDirectory("user");
+        fs.createFile("notes.txt");
+        fs.writeFile("notes.txt", std::vector<char>{'h', 'i'});
+        fs.changeDirectory("user");
+        fs.createFile("sparse.idx");
+        FileDescriptor fd(*fs.getCurrentDirectory()->findFile("sparse.idx"));
+        fd.pwrite("end", 3, 100 * BlockPool::BLOCK_SIZE);
+        fs.save(imagePath);
+    }
+
+    FileSystem fs;
+    fs.createFile("stale.txt");
+    fs.load(imagePath);
+    REQUIRE(fs.getCurrentDirectory()->listContents() == std::vector<std::string>{"home"});
+
+    fs.changeDirectory("/home");
+    REQUIRE(fs.readFile("notes.txt") == std::vector<char>({'h', 'i'}));
+    fs.changeDirectory("user");
+    File* sparse = fs.getCurrentDirectory()->findFile("sparse.idx");
+    REQUIRE(sparse->size() == 100 * BlockPool::BLOCK_SIZE + 3);
+    REQUIRE(sparse->blockCount() == 1);
+
+    // Writing copies the data out of the mapping; the image itself is unchanged
+    FileDescriptor fd(*sparse);
+    fd.pwrite("new", 3, 0);
+    char buffer[3];
+    REQUIRE(fd.pread(buffer, 3, 100 * BlockPool::BLOCK_SIZE) == 3);
+    REQUIRE(std::string(buffer, 3) == "end");
+    REQUIRE(sparse->blockCount() == 2);
+
+    FileSystem reloaded;
+    reloaded.load(imagePath);
+    reloaded.changeDirectory("/home/user");
+    REQUIRE(reloaded.readFile("sparse.idx")[0] == 0);
+    std::remove(imagePath.c_str());
+}
+
+// Test for rejecting files that are not filesystem images
+TEST_CASE("Load Invalid Image", "[image]") {
+    FileSystem fs;
+    REQUIRE_THROWS_AS(fs.load("does_not_exist.fsimg"), std::runtime_error);
+    std::FILE* out = std::fopen("not_an_image.fsimg", "wb");
+    std::fputs("definitely not an image", out);
+    std::fclose(out);
+    REQUIRE_THROWS_AS(fs.load("not_an_image.fsimg"), std::runtime_error);
+    std::remove("not_an_image.fsimg");
+}
+
+// Test for recovering committed mutations from the journal after a restart
+TEST_CASE("Journal Replay After Restart", "[journal]") {
+    const std::string imagePath = "test_journal.fsimg";
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("logs");
+        fs.changeDirectory("logs");
+        fs.createFile("app.log");
+        fs.writeFile("app.log", std::vector<char>{'o', 'k'});
+        fs.createFile("tmp.log");
+        fs.deleteFile("tmp.log");
+        // Destroyed without a checkpoint: the image is stale and only the journal has the changes
+    }
+    {
+        // A torn record at the tail of the journal is ignored
+        std::FILE* journal = std::fopen((imagePath + ".journal").c_str(), "ab");
+        std::fputs("\x40\x00\x00\x00garbage", journal);
+        std::fclose(journal);
+    }
+
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    fs.changeDirectory("/logs");
+    REQUIRE(fs.getCurrentDirectory()->listContents() == std::vector<std::string>{"app.log"});
+    REQUIRE(fs.readFile("app.log") == std::vector<char>({'o', 'k'}));
+
+    fs.writeFile("app.log", std::vector<char>{'n', 'e', 'w'});
+    fs.checkpoint();
+    fs.closePersistent();
+
+    FileSystem reopened;
+    reopened.openPersistent(imagePath);
+    reopened.changeDirectory("/logs");
+    REQUIRE(reopened.readFile("app.log") == std::vector<char>({'n', 'e', 'w'}));
+    reopened.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for replaying changes into a directory deleted and created again
+TEST_CASE("Journal Replay Into Recreated Directory", "[journal]") {
+    const std::string imagePath = "test_recreate.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("/c");
+        fs.createFile("/c/z");
+        fs.deleteDirectory("/c");
+        fs.createDirectory("/d");
+        fs.createDirectory("/c"); // May reuse the node of the deleted /c
+        fs.createFile("/c/w");
+        fs.writeFile("/c/w", std::vector<char>{'w'});
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    REQUIRE(fs.getRootDirectory().findDirectory("c")->listContents() == std::vector<std::string>{"w"});
+    REQUIRE(fs.getRootDirectory().findDirectory("d")->listContents().empty());
+    REQUIRE(fs.readFile("/c/w") == std::vector<char>{'w'});
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for concurrent commits sharing the journal
+TEST_CASE("Journal Group Commit", "[journal]") {
+    const std::string journalPath = "test_group.journal";
+    {
+        Journal journal(journalPath, 0);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&journal, t] {
+                for (int i = 0; i < 50; ++i) {
+                    std::string path = "/t" + std::to_string(t) + "_" + std::to_string(i);
+                    journal.commit(journal.append(JournalOp::CreateFile, path));
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        REQUIRE(journal.lastLsn() == 200);
+    }
+    size_t replayed = 0;
+    uint64_t last = Journal::replay(journalPath, 0, [&](const JournalRecord& record) {
+        REQUIRE(record.op == JournalOp::CreateFile);
+        ++replayed;
+    });
+    REQUIRE(replayed == 200);
+    REQUIRE(last == 200);
+    std::remove(journalPath.c_str());
+}
+
+#ifndef _WIN32
+// Test for refusing to log anything once a flush has failed
+TEST_CASE("Journal Write Failure", "[journal]") {
+    const std::string journalPath = "test_failed.journal";
+    {
+        Journal journal(journalPath, 0);
+        uint64_t first = journal.append(JournalOp::CreateFile, "/first");
+        journal.commit(first);
+        uint64_t durableBytes = journal.size();
+        uint64_t second = journal.append(JournalOp::CreateFile, "/second");
+        uint64_t third = journal.append(JournalOp::WriteFile, "/second", std::string(100, 'x').c_str(), 100);
+
+        // Cap the file size a few bytes past what is on disk, so the next write is torn in the first record
+        struct sigaction ignore = {}, previous;
+        ignore.sa_handler = SIG_IGN;
+        sigaction(SIGXFSZ, &ignore, &previous);
+        struct rlimit limit, saved;
+        getrlimit(RLIMIT_FSIZE, &saved);
+        limit = saved;
+        limit.rlim_cur = durableBytes + 8;
+        setrlimit(RLIMIT_FSIZE, &limit);
+        REQUIRE_THROWS_AS(journal.commit(third), std::runtime_error);
+        setrlimit(RLIMIT_FSIZE, &saved);
+        sigaction(SIGXFSZ, &previous, nullptr);
+
+        REQUIRE_THROWS_AS(journal.commit(second), std::runtime_error); // Lost with the failed batch
+        REQUIRE_THROWS_AS(journal.append(JournalOp::CreateFile, "/fourth"), std::runtime_error);
+        journal.commit(first); // Already durable
+    }
+    size_t replayed = 0;
+    Journal::replay(journalPath, 0, [&](const JournalRecord&) { ++replayed; });
+    REQUIRE(replayed == 1); // Replay stops at the torn record
+    std::remove(journalPath.c_str());
+}
+
+// Test for checkpoints that fail to write the image keeping every record
+TEST_CASE("Failed Checkpoint Keeps The Journal", "[journal]") {
+    const std::string imagePath = "test_failed_checkpoint.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createFile("before");
+        fs.writeFile("before", std::vector<char>{'1'});
+        mkdir((imagePath + ".tmp").c_str(), 0755); // Where save writes the image, so it cannot
+        REQUIRE_THROWS_AS(fs.checkpoint(), std::runtime_error);
+        fs.createFile("between");
+        REQUIRE_THROWS_AS(fs.checkpoint(), std::runtime_error); // Must not drop the log the first one rotated
+        rmdir((imagePath + ".tmp").c_str());
+        fs.createFile("after");
+        // Destroyed without a successful checkpoint: the image is stale and only the journal has the changes
+    }
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        REQUIRE(fs.readFile("/before") == std::vector<char>{'1'});
+        REQUIRE(fs.listContents() == std::vector<std::string>({"before", "between", "after"}));
+        fs.createFile("later");
+        fs.checkpoint(); // Succeeds, and folds everything into the image
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    REQUIRE(fs.listContents() == std::vector<std::string>({"before", "between", "after", "later"}));
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    std::remove((imagePath + ".journal.prev").c_str());
+}
+#endif
+
+// Test for sessions keeping their own current directory
+TEST_CASE("Sessions Have Independent Directories", "[session]") {
+    FileSystem fs;
+    fs.createDirectory("a");
+    fs.createDirectory("b");
+    Session first(fs);
+    Session second(fs);
+    first.changeDirectory("/a");
+    second.changeDirectory("b");
+    first.createFile("one.txt");
+    second.createFile("two.txt");
+    REQUIRE(first.listContents() == std::vector<std::string>({"one.txt"}));
+    REQUIRE(second.listContents() == std::vector<std::string>({"two.txt"}));
+    REQUIRE(fs.getCurrentDirectory() == &fs.getRootDirectory());
+
+    REQUIRE_THROWS_AS(fs.deleteDirectory("a"), std::runtime_error); // first is still working in it
+    first.changeDirectory("..");
+    fs.deleteDirectory("a");
+    REQUIRE(fs.listContents() == std::vector<std::string>({"b"}));
+}
+
+// Test for readers and writers working through separate sessions at once
+TEST_CASE("Concurrent Sessions", "[session]") {
+    FileSystem fs;
+    for (int t = 0; t < 4; ++t) {
+        fs.createDirectory("d" + std::to_string(t));
+    }
+    fs.createFile("shared.txt");
+    fs.writeFile("shared.txt", std::vector<char>(100, 'x'));
+
+    std::atomic<int> shortReads(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&fs, &shortReads, t] {
+            Session session(fs);
+            for (int i = 0; i < 100; ++i) {
+                if (session.readFile("shared.txt").size() != 100) { // Readers share the root and the file
+                    ++shortReads;
+                }
+            }
+            session.changeDirectory("d" + std::to_string(t));
+            for (int i = 0; i < 50; ++i) {
+                std::string name = "f" + std::to_string(i);
+                session.createFile(name);
+                session.writeFile(name, std::vector<char>(i, 'a' + t));
+            }
+        });
+    }
+    workers.emplace_back([&fs] {
+        Session writer(fs);
+        for (int i = 0; i < 100; ++i) {
+            writer.writeFile("shared.txt", std::vector<char>(100, static_cast<char>('a' + i % 26)));
+        }
+    });
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(shortReads == 0);
+    for (int t = 0; t < 4; ++t) {
+        fs.changeDirectory("/d" + std::to_string(t));
+        REQUIRE(fs.listContents().size() == 50);
+        REQUIRE(fs.readFile("f49") == std::vector<char>(49, static_cast<char>('a' + t)));
+    }
+}
+
+// Test for resolving absolute paths through the dentry cache
+TEST_CASE("Dentry Cache Hits and Invalidation", "[dentrycache]") {
+    FileSystem fs;
+    fs.createDirectory("a");
+    fs.changeDirectory("a");
+    fs.createDirectory("b");
+    fs.changeDirectory("/");
+
+    fs.changeDirectory("/a/b");
+    Directory* first = fs.getCurrentDirectory();
+    fs.changeDirectory("/a/b");
+    REQUIRE(fs.getCurrentDirectory() == first);
+    DentryCache::Stats stats = fs.getDentryCacheStats();
+    REQUIRE(stats.hits == 1);
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.entries == 1);
+
+    fs.changeDirectory("/a//b/"); // Not canonical, resolved without the cache
+    REQUIRE(fs.getDentryCacheStats().hits == 1);
+
+    fs.changeDirectory("/");
+    fs.deleteDirectory("a");
+    REQUIRE(fs.getDentryCacheStats().entries == 0);
+    REQUIRE_THROWS_AS(fs.changeDirectory("/a/b"), std::runtime_error);
+
+    fs.createDirectory("a");
+    fs.changeDirectory("a");
+    fs.createDirectory("b");
+    fs.changeDirectory("/a/b");
+    REQUIRE(fs.getCurrentDirectory()->getParentDirectory()->getParentDirectory() == &fs.getRootDirectory());
+
+    fs.resetDentryCacheStats();
+    REQUIRE(fs.getDentryCacheStats().hits == 0);
+    REQUIRE(fs.getDentryCacheStats().misses == 0);
+}
+
+// Test for invalidating exactly the paths at or below a directory
+TEST_CASE("Dentry Cache Invalidates Only The Subtree", "[dentrycache]") {
+    Directory root("root");
+    Directory* a = root.createDirectory("a");
+    Directory* b = a->createDirectory("b");
+    Directory* c = b->createDirectory("c");
+    Directory* ab = root.createDirectory("ab");
+    Directory* dashed = root.createDirectory("a-b");
+
+    DentryCache cache;
+    cache.insert("/a", a);
+    cache.insert("/a/b", b);
+    cache.insert("/a/b/c", c);
+    cache.insert("/ab", ab);
+    cache.insert("/a-b", dashed); // Sorts between "/a" and "/a/"
+    cache.insert("/a-b/b", b);
+
+    cache.invalidate("/a/b");
+    REQUIRE(cache.stats().entries == 4);
+    REQUIRE(cache.lookup("/a/b") == nullptr);
+    REQUIRE(cache.lookup("/a/b/c") == nullptr);
+    REQUIRE(cache.lookup("/a") == a);
+
+    cache.invalidate("/a");
+    REQUIRE(cache.stats().entries == 3);
+    REQUIRE(cache.lookup("/ab") == ab);
+    REQUIRE(cache.lookup("/a-b") == dashed);
+    REQUIRE(cache.lookup("/a-b/b") == b);
+
+    DentryCache small(16); // One entry per shard, so inserts evict
+    for (int i = 0; i < 200; ++i) {
+        small.insert("/a/" + std::to_string(i), a);
+    }
+    REQUIRE(small.stats().entries <= 16);
+    small.invalidate("/a");
+    REQUIRE(small.stats().entries == 0);
+}
+
+// Test for splitting paths into views without allocating
+TEST_CASE("Path Tokenizer", "[path]") {
+    std::string path = "//home/./user//docs/../file.txt/";
+    PathTokenizer tokenizer(path);
+    std::vector<std::string> parts;
+    std::string_view part;
+    while (tokenizer.next(part)) {
+        REQUIRE(part.data() >= path.data());
+        REQUIRE(part.data() < path.data() + path.size()); // Views into the caller's string
+        parts.emplace_back(part);
+    }
+    REQUIRE(parts == std::vector<std::string>({"home", "user", "docs", "..", "file.txt"}));
+    PathTokenizer empty("///");
+    REQUIRE_FALSE(empty.next(part));
+}
+
+// Test for file and directory operations given paths rather than names
+TEST_CASE("Operations Take Paths", "[path]") {
+    FileSystem fs;
+    fs.createDirectory("home");
+    fs.createDirectory("/home/user");
+    fs.createFile("home/user/notes.txt");
+    fs.writeFile("/home//user/./notes.txt", std::vector<char>{'o', 'k'});
+    fs.changeDirectory("/home/user/../user");
+    REQUIRE(fs.getCurrentDirectory()->getName() == "user");
+    REQUIRE(fs.readFile("notes.txt") == std::vector<char>({'o', 'k'}));
+    REQUIRE(fs.readFile("../user/notes.txt") == std::vector<char>({'o', 'k'}));
+
+    fs.changeDirectory("/");
+    fs.deleteFile("home/user/notes.txt");
+    REQUIRE(fs.getRootDirectory().findDirectory("home")->findDirectory("user")->listContents().empty());
+    fs.deleteDirectory("/home/user");
+    REQUIRE(fs.getRootDirectory().findDirectory("home")->listContents().empty());
+    REQUIRE_THROWS_AS(fs.createFile("missing/file.txt"), std::runtime_error);
+    REQUIRE_THROWS_AS(fs.createDirectory("home/.."), std::runtime_error);
+}
+
+// Test for per-operation statistics
+TEST_CASE("Operation Statistics", "[stats]") {
+    FileSystem fs;
+    fs.createFile("untimed.txt");
+    REQUIRE(fs.getStats()[StatsOp::Create].calls == 0); // Off until enabled
+
+    fs.setStatsEnabled(true);
+    fs.createDirectory("logs");
+    fs.createFile("logs/app.log");
+    fs.writeFile("logs/app.log", std::vector<char>(100, 'x'));
+    fs.readFile("logs/app.log");
+    REQUIRE_THROWS_AS(fs.readFile("logs/missing.log"), std::runtime_error);
+    fs.changeDirectory("/logs");
+    fs.deleteFile("app.log");
+
+    std::thread other([&fs] {
+        Session session(fs);
+        session.createFile("other.txt"); // Recorded in another thread's shard
+    });
+    other.join();
+
+    OperationStats::Snapshot stats = fs.getStats();
+    REQUIRE(stats[StatsOp::Create].calls == 3);
+    REQUIRE(stats[StatsOp::Write].calls == 1);
+    REQUIRE(stats[StatsOp::Write].bytes == 100);
+    REQUIRE(stats[StatsOp::Read].calls == 2);
+    REQUIRE(stats[StatsOp::Read].bytes == 100);
+    REQUIRE(stats[StatsOp::Delete].calls == 1);
+    REQUIRE(stats[StatsOp::ChangeDirectory].calls == 1);
+    REQUIRE(stats[StatsOp::Lookup].calls >= 5);
+    uint64_t bucketed = 0;
+    for (uint64_t count : stats[StatsOp::Create].buckets) {
+        bucketed += count;
+    }
+    REQUIRE(bucketed == 3);
+    REQUIRE(stats[StatsOp::Create].percentile(0.5) <= stats[StatsOp::Create].percentile(0.99));
+
+    fs.resetStats();
+    REQUIRE(fs.getStats()[StatsOp::Create].calls == 0);
+
+    fs.createFile("raw.bin");
+    File* raw = fs.getCurrentDirectory()->findFile("raw.bin");
+    FileDescriptor fd = fs.openDescriptor(*raw);
+    char buffer[64];
+    REQUIRE(fd.pwrite("0123456789", 10, 0) == 10);
+    REQUIRE(fd.pread(buffer, sizeof(buffer), 0) == 10);
+    ConstIoVec out[] = {{"abc", 3}, {"de", 2}};
+    REQUIRE(fd.writev(out, 2) == 5);
+    fd.seek(0);
+    IoVec in[] = {{buffer, 4}, {buffer + 4, 4}};
+    REQUIRE(fd.readv(in, 2) == 8);
+    FileDescriptor(*raw).pwrite("x", 1, 0); // Not opened through the filesystem, so not counted
+    {
+        IoRing ring(fs, 8, 2);
+        REQUIRE(ring.submitAsync({IoOp::Write, raw, buffer, 6, 10, nullptr, 1}).get().result == 6);
+        REQUIRE(ring.submitAsync({IoOp::Read, raw, buffer, sizeof(buffer), 0, nullptr, 2}).get().result == 16);
+    }
+    stats = fs.getStats();
+    REQUIRE(stats[StatsOp::Write].calls == 3);
+    REQUIRE(stats[StatsOp::Write].bytes == 21);
+    REQUIRE(stats[StatsOp::Read].calls == 3);
+    REQUIRE(stats[StatsOp::Read].bytes == 34);
+}
+
+// Test for scatter/gather reads and writes
+TEST_CASE("FileDescriptor Vectored I/O", "[filedescriptor]") {
+    File file("record.bin");
+    FileDescriptor fd(file);
+    std::string header = "HDR:";
+    std::vector<char> payload(BlockPool::BLOCK_SIZE + 10, 'p'); // Straddles a block boundary
+    std::string trailer = ":END";
+    ConstIoVec out[] = {{header.data(), header.size()}, {payload.data(), payload.size()}, {trailer.data(), trailer.size()}};
+    size_t total = header.size() + payload.size() + trailer.size();
+    REQUIRE(fd.writev(out, 3) == total);
+    REQUIRE(file.size() == total);
+    REQUIRE(file.blockCount() == 2);
+    REQUIRE(fd.pwritev(out, 3, total) == total); // A second record right behind the first
+    REQUIRE(file.size() == 2 * total);
+
+    char head[4];
+    std::vector<char> body(payload.size());
+    char tail[4];
+    IoVec in[] = {{head, sizeof(head)}, {body.data(), body.size()}, {tail, sizeof(tail)}};
+    REQUIRE(fd.preadv(in, 3, total) == total);
+    REQUIRE(std::string(head, 4) == "HDR:");
+    REQUIRE(body == payload);
+    REQUIRE(std::string(tail, 4) == ":END");
+
+    fd.seek(2 * total - 6);
+    REQUIRE(fd.readv(in, 3) == 6); // Stops at the end of the file
+    REQUIRE(std::string(head, 4) == "pp:E");
+}
+
+// Test for submitting requests through the I/O ring
+TEST_CASE("IoRing Submission and Completion", "[ioring]") {
+    FileSystem fs;
+    fs.createDirectory("data");
+    IoRing ring(fs, 8, 4);
+
+    const size_t count = 20;
+    std::vector<std::string> paths;
+    std::vector<IoRequest> creates;
+    for (size_t i = 0; i < count; ++i) {
+        paths.push_back("/data/f" + std::to_string(i));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        creates.push_back({IoOp::CreateFile, nullptr, nullptr, 0, 0, paths[i].c_str(), i});
+    }
+    std::vector<bool> seen(count, false);
+    IoCompletion done[8];
+    size_t submitted = 0;
+    size_t reaped = 0;
+    while (reaped < count) {
+        submitted += ring.submit(creates.data() + submitted, count - submitted); // The ring holds only 8 at a time
+        size_t got = ring.wait(done, 8);
+        for (size_t i = 0; i < got; ++i) {
+            REQUIRE(done[i].result == 0);
+            seen[done[i].userData] = true;
+        }
+        reaped += got;
+    }
+    REQUIRE(std::count(seen.begin(), seen.end(), true) == count);
+    fs.changeDirectory("/data");
+    REQUIRE(fs.listContents().size() == count);
+    REQUIRE(ring.poll(done, 8) == 0);
+
+    File* file = fs.getCurrentDirectory()->findFile("f0");
+    std::string first = "hello ";
+    std::string second = "world";
+    IoRequest writes[] = {{IoOp::Write, file, first.data(), first.size(), 0, nullptr, 1},
+                          {IoOp::Write, file, second.data(), second.size(), first.size(), nullptr, 2}};
+    REQUIRE(ring.submit(writes, 2) == 2);
+    REQUIRE(ring.wait(done, 8, 2) == 2);
+    REQUIRE(done[0].result + done[1].result == 11);
+
+    char buffer[11];
+    std::future<IoCompletion> read = ring.submitAsync({IoOp::Read, file, buffer, sizeof(buffer), 0, nullptr, 3});
+    IoCompletion completion = read.get();
+    REQUIRE(completion.userData == 3);
+    REQUIRE(completion.result == 11);
+    REQUIRE(std::string(buffer, 11) == "hello world");
+
+    REQUIRE(ring.submitAsync({IoOp::DeleteFile, nullptr, nullptr, 0, 0, "/missing/f0", 4}).get().result == -1);
+}
+
+// Test for applying a batch of mutations
+TEST_CASE("Batch Operations", "[batch]") {
+    const std::string imagePath = "test_batch.fsimg";
+    std::remove(imagePath.c_str()); // Left over from an interrupted run
+    std::remove((imagePath + ".journal").c_str());
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        std::vector<BatchOp> ops;
+        ops.push_back({BatchOpType::CreateDirectory, "/data", {}});
+        for (int i = 0; i < 100; ++i) {
+            ops.push_back({BatchOpType::CreateFile, "/data/f" + std::to_string(i), {}});
+        }
+        ops.push_back({BatchOpType::WriteFile, "/data/f7", {'h', 'i'}});
+        ops.push_back({BatchOpType::DeleteFile, "/data/f8", {}});
+        ops.push_back({BatchOpType::CreateFile, "top.txt", {}}); // Relative to the current directory
+        ops.push_back({BatchOpType::CreateFile, "/missing/f", {}});
+        ops.push_back({BatchOpType::WriteFile, "/data/f8", {'x'}}); // Deleted earlier in the batch
+        ops.push_back({BatchOpType::CreateFile, "/data/..", {}});
+
+        std::vector<BatchResult> results = fs.applyBatch(ops);
+        REQUIRE(results.size() == ops.size());
+        for (size_t i = 0; i < 104; ++i) {
+            REQUIRE(results[i].ok);
+        }
+        REQUIRE_FALSE(results[104].ok);
+        REQUIRE(results[104].error.find("not found") != std::string::npos);
+        REQUIRE_FALSE(results[105].ok);
+        REQUIRE_FALSE(results[106].ok);
+        REQUIRE(results[106].error.find("Invalid path") != std::string::npos);
+        // Not checkpointed: the journal alone has the batch
+    }
+
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    REQUIRE(fs.listContents().size() == 2);
+    fs.changeDirectory("/data");
+    REQUIRE(fs.listContents().size() == 99);
+    REQUIRE(fs.readFile("f7") == std::vector<char>({'h', 'i'}));
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for copy-on-write file clones
+TEST_CASE("Copy-On-Write Clones", "[clone]") {
+    FileSystem fs;
+    fs.createDirectory("base");
+    fs.createDirectory("base/conf");
+    fs.createFile("base/conf/app.cfg");
+    std::vector<char> contents(4 * BlockPool::BLOCK_SIZE, 'b');
+    fs.writeFile("base/conf/app.cfg", contents);
+    size_t before = BlockPool::instance().blocksInUse();
+
+    fs.cloneFile("base/conf/app.cfg", "copy.cfg");
+    fs.cloneDirectory("/base", "/site");
+    REQUIRE(BlockPool::instance().blocksInUse() == before); // Only metadata was copied
+    REQUIRE(fs.readFile("copy.cfg") == contents);
+    REQUIRE(fs.readFile("/site/conf/app.cfg") == contents);
+
+    File* copy = fs.getCurrentDirectory()->findFile("copy.cfg");
+    FileDescriptor fd(*copy);
+    fd.pwrite("X", 1, BlockPool::BLOCK_SIZE + 5); // Diverges in one block
+    REQUIRE(BlockPool::instance().blocksInUse() == before + 1);
+    REQUIRE(fs.readFile("base/conf/app.cfg") == contents);
+    REQUIRE(fs.readFile("/site/conf/app.cfg") == contents);
+    REQUIRE(fs.readFile("copy.cfg")[BlockPool::BLOCK_SIZE + 5] == 'X');
+
+    fs.deleteDirectory("base");
+    REQUIRE(fs.readFile("/site/conf/app.cfg") == contents); // Still holds its references
+    fs.deleteDirectory("site");
+    fs.deleteFile("copy.cfg");
+    REQUIRE(BlockPool::instance().blocksInUse() == before - 4);
+
+    REQUIRE_THROWS_AS(fs.cloneFile("missing.cfg", "other.cfg"), std::runtime_error);
+    fs.createDirectory("tree");
+    REQUIRE_THROWS_AS(fs.cloneDirectory("tree", "tree/inner"), std::runtime_error);
+    fs.createDirectory("taken");
+    REQUIRE_THROWS_AS(fs.cloneDirectory("tree", "taken"), std::runtime_error);
+}
+
+// Test for replaying clones from the journal
+TEST_CASE("Clone Journal Replay", "[clone]") {
+    const std::string imagePath = "test_clone.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("a");
+        fs.createFile("a/f");
+        fs.writeFile("a/f", std::vector<char>{'1'});
+        fs.cloneDirectory("a", "b");
+        fs.cloneFile("a/f", "b/g");
+        fs.writeFile("a/f", std::vector<char>{'2'}); // After the clones, so the copies keep '1'
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    REQUIRE(fs.readFile("/a/f") == std::vector<char>{'2'});
+    REQUIRE(fs.readFile("/b/f") == std::vector<char>{'1'});
+    REQUIRE(fs.readFile("/b/g") == std::vector<char>{'1'});
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for checkpoints taken while other sessions keep changing the tree
+TEST_CASE("Checkpoint Under Concurrent Writes", "[journal]") {
+    const std::string imagePath = "test_checkpoint_concurrent.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    std::vector<std::string> names;
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("d");
+        std::atomic<bool> done(false);
+        std::thread writer([&fs, &done] {
+            Session session(fs);
+            for (int i = 0; !done || i < 200; ++i) {
+                std::string name = "/d/f" + std::to_string(i);
+                session.createFile(name);
+                session.writeFile(name, std::vector<char>(i % 100, static_cast<char>('a' + i % 26)));
+                if (i % 3 == 0) {
+                    session.deleteFile("/d/f" + std::to_string(i / 2));
+                }
+            }
+        });
+        for (int i = 0; i < 10; ++i) {
+            fs.checkpoint(); // Writes the image from a snapshot while the writer carries on
+        }
+        done = true;
+        writer.join();
+        fs.changeDirectory("/d");
+        names = fs.listContents();
+        std::sort(names.begin(), names.end());
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    fs.changeDirectory("/d");
+    std::vector<std::string> reopened = fs.listContents();
+    std::sort(reopened.begin(), reopened.end());
+    REQUIRE(reopened == names);
+    for (const std::string& name : names) {
+        int i = std::stoi(name.substr(1));
+        REQUIRE(fs.readFile(name) == std::vector<char>(i % 100, static_cast<char>('a' + i % 26)));
+    }
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for cloning directories while other sessions write inside the source
+TEST_CASE("Clones Under Concurrent Writes", "[clone]") {
+    const std::string imagePath = "test_clone_concurrent.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    const int clones = 20;
+    std::vector<std::vector<char>> copied(clones);
+    std::vector<std::vector<std::string>> listed(clones);
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("src");
+        fs.createDirectory("src/data");
+        fs.createDirectory("src/logs");
+        fs.createFile("src/data/f");
+        fs.createDirectory("other");
+        std::vector<std::thread> workers;
+        workers.emplace_back([&fs] {
+            Session session(fs);
+            for (int i = 0; i < clones; ++i) {
+                session.cloneDirectory("/src", "/c" + std::to_string(i));
+            }
+        });
+        workers.emplace_back([&fs] {
+            Session session(fs);
+            for (int i = 0; i < 200; ++i) {
+                session.writeFile("/src/data/f", std::vector<char>(i % 50, static_cast<char>('a' + i % 26)));
+                session.createFile("/src/logs/l" + std::to_string(i));
+                session.createFile("/other/o" + std::to_string(i)); // Outside the source, so never held up by a copy
+            }
+        });
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (int i = 0; i < clones; ++i) {
+            std::string copy = "/c" + std::to_string(i);
+            copied[i] = fs.readFile(copy + "/data/f");
+            fs.changeDirectory(copy + "/logs");
+            listed[i] = fs.listContents();
+            std::sort(listed[i].begin(), listed[i].end());
+            SubtreeUsage usage = fs.usage(copy);
+            REQUIRE(usage.directories == 2);
+            REQUIRE(usage.files == listed[i].size() + 1);
+            REQUIRE(usage.bytes == copied[i].size());
+        }
+        uint64_t files = 401; // The source's file, its logs, and the files in /other
+        for (const std::vector<std::string>& names : listed) {
+            files += names.size() + 1;
+        }
+        REQUIRE(fs.usage("/").files == files); // Each copy counted once it was linked in
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    for (int i = 0; i < clones; ++i) { // Replay copies the source as it stood when each clone was made
+        std::string copy = "/c" + std::to_string(i);
+        REQUIRE(fs.readFile(copy + "/data/f") == copied[i]);
+        fs.changeDirectory(copy + "/logs");
+        std::vector<std::string> names = fs.listContents();
+        std::sort(names.begin(), names.end());
+        REQUIRE(names == listed[i]);
+    }
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for file clones crossing between two directories in both directions at once
+TEST_CASE("Crossing File Clones", "[clone]") {
+    FileSystem fs;
+    fs.createDirectory("a");
+    fs.createDirectory("b");
+    fs.createFile("a/f");
+    fs.createFile("b/g");
+    fs.writeFile("a/f", std::vector<char>{'f'});
+    fs.writeFile("b/g", std::vector<char>{'g'});
+    std::vector<std::thread> workers;
+    workers.emplace_back([&fs] {
+        Session session(fs);
+        for (int i = 0; i < 200; ++i) {
+            session.cloneFile("/a/f", "/b/f" + std::to_string(i));
+        }
+    });
+    workers.emplace_back([&fs] {
+        Session session(fs);
+        for (int i = 0; i < 200; ++i) {
+            session.cloneFile("/b/g", "/a/g" + std::to_string(i));
+            session.cloneFile("/a/f", "/a/h" + std::to_string(i)); // Both ends in one directory
+        }
+    });
+    workers.emplace_back([&fs] {
+        Session session(fs);
+        for (int i = 0; i < 200; ++i) {
+            session.writeFile("/a/f", std::vector<char>(1, static_cast<char>('a' + i % 26)));
+        }
+    });
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(fs.usage("/a").files == 401);
+    REQUIRE(fs.usage("/b").files == 201);
+    REQUIRE(fs.readFile("/a/g199") == std::vector<char>{'g'});
+    REQUIRE(fs.readFile("/b/f199").size() == 1);
+    REQUIRE_THROWS_AS(fs.cloneFile("/a/f", "/b/f0"), std::runtime_error);
+}
+
+// Test for point-in-time snapshots of the tree
+TEST_CASE("Snapshots", "[snapshot]") {
+    FileSystem fs;
+    fs.createDirectory("etc");
+    fs.createDirectory("var");
+    for (int i = 0; i < 100; ++i) {
+        fs.createFile("etc/f" + std::to_string(i));
+    }
+    fs.writeFile("etc/f1", std::vector<char>{'o', 'l', 'd'});
+    fs.createDirectory("var/log");
+    fs.createFile("var/log/app.log");
+    fs.writeFile("var/log/app.log", std::vector<char>{'l', 'o', 'g'});
+
+    std::shared_ptr<Snapshot> snapshot = fs.snapshot();
+    REQUIRE(snapshot->preservedCount() == 0); // Nothing copied up front
+
+    fs.writeFile("etc/f1", std::vector<char>{'n', 'e', 'w'});
+    fs.createFile("etc/added");
+    fs.deleteFile("etc/f2");
+    fs.deleteDirectory("var/log");
+    File* f3 = fs.getRootDirectory().findDirectory("etc")->findFile("f3");
+    FileDescriptor(*f3).pwrite("x", 1, 0); // Descriptor writes are preserved too
+    REQUIRE(snapshot->preservedCount() == 4); // etc, var, f1 and f3, each copied once
+
+    REQUIRE(snapshot->readFile("/etc/f1") == std::vector<char>({'o', 'l', 'd'}));
+    REQUIRE(snapshot->readFile("etc/f3").empty());
+    REQUIRE(snapshot->readFile("/var/log/app.log") == std::vector<char>({'l', 'o', 'g'})); // Deleted from the live tree
+    std::vector<std::string> etc = snapshot->listContents("/etc");
+    REQUIRE(etc.size() == 100);
+    REQUIRE(std::find(etc.begin(), etc.end(), "f2") != etc.end());
+    REQUIRE(std::find(etc.begin(), etc.end(), "added") == etc.end());
+    REQUIRE(snapshot->listContents("/var/log/..") == std::vector<std::string>{"log"});
+    REQUIRE_THROWS_AS(snapshot->readFile("/etc/added"), std::runtime_error);
+
+    REQUIRE(fs.readFile("/etc/f1") == std::vector<char>({'n', 'e', 'w'}));
+    fs.changeDirectory("/var");
+    REQUIRE(fs.listContents().empty());
+
+    std::shared_ptr<Snapshot> second = fs.snapshot();
+    fs.writeFile("/etc/f1", std::vector<char>{'3'});
+    REQUIRE(second->readFile("/etc/f1") == std::vector<char>({'n', 'e', 'w'}));
+    REQUIRE(snapshot->readFile("/etc/f1") == std::vector<char>({'o', 'l', 'd'})); // Kept its own, older copy
+    REQUIRE(second->preservedCount() == 1);
+
+    REQUIRE_THROWS_AS(fs.load("unused.fsimg"), std::runtime_error);
+    snapshot.reset();
+    second.reset();
+    fs.writeFile("/etc/f1", std::vector<char>{'4'}); // No snapshot left to preserve into
+}
+
+// Test for reading a snapshot while writers keep changing the tree
+TEST_CASE("Snapshot Under Concurrent Writes", "[snapshot]") {
+    FileSystem fs;
+    fs.createDirectory("data");
+    for (int i = 0; i < 50; ++i) {
+        fs.createFile("data/f" + std::to_string(i));
+        fs.writeFile("data/f" + std::to_string(i), std::vector<char>(64, 'a'));
+    }
+    std::shared_ptr<Snapshot> snapshot = fs.snapshot();
+    std::atomic<bool> done(false);
+    std::thread writer([&fs, &done] {
+        Session session(fs);
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 0; i < 50; ++i) {
+                std::string path = "/data/f" + std::to_string(i);
+                session.writeFile(path, std::vector<char>(64, 'b'));
+                session.deleteFile(path);
+                session.createFile(path);
+            }
+        }
+        done = true;
+    });
+    std::atomic<int> failures(0);
+    while (!done) {
+        for (int i = 0; i < 50; ++i) {
+            if (snapshot->readFile("/data/f" + std::to_string(i)) != std::vector<char>(64, 'a')) {
+                ++failures;
+            }
+        }
+        if (snapshot->listContents("/data").size() != 50) {
+            ++failures;
+        }
+    }
+    writer.join();
+    REQUIRE(failures == 0);
+}
+
+// Test for merging identical blocks across files
+TEST_CASE("Block Deduplication", "[dedup]") {
+    FileSystem fs;
+    fs.createDirectory("vendor");
+    std::vector<char> asset(3 * BlockPool::BLOCK_SIZE);
+    for (size_t i = 0; i < asset.size(); ++i) {
+        asset[i] = static_cast<char>(i * 7 + i / BlockPool::BLOCK_SIZE); // Three different blocks
+    }
+    for (int i = 0; i < 10; ++i) {
+        std::string path = "vendor/copy" + std::to_string(i);
+        fs.createFile(path);
+        fs.writeFile(path, asset);
+    }
+    fs.createFile("unique");
+    fs.writeFile("unique", std::vector<char>(BlockPool::BLOCK_SIZE, 'u'));
+    size_t before = BlockPool::instance().blocksInUse();
+
+    REQUIRE(fs.deduplicate() == 27); // Nine copies of three blocks
+    REQUIRE(BlockPool::instance().blocksInUse() == before - 27);
+    BlockStore::Stats stats = fs.getDeduplicationStats();
+    REQUIRE(stats.blocksScanned == 31);
+    REQUIRE(stats.duplicates == 27);
+    REQUIRE(stats.bytesSaved == 27 * BlockPool::BLOCK_SIZE);
+    REQUIRE(stats.uniqueBlocks == 4);
+    REQUIRE(stats.hitRate() > 0.8);
+    REQUIRE(fs.deduplicate() == 0); // Nothing new to scan
+
+    fs.writeFile("vendor/copy3", std::vector<char>(10, 'x')); // Diverges without touching the others
+    for (int i = 0; i < 10; ++i) {
+        if (i != 3) {
+            REQUIRE(fs.readFile("vendor/copy" + std::to_string(i)) == asset);
+        }
+    }
+    REQUIRE(fs.readFile("vendor/copy3") == std::vector<char>(10, 'x'));
+
+    fs.deleteDirectory("vendor");
+    fs.deleteFile("unique");
+    fs.deduplicate(); // The sweep hands the stored blocks back to the pool
+    REQUIRE(fs.getDeduplicationStats().uniqueBlocks == 0);
+
+    fs.setDeduplication(true, std::chrono::milliseconds(1));
+    fs.createFile("a");
+    fs.createFile("b");
+    fs.writeFile("a", asset);
+    fs.writeFile("b", asset);
+    for (int i = 0; i < 1000 && fs.getDeduplicationStats().duplicates < 30; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    fs.setDeduplication(false);
+    REQUIRE(fs.getDeduplicationStats().duplicates == 30);
+    REQUIRE(fs.readFile("b") == asset);
+}
+
+// Test for the LZ codec on its own
+TEST_CASE("LZ Codec Round Trip", "[compression]") {
+    std::mt19937 random(42);
+    std::vector<std::vector<char>> inputs = {{}, {'a'}, {'a', 'b', 'c'}, std::vector<char>(10000, 'z')};
+    std::vector<char> text;
+    while (text.size() < 20000) {
+        std::string word = "block" + std::to_string(random() % 50) + " ";
+        text.insert(text.end(), word.begin(), word.end());
+    }
+    inputs.push_back(text);
+    std::vector<char> noise(5000);
+    for (char& c : noise) {
+        c = static_cast<char>(random());
+    }
+    inputs.push_back(noise);
+
+    for (const std::vector<char>& input : inputs) {
+        std::vector<char> packed(LzCodec::bound(input.size()));
+        size_t length = LzCodec::compress(input.data(), input.size(), packed.data());
+        REQUIRE(length <= packed.size());
+        std::vector<char> output(input.size());
+        REQUIRE(LzCodec::decompress(packed.data(), length, output.data(), output.size()));
+        REQUIRE(output == input);
+        if (length > 2) {
+            REQUIRE_FALSE(LzCodec::decompress(packed.data(), length / 2, output.data(), output.size())); // Truncated
+        }
+    }
+    std::vector<char> packed(LzCodec::bound(text.size()));
+    REQUIRE(LzCodec::compress(text.data(), text.size(), packed.data()) < text.size() / 2);
+}
+
+// Test for compressing files nobody has touched for a while
+TEST_CASE("Cold File Compression", "[compression]") {
+    const std::string imagePath = "test_compression.fsimg";
+    std::remove(imagePath.c_str());
+    FileSystem fs;
+    std::vector<char> text;
+    while (text.size() < 8 * BlockPool::BLOCK_SIZE) {
+        std::string line = "line " + std::to_string(text.size() % 97) + ": the quick brown fox\n";
+        text.insert(text.end(), line.begin(), line.end());
+    }
+    std::vector<char> noise(2 * BlockPool::BLOCK_SIZE);
+    std::mt19937 random(7);
+    for (char& c : noise) {
+        c = static_cast<char>(random());
+    }
+    fs.createFile("log");
+    fs.writeFile("log", text);
+    fs.createFile("noise");
+    fs.writeFile("noise", noise);
+    fs.createFile("sparse");
+    File* sparse = fs.getCurrentDirectory()->findFile("sparse");
+    FileDescriptor(*sparse).pwrite(text.data(), 100, 5 * BlockPool::BLOCK_SIZE + 10); // One block past a hole
+    File* log = fs.getCurrentDirectory()->findFile("log");
+
+    REQUIRE(fs.compressColdFiles(std::chrono::hours(1)) == 0); // Everything is still warm
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CompressedBlocks::resetStats();
+    size_t before = BlockPool::instance().blocksInUse();
+    REQUIRE(fs.compressColdFiles(std::chrono::milliseconds(1)) == 2); // The noise does not compress
+    REQUIRE(log->isCompressed());
+    REQUIRE(sparse->isCompressed());
+    size_t packedBlocks = (text.size() + BlockPool::BLOCK_SIZE - 1) / BlockPool::BLOCK_SIZE + 1;
+    REQUIRE(BlockPool::instance().blocksInUse() == before - packedBlocks);
+    CompressedBlocks::Stats stats = fs.getCompressionStats();
+    REQUIRE(stats.filesCompressed == 2);
+    REQUIRE(stats.ratio() > 3);
+    REQUIRE(stats.blocksDecompressed == 0);
+
+    REQUIRE(fs.readFile("log") == text); // Decompressed on demand, still packed afterwards
+    REQUIRE(log->isCompressed());
+    char buffer[100];
+    REQUIRE(FileDescriptor(*sparse).pread(buffer, 100, 5 * BlockPool::BLOCK_SIZE + 10) == 100);
+    REQUIRE(std::equal(buffer, buffer + 100, text.begin()));
+    REQUIRE(FileDescriptor(*sparse).pread(buffer, 10, 0) == 10);
+    REQUIRE(std::count(buffer, buffer + 10, 0) == 10); // The hole stays a hole
+    stats = fs.getCompressionStats();
+    REQUIRE(stats.blocksDecompressed >= packedBlocks);
+    REQUIRE(stats.decompressNanoseconds > 0);
+
+    std::shared_ptr<Snapshot> snapshot = fs.snapshot();
+    FileDescriptor(*log).pwrite("LINE", 4, 0); // Unpacks the file
+    REQUIRE_FALSE(log->isCompressed());
+    REQUIRE(snapshot->readFile("log") == text);
+    std::vector<char> changed = text;
+    std::copy_n("LINE", 4, changed.begin());
+    REQUIRE(fs.readFile("log") == changed);
+    snapshot.reset();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    REQUIRE(fs.compressColdFiles(std::chrono::milliseconds(1)) == 1);
+    fs.save(imagePath); // Saved from the packed blocks
+    FileSystem loaded;
+    loaded.load(imagePath);
+    REQUIRE(loaded.readFile("log") == changed);
+    REQUIRE(loaded.readFile("noise") == noise);
+    std::remove(imagePath.c_str());
+
+    fs.setCompression(true, std::chrono::milliseconds(1), std::chrono::milliseconds(1));
+    fs.writeFile("noise", text);
+    File* rewritten = fs.getCurrentDirectory()->findFile("noise");
+    for (int i = 0; i < 1000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::shared_lock<std::shared_mutex> lock(rewritten->getMutex());
+        if (rewritten->isCompressed()) {
+            break;
+        }
+    }
+    fs.setCompression(false);
+    REQUIRE(rewritten->isCompressed());
+    REQUIRE(fs.readFile("noise") == text);
+}
+
+// Test for evicting cold files to disk under a memory budget
+TEST_CASE("Tiered Storage", "[spill]") {
+    const std::string imagePath = "test_spill.fsimg";
+    std::remove(imagePath.c_str());
+    FileSystem fs;
+    std::vector<std::vector<char>> contents;
+    for (int i = 0; i < 10; ++i) {
+        std::string name = "f" + std::to_string(i);
+        std::vector<char> data(8 * BlockPool::BLOCK_SIZE);
+        for (size_t j = 0; j < data.size(); ++j) {
+            data[j] = static_cast<char>(i * 31 + j * 7 + j / 4093);
+        }
+        fs.createFile(name);
+        fs.writeFile(name, data);
+        contents.push_back(data);
+        std::this_thread::sleep_for(std::chrono::milliseconds(3)); // Gives each file its own access time
+    }
+    Directory* dir = fs.getCurrentDirectory();
+    auto file = [&](int i) { return dir->findFile("f" + std::to_string(i)); };
+
+    size_t inUse = BlockPool::instance().blocksInUse();
+    fs.setMemoryBudget((inUse - 30) * BlockPool::BLOCK_SIZE, "test_spill.bin", std::chrono::hours(1));
+    REQUIRE(fs.enforceMemoryBudget() == 4); // The four least recently used files cover the excess
+    for (int i = 0; i < 10; ++i) {
+        REQUIRE(file(i)->isSpilled() == (i < 4));
+        REQUIRE(file(i)->size() == contents[i].size()); // Metadata stays in memory
+    }
+    REQUIRE(BlockPool::instance().blocksInUse() <= inUse - 30);
+    SpillFile::Stats stats = fs.getSpillStats();
+    REQUIRE(stats.blocksOnDisk == 32);
+    REQUIRE(stats.blocksWritten == 32);
+
+    REQUIRE(fs.readFile("f0") == contents[0]); // Served from disk
+    char buffer[100];
+    REQUIRE(FileDescriptor(*file(1)).pread(buffer, 100, 3 * BlockPool::BLOCK_SIZE - 50) == 100);
+    REQUIRE(std::equal(buffer, buffer + 100, contents[1].begin() + 3 * BlockPool::BLOCK_SIZE - 50));
+    REQUIRE(file(0)->isSpilled());
+    REQUIRE(fs.getSpillStats().blocksRead >= 10);
+
+    fs.deleteFile("f3");
+    REQUIRE(fs.getSpillStats().blocksOnDisk == 24); // Slots freed with the file
+    FileDescriptor(*file(1)).pwrite("new", 3, 0); // Faults the file back in
+    REQUIRE_FALSE(file(1)->isSpilled());
+    std::copy_n("new", 3, contents[1].begin());
+    REQUIRE(fs.readFile("f1") == contents[1]);
+    REQUIRE(fs.getSpillStats().blocksOnDisk == 16);
+
+    fs.save(imagePath); // Saved from the spill file
+    FileSystem loaded;
+    loaded.load(imagePath);
+    REQUIRE(loaded.readFile("f2") == contents[2]);
+    std::remove(imagePath.c_str());
+
+    fs.setMemoryBudget((inUse + 1000) * BlockPool::BLOCK_SIZE, "test_spill.bin", std::chrono::hours(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    REQUIRE(fs.readFile("f0") == contents[0]); // Read since the last pass, so brought back
+    REQUIRE(fs.enforceMemoryBudget() == 0);
+    REQUIRE_FALSE(file(0)->isSpilled());
+    REQUIRE(file(2)->isSpilled());
+    REQUIRE(fs.readFile("f0") == contents[0]);
+
+    fs.setMemoryBudget(BlockPool::BLOCK_SIZE, "test_spill.bin", std::chrono::milliseconds(1));
+    for (int i = 0; i < 1000; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::shared_lock<std::shared_mutex> lock(file(9)->getMutex());
+        if (file(9)->isSpilled()) {
+            break;
+        }
+    }
+    fs.setMemoryBudget(0);
+    for (int i = 0; i < 10; ++i) {
+        if (i != 3) {
+            REQUIRE(file(i)->isSpilled());
+            REQUIRE(fs.readFile("f" + std::to_string(i)) == contents[i]);
+        }
+    }
+    REQUIRE(fs.getSpillStats().blocksOnDisk == 0); // No budget, no spill file
+}
+
+// Test for holding a tree to its budget while other trees and snapshots hold blocks
+TEST_CASE("Memory Budget Counts Its Own Tree", "[spill]") {
+    const size_t blockSize = BlockPool::BLOCK_SIZE;
+    FileSystem other;
+    other.createFile("big");
+    other.writeFile("big", std::vector<char>(64 * blockSize, 'o'));
+
+    FileSystem fs;
+    fs.createDirectory("logs");
+    fs.createFile("logs/a");
+    fs.writeFile("logs/a", std::vector<char>(8 * blockSize, 'a'));
+    fs.createFile("b");
+    fs.writeFile("b", std::vector<char>(4 * blockSize, 'b'));
+    fs.cloneFile("b", "b2"); // Shares the blocks, but each file counts them
+    std::shared_ptr<Snapshot> view = fs.snapshot();
+    fs.writeFile("b2", std::vector<char>(4 * blockSize, 'c')); // The snapshot keeps the old blocks of b2
+    REQUIRE(BlockPool::instance().blocksInUse() >= 64 + 8 + 4 + 4);
+
+    fs.setMemoryBudget(16 * blockSize, "test_budget.bin", std::chrono::hours(1));
+    REQUIRE(fs.enforceMemoryBudget() == 0); // Other trees and the snapshot's copies do not count
+    fs.deleteDirectory("logs"); // Kept for the snapshot, but out of the tree
+    fs.setMemoryBudget(8 * blockSize, "test_budget.bin", std::chrono::hours(1));
+    REQUIRE(fs.enforceMemoryBudget() == 0);
+    fs.setMemoryBudget(4 * blockSize, "test_budget.bin", std::chrono::hours(1));
+    REQUIRE(fs.enforceMemoryBudget() == 1);
+    view.reset();
+
+    fs.setMemoryBudget(0);
+    REQUIRE(fs.readFile("b") == std::vector<char>(4 * blockSize, 'b'));
+    REQUIRE(fs.readFile("b2") == std::vector<char>(4 * blockSize, 'c'));
+}
+
+// Test for the work-stealing pool on its own
+TEST_CASE("Work-Stealing Pool", "[pool]") {
+    WorkStealingPool pool(4);
+    REQUIRE(pool.workerCount() == 4);
+    std::atomic<uint64_t> sum(0);
+    std::function<void(uint64_t, uint64_t)> split = [&](uint64_t begin, uint64_t end) {
+        if (end - begin <= 16) {
+            for (uint64_t i = begin; i < end; ++i) {
+                sum.fetch_add(i, std::memory_order_relaxed);
+            }
+            return;
+        }
+        uint64_t middle = begin + (end - begin) / 2;
+        pool.spawn([&, middle, end] { split(middle, end); });
+        split(begin, middle);
+    };
+    pool.run([&] { split(0, 100000); });
+    REQUIRE(sum == uint64_t(100000) * 99999 / 2);
+
+    std::atomic<int> inner(0);
+    pool.run([&] {
+        for (int i = 0; i < 8; ++i) {
+            pool.spawn([&] { pool.run([&] { inner.fetch_add(1); }); }); // Nested runs help instead of blocking
+        }
+    });
+    REQUIRE(inner == 8);
+
+    std::atomic<int> ran(0);
+    REQUIRE_THROWS_AS(pool.run([&] {
+        for (int i = 0; i < 10; ++i) {
+            pool.spawn([&, i] {
+                ran.fetch_add(1);
+                if (i == 3) {
+                    throw std::runtime_error("task failed");
+                }
+            });
+        }
+    }), std::runtime_error);
+    REQUIRE(ran == 10); // The rest of the group still ran
+    REQUIRE_THROWS_AS(pool.spawn([] {}), std::logic_error);
+}
+
+// Test for recursive walk, usage, copy and delete
+TEST_CASE("Parallel Tree Operations", "[tree]") {
+    WorkStealingPool pool(4);
+    FileSystem fs;
+    fs.setWorkPool(pool);
+    std::function<void(const std::string&, int)> build = [&](const std::string& path, int depth) {
+        for (int i = 0; i < 5; ++i) {
+            fs.createFile(path + "/f" + std::to_string(i));
+        }
+        fs.writeFile(path + "/f0", std::vector<char>(100, 'x'));
+        if (depth == 0) {
+            return;
+        }
+        for (int i = 0; i < 4; ++i) {
+            std::string child = path + "/d" + std::to_string(i);
+            fs.createDirectory(child);
+            build(child, depth - 1);
+        }
+    };
+    fs.createDirectory("tree");
+    build("/tree", 3); // 85 directories below and including /tree
+    fs.createDirectory("/tree/wide");
+    std::vector<BatchOp> batch;
+    for (int i = 0; i < 10000; ++i) {
+        batch.push_back({BatchOpType::CreateFile, "/tree/wide/w" + std::to_string(i), {}});
+    }
+    fs.applyBatch(batch);
+
+    std::mutex mutex;
+    std::set<std::string> files;
+    std::set<std::string> directories;
+    bool duplicate = false;
+    fs.walk("tree", [&](const std::string& path, const File* file) {
+        std::lock_guard<std::mutex> lock(mutex); // Called from the pool's workers
+        duplicate |= !(file ? files : directories).insert(path).second;
+    });
+    REQUIRE_FALSE(duplicate);
+    REQUIRE(directories.size() == 85);
+    REQUIRE(files.size() == 85 * 5 + 10000);
+    REQUIRE(directories.count("/tree/d2/d1/d3"));
+    REQUIRE(files.count("/tree/d2/d1/d3/f4"));
+    REQUIRE(files.count("/tree/wide/w9999"));
+
+    TreeUsage usage = fs.diskUsage("/tree");
+    REQUIRE(usage.files == 85 * 5 + 10000);
+    REQUIRE(usage.directories == 85);
+    REQUIRE(usage.bytes == 85 * 100);
+    REQUIRE(usage.allocatedBytes == 85 * BlockPool::BLOCK_SIZE);
+    REQUIRE(fs.diskUsage("/tree/d0").files == 21 * 5);
+    REQUIRE_THROWS_AS(fs.diskUsage("/missing"), std::runtime_error);
+    REQUIRE_THROWS_AS(fs.walk("tree", [](const std::string&, const File*) { throw std::runtime_error("stop"); }),
+                      std::runtime_error);
+
+    size_t filesBefore = NodePool<File>::instance().size();
+    fs.cloneDirectory("/tree", "/copy");
+    REQUIRE(NodePool<File>::instance().size() == filesBefore + 85 * 5 + 10000);
+    TreeUsage copied = fs.diskUsage("/copy");
+    REQUIRE(copied.files == usage.files);
+    REQUIRE(copied.directories == usage.directories);
+    REQUIRE(copied.bytes == usage.bytes);
+    REQUIRE(fs.readFile("/copy/d3/d3/d3/f0") == std::vector<char>(100, 'x'));
+
+    fs.deleteDirectory("/copy");
+    REQUIRE(NodePool<File>::instance().size() == filesBefore);
+    std::shared_ptr<Snapshot> snapshot = fs.snapshot();
+    fs.deleteDirectory("/tree"); // Retired whole while the snapshot can still reach it
+    REQUIRE(snapshot->readFile("/tree/d1/d2/f0") == std::vector<char>(100, 'x'));
+    snapshot.reset();
+    REQUIRE(NodePool<File>::instance().size() == filesBefore - (85 * 5 + 10000));
+    REQUIRE(pool.stealCount() > 0);
+}
+
+// Test for the running subtree totals kept by each directory
+TEST_CASE("Subtree Usage Totals", "[usage]") {
+    FileSystem fs;
+    auto matchesWalk = [&fs](const std::string& path) { // The totals agree with a full walk
+        SubtreeUsage totals = fs.usage(path);
+        TreeUsage walked = fs.diskUsage(path);
+        return totals.bytes == walked.bytes && totals.files == walked.files && totals.directories == walked.directories;
+    };
+    fs.createDirectory("a");
+    fs.createDirectory("/a/b");
+    fs.createDirectory("/a/b/c");
+    fs.createFile("/a/top.txt");
+    fs.createFile("/a/b/c/deep.txt");
+    fs.writeFile("/a/top.txt", std::vector<char>(10, 'x'));
+    fs.writeFile("/a/b/c/deep.txt", std::vector<char>(1000, 'y'));
+    SubtreeUsage usage = fs.usage("/a");
+    REQUIRE(usage.bytes == 1010);
+    REQUIRE(usage.files == 2);
+    REQUIRE(usage.directories == 2);
+    REQUIRE(fs.usage("/").directories == 3);
+    REQUIRE(fs.usage("/a/b/c").directories == 0);
+
+    // Writes through a descriptor, shrinking and growing, travel up too
+    File* deep = fs.getRootDirectory().findDirectory("a")->findDirectory("b")->findDirectory("c")->findFile("deep.txt");
+    FileDescriptor fd(*deep);
+    fd.pwrite("z", 1, 5000);
+    REQUIRE(fs.usage("/a/b").bytes == 5001);
+    fs.writeFile("/a/b/c/deep.txt", std::vector<char>(3, 'y'));
+    REQUIRE(fs.usage("/").bytes == 13);
+    REQUIRE(matchesWalk("/"));
+
+    fs.cloneDirectory("/a/b", "/copy");
+    REQUIRE(fs.usage("/copy").bytes == 3);
+    REQUIRE(fs.usage("/").files == 3);
+    REQUIRE(fs.usage("/").directories == 5);
+    fs.deleteFile("/a/top.txt");
+    REQUIRE(fs.usage("/a").bytes == 3);
+    fs.deleteDirectory("/a/b");
+    usage = fs.usage("/a");
+    REQUIRE(usage.bytes == 0);
+    REQUIRE(usage.files == 0);
+    REQUIRE(usage.directories == 0);
+    REQUIRE(matchesWalk("/"));
+
+    // Files kept for a snapshot stop counting once deleted
+    fs.createFile("/copy/kept.txt");
+    fs.writeFile("/copy/kept.txt", std::vector<char>(7, 'k'));
+    std::shared_ptr<Snapshot> snapshot = fs.snapshot();
+    fs.deleteFile("/copy/kept.txt");
+    fs.deleteDirectory("/copy");
+    REQUIRE(fs.usage("/").bytes == 0);
+    REQUIRE(fs.usage("/").directories == 1);
+    snapshot.reset();
+
+    // An image carries the totals, so they are right before anything is loaded
+    const std::string imagePath = "test_usage.fsimg";
+    for (int i = 0; i < 3; ++i) {
+        fs.createDirectory("/a/d" + std::to_string(i));
+        fs.createFile("/a/d" + std::to_string(i) + "/f");
+        fs.writeFile("/a/d" + std::to_string(i) + "/f", std::vector<char>(100 * (i + 1), 'i'));
+    }
+    fs.save(imagePath);
+    FileSystem loaded;
+    loaded.load(imagePath);
+    REQUIRE(loaded.getRootDirectory().getUsage().bytes == 600); // Read from the root record alone
+    usage = loaded.usage("/a");
+    REQUIRE(usage.bytes == 600);
+    REQUIRE(usage.files == 3);
+    REQUIRE(usage.directories == 3);
+    loaded.writeFile("/a/d2/f", std::vector<char>(1, 'n'));
+    REQUIRE(loaded.usage("/").bytes == 301);
+    REQUIRE(matchesWalk("/"));
+    std::remove(imagePath.c_str());
+}
+
+// Test for iterating a directory in place and paging through it in name order
+TEST_CASE("Directory Iteration and Paging", "[listing]") {
+    Directory dir("dir");
+    for (int i = 9; i >= 0; --i) {
+        dir.createFile("file" + std::to_string(i));
+    }
+    dir.createDirectory("sub");
+    dir.createFile("sub"); // A file and a directory may share a name
+    REQUIRE(dir.entryCount() == 12);
+
+    std::vector<std::string> seen;
+    for (DirectoryEntry entry : dir.entries()) {
+        REQUIRE((entry.file != nullptr) != (entry.directory != nullptr));
+        const std::string& own = entry.file ? entry.file->getName() : entry.directory->getName();
+        REQUIRE(entry.name.data() == own.data()); // A view of the node's own name, not a copy
+        seen.push_back(std::string(entry.name));
+    }
+    std::vector<std::string> listed = dir.listContents();
+    REQUIRE(std::multiset<std::string>(seen.begin(), seen.end()) == std::multiset<std::string>(listed.begin(), listed.end()));
+
+    std::vector<std::string> ordered;
+    std::string afterName;
+    bool afterDirectory = false;
+    bool more = true;
+    size_t pages = 0;
+    while (more) {
+        std::vector<DirectoryEntry> page = dir.listPage(afterName, afterDirectory, 5, more);
+        REQUIRE(page.size() <= 5);
+        for (const DirectoryEntry& entry : page) {
+            ordered.push_back(std::string(entry.name) + (entry.directory ? "/" : ""));
+        }
+        afterName = std::string(page.back().name);
+        afterDirectory = page.back().directory != nullptr;
+        ++pages;
+    }
+    REQUIRE(pages == 3);
+    REQUIRE(ordered.size() == 12);
+    REQUIRE(ordered.front() == "file0");
+    REQUIRE(ordered[9] == "file9");
+    REQUIRE(ordered[10] == "sub"); // The file sorts before the directory of the same name
+    REQUIRE(ordered[11] == "sub/");
+
+    // A cursor survives changes between pages
+    FileSystem fs;
+    for (int i = 0; i < 6; ++i) {
+        fs.createFile("n" + std::to_string(i));
+    }
+    ListPage first = fs.listPage(ListCursor{}, 3);
+    REQUIRE(first.more);
+    REQUIRE(first.entries.size() == 3);
+    REQUIRE(first.entries.back().name == "n2");
+    fs.createFile("a"); // Sorts before the cursor, so it is not seen
+    fs.deleteFile("n3");
+    fs.createDirectory("z");
+    ListPage second = fs.listPage(first.next, 3);
+    REQUIRE(second.more == false);
+    REQUIRE(second.entries.size() == 3);
+    REQUIRE(second.entries[0].name == "n4");
+    REQUIRE(second.entries[2].name == "z");
+    REQUIRE(second.entries[2].directory);
+    ListPage end = fs.listPage(second.next, 3);
+    REQUIRE(end.entries.empty());
+    REQUIRE(end.more == false);
+    REQUIRE(end.next.name == "z");
+}
+
+// Test for glob and substring queries, with and without the name index
+TEST_CASE("Name Index Queries", "[nameindex]") {
+    REQUIRE(NameIndex::matchesGlob("app.log", "*.log"));
+    REQUIRE(NameIndex::matchesGlob("abc", "a?c"));
+    REQUIRE(NameIndex::matchesGlob("aXbYc", "a*b*c"));
+    REQUIRE(NameIndex::matchesGlob("", "*"));
+    REQUIRE_FALSE(NameIndex::matchesGlob("app.log.1", "*.log"));
+    REQUIRE_FALSE(NameIndex::matchesGlob("abc", "abc*d"));
+
+    FileSystem fs;
+    for (const char* dir : {"/logs", "/logs/old", "/var", "/var/cache", "/var/caches"}) {
+        fs.createDirectory(dir);
+    }
+    for (const char* file : {"/logs/app.log", "/logs/error.log", "/logs/old/app.log.1", "/var/cache/webcache.db",
+                             "/var/cache/a.c", "/var/cache/b.cc", "/var/c", "/readme"}) {
+        fs.createFile(file);
+    }
+    auto paths = [](const std::vector<NameMatch>& matches) {
+        std::vector<std::string> result;
+        for (const NameMatch& match : matches) {
+            result.push_back(match.path + (match.directory ? "/" : ""));
+        }
+        return result;
+    };
+    const std::vector<std::string> globs = {"*.log", "*.c", "c", "cache*", "*a*", "?", "app.log*", "*", "nothing*", "a.?"};
+    const std::vector<std::string> texts = {"cache", "log", "c", ".c", "", "zzz", "ebcache.d"};
+    std::vector<std::vector<std::string>> walked; // Answers from walking the tree, without the index
+    for (const std::string& pattern : globs) {
+        walked.push_back(paths(fs.glob(pattern)));
+    }
+    for (const std::string& text : texts) {
+        walked.push_back(paths(fs.search(text)));
+    }
+    REQUIRE(walked[0] == std::vector<std::string>{"/logs/app.log", "/logs/error.log"});
+    REQUIRE(walked[1] == std::vector<std::string>{"/var/cache/a.c"});
+    REQUIRE(walked[10] == std::vector<std::string>{"/var/cache/", "/var/cache/webcache.db", "/var/caches/"});
+
+    fs.setNameIndex(true);
+    size_t query = 0;
+    for (const std::string& pattern : globs) {
+        REQUIRE(paths(fs.glob(pattern)) == walked[query++]);
+    }
+    for (const std::string& text : texts) {
+        REQUIRE(paths(fs.search(text)) == walked[query++]);
+    }
+
+    // The index follows changes to the tree
+    fs.deleteFile("/logs/error.log");
+    fs.createFile("/var/cache/new.log");
+    REQUIRE(paths(fs.glob("*.log")) == std::vector<std::string>{"/logs/app.log", "/var/cache/new.log"});
+    fs.cloneDirectory("/logs", "/copy");
+    fs.deleteDirectory("/var");
+    REQUIRE(paths(fs.glob("*.log")) == std::vector<std::string>{"/copy/app.log", "/logs/app.log"});
+    REQUIRE(fs.search("cache").empty());
+    std::vector<BatchOp> batch;
+    for (int i = 0; i < 3000; ++i) {
+        batch.push_back({BatchOpType::CreateFile, "/logs/tmp" + std::to_string(i) + ".log", {}});
+    }
+    fs.applyBatch(batch);
+    REQUIRE(fs.glob("tmp*.log").size() == 3000);
+    REQUIRE(fs.glob("tmp2999.lo?").size() == 1);
+    for (BatchOp& op : batch) {
+        op.type = BatchOpType::DeleteFile;
+    }
+    fs.applyBatch(batch); // Enough removals to rebuild the index
+    REQUIRE(fs.glob("tmp*").empty());
+    REQUIRE(paths(fs.glob("*.log*")) == std::vector<std::string>{"/copy/app.log", "/copy/old/app.log.1", "/logs/app.log", "/logs/old/app.log.1"});
+
+    // Replacing the tree rebuilds the index
+    const std::string imagePath = "test_names.fsimg";
+    fs.save(imagePath);
+    FileSystem loaded;
+    loaded.setNameIndex(true);
+    loaded.createFile("stale.log");
+    loaded.load(imagePath);
+    REQUIRE(paths(loaded.glob("*.log")) == std::vector<std::string>{"/copy/app.log", "/logs/app.log"});
+    loaded.setNameIndex(false);
+    REQUIRE(paths(loaded.glob("*.log")) == std::vector<std::string>{"/copy/app.log", "/logs/app.log"});
+    std::remove(imagePath.c_str());
+}
+
+// Test for renaming and moving files and directories in place
+TEST_CASE("Rename and Move", "[rename]") {
+    FileSystem fs;
+    fs.setNameIndex(true);
+    fs.createDirectory("/src");
+    fs.createDirectory("/src/lib");
+    fs.createDirectory("/dst");
+    for (int i = 0; i < 50; ++i) {
+        fs.createFile("/src/lib/f" + std::to_string(i));
+    }
+    std::vector<char> contents(2 * BlockPool::BLOCK_SIZE, 'm');
+    fs.writeFile("/src/lib/f0", contents);
+    fs.createFile("/src/notes.txt");
+    fs.writeFile("/src/notes.txt", std::vector<char>{'n'});
+    Session worker(fs);
+    worker.changeDirectory("/src/lib"); // Also caches the path
+    Directory* lib = worker.getCurrentDirectory();
+    size_t blocks = BlockPool::instance().blocksInUse();
+    std::shared_ptr<Snapshot> snapshot = fs.snapshot();
+
+    fs.rename("/src/lib", "/dst/moved");
+    REQUIRE(BlockPool::instance().blocksInUse() == blocks); // Nothing copied
+    REQUIRE(fs.readFile("/dst/moved/f0") == contents);
+    REQUIRE_THROWS_AS(fs.readFile("/src/lib/f0"), std::runtime_error);
+    REQUIRE_THROWS_AS(fs.changeDirectory("/src/lib"), std::runtime_error); // The cached path was dropped
+    REQUIRE(lib->getParentDirectory() == fs.getRootDirectory().findDirectory("dst"));
+    REQUIRE(lib->getName() == "moved");
+    REQUIRE(worker.getCurrentDirectory() == lib); // Still working inside it
+    REQUIRE(worker.readFile("f0") == contents);
+    REQUIRE(fs.usage("/src").files == 1);
+    REQUIRE(fs.usage("/src").directories == 0);
+    REQUIRE(fs.usage("/dst").bytes == contents.size());
+    REQUIRE(fs.usage("/dst").files == 50);
+    REQUIRE(fs.usage("/dst").directories == 1);
+    REQUIRE(fs.usage("/").files == 51);
+
+    fs.rename("/src/notes.txt", "/dst/moved/README");
+    File* readme = lib->findFile("README");
+    REQUIRE(readme != nullptr);
+    FileDescriptor(*readme).pwrite("abc", 3, 1); // Size changes reach the new parent's totals
+    REQUIRE(fs.readFile("/dst/moved/README") == std::vector<char>({'n', 'a', 'b', 'c'}));
+    REQUIRE(fs.usage("/src").files == 0);
+    REQUIRE(fs.usage("/src").bytes == 0);
+    REQUIRE(fs.usage("/dst").bytes == contents.size() + 4);
+    fs.rename("/dst/moved/f1", "/dst/moved/renamed");
+    fs.rename("/dst/moved/renamed", "/dst/moved/renamed"); // Onto itself changes nothing
+    REQUIRE(fs.glob("renamed").size() == 1);
+    REQUIRE(fs.glob("f1").empty());
+    REQUIRE(fs.glob("moved")[0].path == "/dst/moved");
+    REQUIRE(fs.glob("README")[0].path == "/dst/moved/README");
+    REQUIRE(fs.search("lib").empty());
+
+    // The snapshot still sees the tree as it was
+    REQUIRE(snapshot->readFile("/src/lib/f0") == contents);
+    REQUIRE(snapshot->readFile("/src/notes.txt") == std::vector<char>{'n'});
+    REQUIRE(snapshot->listContents("/dst").empty());
+    snapshot.reset();
+
+    REQUIRE_THROWS_AS(fs.rename("/src/missing", "/dst/other"), std::runtime_error);
+    REQUIRE_THROWS_AS(fs.rename("/dst/moved/f2", "/dst/moved/f3"), std::runtime_error);
+    REQUIRE_THROWS_AS(fs.rename("/dst", "/dst/moved/inner"), std::runtime_error);
+    fs.rename("/dst", "/dst");
+    REQUIRE(fs.usage("/").directories == 3);
+}
+
+// Test for replaying renames from the journal
+TEST_CASE("Rename Journal Replay", "[rename]") {
+    const std::string imagePath = "test_rename.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("a");
+        fs.createDirectory("a/b");
+        fs.createFile("a/b/f");
+        fs.writeFile("a/b/f", std::vector<char>{'1'});
+        fs.checkpoint();
+        fs.createDirectory("c");
+        fs.rename("a/b", "c/d");
+        fs.rename("c/d/f", "g");
+        fs.createDirectory("a/b"); // Reuses the old name
+        fs.createFile("/a/b/y");
+        fs.createFile("/e");
+        fs.rename("/c", "/h");
+        fs.createDirectory("/c");
+        fs.createFile("/c/z");
+        fs.rename("/e", "/c/e");
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    REQUIRE(fs.readFile("/g") == std::vector<char>{'1'});
+    REQUIRE(fs.getRootDirectory().findDirectory("h")->findDirectory("d")->getFiles().empty());
+    REQUIRE(fs.getRootDirectory().findDirectory("a")->findDirectory("b")->listContents() == std::vector<std::string>{"y"});
+    std::vector<std::string> c = fs.getRootDirectory().findDirectory("c")->listContents();
+    std::sort(c.begin(), c.end());
+    REQUIRE(c == std::vector<std::string>({"e", "z"})); // Not in the moved directory
+    REQUIRE(fs.usage("/h").directories == 1);
+    REQUIRE(fs.usage("/h").files == 0);
+    REQUIRE(fs.usage("/").files == 4);
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for file moves crossing between two directories in both directions at once
+TEST_CASE("Concurrent File Renames", "[rename]") {
+    const std::string imagePath = "test_rename_concurrent.fsimg";
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+    auto sorted = [](FileSystem& fs, const std::string& dir) {
+        fs.changeDirectory(dir);
+        std::vector<std::string> names = fs.listContents();
+        std::sort(names.begin(), names.end());
+        return names;
+    };
+    std::vector<std::string> a, b;
+    {
+        FileSystem fs;
+        fs.openPersistent(imagePath);
+        fs.createDirectory("a");
+        fs.createDirectory("b");
+        for (int i = 0; i < 200; ++i) {
+            fs.createFile("/a/f" + std::to_string(i));
+            fs.createFile("/b/g" + std::to_string(i));
+        }
+        std::vector<std::thread> workers;
+        workers.emplace_back([&fs] {
+            Session session(fs);
+            for (int i = 0; i < 200; ++i) {
+                session.rename("/a/f" + std::to_string(i), "/b/f" + std::to_string(i));
+            }
+        });
+        workers.emplace_back([&fs] {
+            Session session(fs);
+            for (int i = 0; i < 200; ++i) {
+                session.rename("/b/g" + std::to_string(i), "/a/g" + std::to_string(i));
+                session.rename("/a/g" + std::to_string(i), "/a/h" + std::to_string(i)); // In place
+            }
+        });
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        a = sorted(fs, "/a");
+        b = sorted(fs, "/b");
+        REQUIRE(a.size() == 200);
+        REQUIRE(a.front() == "h0");
+        REQUIRE(b.size() == 200);
+        REQUIRE(b.front() == "f0");
+        REQUIRE(fs.usage("/a").files == 200);
+        REQUIRE_THROWS_AS(fs.rename("/a/h0", "/b/f0"), std::runtime_error);
+        REQUIRE_THROWS_AS(fs.rename("/a/missing", "/b/x"), std::runtime_error);
+    }
+    FileSystem fs;
+    fs.openPersistent(imagePath);
+    REQUIRE(sorted(fs, "/a") == a);
+    REQUIRE(sorted(fs, "/b") == b);
+    fs.closePersistent();
+    std::remove(imagePath.c_str());
+    std::remove((imagePath + ".journal").c_str());
+}
+
+// Test for subtree totals staying right while a directory moves under a file being extended
+TEST_CASE("Directory Moves Racing File Writes", "[rename]") {
+    FileSystem fs;
+    fs.createDirectory("a");
+    fs.createDirectory("a/b");
+    fs.createDirectory("c");
+    fs.createFile("a/b/f");
+    File* file = fs.getRootDirectory().findDirectory("a")->findDirectory("b")->findFile("f");
+    std::atomic<bool> done(false);
+    std::thread writer([file, &done] {
+        FileDescriptor fd(*file);
+        for (size_t offset = 0; !done; ++offset) {
+            fd.pwrite("x", 1, offset); // Each write grows the file, sending a change up the tree
+        }
+    });
+    Session session(fs);
+    for (int i = 0; i < 5000; ++i) {
+        session.rename("/a/b", "/c/b");
+        session.rename("/c/b", "/a/b");
+    }
+    done = true;
+    writer.join();
+    uint64_t size = file->size();
+    REQUIRE(size > 0);
+    REQUIRE(fs.usage("/a").bytes == size);
+    REQUIRE(fs.usage("/c").bytes == 0);
+    REQUIRE(fs.usage("/").bytes == size);
+}
\ No newline at end of file
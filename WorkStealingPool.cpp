@@ -0,0 +1,211 @@
+#include "WorkStealingPool.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+thread_local WorkStealingPool* currentPool = nullptr; ///< The pool whose worker is running on this thread, if any.
+thread_local size_t currentWorker = 0; ///< That worker's index.
+thread_local void* currentGroup = nullptr; ///< The group of the task running on this thread, if any.
+
+} // namespace
+
+/**
+ * @brief Starts a pool.
+ * @param workerCount The number of worker threads; 0 for one per hardware thread.
+ */
+WorkStealingPool::WorkStealingPool(size_t workerCount)
+    : queued(0), sleepers(0), nextWorker(0), steals(0), stopping(false) {
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) { // Every deque exists before any worker goes looking for work
+        workers[i]->thread = std::thread(&WorkStealingPool::runWorker, this, i);
+    }
+}
+
+/**
+ * @brief Destructor for the WorkStealingPool class; finishes queued work and joins the workers.
+ */
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+/**
+ * @brief Gets the process-wide pool, with one worker per hardware thread.
+ * @details The pool is never destroyed, so it can be used while static objects are torn down.
+ * @return A reference to the shared pool.
+ */
+WorkStealingPool& WorkStealingPool::instance() {
+    static WorkStealingPool* pool = new WorkStealingPool();
+    return *pool;
+}
+
+/**
+ * @brief Gets the number of worker threads.
+ * @return The number of workers.
+ */
+size_t WorkStealingPool::workerCount() const {
+    return workers.size();
+}
+
+/**
+ * @brief Gets the number of tasks idle workers have stolen so far.
+ * @return The number of steals.
+ */
+uint64_t WorkStealingPool::stealCount() const {
+    return steals.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Queues a job on a worker's deque and wakes a sleeper if there is one.
+ * @param worker The worker whose deque takes the job.
+ * @param job The job.
+ */
+void WorkStealingPool::push(size_t worker, Job job) {
+    queued.fetch_add(1); // Counted first, so a worker never sleeps through it
+    {
+        std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+        workers[worker]->jobs.push_back(std::move(job));
+    }
+    if (sleepers.load() > 0) { // Sequentially consistent with the sleeper's check of queued
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+/**
+ * @brief Takes a job: the newest from a worker's own deque, else the oldest from another's.
+ * @param self The worker looking for work.
+ * @param job Receives the job.
+ * @return true if a job was found.
+ */
+bool WorkStealingPool::take(size_t self, Job& job) {
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(self + i) % workers.size()]; // Start with the next worker, so thieves spread out
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queued.fetch_sub(1);
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Runs a job and finishes it in its group.
+ * @param job The job.
+ */
+void WorkStealingPool::execute(Job& job) {
+    Group* group = job.group;
+    void* outer = currentGroup; // Set when helping out from inside another task's run()
+    currentGroup = group;
+    try {
+        job.task();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if (!group->error) {
+            group->error = std::current_exception(); // Later failures are dropped; the rest of the group still runs
+        }
+    }
+    currentGroup = outer;
+    job.task = nullptr; // Release whatever the task captured before the group can finish
+    if (group->pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(group->mutex); // The waiter cannot return, and free the group, until we let go
+        group->finished = true;
+        group->done.notify_all();
+    }
+}
+
+/**
+ * @brief Body of each worker thread.
+ * @param self The worker's index.
+ */
+void WorkStealingPool::runWorker(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+    while (true) {
+        Job job;
+        if (take(self, job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepers.fetch_add(1);
+        wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+        sleepers.fetch_sub(1);
+        if (stopping && queued.load() == 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Runs a task, and every task it spawns, and waits for all of them.
+ * @details May be called from inside a task, in which case the caller helps
+ * with the queued work while it waits.
+ * @param task The task.
+ * @throws Whatever the first failing task threw, once every task has finished.
+ */
+void WorkStealingPool::run(Task task) {
+    Group group;
+    group.pending.store(1);
+    group.finished = false;
+    bool inside = currentPool == this;
+    size_t target = inside ? currentWorker : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    push(target, {std::move(task), &group});
+
+    if (inside) {
+        while (group.pending.load() != 0) { // Blocking here could leave every worker waiting
+            Job job;
+            if (take(currentWorker, job)) {
+                execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+    std::unique_lock<std::mutex> lock(group.mutex);
+    group.done.wait(lock, [&group] { return group.finished; });
+    if (group.error) {
+        std::rethrow_exception(group.error);
+    }
+}
+
+/**
+ * @brief Spawns a task into the run() the calling task belongs to.
+ * @param task The task.
+ * @throws std::logic_error if called from outside a task running on this pool.
+ */
+void WorkStealingPool::spawn(Task task) {
+    if (currentPool != this || !currentGroup) {
+        throw std::logic_error("spawn() must be called from a task running on the pool");
+    }
+    Group* group = static_cast<Group*>(currentGroup);
+    group->pending.fetch_add(1);
+    push(currentWorker, {std::move(task), group});
+}
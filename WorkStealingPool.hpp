@@ -0,0 +1,146 @@
+#ifndef WORKSTEALINGPOOL_HPP
+#define WORKSTEALINGPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class WorkStealingPool
+ * @brief A thread pool for recursive, fork-style work such as walking a tree.
+ *
+ * Each worker keeps its own deque of tasks. Tasks spawned by a running task go
+ * onto the deque of the worker running it, which takes work from its own end
+ * (newest first, so a walk goes deep and stays cache friendly) while idle
+ * workers steal from the other end (oldest first, so they take the biggest
+ * untouched subtrees). Workers only meet on a deque's mutex when one of them
+ * runs dry, so a wide tree keeps every core busy with little contention.
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>; ///< A unit of work.
+
+private:
+    /**
+     * @brief The tasks started by one run() call and everything they spawn.
+     */
+    struct Group {
+        std::atomic<size_t> pending; ///< Tasks spawned and not yet finished.
+        std::mutex mutex; ///< Guards finished and error.
+        std::condition_variable done; ///< Signalled when the last task finishes.
+        bool finished; ///< Set, under the mutex, once pending reaches zero.
+        std::exception_ptr error; ///< The first exception a task threw.
+    };
+
+    /**
+     * @brief A task and the group it belongs to.
+     */
+    struct Job {
+        Task task; ///< The work.
+        Group* group; ///< The group waiting for it.
+    };
+
+    /**
+     * @brief One worker thread and its deque.
+     */
+    struct Worker {
+        std::mutex mutex; ///< Guards jobs.
+        std::deque<Job> jobs; ///< The worker's tasks; it takes from the back, thieves from the front.
+        std::thread thread; ///< The worker thread.
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers; ///< The workers.
+    std::atomic<size_t> queued; ///< Jobs waiting in any deque.
+    std::atomic<size_t> sleepers; ///< Workers waiting for work.
+    std::atomic<size_t> nextWorker; ///< Where tasks from outside the pool go, round robin.
+    std::atomic<uint64_t> steals; ///< Tasks taken from another worker's deque.
+    std::mutex sleepMutex; ///< Guards stopping and sleeping workers.
+    std::condition_variable wake; ///< Wakes sleeping workers.
+    bool stopping; ///< Set to shut the workers down.
+
+    /**
+     * @brief Queues a job on a worker's deque and wakes a sleeper if there is one.
+     * @param worker The worker whose deque takes the job.
+     * @param job The job.
+     */
+    void push(size_t worker, Job job);
+
+    /**
+     * @brief Takes a job: the newest from a worker's own deque, else the oldest from another's.
+     * @param self The worker looking for work.
+     * @param job Receives the job.
+     * @return true if a job was found.
+     */
+    bool take(size_t self, Job& job);
+
+    /**
+     * @brief Runs a job and finishes it in its group.
+     * @param job The job.
+     */
+    void execute(Job& job);
+
+    /**
+     * @brief Body of each worker thread.
+     * @param self The worker's index.
+     */
+    void runWorker(size_t self);
+
+public:
+    /**
+     * @brief Starts a pool.
+     * @param workerCount The number of worker threads; 0 for one per hardware thread.
+     */
+    explicit WorkStealingPool(size_t workerCount = 0);
+
+    /**
+     * @brief Destructor for the WorkStealingPool class; finishes queued work and joins the workers.
+     */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Gets the process-wide pool, with one worker per hardware thread.
+     * @return A reference to the shared pool.
+     */
+    static WorkStealingPool& instance();
+
+    /**
+     * @brief Gets the number of worker threads.
+     * @return The number of workers.
+     */
+    size_t workerCount() const;
+
+    /**
+     * @brief Gets the number of tasks idle workers have stolen so far.
+     * @return The number of steals.
+     */
+    uint64_t stealCount() const;
+
+    /**
+     * @brief Runs a task, and every task it spawns, and waits for all of them.
+     * @details May be called from inside a task, in which case the caller helps
+     * with the queued work while it waits.
+     * @param task The task.
+     * @throws Whatever the first failing task threw, once every task has finished.
+     */
+    void run(Task task);
+
+    /**
+     * @brief Spawns a task into the run() the calling task belongs to.
+     * @param task The task.
+     * @throws std::logic_error if called from outside a task running on this pool.
+     */
+    void spawn(Task task);
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <limits>
+#include <iomanip>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -18,20 +19,51 @@ void printMenu() {
     cout << "7. List Directory Contents\n";
     cout << "8. Change Directory\n";
     cout << "9. Display Current Directory\n";
-    cout << "10. Exit\n";
+    cout << "10. Show Statistics\n";
+    cout << "11. Exit\n";
     cout << "Enter your choice: ";
 }
 
-void listDirectoryContents(Directory* dir) {
-    auto contents = dir->listContents();
+const size_t PAGE_SIZE = 20; // Entries listed before asking for more
+
+void listDirectoryContents(FileSystem& fs) {
     cout << "Directory contents:\n";
-    for (const auto& item : contents) {
-        cout << item << "\n";
+    ListCursor cursor{};
+    while (true) {
+        ListPage page = fs.listPage(cursor, PAGE_SIZE); // Sorted by name; only this page's names are copied
+        for (const ListEntry& entry : page.entries) {
+            cout << entry.name << (entry.directory ? "/" : "") << "\n";
+        }
+        if (!page.more) {
+            break;
+        }
+        cout << "-- Press Enter for more, or q to stop: ";
+        string answer;
+        getline(cin, answer);
+        if (answer == "q") {
+            break;
+        }
+        cursor = page.next;
+    }
+}
+
+void printStatistics(const OperationStats::Snapshot& stats) {
+    cout << left << setw(8) << "op" << right << setw(10) << "calls" << setw(14) << "bytes"
+         << setw(12) << "mean ns" << setw(12) << "p50 ns" << setw(12) << "p99 ns" << "\n";
+    for (size_t i = 0; i < OperationStats::OPS; ++i) {
+        StatsOp op = static_cast<StatsOp>(i);
+        const OperationStats::OpSnapshot& counters = stats[op];
+        cout << left << setw(8) << OperationStats::name(op) << right << setw(10) << counters.calls
+             << setw(14) << counters.bytes << setw(12) << (counters.calls ? counters.totalNanos / counters.calls : 0)
+             << setw(12) << counters.percentile(0.5) << setw(12) << counters.percentile(0.99) << "\n";
     }
 }
 
 int main() {
     FileSystem fs;
+    fs.setStatsEnabled(true);
+    fs.setDeduplication(true); // Merge identical blocks in the background
+    fs.setCompression(true); // Pack files left alone for 30 seconds
     int choice;
     string filename, dirname;
     vector<char> data;
@@ -46,15 +78,23 @@ int main() {
             case 1:
                 cout << "Enter filename: ";
                 getline(cin, filename);
-                fs.createFile(filename);
-                cout << "File created successfully.\n";
+                try {
+                    fs.createFile(filename);
+                    cout << "File created successfully.\n";
+                } catch (const runtime_error& e) {
+                    cout << e.what() << "\n";
+                }
                 break;
 
             case 2:
                 cout << "Enter filename: ";
                 getline(cin, filename);
-                fs.deleteFile(filename);
-                cout << "File deleted successfully.\n";
+                try {
+                    fs.deleteFile(filename);
+                    cout << "File deleted successfully.\n";
+                } catch (const runtime_error& e) {
+                    cout << e.what() << "\n";
+                }
                 break;
 
             case 3:
@@ -89,19 +129,27 @@ int main() {
             case 5:
                 cout << "Enter directory name: ";
                 getline(cin, dirname);
-                fs.createDirectory(dirname);
-                cout << "Directory created successfully.\n";
+                try {
+                    fs.createDirectory(dirname);
+                    cout << "Directory created successfully.\n";
+                } catch (const runtime_error& e) {
+                    cout << e.what() << "\n";
+                }
                 break;
 
             case 6:
                 cout << "Enter directory name: ";
                 getline(cin, dirname);
-                fs.deleteDirectory(dirname);
-                cout << "Directory deleted successfully.\n";
+                try {
+                    fs.deleteDirectory(dirname);
+                    cout << "Directory deleted successfully.\n";
+                } catch (const runtime_error& e) {
+                    cout << e.what() << "\n";
+                }
                 break;
 
             case 7:
-                listDirectoryContents(fs.getCurrentDirectory());
+                listDirectoryContents(fs);
                 break;
 
             case 8:
@@ -116,10 +164,30 @@ int main() {
                 break;
 
             case 9:
-                cout << "Current directory: " << fs.getCurrentDirectory()->getName() << "\n";
+                {
+                    SubtreeUsage usage = fs.getCurrentDirectory()->getUsage();
+                    cout << "Current directory: " << fs.getCurrentDirectory()->getName() << " (" << usage.files << " files, "
+                         << usage.directories << " directories, " << usage.bytes << " bytes below)\n";
+                }
                 break;
 
             case 10:
+                printStatistics(fs.getStats());
+                {
+                    BlockStore::Stats dedup = fs.getDeduplicationStats();
+                    cout << "dedup: " << dedup.duplicates << " of " << dedup.blocksScanned << " blocks merged ("
+                         << dedup.hitRate() * 100 << "%), " << dedup.bytesSaved << " bytes saved\n";
+                    CompressedBlocks::Stats packed = fs.getCompressionStats();
+                    cout << "compression: " << packed.rawBytes << " bytes held in " << packed.compressedBytes << " ("
+                         << packed.ratio() << "x), " << packed.blocksDecompressed << " blocks decompressed in "
+                         << packed.decompressNanoseconds / 1000 << " us\n";
+                    SpillFile::Stats spill = fs.getSpillStats();
+                    cout << "spill: " << spill.blocksOnDisk << " blocks on disk, " << spill.blocksWritten << " written, "
+                         << spill.blocksRead << " read back\n";
+                }
+                break;
+
+            case 11:
                 cout << "Exiting...\n";
                 return 0;
 